@@ -0,0 +1,355 @@
+// ~/ArduinoApps/survillance/cpp_infer/batch.cpp
+// See batch.h.
+
+#include "batch.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "mini_json.h"
+
+namespace batch {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::atomic<bool> g_stop{false};
+
+struct Entry {
+    size_t line = 0;  // 1-based manifest line
+    std::string event_id, mp4, out;
+};
+
+std::string dir_of(const std::string &path) {
+    const size_t slash = path.rfind('/');
+    return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+std::string base_of(const std::string &path) {
+    const size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+std::string resolve(const std::string &base_dir, const std::string &p) {
+    return p.empty() || p[0] == '/' ? p : base_dir + "/" + p;
+}
+
+// events/final/<id>/clip.mp4 -> <id>; events/<id>.mp4 -> <id>
+std::string default_event_id(const std::string &mp4) {
+    const std::string name = base_of(mp4);
+    if (name == "clip.mp4") {
+        const std::string dir = dir_of(mp4);
+        if (dir != ".") return base_of(dir);
+    }
+    const size_t dot = name.rfind('.');
+    return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+// Next to the clip: <dir>/NAME for a clip.mp4, <dir>/<stem>.NAME otherwise
+// (events/<id>.mp4 -> events/<id>.reanalysis.json)
+std::string out_next_to(const std::string &mp4, const std::string &name) {
+    const std::string file = base_of(mp4);
+    if (file == "clip.mp4") return dir_of(mp4) + "/" + name;
+    const size_t dot = file.rfind('.');
+    return dir_of(mp4) + "/" + (dot == std::string::npos || dot == 0 ? file : file.substr(0, dot)) + "." + name;
+}
+
+bool load_manifest(const std::string &path, std::vector<Entry> *out, std::string *err) {
+    std::ifstream f(path);
+    if (!f) {
+        *err = "cannot open " + path;
+        return false;
+    }
+    const std::string base_dir = dir_of(path);
+    std::string text;
+    size_t line = 0;
+    while (std::getline(f, text)) {
+        line++;
+        if (text.find_first_not_of(" \t\r") == std::string::npos) continue;
+        mj::Value v;
+        std::string perr;
+        if (!mj::parse(text, &v, &perr) || v.type != mj::Value::Object || v.get_str("mp4").empty()) {
+            *err = path + ":" + std::to_string(line) + ": want {\"mp4\": ...}" + (perr.empty() ? "" : " (" + perr + ")");
+            return false;
+        }
+        Entry e;
+        e.line = line;
+        e.mp4 = resolve(base_dir, v.get_str("mp4"));
+        e.event_id = v.get_str("event_id", default_event_id(e.mp4));
+        e.out = resolve(base_dir, v.get_str("out"));
+        out->push_back(e);
+    }
+    return true;
+}
+
+// Lines that finished ok; a torn last line (no newline) is cut off so the
+// next append starts clean.
+std::set<size_t> load_progress(const std::string &path) {
+    std::set<size_t> done;
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return done;
+    std::ostringstream o;
+    o << f.rdbuf();
+    const std::string text = o.str();
+    const size_t keep = text.rfind('\n') == std::string::npos ? 0 : text.rfind('\n') + 1;
+    if (keep < text.size() && ::truncate(path.c_str(), (off_t)keep) != 0) {
+        std::cerr << "[BATCH] cannot trim " << path << ": " << std::strerror(errno) << "\n";
+    }
+    std::istringstream in(text.substr(0, keep));
+    std::string line;
+    while (std::getline(in, line)) {
+        mj::Value v;
+        std::string err;
+        if (mj::parse(line, &v, &err) && v.get_bool("ok") && v.get_num("line", 0) > 0) {
+            done.insert((size_t)v.get_num("line", 0));
+        }
+    }
+    return done;
+}
+
+// Cuts a torn last line (no newline) off an append-only JSONL file without
+// reading the whole of it.
+void trim_torn_line(const std::string &path) {
+    const int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    off_t keep = 0;
+    if (::fstat(fd, &st) == 0) {
+        char buf[4096];
+        off_t end = st.st_size;
+        while (end > 0 && keep == 0) {
+            const off_t at = std::max<off_t>(0, end - (off_t)sizeof(buf));
+            const ssize_t n = ::pread(fd, buf, (size_t)(end - at), at);
+            if (n <= 0) break;
+            for (ssize_t i = n - 1; i >= 0; i--) {
+                if (buf[i] == '\n') {
+                    keep = at + i + 1;
+                    break;
+                }
+            }
+            end = at;
+        }
+        if (keep < st.st_size && ::ftruncate(fd, keep) != 0) {
+            std::cerr << "[BATCH] cannot trim " << path << ": " << std::strerror(errno) << "\n";
+        }
+    }
+    ::close(fd);
+}
+
+// result_json() is indented over several lines; strings carry their
+// newlines escaped, so dropping the raw ones leaves one valid JSON line.
+std::string one_line(const std::string &json) {
+    std::string o;
+    o.reserve(json.size());
+    bool lead = false;
+    for (char c : json) {
+        if (c == '\n') {
+            lead = true;
+            continue;
+        }
+        if (lead && c == ' ') continue;
+        lead = false;
+        o += c;
+    }
+    return o;
+}
+
+// O_APPEND lines, one write() each (under the caller's lock).
+class Appender {
+public:
+    ~Appender() {
+        if (fd_ >= 0) {
+            ::fdatasync(fd_);
+            ::close(fd_);
+        }
+    }
+    bool open(const std::string &path) {
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        return fd_ >= 0;
+    }
+    bool line(const std::string &s) {
+        const std::string msg = s + "\n";
+        size_t off = 0;
+        while (off < msg.size()) {
+            const ssize_t n = ::write(fd_, msg.data() + off, msg.size() - off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            off += (size_t)n;
+        }
+        return true;
+    }
+    void sync() { ::fdatasync(fd_); }
+
+private:
+    int fd_ = -1;
+};
+
+struct Totals {
+    size_t ok = 0, failed = 0;
+    uint64_t frames = 0;
+};
+
+}  // namespace
+
+int run(const Config &cfg, const engine::Options &base) {
+    std::vector<Entry> entries;
+    std::string err;
+    if (!load_manifest(cfg.manifest, &entries, &err)) {
+        std::cerr << "[BATCH] " << err << "\n";
+        return 2;
+    }
+    const std::string progress_path = cfg.manifest + ".progress";
+    const std::set<size_t> done = load_progress(progress_path);
+    std::vector<Entry> todo;
+    for (const Entry &e : entries) {
+        if (!done.count(e.line)) todo.push_back(e);
+    }
+    const size_t skipped = entries.size() - todo.size();
+
+    Appender progress;
+    if (!progress.open(progress_path)) {
+        std::cerr << "[BATCH] cannot open " << progress_path << ": " << std::strerror(errno) << "\n";
+        return 2;
+    }
+    Appender combined;
+    if (!cfg.combined.empty()) {
+        trim_torn_line(cfg.combined);
+        if (!combined.open(cfg.combined)) {
+            std::cerr << "[BATCH] cannot open " << cfg.combined << ": " << std::strerror(errno) << "\n";
+            return 2;
+        }
+    }
+
+    const int jobs = std::max(1, std::min(cfg.jobs, (int)std::max<size_t>(1, todo.size())));
+    // libav's one-thread-per-core default, shared out between the workers
+    engine::Options opt_base = base;
+    if (opt_base.decode_threads == 0) {
+        opt_base.decode_threads = (int)std::max(1u, std::thread::hardware_concurrency() / (unsigned)jobs);
+    }
+    std::cerr << "[BATCH] " << cfg.manifest << ": " << entries.size() << " entries, " << skipped
+              << " already done, " << jobs << " job(s), results "
+              << (cfg.combined.empty() ? "next to each clip (" + cfg.out_name + ")" : "in " + cfg.combined) << "\n";
+
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = [](int) { g_stop = true; };
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    std::mutex mu;
+    std::condition_variable cv;
+    Totals totals;
+    int running = jobs;
+    std::atomic<size_t> next{0};
+    const Clock::time_point t0 = Clock::now();
+
+    // One for every worker: each clip gets what the ones in flight left
+    engine::MemoryGovernor memory(cfg.memory);
+
+    auto worker = [&] {
+        auto io = io::make_io_engine(cfg.io_backend);
+        for (;;) {
+            const size_t i = next.fetch_add(1);
+            if (i >= todo.size() || g_stop) break;
+            const Entry &e = todo[i];
+            engine::Options opt = opt_base;
+            opt.event_id = e.event_id;
+            opt.mp4_path = e.mp4;
+            const engine::Result res = engine::analyze_clip(opt, io.get(), nullptr, nullptr, nullptr, &memory);
+
+            std::string record, result_line;
+            bool ok = res.ok;
+            if (cfg.combined.empty()) {
+                const std::string out = e.out.empty() ? out_next_to(e.mp4, cfg.out_name) : e.out;
+                bool wrote = false;
+                io->write_atomic(out, engine::result_json(opt, res), [&](bool w) { wrote = w; });
+                io->drain();
+                if (!wrote) std::cerr << "[BATCH] failed to write " << out << "\n";
+                ok = ok && wrote;
+                record = "{\"line\":" + std::to_string(e.line) + ",\"event_id\":\"" + engine::json_escape(e.event_id) +
+                         "\",\"ok\":" + (ok ? "true" : "false") + ",\"out\":\"" + engine::json_escape(out) + "\"}";
+            } else {
+                result_line = "{\"line\":" + std::to_string(e.line) + ",\"event_id\":\"" +
+                              engine::json_escape(e.event_id) + "\",\"mp4\":\"" + engine::json_escape(e.mp4) +
+                              "\",\"ok\":" + (ok ? "true" : "false") +
+                              ",\"result\":" + one_line(engine::result_json(opt, res)) + "}";
+            }
+            if (!res.ok) std::cerr << "[BATCH] " << e.event_id << ": " << res.error << "\n";
+
+            std::lock_guard<std::mutex> lk(mu);
+            if (!result_line.empty()) {
+                // Durable before the progress file calls the line done
+                if (!combined.line(result_line)) {
+                    std::cerr << "[BATCH] " << cfg.combined << " write failed: " << std::strerror(errno) << "\n";
+                    ok = false;
+                }
+                combined.sync();
+                record = "{\"line\":" + std::to_string(e.line) + ",\"event_id\":\"" + engine::json_escape(e.event_id) +
+                         "\",\"ok\":" + (ok ? "true" : "false") + "}";
+            }
+            if (!progress.line(record)) std::cerr << "[BATCH] progress write failed: " << std::strerror(errno) << "\n";
+            (ok ? totals.ok : totals.failed)++;
+            totals.frames += (uint64_t)res.frames_analyzed;
+        }
+        std::lock_guard<std::mutex> lk(mu);
+        running--;
+        cv.notify_all();
+    };
+
+    std::vector<std::thread> pool;
+    for (int j = 0; j < jobs; j++) pool.emplace_back(worker);
+
+    auto rates = [&](const Totals &t, double *secs, double *cps, double *fps) {
+        *secs = std::chrono::duration<double>(Clock::now() - t0).count();
+        *cps = *secs > 0 ? (double)(t.ok + t.failed) / *secs : 0;
+        *fps = *secs > 0 ? (double)t.frames / *secs : 0;
+    };
+    {
+        std::unique_lock<std::mutex> lk(mu);
+        while (running > 0) {
+            if (cv.wait_for(lk, std::chrono::duration<double>(cfg.report_s), [&] { return running == 0; })) break;
+            double secs, cps, fps;
+            rates(totals, &secs, &cps, &fps);
+            const size_t n = totals.ok + totals.failed;
+            progress.sync();
+            char buf[160];
+            std::snprintf(buf, sizeof(buf), "[BATCH] %zu/%zu clips, %.2f clips/s, %.1f frames/s, eta %.0f s\n", n,
+                          todo.size(), cps, fps, cps > 0 ? (double)(todo.size() - n) / cps : -1.0);
+            std::cerr << buf;
+        }
+    }
+    for (std::thread &t : pool) t.join();
+
+    double secs, cps, fps;
+    rates(totals, &secs, &cps, &fps);
+    const size_t left = todo.size() - totals.ok - totals.failed;
+    char buf[384];
+    std::snprintf(buf, sizeof(buf),
+                  "{\"type\":\"batch\",\"entries\":%zu,\"ok\":%zu,\"failed\":%zu,\"skipped\":%zu,\"left\":%zu,"
+                  "\"frames\":%llu,\"jobs\":%d,\"seconds\":%.2f,\"clips_per_s\":%.3f,\"frames_per_s\":%.2f}",
+                  entries.size(), totals.ok, totals.failed, skipped, left, (unsigned long long)totals.frames, jobs,
+                  secs, cps, fps);
+    std::cout << buf << std::endl;
+    if (left) std::cerr << "[BATCH] stopped with " << left << " left; rerun to resume\n";
+    return totals.failed || left ? 1 : 0;
+}
+
+}  // namespace batch
@@ -0,0 +1,48 @@
+// ~/ArduinoApps/survillance/cpp_infer/batch.h
+// ei_infer_mp4 --batch: re-analyse many stored clips in one process.
+//
+// Manifest: JSON lines, {"mp4": "events/final/<id>/clip.mp4"} plus optional
+// "event_id" (default: the clip's directory name, or its stem when it is not
+// a clip.mp4) and "out" (result path for that clip). Relative paths are taken
+// from the manifest's directory, as in survi_sweep.
+//
+// --jobs workers take entries in manifest order. Clips decode and preprocess
+// in parallel; the classifier itself runs one inference at a time (engine.h).
+// Each result goes next to its clip as --out_name (<id>/clip.mp4 ->
+// <id>/NAME, <id>.mp4 -> <id>.NAME) or to the entry's "out", or is one line
+// of --combined FILE.jsonl:
+//   {"line":N, "event_id":"..", "mp4":"..", "ok":true, "result":{...}}
+//
+// Resume: every finished entry appends {"line":N, "ok":..} to
+// <manifest>.progress. A rerun skips the lines that finished ok and retries
+// the rest; a torn last line from a crash is cut off first. SIGINT / SIGTERM
+// stop after the clips in flight. The combined file gets a record per
+// attempt, so a retried line appears once per try (and an ok one can repeat
+// after a crash between the two appends): the last record of a line wins.
+//
+// Throughput (clips/s, frames/s) goes to stderr while it runs and as one
+// summary JSON line on stdout at the end.
+#pragma once
+
+#include <string>
+
+#include "engine.h"
+#include "io_engine.h"
+
+namespace batch {
+
+struct Config {
+    std::string manifest;
+    int jobs = 1;
+    std::string out_name = "reanalysis.json";  // next to each clip
+    std::string combined;                      // JSONL instead of per-clip files
+    io::Backend io_backend = io::Backend::Auto;
+    double report_s = 10.0;                    // stderr progress interval
+    engine::MemoryConfig memory;               // limit_mb > 0: one governor shared by the workers
+};
+
+// base: the analysis options for every clip (event_id / mp4_path are the
+// entry's). Returns the process exit code: 0 when every entry finished ok.
+int run(const Config &cfg, const engine::Options &base);
+
+}  // namespace batch
@@ -0,0 +1,523 @@
+// ~/ArduinoApps/survillance/cpp_infer/bench.cpp
+// Multi-camera capacity benchmark for one hub.
+//
+// Runs N simulated cameras concurrently, each replaying the given files in
+// real time (replay.h) through the same per-frame work as main.py's capture
+// loop: resize, motion detection (motion.h), 1 s segment recording and the
+// idle/active/postroll event FSM. Finalised event clips go to one analysis
+// worker running the engine (analyze_clip is single-threaded by design,
+// like main.py's analysis_worker).
+//
+// Per level it reports, per camera, frames due / processed / dropped (a
+// frame is dropped when the camera thread is more than one frame interval
+// behind the replay clock, as a V4L2 ring would overwrite it), events, and
+// finalize->result latency percentiles, plus process CPU and memory.
+//
+// --sweep MAX runs N = 1..MAX and reports the highest N that meets the SLO:
+// p95 finalize->result latency <= --slo_ms, every camera dropping at most
+// --max_drop_pct of its frames, and no event left unanalysed after --drain_s.
+// A level with no analysed event at all fails (there is no p95 to check).
+//
+// Differences from the real pipeline, on purpose: the event clip is written
+// by its own VideoWriter while the event runs (no preroll concat), and
+// segments are deleted as soon as they are closed (disk I/O load without
+// filling the card).
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.h"
+#include "motion.h"
+#include "replay.h"
+
+using Clock = std::chrono::steady_clock;
+
+// -------------------------
+// Options
+// -------------------------
+struct BenchOptions {
+    std::vector<std::string> files;
+    int cameras = 1;
+    int sweep_max = 0;          // > 0: N = 1..sweep_max
+    double seconds = 60.0;      // per level
+    double fps = 15.0;
+    int width = 640, height = 360;
+    MotionParams motion;
+    int on_frames = 3;
+    double off_seconds = 2.0;
+    double postroll_seconds = 3.0;
+    double max_event_seconds = 300.0;
+    bool record = true;
+    int frames = 5;
+    float threshold = 0.5f;
+    dec::Fidelity fidelity = dec::Fidelity::Full;
+    double slo_ms = 5000.0;
+    double max_drop_pct = 1.0;
+    double drain_s = 60.0;
+    std::string work_dir = "/tmp/survi_bench";
+    std::string out_path;       // empty: stdout
+};
+
+static void usage(const char *argv0) {
+    std::cerr
+        << "Usage:\n"
+        << "  " << argv0 << " [--cameras N | --sweep MAX] [--seconds S] [--fps F] [--width W --height H]\n"
+        << "        [--slo_ms MS] [--max_drop_pct P] [--drain_s S] [--frames N] [--threshold T]\n"
+        << "        [--fidelity full|fast] [--motion_model diff|background]\n"
+        << "        [--no_record] [--work DIR] [--out report.json] file...\n"
+        << "\n"
+        << "  file       recorded .mp4 / .mjpg clips; camera i starts at file i % count\n"
+        << "  --sweep    run 1..MAX cameras and report the highest N within the SLO\n"
+        << "  --slo_ms   p95 finalize->result latency budget (default 5000)\n"
+        << "  --motion_model  background: adaptive background model (bg_model.h); compare events\n"
+        << "\n"
+        << "Example:\n"
+        << "  " << argv0 << " --sweep 8 --seconds 120 --slo_ms 4000 walk.mp4 cars.mp4\n";
+}
+
+// -------------------------
+// Small helpers
+// -------------------------
+static double secs_since(Clock::time_point t) {
+    return std::chrono::duration<double>(Clock::now() - t).count();
+}
+
+static double cpu_seconds() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+// VmRSS / VmHWM from /proc/self/status, in kB (0 if unavailable).
+static long proc_status_kb(const char *key) {
+    std::ifstream f("/proc/self/status");
+    std::string line;
+    const size_t n = std::strlen(key);
+    while (std::getline(f, line)) {
+        if (line.compare(0, n, key) == 0 && line.size() > n && line[n] == ':') {
+            return std::atol(line.c_str() + n + 1);
+        }
+    }
+    return 0;
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return -1;
+    std::sort(v.begin(), v.end());
+    const size_t i = (size_t)std::min<double>(v.size() - 1, std::round(p / 100.0 * (v.size() - 1)));
+    return v[i];
+}
+
+// -------------------------
+// Analysis worker
+// -------------------------
+struct AnalysisJob {
+    int camera = 0;
+    std::string clip;
+    Clock::time_point trigger, finalize;
+};
+
+struct EventSample {
+    int camera = 0;
+    double queue_ms = 0;        // finalize -> analysis start
+    double result_ms = 0;       // finalize -> result
+    double trigger_ms = 0;      // trigger -> result
+    bool ok = false;
+};
+
+class AnalysisWorker {
+public:
+    explicit AnalysisWorker(const BenchOptions &o) : opt_(o), th_([this] { run(); }) {}
+    ~AnalysisWorker() { stop(); }
+
+    void submit(AnalysisJob j) {
+        std::lock_guard<std::mutex> lk(mu_);
+        q_.push_back(std::move(j));
+        cv_.notify_one();
+    }
+
+    // Waits up to `timeout_s` for the queue to empty; returns jobs left.
+    size_t drain(double timeout_s) {
+        std::unique_lock<std::mutex> lk(mu_);
+        idle_cv_.wait_for(lk, std::chrono::duration<double>(timeout_s), [&] { return q_.empty() && !busy_; });
+        return q_.size() + (busy_ ? 1 : 0);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            if (stop_) return;
+            stop_ = true;
+            cv_.notify_all();
+        }
+        th_.join();
+        for (auto &j : q_) std::remove(j.clip.c_str());
+        q_.clear();
+    }
+
+    std::vector<EventSample> samples() {
+        std::lock_guard<std::mutex> lk(mu_);
+        return samples_;
+    }
+
+private:
+    void run() {
+        for (;;) {
+            AnalysisJob j;
+            {
+                std::unique_lock<std::mutex> lk(mu_);
+                cv_.wait(lk, [&] { return stop_ || !q_.empty(); });
+                if (stop_) return;
+                j = std::move(q_.front());
+                q_.pop_front();
+                busy_ = true;
+            }
+            const auto start = Clock::now();
+            engine::Options eo;
+            eo.event_id = "bench";
+            eo.mp4_path = j.clip;
+            eo.frames = opt_.frames;
+            eo.threshold = opt_.threshold;
+            eo.fidelity = opt_.fidelity;
+            const engine::Result res = engine::analyze_clip(eo);
+            const auto done = Clock::now();
+            std::remove(j.clip.c_str());
+
+            EventSample s;
+            s.camera = j.camera;
+            s.queue_ms = std::chrono::duration<double, std::milli>(start - j.finalize).count();
+            s.result_ms = std::chrono::duration<double, std::milli>(done - j.finalize).count();
+            s.trigger_ms = std::chrono::duration<double, std::milli>(done - j.trigger).count();
+            s.ok = res.ok;
+
+            std::lock_guard<std::mutex> lk(mu_);
+            samples_.push_back(s);
+            busy_ = false;
+            if (q_.empty()) idle_cv_.notify_all();
+        }
+    }
+
+    const BenchOptions &opt_;
+    std::mutex mu_;
+    std::condition_variable cv_, idle_cv_;
+    std::deque<AnalysisJob> q_;
+    std::vector<EventSample> samples_;
+    bool busy_ = false;
+    bool stop_ = false;
+    std::thread th_;
+};
+
+// -------------------------
+// Simulated camera
+// -------------------------
+struct CameraStats {
+    uint64_t due = 0;        // frames the replay clock delivered
+    uint64_t processed = 0;
+    uint64_t dropped = 0;
+    uint64_t events = 0;     // finalised and queued
+    uint64_t unfinished = 0; // still active / in postroll at the end
+};
+
+static void camera_loop(int cam, const BenchOptions &opt, AnalysisWorker *worker, Clock::time_point deadline,
+                        std::atomic<bool> *failed, CameraStats *st) {
+    replay::Playlist playlist(opt.files, opt.fps, 0, (size_t)cam);
+    MotionDetector md(opt.motion);
+    const int fourcc = cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+    const std::string prefix = opt.work_dir + "/cam" + std::to_string(cam);
+    const cv::Size size(opt.width, opt.height);
+    const auto interval = std::chrono::microseconds((int64_t)(1e6 / opt.fps));
+
+    cv::VideoWriter seg, clip;
+    double seg_start = 0;
+    uint64_t seg_n = 0, evt_n = 0;
+    std::string seg_path, clip_path;
+
+    enum { Idle, Active, Postroll } state = Idle;
+    int streak = 0;
+    double last_motion = 0, postroll_until = 0, evt_start = 0;
+    Clock::time_point trigger;
+
+    cv::Mat frame, sized;
+    int64_t pos_us = 0;
+    const auto t0 = Clock::now();
+    while (Clock::now() < deadline) {
+        if (!playlist.next(frame, &pos_us)) {
+            failed->store(true);
+            return;
+        }
+        st->due++;
+        const auto due = t0 + std::chrono::microseconds(pos_us);
+        if (Clock::now() > due + interval) {
+            st->dropped++;
+            continue;
+        }
+        std::this_thread::sleep_until(due);
+        const double ts = pos_us / 1e6;
+
+        cv::resize(frame, sized, size, 0, 0, cv::INTER_AREA);
+
+        if (opt.record) {
+            if (!seg.isOpened()) {
+                seg_path = prefix + "_seg" + std::to_string(seg_n++ % 4) + ".mp4";
+                seg.open(seg_path, fourcc, opt.fps, size);
+                seg_start = ts;
+            }
+            seg.write(sized);
+            if (ts - seg_start >= 1.0) {
+                seg.release();
+                std::remove(seg_path.c_str());
+            }
+        }
+
+        const MotionResult m = md.update(sized);
+        if (m.motion) {
+            streak++;
+            last_motion = ts;
+        } else {
+            streak = std::max(0, streak - 1);
+        }
+
+        if (state == Idle && streak >= opt.on_frames) {
+            state = Active;
+            evt_start = ts;
+            trigger = Clock::now();
+            clip_path = prefix + "_evt" + std::to_string(evt_n++) + ".mp4";
+            clip.open(clip_path, fourcc, opt.fps, size);
+        }
+        if (state == Postroll && streak >= opt.on_frames) state = Active;
+        if (state == Active &&
+            (ts - last_motion >= opt.off_seconds || ts - evt_start >= opt.max_event_seconds)) {
+            state = Postroll;
+            postroll_until = ts + opt.postroll_seconds;
+        }
+        if (state != Idle && clip.isOpened()) clip.write(sized);
+        if (state == Postroll && ts >= postroll_until) {
+            clip.release();
+            worker->submit(AnalysisJob{cam, clip_path, trigger, Clock::now()});
+            st->events++;
+            state = Idle;
+        }
+        st->processed++;
+    }
+
+    if (seg.isOpened()) {
+        seg.release();
+        std::remove(seg_path.c_str());
+    }
+    if (state != Idle) {
+        clip.release();
+        std::remove(clip_path.c_str());
+        st->unfinished++;
+    }
+}
+
+// -------------------------
+// One level: N cameras for opt.seconds
+// -------------------------
+struct LevelReport {
+    int cameras = 0;
+    std::vector<CameraStats> cams;
+    std::vector<EventSample> events;
+    size_t unanalysed = 0;
+    double wall_s = 0, cpu_pct = 0;
+    long rss_peak_kb = 0, hwm_kb = 0;
+    double p50 = -1, p95 = -1, p99 = -1, max_drop_pct = 0;
+    bool source_failed = false;
+    bool pass = false;
+};
+
+static LevelReport run_level(const BenchOptions &opt, int n) {
+    LevelReport rep;
+    rep.cameras = n;
+    rep.cams.resize(n);
+
+    AnalysisWorker worker(opt);
+    std::atomic<bool> failed{false};
+    std::atomic<bool> sampling{true};
+    std::atomic<long> rss_peak{0};
+    std::thread mem([&] {
+        while (sampling) {
+            rss_peak = std::max(rss_peak.load(), proc_status_kb("VmRSS"));
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        }
+    });
+
+    const auto t0 = Clock::now();
+    const double cpu0 = cpu_seconds();
+    const auto deadline = t0 + std::chrono::microseconds((int64_t)(opt.seconds * 1e6));
+    std::vector<std::thread> cams;
+    for (int i = 0; i < n; i++) {
+        cams.emplace_back(camera_loop, i, std::cref(opt), &worker, deadline, &failed, &rep.cams[i]);
+    }
+    for (auto &t : cams) t.join();
+    rep.unanalysed = worker.drain(opt.drain_s);
+    rep.wall_s = secs_since(t0);
+    const unsigned ncpu = std::max(1u, std::thread::hardware_concurrency());
+    rep.cpu_pct = 100.0 * (cpu_seconds() - cpu0) / rep.wall_s / ncpu;
+    sampling = false;
+    mem.join();
+    worker.stop();
+
+    rep.events = worker.samples();
+    rep.rss_peak_kb = rss_peak;
+    rep.hwm_kb = proc_status_kb("VmHWM");
+    rep.source_failed = failed;
+
+    std::vector<double> lat;
+    for (const auto &e : rep.events) lat.push_back(e.result_ms);
+    rep.p50 = percentile(lat, 50);
+    rep.p95 = percentile(lat, 95);
+    rep.p99 = percentile(lat, 99);
+    for (const auto &c : rep.cams) {
+        if (c.due) rep.max_drop_pct = std::max(rep.max_drop_pct, 100.0 * c.dropped / c.due);
+    }
+    // A level that analysed no event has no latency to hold to the SLO:
+    // that is a fail, not a pass
+    rep.pass = !rep.source_failed && rep.unanalysed == 0 && rep.max_drop_pct <= opt.max_drop_pct &&
+               !rep.events.empty() && rep.p95 >= 0 && rep.p95 <= opt.slo_ms;
+    return rep;
+}
+
+static std::string level_json(const LevelReport &r) {
+    std::ostringstream o;
+    o << "    {\"cameras\": " << r.cameras << ", \"pass\": " << (r.pass ? "true" : "false")
+      << ", \"wall_s\": " << r.wall_s << ", \"cpu_pct\": " << r.cpu_pct
+      << ", \"rss_peak_kb\": " << r.rss_peak_kb << ", \"vm_hwm_kb\": " << r.hwm_kb
+      << ",\n     \"events\": " << r.events.size() << ", \"unanalysed\": " << r.unanalysed
+      << ", \"latency_ms\": {\"p50\": " << r.p50 << ", \"p95\": " << r.p95 << ", \"p99\": " << r.p99 << "}"
+      << ", \"max_drop_pct\": " << r.max_drop_pct << (r.source_failed ? ", \"source_failed\": true" : "")
+      << ",\n     \"per_camera\": [";
+    for (size_t i = 0; i < r.cams.size(); i++) {
+        const CameraStats &c = r.cams[i];
+        std::vector<double> lat;
+        for (const auto &e : r.events) {
+            if (e.camera == (int)i) lat.push_back(e.result_ms);
+        }
+        o << (i ? ",\n       " : "\n       ") << "{\"camera\": " << i << ", \"frames_due\": " << c.due
+          << ", \"processed\": " << c.processed << ", \"dropped\": " << c.dropped << ", \"events\": " << c.events
+          << ", \"unfinished\": " << c.unfinished << ", \"p95_ms\": " << percentile(lat, 95) << "}";
+    }
+    o << "]}";
+    return o.str();
+}
+
+// -------------------------
+// Main
+// -------------------------
+int main(int argc, char **argv) {
+    BenchOptions opt;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto need = [&](const char *flag) {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << flag << "\n";
+                usage(argv[0]);
+                std::exit(2);
+            }
+        };
+
+        if (a == "--cameras") { need("--cameras"); opt.cameras = std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--sweep") { need("--sweep"); opt.sweep_max = std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--seconds") { need("--seconds"); opt.seconds = std::max(1.0, std::atof(argv[++i])); }
+        else if (a == "--fps") { need("--fps"); opt.fps = std::max(1.0, std::atof(argv[++i])); }
+        else if (a == "--width") { need("--width"); opt.width = std::max(16, std::atoi(argv[++i])); }
+        else if (a == "--height") { need("--height"); opt.height = std::max(16, std::atoi(argv[++i])); }
+        else if (a == "--slo_ms") { need("--slo_ms"); opt.slo_ms = std::atof(argv[++i]); }
+        else if (a == "--max_drop_pct") { need("--max_drop_pct"); opt.max_drop_pct = std::atof(argv[++i]); }
+        else if (a == "--drain_s") { need("--drain_s"); opt.drain_s = std::max(0.0, std::atof(argv[++i])); }
+        else if (a == "--frames") { need("--frames"); opt.frames = std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--threshold") { need("--threshold"); opt.threshold = std::stof(argv[++i]); }
+        else if (a == "--fidelity") {
+            need("--fidelity");
+            if (!dec::parse_fidelity(argv[++i], &opt.fidelity)) {
+                std::cerr << "Bad --fidelity: " << argv[i] << "\n";
+                return 2;
+            }
+        }
+        else if (a == "--motion_model") {
+            need("--motion_model");
+            const std::string m = argv[++i];
+            if (m != "diff" && m != "background") {
+                std::cerr << "Bad --motion_model: " << m << "\n";
+                return 2;
+            }
+            opt.motion.background = m == "background";
+        }
+        else if (a == "--no_record") { opt.record = false; }
+        else if (a == "--work") { need("--work"); opt.work_dir = argv[++i]; }
+        else if (a == "--out") { need("--out"); opt.out_path = argv[++i]; }
+        else if (a == "--help" || a == "-h") { usage(argv[0]); return 0; }
+        else if (!a.empty() && a[0] == '-') {
+            std::cerr << "Unknown arg: " << a << "\n";
+            usage(argv[0]);
+            return 2;
+        }
+        else opt.files.push_back(a);
+    }
+    if (opt.files.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+    ::mkdir(opt.work_dir.c_str(), 0755);
+
+    std::vector<LevelReport> levels;
+    int capacity = 0;
+    const int lo = opt.sweep_max > 0 ? 1 : opt.cameras;
+    const int hi = opt.sweep_max > 0 ? opt.sweep_max : opt.cameras;
+    for (int n = lo; n <= hi; n++) {
+        std::cerr << "[BENCH] " << n << " camera(s) for " << opt.seconds << " s\n";
+        levels.push_back(run_level(opt, n));
+        const LevelReport &r = levels.back();
+        std::cerr << "[BENCH]   events=" << r.events.size() << " p95=" << r.p95 << "ms drop=" << r.max_drop_pct
+                  << "% cpu=" << r.cpu_pct << "% rss_peak=" << r.rss_peak_kb << "kB -> "
+                  << (r.pass ? "PASS" : "FAIL")
+                  << (r.events.empty() ? " (no event analysed; try a longer --seconds)" : "") << "\n";
+        if (r.pass) capacity = n;
+        if (r.source_failed || (opt.sweep_max > 0 && !r.pass)) break;
+    }
+
+    std::ostringstream o;
+    o << "{\n  \"slo\": {\"p95_ms\": " << opt.slo_ms << ", \"max_drop_pct\": " << opt.max_drop_pct
+      << ", \"drain_s\": " << opt.drain_s << "},\n"
+      << "  \"fidelity\": \"" << dec::fidelity_name(opt.fidelity) << "\""
+      << ", \"fps\": " << opt.fps << ", \"frame\": [" << opt.width << ", " << opt.height << "]"
+      << ", \"seconds_per_level\": " << opt.seconds << ", \"cpus\": " << std::thread::hardware_concurrency()
+      << ",\n  \"max_cameras_within_slo\": " << capacity << ",\n  \"levels\": [\n";
+    for (size_t i = 0; i < levels.size(); i++) {
+        o << level_json(levels[i]) << (i + 1 < levels.size() ? ",\n" : "\n");
+    }
+    o << "  ]\n}\n";
+
+    if (opt.out_path.empty()) {
+        std::cout << o.str();
+    } else {
+        std::ofstream f(opt.out_path);
+        f << o.str();
+        if (!f) {
+            std::cerr << "Failed to write " << opt.out_path << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
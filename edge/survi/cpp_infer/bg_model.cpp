@@ -0,0 +1,164 @@
+// ~/ArduinoApps/survillance/cpp_infer/bg_model.cpp
+// See bg_model.h.
+
+#include "bg_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace bgm {
+
+namespace {
+
+// Cells darker than this carry no usable gain ratio (sensor noise dominates).
+constexpr float kGainFloor = 16.0f;
+// Fewer usable cells than this: assume no gain change.
+constexpr size_t kGainMinCells = 16;
+
+}  // namespace
+
+BackgroundModel::BackgroundModel(const BgConfig &cfg) : cfg_(cfg) {
+    cfg_.cell = std::max(1, cfg_.cell);
+    cfg_.var_min = std::max(1.0f, cfg_.var_min);
+    cfg_.var_init = std::max(cfg_.var_min, cfg_.var_init);
+}
+
+void BackgroundModel::learn(const float *cur) {
+    std::memcpy(mean_.data(), cur, mean_.size() * sizeof(float));
+    std::fill(var_.begin(), var_.end(), cfg_.var_init);
+    std::fill(fg_.begin(), fg_.end(), 0);
+    gain_ = 1.0f;
+}
+
+int BackgroundModel::update(const uint8_t *gray, int w, int h, size_t stride, uint8_t *mask, size_t mask_stride) {
+    if (!gray || w <= 0 || h <= 0) return 0;
+    const int c = cfg_.cell;
+    if (w != w_ || h != h_) {
+        w_ = w;
+        h_ = h;
+        gw_ = (w + c - 1) / c;
+        gh_ = (h + c - 1) / c;
+        const size_t n = (size_t)gw_ * gh_;
+        mean_.assign(n, 0.0f);
+        var_.assign(n, 0.0f);
+        cur_.assign(n, 0.0f);
+        fg_.assign(n, 0);
+        ratio_.reserve(n);
+        primed_ = false;
+    }
+
+    // Decimate: mean of each cell
+    std::fill(cur_.begin(), cur_.end(), 0.0f);
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row = gray + (size_t)y * stride;
+        float *acc = cur_.data() + (size_t)(y / c) * gw_;
+        for (int gx = 0; gx < gw_; gx++) {
+            const int x1 = std::min(w, (gx + 1) * c);
+            uint32_t s = 0;
+            for (int x = gx * c; x < x1; x++) s += row[x];
+            acc[gx] += (float)s;
+        }
+    }
+    for (int gy = 0; gy < gh_; gy++) {
+        const int ch = std::min(h, (gy + 1) * c) - gy * c;
+        for (int gx = 0; gx < gw_; gx++) {
+            const int cw = std::min(w, (gx + 1) * c) - gx * c;
+            cur_[(size_t)gy * gw_ + gx] /= (float)(cw * ch);
+        }
+    }
+
+    if (mask) {
+        for (int y = 0; y < h; y++) std::memset(mask + (size_t)y * mask_stride, 0, (size_t)w);
+    }
+    if (!primed_) {
+        learn(cur_.data());
+        primed_ = true;
+        return 0;
+    }
+
+    // Global gain over last frame's background cells
+    const size_t n = cur_.size();
+    ratio_.clear();
+    for (size_t i = 0; i < n; i++) {
+        if (!fg_[i] && mean_[i] >= kGainFloor) ratio_.push_back(cur_[i] / mean_[i]);
+    }
+    float gain = 1.0f;
+    if (ratio_.size() >= kGainMinCells) {
+        auto mid = ratio_.begin() + ratio_.size() / 2;
+        std::nth_element(ratio_.begin(), mid, ratio_.end());
+        gain = std::min(cfg_.gain_max, std::max(cfg_.gain_min, *mid));
+    }
+    gain_ = gain;
+
+    int n_fg = 0;
+    for (size_t i = 0; i < n; i++) {
+        const float d = cur_[i] / gain - mean_[i];
+        const float thr = std::max(cfg_.k_sigma * std::sqrt(var_[i]), cfg_.min_diff);
+        fg_[i] = std::fabs(d) > thr;
+        n_fg += fg_[i];
+    }
+
+    if ((float)n_fg > cfg_.max_fg_frac * (float)n) {
+        learn(cur_.data());
+        relearns_++;
+        return 0;
+    }
+
+    // Learn. The mean follows the raw frame, so after a lasting light change
+    // the gain drifts back to 1; the variance is of the compensated residual.
+    for (size_t i = 0; i < n; i++) {
+        const float a = fg_[i] ? cfg_.alpha_fg : cfg_.alpha;
+        const float d = cur_[i] / gain - mean_[i];
+        mean_[i] += a * (cur_[i] - mean_[i]);
+        if (!fg_[i]) var_[i] = std::max(cfg_.var_min, var_[i] + a * (d * d - var_[i]));
+    }
+
+    if (mask && n_fg) {
+        for (int gy = 0; gy < gh_; gy++) {
+            const uint8_t *f = fg_.data() + (size_t)gy * gw_;
+            const int y1 = std::min(h, (gy + 1) * c);
+            for (int gx = 0; gx < gw_; gx++) {
+                if (!f[gx]) continue;
+                const int x0 = gx * c, x1 = std::min(w, x0 + c);
+                for (int y = gy * c; y < y1; y++) std::memset(mask + (size_t)y * mask_stride + x0, 255, (size_t)(x1 - x0));
+            }
+        }
+    }
+    return n_fg;
+}
+
+}  // namespace bgm
+
+// -------------------------
+// C API (python/bg_model.py)
+// -------------------------
+extern "C" {
+
+void *bg_open(int cell, float alpha, float k_sigma, float min_diff, float max_fg_frac) {
+    bgm::BgConfig cfg;
+    if (cell > 0) cfg.cell = cell;
+    if (alpha > 0) cfg.alpha = alpha;
+    if (k_sigma > 0) cfg.k_sigma = k_sigma;
+    if (min_diff > 0) cfg.min_diff = min_diff;
+    if (max_fg_frac > 0) cfg.max_fg_frac = max_fg_frac;
+    return new bgm::BackgroundModel(cfg);
+}
+
+void bg_close(void *h) { delete (bgm::BackgroundModel *)h; }
+
+// Returns the number of foreground cells, -1 on bad arguments.
+int bg_update(void *h, const uint8_t *gray, int w, int hgt, int stride, uint8_t *mask, int mask_stride) {
+    if (!h || !gray || w <= 0 || hgt <= 0 || stride < w || (mask && mask_stride < w)) return -1;
+    return ((bgm::BackgroundModel *)h)->update(gray, w, hgt, (size_t)stride, mask, (size_t)mask_stride);
+}
+
+void bg_reset(void *h) {
+    if (h) ((bgm::BackgroundModel *)h)->reset();
+}
+
+float bg_gain(void *h) { return h ? ((bgm::BackgroundModel *)h)->gain() : 1.0f; }
+
+uint64_t bg_relearns(void *h) { return h ? ((bgm::BackgroundModel *)h)->relearns() : 0; }
+
+}  // extern "C"
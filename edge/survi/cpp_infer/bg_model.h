@@ -0,0 +1,71 @@
+// ~/ArduinoApps/survillance/cpp_infer/bg_model.h
+// Adaptive background model for motion triggering.
+//
+// The frame-difference detector (motion.h, main.py's capture loop) fires on
+// anything that changes between two frames: clouds, headlights sweeping a
+// wall, the IR cut filter switching, auto-exposure steps. Every one of those
+// becomes an event, i.e. a concat, a transcode and a runner pass.
+//
+// This model keeps a running mean and variance per cell of a decimated grid
+// (cell x cell pixels averaged) and marks a cell foreground when it is more
+// than k_sigma standard deviations (and at least min_diff gray levels) away
+// from its mean. Before that test the frame is divided by a global gain: the
+// median ratio frame / background over the cells that were background last
+// frame, so a frame-wide brightness change moves every cell together and
+// cancels out. A change the gain can't explain (more than max_fg_frac of the
+// cells foreground at once, e.g. IR switching on) relearns the background
+// from the current frame instead of reporting motion.
+//
+// The output is a full-resolution 0/255 mask, so callers keep their own
+// dilate -> contours -> area_min gating unchanged.
+//
+// Plain C++ on 8-bit gray buffers (no OpenCV), exported with a C API for
+// python/bg_model.py.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bgm {
+
+struct BgConfig {
+    int cell = 8;               // grid cell size, pixels
+    float alpha = 0.03f;        // background learning rate
+    float alpha_fg = 0.002f;    // learning rate under foreground (parked car fades in)
+    float k_sigma = 3.0f;       // foreground beyond this many std devs ...
+    float min_diff = 25.0f;     // ... and at least this many gray levels
+    float var_init = 100.0f;    // variance of a freshly learned cell
+    float var_min = 16.0f;
+    float max_fg_frac = 0.5f;   // more foreground than this: relearn, no motion
+    float gain_min = 0.4f, gain_max = 2.5f;
+};
+
+class BackgroundModel {
+public:
+    explicit BackgroundModel(const BgConfig &cfg = BgConfig());
+
+    // gray: w x h, `stride` bytes per row. mask (may be null): w x h,
+    // mask_stride bytes per row, set to 255 on foreground cells and 0
+    // elsewhere. Returns the number of foreground cells. The first frame
+    // (or one of another size) only primes the model.
+    int update(const uint8_t *gray, int w, int h, size_t stride, uint8_t *mask, size_t mask_stride);
+    void reset() { primed_ = false; }
+
+    float gain() const { return gain_; }           // last frame / background brightness
+    uint64_t relearns() const { return relearns_; } // frame-wide changes absorbed
+    int cells() const { return gw_ * gh_; }
+
+private:
+    void learn(const float *cur);
+
+    BgConfig cfg_;
+    bool primed_ = false;
+    int w_ = 0, h_ = 0, gw_ = 0, gh_ = 0;
+    std::vector<float> mean_, var_, cur_, ratio_;
+    std::vector<uint8_t> fg_;
+    float gain_ = 1.0f;
+    uint64_t relearns_ = 0;
+};
+
+}  // namespace bgm
@@ -0,0 +1,108 @@
+// ~/ArduinoApps/survillance/cpp_infer/clip_sampler.cpp
+// See clip_sampler.h.
+
+#include "clip_sampler.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace yolo {
+
+namespace {
+
+float iou(const Box &a, const Box &b) {
+    const float ix = std::max(0.0f, std::min(a.x1, b.x1) - std::max(a.x0, b.x0));
+    const float iy = std::max(0.0f, std::min(a.y1, b.y1) - std::max(a.y0, b.y0));
+    const float inter = ix * iy;
+    const float uni = (a.x1 - a.x0) * (a.y1 - a.y0) + (b.x1 - b.x0) * (b.y1 - b.y0) - inter;
+    return uni > 0 ? inter / uni : 0.0f;
+}
+
+Box lerp(const Box &a, const Box &b, float t) {
+    Box o = a;
+    o.conf = a.conf + (b.conf - a.conf) * t;
+    o.x0 = a.x0 + (b.x0 - a.x0) * t;
+    o.y0 = a.y0 + (b.y0 - a.y0) * t;
+    o.x1 = a.x1 + (b.x1 - a.x1) * t;
+    o.y1 = a.y1 + (b.y1 - a.y1) * t;
+    return o;
+}
+
+}  // namespace
+
+// -------------------------
+// Sampling
+// -------------------------
+FrameSampler::FrameSampler(const SamplerConfig &cfg, std::vector<int64_t> hints_ms)
+    : cfg_(cfg), hints_(std::move(hints_ms)) {
+    cfg_.dense_stride = std::max(1, cfg_.dense_stride);
+    cfg_.sparse_stride = std::max(cfg_.dense_stride, cfg_.sparse_stride);
+    std::sort(hints_.begin(), hints_.end());
+}
+
+// Frames arrive in time order, so the hint cursor only moves forward.
+bool FrameSampler::near_hint(int64_t t_ms) {
+    if (t_ms < 0) return false;
+    while (hint_pos_ < hints_.size() && hints_[hint_pos_] < t_ms - cfg_.hint_window_ms) hint_pos_++;
+    return hint_pos_ < hints_.size() && hints_[hint_pos_] <= t_ms + cfg_.hint_window_ms;
+}
+
+bool FrameSampler::want(int frame_idx, int64_t t_ms, bool motion, bool live_tracks) {
+    const bool dense = near_hint(t_ms) || motion || live_tracks;
+    if (last_ >= 0 && frame_idx - last_ < (dense ? cfg_.dense_stride : cfg_.sparse_stride)) return false;
+    last_ = frame_idx;
+    return true;
+}
+
+// -------------------------
+// Propagation
+// -------------------------
+std::vector<std::vector<TrackedBox>> propagate_tracks(const std::vector<std::pair<int, std::vector<Box>>> &samples,
+                                                      int n_frames, float match_iou) {
+    std::vector<std::vector<TrackedBox>> out((size_t)std::max(0, n_frames));
+    for (const auto &s : samples) {
+        if (s.first < 0 || s.first >= n_frames) continue;
+        for (const Box &b : s.second) out[s.first].push_back(TrackedBox{b, false});
+    }
+
+    for (size_t k = 0; k + 1 < samples.size(); k++) {
+        const int fa = samples[k].first, fb = samples[k + 1].first;
+        if (fb - fa < 2 || fa < 0 || fb >= n_frames) continue;
+        const std::vector<Box> &a = samples[k].second, &b = samples[k + 1].second;
+
+        // Greedy pairing, best IoU first
+        std::vector<std::tuple<float, int, int>> cand;
+        for (size_t i = 0; i < a.size(); i++) {
+            for (size_t j = 0; j < b.size(); j++) {
+                if (a[i].class_id != b[j].class_id) continue;
+                const float v = iou(a[i], b[j]);
+                if (v >= match_iou) cand.emplace_back(v, (int)i, (int)j);
+            }
+        }
+        std::sort(cand.begin(), cand.end(), [](const auto &x, const auto &y) { return std::get<0>(x) > std::get<0>(y); });
+        std::vector<int> pair_a(a.size(), -1);
+        std::vector<char> used_b(b.size(), 0);
+        for (const auto &c : cand) {
+            const int i = std::get<1>(c), j = std::get<2>(c);
+            if (pair_a[i] >= 0 || used_b[j]) continue;
+            pair_a[i] = j;
+            used_b[j] = 1;
+        }
+
+        const int mid = fa + (fb - fa) / 2;
+        for (int f = fa + 1; f < fb; f++) {
+            const float t = (float)(f - fa) / (float)(fb - fa);
+            auto &dst = out[f];
+            for (size_t i = 0; i < a.size(); i++) {
+                if (pair_a[i] >= 0) dst.push_back(TrackedBox{lerp(a[i], b[pair_a[i]], t), true});
+                else if (f <= mid) dst.push_back(TrackedBox{a[i], true});
+            }
+            for (size_t j = 0; j < b.size(); j++) {
+                if (!used_b[j] && f > mid) dst.push_back(TrackedBox{b[j], true});
+            }
+        }
+    }
+    return out;
+}
+
+}  // namespace yolo
@@ -0,0 +1,64 @@
+// ~/ArduinoApps/survillance/cpp_infer/clip_sampler.h
+// Which frames of a clip survi_yolo_server actually runs the detector on, and
+// how boxes reach the frames it skipped.
+//
+// FrameSampler decides while the clip decodes: a sparse stride by default,
+// a dense one while there is motion (motion.h on a reduced copy), near a
+// time the edge runner reported a detection (result.json t_ms), or while the
+// last sampled frame still had tracked objects. The first and last frames are
+// always sampled.
+//
+// propagate_tracks() then fills the gaps: boxes of two neighbouring samples
+// are paired greedily by IoU within a class and interpolated frame by frame
+// (position and confidence); an unpaired box is held for its half of the
+// gap, as if it had entered or left midway. The output has one entry per
+// decoded frame, so per-frame counts, threat score and summary come out on
+// the same scale as running the detector on every frame.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "yolo_detector.h"
+
+namespace yolo {
+
+struct SamplerConfig {
+    int sparse_stride = 15;         // frames between samples when nothing is going on (1 s at 15 fps)
+    int dense_stride = 3;           // ... around motion, hints and live tracks
+    int64_t hint_window_ms = 1500;  // dense within this distance of a hint
+    float match_iou = 0.3f;         // pairing threshold between neighbouring samples
+};
+
+class FrameSampler {
+public:
+    // hints_ms: frame times of the edge runner's detections (any order).
+    FrameSampler(const SamplerConfig &cfg, std::vector<int64_t> hints_ms);
+
+    // Called for every decoded frame in order; true: run the detector on it.
+    // live_tracks: the last sampled frame's result had tracked boxes (it may
+    // still be pending; false until known).
+    bool want(int frame_idx, int64_t t_ms, bool motion, bool live_tracks);
+
+    int last_sampled() const { return last_; }
+
+private:
+    bool near_hint(int64_t t_ms);
+
+    SamplerConfig cfg_;
+    std::vector<int64_t> hints_;  // sorted
+    size_t hint_pos_ = 0;
+    int last_ = -1;
+};
+
+struct TrackedBox {
+    Box box;
+    bool propagated = false;  // filled in between samples, not detected on this frame
+};
+
+// samples: (frame index, that frame's boxes) in increasing frame order, the
+// first at frame 0 and the last at n_frames - 1. Returns n_frames entries.
+std::vector<std::vector<TrackedBox>> propagate_tracks(const std::vector<std::pair<int, std::vector<Box>>> &samples,
+                                                      int n_frames, float match_iou);
+
+}  // namespace yolo
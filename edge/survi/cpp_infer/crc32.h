@@ -0,0 +1,38 @@
+// ~/ArduinoApps/survillance/cpp_infer/crc32.h
+// CRC-32 (IEEE, reflected 0xEDB88320) of the event store WAL and the
+// detection store blocks. The table is built at compile time, so any number
+// of threads may checksum at once.
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace crc {
+
+namespace detail {
+
+constexpr std::array<uint32_t, 256> make_table() {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+        t[i] = c;
+    }
+    return t;
+}
+
+inline constexpr std::array<uint32_t, 256> kTable = make_table();
+
+}  // namespace detail
+
+// Continues `crc` (0 to start) over p[0, n).
+inline uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t n) {
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) crc = detail::kTable[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline uint32_t crc32(const uint8_t *p, size_t n) { return crc32_update(0, p, n); }
+
+}  // namespace crc
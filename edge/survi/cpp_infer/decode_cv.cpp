@@ -0,0 +1,77 @@
+// ~/ArduinoApps/survillance/cpp_infer/decode_cv.cpp
+// OpenCV fallback FrameSource: cv::VideoCapture, full-size BGR frames.
+
+#include "frame_source.h"
+
+#include <opencv2/opencv.hpp>
+
+namespace dec {
+
+namespace {
+
+class CvSource : public FrameSource {
+public:
+    CvSource(const std::string &path, const Mp4Index *index) : cap_(path), index_(index) {}
+
+    bool ok() const { return cap_.isOpened(); }
+
+    const char *name() const override { return "opencv"; }
+
+    int frame_count() const override {
+        // CAP_PROP_FRAME_COUNT is only an estimate (duration * fps)
+        return (int)cap_.get(cv::CAP_PROP_FRAME_COUNT);
+    }
+
+    // With the index, seeks land on the keyframe at or before the target and
+    // the decoder grabs forward to it, or just grabs forward when the target
+    // is later in the GOP it is already in. Without it, OpenCV's own
+    // (timestamp-estimated) frame seek.
+    bool read(int fi) override {
+        if (index_) {
+            const int kf = (int)index_->keyframe_before((size_t)fi);
+            if (pos_ < kf || pos_ > fi) {
+                cap_.set(cv::CAP_PROP_POS_FRAMES, kf);
+                pos_ = kf;
+            }
+            while (pos_ < fi && cap_.grab()) pos_++;
+            const bool got = pos_ == fi && cap_.read(frame_) && !frame_.empty();
+            pos_++;
+            return got;
+        }
+        cap_.set(cv::CAP_PROP_POS_FRAMES, fi);
+        return cap_.read(frame_) && !frame_.empty();
+    }
+
+    int width() const override { return frame_.cols; }
+    int height() const override { return frame_.rows; }
+
+    bool rgb(const Region &r, int W, int H, uint8_t *out) override {
+        const cv::Rect roi = cv::Rect(r.x, r.y, r.w, r.h) & cv::Rect(0, 0, frame_.cols, frame_.rows);
+        if (roi.width <= 0 || roi.height <= 0) return false;
+        cv::Mat resized;
+        cv::resize(frame_(roi), resized, cv::Size(W, H), 0, 0, cv::INTER_AREA);
+        // Written straight into the caller's buffer
+        cv::Mat dst(H, W, CV_8UC3, out);
+        cv::cvtColor(resized, dst, cv::COLOR_BGR2RGB);
+        return true;
+    }
+
+private:
+    cv::VideoCapture cap_;
+    const Mp4Index *index_;
+    cv::Mat frame_;
+    int pos_ = -1;  // index of the frame the next grab() returns
+};
+
+}  // namespace
+
+std::unique_ptr<FrameSource> open_opencv(const std::string &path, const SourceOptions &opt, std::string *err) {
+    std::unique_ptr<CvSource> src(new CvSource(path, opt.index));
+    if (!src->ok()) {
+        if (err) *err = "failed to open mp4";
+        return nullptr;
+    }
+    return std::unique_ptr<FrameSource>(std::move(src));
+}
+
+}  // namespace dec
@@ -0,0 +1,285 @@
+// ~/ArduinoApps/survillance/cpp_infer/decode_libav.cpp
+// libavformat/libavcodec FrameSource (see frame_source.h).
+//
+// Threading: thread_count is set explicitly (one per core unless told
+// otherwise) with both frame and slice threading allowed; the codec picks
+// what it supports (mpeg4 part 2 does frame threads). Frame threading holds
+// back thread_count - 1 frames, which only matters right after a seek, where
+// the frames up to the target have to be decoded anyway.
+//
+// Fidelity::Fast (frames feed a 160x160 classifier only):
+//   - skip_loop_filter = ALL: no deblocking (H.264; mpeg4 part 2 has none)
+//   - AV_CODEC_FLAG2_FAST: non-spec-compliant speedups the codec offers
+//   - lowres: codecs that can reconstruct at 1/2, 1/4, ... size (mpeg4
+//     part 2, i.e. our mp4v recordings, and MJPEG) decode at the smallest
+//     scale whose short side still covers min_side, so IDCT, motion
+//     compensation and the later swscale all touch fewer pixels
+//   - per packet, with the sample table: every frame that is not a sampling
+//     target gets skip_frame = NONREF (dropped if nothing references it) and
+//     skip_idct = NONREF (if the codec decodes it anyway, its residual is
+//     not reconstructed - valid because nobody shows or references it).
+//     Targets and reference frames decode normally.
+
+#include "frame_source.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+#include <libavutil/mem.h>
+#include <libswscale/swscale.h>
+}
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace dec {
+
+namespace {
+
+constexpr int kAvioBuf = 64 * 1024;
+
+// AVIOContext callbacks over a preloaded clip
+int mem_read(void *opaque, uint8_t *buf, int n) {
+    const int r = static_cast<io::ClipBuffer *>(opaque)->read(buf, n);
+    return r <= 0 ? AVERROR_EOF : r;
+}
+
+int64_t mem_seek(void *opaque, int64_t off, int whence) {
+    return static_cast<io::ClipBuffer *>(opaque)->seek(off, whence & ~AVSEEK_FORCE);
+}
+
+std::string av_err(int r) {
+    char buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(r, buf, sizeof buf);
+    return buf;
+}
+
+class LibavSource : public FrameSource {
+public:
+    ~LibavSource() override {
+        sws_freeContext(sws_);
+        av_frame_free(&view_);
+        av_frame_free(&frame_);
+        av_packet_free(&pkt_);
+        avcodec_free_context(&ctx_);
+        avformat_close_input(&fmt_);  // leaves a custom pb alone
+        if (avio_) {
+            av_freep(&avio_->buffer);
+            avio_context_free(&avio_);
+        }
+    }
+
+    bool open(const std::string &path, const SourceOptions &opt, std::string *err) {
+        index_ = opt.index;
+        fmt_ = avformat_alloc_context();
+        if (!fmt_) return fail(err, "out of memory");
+        if (opt.memory) {
+            uint8_t *buf = static_cast<uint8_t *>(av_malloc(kAvioBuf));
+            avio_ = buf ? avio_alloc_context(buf, kAvioBuf, 0, opt.memory, mem_read, nullptr, mem_seek) : nullptr;
+            if (!avio_) {
+                av_free(buf);
+                return fail(err, "out of memory");
+            }
+            opt.memory->seek(0, SEEK_SET);
+            fmt_->pb = avio_;
+            fmt_->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+        int r = avformat_open_input(&fmt_, opt.memory ? nullptr : path.c_str(), nullptr, nullptr);
+        if (r < 0) return fail(err, "failed to open mp4: " + av_err(r));
+
+        stream_ = av_find_best_stream(fmt_, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (stream_ < 0) return fail(err, "no video stream");
+        AVStream *st = fmt_->streams[stream_];
+        // The mp4 sample description already has what the decoder needs;
+        // probing (which decodes frames) only for containers that do not
+        if (st->codecpar->width <= 0 && (r = avformat_find_stream_info(fmt_, nullptr)) < 0) {
+            return fail(err, "stream info: " + av_err(r));
+        }
+        // Only the video packets are of interest to the demuxer
+        for (unsigned i = 0; i < fmt_->nb_streams; i++) {
+            if ((int)i != stream_) fmt_->streams[i]->discard = AVDISCARD_ALL;
+        }
+
+        const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
+        if (!codec) return fail(err, std::string("no decoder for ") + avcodec_get_name(st->codecpar->codec_id));
+        ctx_ = avcodec_alloc_context3(codec);
+        if (!ctx_ || avcodec_parameters_to_context(ctx_, st->codecpar) < 0) return fail(err, "codec context");
+        fast_ = opt.fidelity == Fidelity::Fast;
+        if (fast_) {
+            ctx_->skip_loop_filter = AVDISCARD_ALL;
+            ctx_->flags2 |= AV_CODEC_FLAG2_FAST;
+            const int short_side = std::min(st->codecpar->width, st->codecpar->height);
+            int lowres = 0;
+            while (lowres < codec->max_lowres && (short_side >> (lowres + 1)) >= std::max(1, opt.min_side)) lowres++;
+            ctx_->lowres = lowres;
+        }
+        ctx_->thread_count = opt.threads > 0 ? opt.threads : (int)std::max(1u, std::thread::hardware_concurrency());
+        ctx_->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+        if ((r = avcodec_open2(ctx_, codec, nullptr)) < 0) return fail(err, "open decoder: " + av_err(r));
+
+        pkt_ = av_packet_alloc();
+        frame_ = av_frame_alloc();
+        view_ = av_frame_alloc();
+        if (!pkt_ || !frame_ || !view_) return fail(err, "out of memory");
+        return true;
+    }
+
+    const char *name() const override { return "libav"; }
+
+    int frame_count() const override {
+        const AVStream *st = fmt_->streams[stream_];
+        if (st->nb_frames > 0) return (int)st->nb_frames;
+        if (fmt_->duration > 0 && st->avg_frame_rate.num > 0) {
+            return (int)(fmt_->duration * av_q2d(st->avg_frame_rate) / AV_TIME_BASE);
+        }
+        return 0;
+    }
+
+    bool read(int fi) override {
+        if (fi == cur_) return true;
+        if (index_) {
+            // Same policy as the OpenCV path: seek to the keyframe unless
+            // the target is ahead in the GOP being decoded
+            const int kf = (int)index_->keyframe_before((size_t)fi);
+            if (cur_ + 1 < kf || cur_ >= fi) {
+                const AVStream *st = fmt_->streams[stream_];
+                const int64_t ts = av_rescale_q(index_->pts((size_t)kf), AVRational{1, (int)index_->timescale()},
+                                                st->time_base);
+                if (!seek(ts)) return false;
+            }
+        } else if (cur_ >= fi) {
+            if (!seek(fmt_->streams[stream_]->start_time == AV_NOPTS_VALUE ? 0 : fmt_->streams[stream_]->start_time)) {
+                return false;
+            }
+            counted_ = 0;
+        }
+        while (decode_next()) {
+            if (cur_ >= fi) return true;
+        }
+        return false;
+    }
+
+    // Packets run ahead of read() by up to thread_count frames, so the
+    // keep / discard decision needs every target, not just the current one.
+    void plan(const std::vector<int> &targets) override {
+        targets_ = targets;
+        std::sort(targets_.begin(), targets_.end());
+    }
+
+    int width() const override { return frame_->width; }
+    int height() const override { return frame_->height; }
+
+    bool rgb(const Region &r, int W, int H, uint8_t *out) override {
+        const int x = std::max(0, std::min(r.x, frame_->width - 1));
+        const int y = std::max(0, std::min(r.y, frame_->height - 1));
+        const int w = std::max(1, std::min(r.w, frame_->width - x));
+        const int h = std::max(1, std::min(r.h, frame_->height - y));
+
+        // Cropping a reference only moves plane pointers: no copy, and the
+        // native (e.g. yuv420p) planes go to swscale as they are
+        av_frame_unref(view_);
+        if (av_frame_ref(view_, frame_) < 0) return false;
+        view_->crop_left = x;
+        view_->crop_top = y;
+        view_->crop_right = frame_->width - x - w;
+        view_->crop_bottom = frame_->height - y - h;
+        if (av_frame_apply_cropping(view_, AV_FRAME_CROP_UNALIGNED) < 0) return false;
+
+        sws_ = sws_getCachedContext(sws_, view_->width, view_->height, (AVPixelFormat)view_->format, W, H,
+                                    AV_PIX_FMT_RGB24, SWS_AREA, nullptr, nullptr, nullptr);
+        if (!sws_) return false;
+        uint8_t *dst[4] = {out, nullptr, nullptr, nullptr};
+        int dst_stride[4] = {W * 3, 0, 0, 0};
+        sws_scale(sws_, view_->data, view_->linesize, 0, view_->height, dst, dst_stride);
+        return true;
+    }
+
+private:
+    bool fail(std::string *err, const std::string &msg) {
+        if (err) *err = msg;
+        return false;
+    }
+
+    bool seek(int64_t ts) {
+        if (av_seek_frame(fmt_, stream_, ts, AVSEEK_FLAG_BACKWARD) < 0) return false;
+        avcodec_flush_buffers(ctx_);
+        eof_ = false;
+        cur_ = -1;
+        return true;
+    }
+
+    // Next decoded frame into frame_; cur_ = its sample number.
+    bool decode_next() {
+        for (;;) {
+            int r = avcodec_receive_frame(ctx_, frame_);
+            if (r == 0) {
+                cur_ = frame_number();
+                return true;
+            }
+            if (r != AVERROR(EAGAIN) || eof_) return false;
+
+            r = av_read_frame(fmt_, pkt_);
+            if (r < 0) {
+                eof_ = true;
+                avcodec_send_packet(ctx_, nullptr);  // drain frames held by the threads
+                continue;
+            }
+            // A corrupt packet just costs its frame
+            if (pkt_->stream_index == stream_) {
+                if (fast_ && index_) {
+                    // Frame threads copy these when the packet is submitted
+                    const AVDiscard d = std::binary_search(targets_.begin(), targets_.end(), packet_number())
+                                            ? AVDISCARD_DEFAULT
+                                            : AVDISCARD_NONREF;
+                    ctx_->skip_frame = d;
+                    ctx_->skip_idct = d;
+                }
+                avcodec_send_packet(ctx_, pkt_);
+            }
+            av_packet_unref(pkt_);
+        }
+    }
+
+    // Sample number of pkt_ (sample table only), -1 when it has no pts.
+    int packet_number() const {
+        if (pkt_->pts == AV_NOPTS_VALUE) return -1;
+        const AVStream *st = fmt_->streams[stream_];
+        return (int)index_->sample_at(av_rescale_q(pkt_->pts, st->time_base, AVRational{1, (int)index_->timescale()}));
+    }
+
+    int frame_number() {
+        if (!index_) return counted_++;
+        const int64_t ts = frame_->best_effort_timestamp;
+        if (ts == AV_NOPTS_VALUE) return cur_ + 1;
+        const AVStream *st = fmt_->streams[stream_];
+        return (int)index_->sample_at(av_rescale_q(ts, st->time_base, AVRational{1, (int)index_->timescale()}));
+    }
+
+    AVFormatContext *fmt_ = nullptr;
+    AVIOContext *avio_ = nullptr;
+    AVCodecContext *ctx_ = nullptr;
+    AVPacket *pkt_ = nullptr;
+    AVFrame *frame_ = nullptr;  // current frame, native pixel format
+    AVFrame *view_ = nullptr;   // cropped reference to it for rgb()
+    SwsContext *sws_ = nullptr;
+    int stream_ = -1;
+    const Mp4Index *index_ = nullptr;
+    int cur_ = -1;      // sample number of frame_ (-1: none yet / after a seek)
+    int counted_ = 0;   // frames decoded since the start (no index)
+    std::vector<int> targets_;  // sorted sampling targets (Fast discard)
+    bool eof_ = false;
+    bool fast_ = false;
+};
+
+}  // namespace
+
+std::unique_ptr<FrameSource> open_libav(const std::string &path, const SourceOptions &opt, std::string *err) {
+    std::unique_ptr<LibavSource> src(new LibavSource());
+    if (!src->open(path, opt, err)) return nullptr;
+    return std::unique_ptr<FrameSource>(std::move(src));
+}
+
+}  // namespace dec
@@ -0,0 +1,510 @@
+// ~/ArduinoApps/survillance/cpp_infer/det_store.cpp
+// See det_store.h for the layout. The C ABI at the bottom is for ctypes
+// callers; the media server links the library directly.
+
+#include "det_store.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+#include "crc32.h"
+
+namespace ds {
+
+// -------------------------
+// On-disk formats
+// -------------------------
+static constexpr uint32_t kBlockMagic = 0x42445153;  // "SQDB"
+
+#pragma pack(push, 1)
+struct BlockHdr {
+    uint32_t magic;
+    uint32_t rows;
+    uint64_t payload_off;  // in detections.col
+    uint32_t payload_len;
+    uint32_t crc;          // crc32 of the payload
+    int64_t t_min_ms;
+    int64_t t_max_ms;
+    uint64_t label_mask;   // bit min(id, 63)
+    uint64_t camera_mask;
+    uint8_t conf_min, conf_max;
+    uint8_t cx_min, cx_max;
+    uint8_t cy_min, cy_max;
+    uint8_t pad[2];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(BlockHdr) == 64, "BlockHdr layout");
+
+// Payload: u32 len_t, u32 len_cam, u32 len_track, then the columns
+//   t      zigzag varint, delta from the previous row (first: from t_min)
+//   cam    varint dictionary ids
+//   label  u8 dictionary ids
+//   conf   u8
+//   cx, cy u8
+//   track  varint
+
+// -------------------------
+// Small helpers
+// -------------------------
+static void put_varint(std::string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out += (char)(uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out += (char)(uint8_t)v;
+}
+
+static bool get_varint(const uint8_t *&p, const uint8_t *end, uint64_t *v) {
+    uint64_t r = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        const uint8_t b = *p++;
+        r |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = r;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+static int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+static uint8_t quant(float v) {
+    return (uint8_t)std::lround(std::min(1.0f, std::max(0.0f, v)) * 255.0f);
+}
+
+static uint64_t mask_bit(uint32_t id) { return 1ull << std::min<uint32_t>(id, 63); }
+
+static bool write_all(int fd, const void *p, size_t n) {
+    const uint8_t *b = (const uint8_t *)p;
+    while (n > 0) {
+        const ssize_t w = ::write(fd, b, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        b += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+static bool pread_all(int fd, void *p, size_t n, uint64_t off) {
+    uint8_t *b = (uint8_t *)p;
+    while (n > 0) {
+        const ssize_t r = ::pread(fd, b, n, (off_t)off);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        b += r;
+        n -= (size_t)r;
+        off += (uint64_t)r;
+    }
+    return true;
+}
+
+static std::string json_escape(const std::string &s) {
+    std::string o;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            o += '\\';
+            o += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)(unsigned char)c);
+            o += buf;
+        } else {
+            o += c;
+        }
+    }
+    return o;
+}
+
+namespace {
+struct FileLock {
+    int fd;
+    explicit FileLock(int f) : fd(f) { while (::flock(fd, LOCK_EX) != 0 && errno == EINTR) {} }
+    ~FileLock() { ::flock(fd, LOCK_UN); }
+};
+}  // namespace
+
+// -------------------------
+// DetStore
+// -------------------------
+DetStore::~DetStore() { close(); }
+
+bool DetStore::open(const std::string &dir, std::string *err) {
+    std::lock_guard<std::mutex> lk(mu_);
+    dir_ = dir;
+    if (::mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST) {
+        if (err) *err = "mkdir " + dir_ + ": " + std::strerror(errno);
+        return false;
+    }
+    col_fd_ = ::open((dir_ + "/detections.col").c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    idx_fd_ = ::open((dir_ + "/detections.idx").c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    lock_fd_ = ::open((dir_ + "/lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (col_fd_ < 0 || idx_fd_ < 0 || lock_fd_ < 0) {
+        if (err) *err = "open " + dir_ + ": " + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void DetStore::close() {
+    flush();
+    std::lock_guard<std::mutex> lk(mu_);
+    for (int *fd : {&col_fd_, &idx_fd_, &lock_fd_}) {
+        if (*fd >= 0) ::close(*fd);
+        *fd = -1;
+    }
+}
+
+bool DetStore::load_dict_locked() {
+    const std::string path = dir_ + "/dict.tsv";
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return true;  // nothing yet
+    if (st.st_size == dict_size_) return true;
+
+    FILE *f = std::fopen(path.c_str(), "r");
+    if (!f) return false;
+    labels_.clear();
+    cameras_.clear();
+    label_names_.clear();
+    camera_names_.clear();
+    char kind;
+    unsigned id;
+    char name[512];
+    while (std::fscanf(f, " %c %u %511[^\n]", &kind, &id, name) == 3) {
+        auto &ids = kind == 'L' ? labels_ : cameras_;
+        auto &names = kind == 'L' ? label_names_ : camera_names_;
+        ids[name] = id;
+        if (names.size() <= id) names.resize(id + 1);
+        names[id] = name;
+    }
+    std::fclose(f);
+    dict_size_ = st.st_size;
+    return true;
+}
+
+uint32_t DetStore::dict_id_locked(char kind, const std::string &name, bool *added) {
+    auto &ids = kind == 'L' ? labels_ : cameras_;
+    auto &names = kind == 'L' ? label_names_ : camera_names_;
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+    const uint32_t id = (uint32_t)names.size();
+    ids[name] = id;
+    names.push_back(name);
+    *added = true;
+    return id;
+}
+
+// Under the flock: cuts a torn header (the index is not a whole number of
+// BlockHdrs) and a last header whose payload is not all in the column file.
+bool DetStore::repair_index_locked() {
+    struct stat ist, cst;
+    if (::fstat(idx_fd_, &ist) != 0 || ::fstat(col_fd_, &cst) != 0) return false;
+    off_t keep = ist.st_size - ist.st_size % (off_t)sizeof(BlockHdr);
+    if (keep >= (off_t)sizeof(BlockHdr)) {
+        BlockHdr h;
+        if (!pread_all(idx_fd_, &h, sizeof(h), (uint64_t)keep - sizeof(h))) return false;
+        if (h.magic != kBlockMagic || h.payload_off + h.payload_len > (uint64_t)cst.st_size) keep -= sizeof(BlockHdr);
+    }
+    if (keep == ist.st_size) return true;
+    std::cerr << "[DETSTORE] " << dir_ << "/detections.idx: dropping " << (ist.st_size - keep)
+              << " bytes of unfinished block header\n";
+    return ::ftruncate(idx_fd_, keep) == 0;
+}
+
+void DetStore::append(const Row &r) {
+    std::lock_guard<std::mutex> lk(mu_);
+    pending_.push_back(r);
+}
+
+bool DetStore::flush() {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (pending_.empty() || col_fd_ < 0) return true;
+    FileLock fl(lock_fd_);
+    if (!repair_index_locked()) return false;
+    load_dict_locked();
+
+    // Dictionary first, so readers can always resolve a block's ids.
+    std::string dict_add;
+    BlockHdr h;
+    std::memset(&h, 0, sizeof(h));
+    h.magic = kBlockMagic;
+    h.rows = (uint32_t)pending_.size();
+    h.t_min_ms = INT64_MAX;
+    h.t_max_ms = INT64_MIN;
+    h.conf_min = h.cx_min = h.cy_min = 255;
+
+    std::vector<uint32_t> cam_ids, label_ids;
+    for (const Row &r : pending_) {
+        bool added = false;
+        const uint32_t c = dict_id_locked('C', r.camera, &added);
+        if (added) dict_add += "C " + std::to_string(c) + " " + r.camera + "\n";
+        added = false;
+        uint32_t l = dict_id_locked('L', r.label, &added);
+        if (added) dict_add += "L " + std::to_string(l) + " " + r.label + "\n";
+        if (l > 255) l = 255;  // u8 column; more than 255 labels is not our model
+        cam_ids.push_back(c);
+        label_ids.push_back(l);
+        h.t_min_ms = std::min(h.t_min_ms, r.t_ms);
+        h.t_max_ms = std::max(h.t_max_ms, r.t_ms);
+    }
+    if (!dict_add.empty()) {
+        const int fd = ::open((dir_ + "/dict.tsv").c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        const bool ok = fd >= 0 && write_all(fd, dict_add.data(), dict_add.size());
+        if (fd >= 0) ::close(fd);
+        if (!ok) {
+            dict_size_ = -1;  // drop the unwritten ids on the next load
+            return false;
+        }
+        struct stat st;
+        if (::stat((dir_ + "/dict.tsv").c_str(), &st) == 0) dict_size_ = st.st_size;
+    }
+
+    std::string t_col, cam_col, track_col, label_col, conf_col, cx_col, cy_col;
+    int64_t prev = h.t_min_ms;
+    for (size_t i = 0; i < pending_.size(); i++) {
+        const Row &r = pending_[i];
+        put_varint(t_col, zigzag(r.t_ms - prev));
+        prev = r.t_ms;
+        put_varint(cam_col, cam_ids[i]);
+        put_varint(track_col, r.track_id);
+        const uint8_t q = quant(r.conf), x = quant(r.cx), y = quant(r.cy);
+        label_col += (char)(uint8_t)label_ids[i];
+        conf_col += (char)q;
+        cx_col += (char)x;
+        cy_col += (char)y;
+        h.label_mask |= mask_bit(label_ids[i]);
+        h.camera_mask |= mask_bit(cam_ids[i]);
+        h.conf_min = std::min(h.conf_min, q);
+        h.conf_max = std::max(h.conf_max, q);
+        h.cx_min = std::min(h.cx_min, x);
+        h.cx_max = std::max(h.cx_max, x);
+        h.cy_min = std::min(h.cy_min, y);
+        h.cy_max = std::max(h.cy_max, y);
+    }
+
+    std::string payload;
+    for (uint32_t len : {(uint32_t)t_col.size(), (uint32_t)cam_col.size(), (uint32_t)track_col.size()}) {
+        payload.append((const char *)&len, 4);
+    }
+    payload += t_col + cam_col + label_col + conf_col + cx_col + cy_col + track_col;
+
+    struct stat st;
+    if (::fstat(col_fd_, &st) != 0) return false;
+    h.payload_off = (uint64_t)st.st_size;
+    h.payload_len = (uint32_t)payload.size();
+    h.crc = crc::crc32((const uint8_t *)payload.data(), payload.size());
+    if (!write_all(col_fd_, payload.data(), payload.size())) return false;
+    if (!write_all(idx_fd_, &h, sizeof(h))) return false;
+    pending_.clear();
+    return true;
+}
+
+bool DetStore::query(const Query &q, QueryResult *out) {
+    std::lock_guard<std::mutex> lk(mu_);
+    *out = QueryResult();
+    if (idx_fd_ < 0) return false;
+    // Size the index before loading the dictionary: every block counted
+    // here had its dictionary entries written first.
+    struct stat st;
+    if (::fstat(idx_fd_, &st) != 0) return false;
+    load_dict_locked();
+
+    // Dictionary filters: an unknown camera / label matches nothing.
+    uint64_t want_cam = ~0ull, want_label = ~0ull;
+    int64_t cam_id = -1, label_id = -1;
+    if (!q.camera.empty()) {
+        auto it = cameras_.find(q.camera);
+        if (it == cameras_.end()) return true;
+        cam_id = it->second;
+        want_cam = mask_bit(it->second);
+    }
+    if (!q.label.empty()) {
+        auto it = labels_.find(q.label);
+        if (it == labels_.end()) return true;
+        label_id = std::min<uint32_t>(it->second, 255);
+        want_label = mask_bit(it->second);
+    }
+    const uint8_t min_q = quant(q.min_conf);
+    const uint8_t zx0 = quant(q.zx0), zx1 = quant(q.zx1), zy0 = quant(q.zy0), zy1 = quant(q.zy1);
+
+    const size_t nblocks = (size_t)st.st_size / sizeof(BlockHdr);
+    out->blocks_total = nblocks;
+    if (nblocks == 0) return true;
+    void *map = ::mmap(nullptr, nblocks * sizeof(BlockHdr), PROT_READ, MAP_SHARED, idx_fd_, 0);
+    if (map == MAP_FAILED) return false;
+    const BlockHdr *hdrs = (const BlockHdr *)map;
+
+    std::set<uint32_t> tracks;
+    std::vector<uint8_t> payload;
+    for (size_t b = 0; b < nblocks; b++) {
+        const BlockHdr &h = hdrs[b];
+        if (h.magic != kBlockMagic) {
+            out->blocks_corrupt++;
+            continue;
+        }
+        if (h.t_max_ms < q.from_ms || h.t_min_ms >= q.to_ms) continue;
+        if (!(h.camera_mask & want_cam) || !(h.label_mask & want_label)) continue;
+        if (h.conf_max < min_q) continue;
+        if (q.has_zone && (h.cx_max < zx0 || h.cx_min > zx1 || h.cy_max < zy0 || h.cy_min > zy1)) continue;
+
+        payload.resize(h.payload_len);
+        if (!pread_all(col_fd_, payload.data(), payload.size(), h.payload_off) ||
+            crc::crc32(payload.data(), payload.size()) != h.crc || payload.size() < 12) {
+            out->blocks_corrupt++;
+            continue;
+        }
+        out->blocks_read++;
+
+        uint32_t len_t, len_cam, len_track;
+        std::memcpy(&len_t, payload.data(), 4);
+        std::memcpy(&len_cam, payload.data() + 4, 4);
+        std::memcpy(&len_track, payload.data() + 8, 4);
+        const size_t n = h.rows;
+        if (12 + (size_t)len_t + len_cam + 4 * n + len_track != payload.size()) {
+            out->blocks_corrupt++;
+            continue;
+        }
+
+        const uint8_t *tp = payload.data() + 12, *t_end = tp + len_t;
+        const uint8_t *cp = t_end, *c_end = cp + len_cam;
+        const uint8_t *labels = c_end, *confs = labels + n, *cxs = confs + n, *cys = cxs + n;
+        const uint8_t *kp = cys + n, *k_end = kp + len_track;
+
+        int64_t t = h.t_min_ms;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t dt, cam, trk;
+            if (!get_varint(tp, t_end, &dt) || !get_varint(cp, c_end, &cam) || !get_varint(kp, k_end, &trk)) break;
+            t += unzigzag(dt);
+            if (t < q.from_ms || t >= q.to_ms) continue;
+            if (cam_id >= 0 && (int64_t)cam != cam_id) continue;
+            if (label_id >= 0 && labels[i] != label_id) continue;
+            if (confs[i] < min_q) continue;
+            if (q.has_zone && (cxs[i] < zx0 || cxs[i] > zx1 || cys[i] < zy0 || cys[i] > zy1)) continue;
+
+            out->count++;
+            out->by_label[labels[i] < label_names_.size() ? label_names_[labels[i]] : "?"]++;
+            out->by_camera[cam < camera_names_.size() ? camera_names_[cam] : "?"]++;
+            if (q.bucket_ms > 0) {
+                const int64_t k = t >= 0 ? t / q.bucket_ms : (t - q.bucket_ms + 1) / q.bucket_ms;
+                out->histogram[k * q.bucket_ms]++;
+            }
+            if (trk) tracks.insert((uint32_t)trk);
+        }
+    }
+    ::munmap(map, nblocks * sizeof(BlockHdr));
+    out->tracks = tracks.size();
+    if (out->blocks_corrupt) {
+        std::cerr << "[DETSTORE] " << dir_ << ": " << out->blocks_corrupt << " of " << nblocks
+                  << " block(s) corrupt, left out of the query\n";
+    }
+    return true;
+}
+
+std::string query_json(const Query &q, const QueryResult &r) {
+    std::ostringstream o;
+    o << "{\"from_ms\":" << q.from_ms << ",\"to_ms\":" << q.to_ms << ",\"count\":" << r.count
+      << ",\"tracks\":" << r.tracks << ",\"by_label\":{";
+    bool first = true;
+    for (const auto &kv : r.by_label) {
+        o << (first ? "" : ",") << "\"" << json_escape(kv.first) << "\":" << kv.second;
+        first = false;
+    }
+    o << "},\"by_camera\":{";
+    first = true;
+    for (const auto &kv : r.by_camera) {
+        o << (first ? "" : ",") << "\"" << json_escape(kv.first) << "\":" << kv.second;
+        first = false;
+    }
+    o << "}";
+    if (q.bucket_ms > 0) {
+        o << ",\"bucket_ms\":" << q.bucket_ms << ",\"histogram\":[";
+        first = true;
+        for (const auto &kv : r.histogram) {
+            o << (first ? "" : ",") << "[" << kv.first << "," << kv.second << "]";
+            first = false;
+        }
+        o << "]";
+    }
+    o << ",\"blocks_total\":" << r.blocks_total << ",\"blocks_read\":" << r.blocks_read
+      << ",\"blocks_corrupt\":" << r.blocks_corrupt << "}";
+    return o.str();
+}
+
+}  // namespace ds
+
+// -------------------------
+// C ABI
+// -------------------------
+extern "C" {
+
+void *ds_open(const char *dir) {
+    auto *s = new ds::DetStore();
+    std::string err;
+    if (!s->open(dir ? dir : "", &err)) {
+        std::cerr << "[DETSTORE] " << err << "\n";
+        delete s;
+        return nullptr;
+    }
+    return s;
+}
+
+void ds_close(void *h) { delete (ds::DetStore *)h; }
+
+void ds_free(char *p) { std::free(p); }
+
+int ds_append(void *h, int64_t t_ms, const char *camera, const char *label, float conf, float cx, float cy,
+              uint32_t track_id) {
+    if (!h || !camera || !label) return -1;
+    ds::Row r;
+    r.t_ms = t_ms;
+    r.camera = camera;
+    r.label = label;
+    r.conf = conf;
+    r.cx = cx;
+    r.cy = cy;
+    r.track_id = track_id;
+    ((ds::DetStore *)h)->append(r);
+    return 0;
+}
+
+int ds_flush(void *h) { return (h && ((ds::DetStore *)h)->flush()) ? 0 : -1; }
+
+// zone: "x0,y0,x1,y1" normalised, or null / "" for the whole frame.
+char *ds_query(void *h, int64_t from_ms, int64_t to_ms, const char *camera, const char *label, float min_conf,
+               const char *zone, int64_t bucket_ms) {
+    if (!h) return nullptr;
+    ds::Query q;
+    q.from_ms = from_ms;
+    q.to_ms = to_ms;
+    q.camera = camera ? camera : "";
+    q.label = label ? label : "";
+    q.min_conf = min_conf;
+    q.bucket_ms = bucket_ms;
+    if (zone && *zone) {
+        q.has_zone = std::sscanf(zone, "%f,%f,%f,%f", &q.zx0, &q.zy0, &q.zx1, &q.zy1) == 4;
+    }
+    ds::QueryResult r;
+    if (!((ds::DetStore *)h)->query(q, &r)) return nullptr;
+    const std::string s = ds::query_json(q, r);
+    char *out = (char *)std::malloc(s.size() + 1);
+    if (out) std::memcpy(out, s.c_str(), s.size() + 1);
+    return out;
+}
+
+}  // extern "C"
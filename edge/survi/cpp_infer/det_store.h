@@ -0,0 +1,100 @@
+// ~/ArduinoApps/survillance/cpp_infer/det_store.h
+// Columnar time-series log of every detection the engine produces, with
+// aggregate queries ("people per hour at camera X this week") that never
+// touch per-event result.json files.
+//
+// Layout of <dir>:
+//   detections.col   column blocks, back to back
+//   detections.idx   one 64-byte BlockHdr per block (time range, label and
+//                    camera bitmasks, confidence / position min-max)
+//   dict.tsv         label and camera dictionaries ("L <id> <name>")
+//   lock             flock() for appends (several runner processes)
+//
+// A crash can leave a torn header at the end of the index; the next flush
+// cuts it off (and a whole last header whose payload never made it) before
+// appending, so later blocks stay aligned.
+//
+// A block holds the rows of one flush (typically one analysed event) as
+// separate columns: zigzag-varint time deltas, varint camera ids, u8 label
+// ids, u8 confidences (conf * 255), u8 box centres (normalised * 255) and
+// varint track ids. Queries read the small index, skip every block whose
+// header cannot match, and decode only the rest.
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ds {
+
+struct Row {
+    int64_t t_ms = 0;      // wall-clock time of the frame
+    std::string camera;
+    std::string label;
+    float conf = 0.0f;
+    float cx = 0.0f;       // box centre, normalised to [0, 1] of the model input
+    float cy = 0.0f;
+    uint32_t track_id = 0; // 0: not tracked
+};
+
+struct Query {
+    int64_t from_ms = 0;
+    int64_t to_ms = INT64_MAX;    // exclusive
+    std::string camera;           // empty: any
+    std::string label;            // empty: any
+    float min_conf = 0.0f;
+    bool has_zone = false;        // box centre inside [x0,x1] x [y0,y1]
+    float zx0 = 0, zy0 = 0, zx1 = 1, zy1 = 1;
+    int64_t bucket_ms = 0;        // > 0: histogram with this bucket width
+};
+
+struct QueryResult {
+    uint64_t count = 0;
+    std::map<std::string, uint64_t> by_label;
+    std::map<std::string, uint64_t> by_camera;
+    std::map<int64_t, uint64_t> histogram;  // bucket start (ms) -> count
+    uint64_t tracks = 0;                     // distinct non-zero track ids
+    uint64_t blocks_total = 0;
+    uint64_t blocks_read = 0;
+    uint64_t blocks_corrupt = 0;             // bad header or payload, not counted
+};
+
+class DetStore {
+public:
+    DetStore() = default;
+    ~DetStore();
+    DetStore(const DetStore &) = delete;
+    DetStore &operator=(const DetStore &) = delete;
+
+    bool open(const std::string &dir, std::string *err);
+    void close();
+
+    // Buffers rows; flush() writes them as one block.
+    void append(const Row &r);
+    bool flush();
+
+    bool query(const Query &q, QueryResult *out);
+
+private:
+    bool load_dict_locked();
+    bool repair_index_locked();
+    uint32_t dict_id_locked(char kind, const std::string &name, bool *added);
+
+    std::string dir_;
+    int col_fd_ = -1;
+    int idx_fd_ = -1;
+    int lock_fd_ = -1;
+
+    std::vector<Row> pending_;
+    std::map<std::string, uint32_t> labels_, cameras_;
+    std::vector<std::string> label_names_, camera_names_;
+    off_t dict_size_ = 0;
+
+    std::mutex mu_;
+};
+
+std::string query_json(const Query &q, const QueryResult &r);
+
+}  // namespace ds
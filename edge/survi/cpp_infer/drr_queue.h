@@ -0,0 +1,133 @@
+// ~/ArduinoApps/survillance/cpp_infer/drr_queue.h
+// Per-camera job queues served by deficit round robin.
+//
+// Every camera (flow) has its own FIFO and a deficit counter. Cameras with
+// work sit in a ring; the camera at the front gets `quantum` credit once per
+// turn and is served while its head job's cost fits in the credit, then the
+// turn passes on. A camera that floods the hub only lengthens its own queue
+// (bounded by max_queue); every other camera still gets its quantum each
+// round, so per-camera throughput is shared in proportion to the quantum,
+// not to how much each one submits. Unused credit is dropped when a queue
+// empties, so idle cameras cannot bank a burst.
+//
+// Job cost is whatever the caller passes (survi_inferd uses classifier runs,
+// frames x tiles^2, which is what analysis time scales with).
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+
+template <typename Job>
+class DrrQueue {
+public:
+    struct FlowStats {
+        size_t queued = 0;
+        uint64_t served = 0;
+        uint64_t rejected = 0;
+        int64_t deficit = 0;
+    };
+
+    DrrQueue(int64_t quantum, size_t max_queue) : quantum_(quantum), max_queue_(max_queue) {}
+
+    // False (job not taken) when the camera's queue is full or the queue
+    // has been closed.
+    bool push(const std::string &flow, int64_t cost, Job job) {
+        std::lock_guard<std::mutex> lk(mu_);
+        Flow &f = flows_[flow];
+        if (closed_ || f.jobs.size() >= max_queue_) {
+            f.rejected++;
+            return false;
+        }
+        f.jobs.push_back(Item{cost < 1 ? 1 : cost, std::move(job)});
+        queued_cost_ += f.jobs.back().cost;
+        if (f.jobs.size() == 1) ring_.push_back(flow);
+        cv_.notify_one();
+        return true;
+    }
+
+    // Blocks for the next job in DRR order. False once closed and empty.
+    bool pop(Job *out, std::string *flow_out = nullptr) {
+        std::unique_lock<std::mutex> lk(mu_);
+        for (;;) {
+            cv_.wait(lk, [&] { return closed_ || !ring_.empty(); });
+            if (ring_.empty()) return false;
+
+            const std::string name = ring_.front();
+            Flow &f = flows_[name];
+            if (!f.credited) {
+                f.deficit += quantum_;
+                f.credited = true;
+            }
+            if (f.jobs.front().cost <= f.deficit) {
+                f.deficit -= f.jobs.front().cost;
+                queued_cost_ -= f.jobs.front().cost;
+                *out = std::move(f.jobs.front().job);
+                f.jobs.pop_front();
+                f.served++;
+                if (f.jobs.empty()) {
+                    f.deficit = 0;
+                    f.credited = false;
+                    ring_.pop_front();
+                }
+                if (flow_out) *flow_out = name;
+                return true;
+            }
+            // Head does not fit: this camera's turn is over.
+            f.credited = false;
+            ring_.pop_front();
+            ring_.push_back(name);
+        }
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lk(mu_);
+        closed_ = true;
+        cv_.notify_all();
+    }
+
+    // Total cost waiting, over every camera.
+    int64_t queued_cost() {
+        std::lock_guard<std::mutex> lk(mu_);
+        return queued_cost_;
+    }
+
+    std::map<std::string, FlowStats> stats() {
+        std::lock_guard<std::mutex> lk(mu_);
+        std::map<std::string, FlowStats> out;
+        for (const auto &kv : flows_) {
+            FlowStats s;
+            s.queued = kv.second.jobs.size();
+            s.served = kv.second.served;
+            s.rejected = kv.second.rejected;
+            s.deficit = kv.second.deficit;
+            out[kv.first] = s;
+        }
+        return out;
+    }
+
+private:
+    struct Item {
+        int64_t cost;
+        Job job;
+    };
+    struct Flow {
+        std::deque<Item> jobs;
+        int64_t deficit = 0;
+        bool credited = false;  // got its quantum for the current turn
+        uint64_t served = 0;
+        uint64_t rejected = 0;
+    };
+
+    const int64_t quantum_;
+    const size_t max_queue_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::map<std::string, Flow> flows_;
+    std::deque<std::string> ring_;  // flows with queued jobs, in service order
+    int64_t queued_cost_ = 0;
+    bool closed_ = false;
+};
@@ -0,0 +1,616 @@
+// ~/ArduinoApps/survillance/cpp_infer/engine.cpp
+// FIT_SHORTEST + center crop + RGB (matches model_metadata.h)
+
+#include "engine.h"
+#include "det_store.h"
+#include "model_file.h"
+#include "mp4_index.h"
+#include "readahead.h"
+#include "repeat_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// Edge Impulse
+#include "../ei/edge-impulse-sdk/classifier/ei_run_classifier.h"
+#include "../ei/model-parameters/model_metadata.h"
+#include "../ei/model-parameters/model_variables.h"
+
+namespace engine {
+
+// -------------------------
+// Small helpers
+// -------------------------
+std::string json_escape(const std::string &s) {
+    std::ostringstream o;
+    for (char c : s) {
+        switch (c) {
+            case '\\': o << "\\\\"; break;
+            case '"':  o << "\\\""; break;
+            case '\b': o << "\\b";  break;
+            case '\f': o << "\\f";  break;
+            case '\n': o << "\\n";  break;
+            case '\r': o << "\\r";  break;
+            case '\t': o << "\\t";  break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    o << "\\u" << std::hex << std::uppercase << (int)c;
+                } else {
+                    o << c;
+                }
+        }
+    }
+    return o.str();
+}
+
+// -------------------------
+// Model files
+// -------------------------
+// A model file runs through a copy of the compiled impulse whose TFLite graph
+// points at the mapping instead of tflite-model/'s array; DSP settings,
+// labels, thresholds and the tensor arena stay the compiled ones. Only TFLite
+// Micro builds have such a graph: EON compiles the model into code.
+#if defined(EI_CLASSIFIER_INFERENCING_ENGINE) && defined(EI_CLASSIFIER_TFLITE) && \
+    EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_TFLITE
+#define SURVI_MODEL_FILES 1
+#endif
+
+#ifdef SURVI_MODEL_FILES
+struct FileImpulse {
+    std::shared_ptr<const ModelFile> file;
+    ei_config_tflite_graph_t graph;
+    ei_learning_block_config_tflite_graph_t block;
+    ei_learning_block_t learn;
+    ei_impulse_t impulse;
+    std::unique_ptr<ei_impulse_handle_t> handle;
+};
+static std::unique_ptr<FileImpulse> g_model;  // set between clips (use_model)
+#endif
+
+// The tensor arena and the FOMO box list behind ei_impulse_result_t are
+// static: one classification (and the read of its boxes) at a time.
+static std::mutex g_classify_mu;
+
+static EI_IMPULSE_ERROR classify(signal_t *signal, ei_impulse_result_t *result) {
+#ifdef SURVI_MODEL_FILES
+    if (g_model) return run_classifier(g_model->handle.get(), signal, result, false);
+#endif
+    return run_classifier(signal, result, false);
+}
+
+const ModelFile *active_model() {
+#ifdef SURVI_MODEL_FILES
+    return g_model ? g_model->file.get() : nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+bool use_model(std::shared_ptr<const ModelFile> model, std::string *err) {
+#ifndef SURVI_MODEL_FILES
+    if (!model) return true;
+    *err = "model files need the TFLite Micro build of the EI library (this one is EON-compiled)";
+    return false;
+#else
+    if (!model) {
+        g_model.reset();
+        return true;
+    }
+    const ei_impulse_t *compiled = ei_default_impulse.impulse;
+    if (compiled->learning_blocks_size != 1) {
+        *err = "model files need a single-model impulse";
+        return false;
+    }
+    const auto *cblock = (const ei_learning_block_config_tflite_graph_t *)compiled->learning_blocks[0].config;
+    const auto *cgraph = (const ei_config_tflite_graph_t *)cblock->graph_config;
+
+    // The compiled model is the preprocessing / postprocessing contract
+    ModelInfo want;
+    if (!read_tflite_info(cgraph->model, cgraph->model_size, &want, err)) {
+        *err = "compiled model: " + *err;
+        return false;
+    }
+    const ModelInfo &got = model->info();
+    if (got.inputs != want.inputs || got.outputs != want.outputs || got.input != want.input ||
+        got.output != want.output) {
+        *err = model->path() + ": " + got.input.str() + " -> " + got.output.str() + ", compiled model is " +
+               want.input.str() + " -> " + want.output.str();
+        return false;
+    }
+
+    std::unique_ptr<FileImpulse> fi(new FileImpulse());
+    fi->file = model;
+    fi->graph = *cgraph;
+    fi->graph.model = model->data();
+    fi->graph.model_size = model->size();
+    fi->block = *cblock;
+    fi->block.graph_config = &fi->graph;
+    fi->learn = compiled->learning_blocks[0];
+    fi->learn.config = &fi->block;
+    fi->impulse = *compiled;
+    fi->impulse.learning_blocks = &fi->learn;
+    fi->handle.reset(new ei_impulse_handle_t(&fi->impulse));
+
+    // One mid-grey frame: the interpreter has to allocate and run it
+    signal_t signal;
+    signal.total_length = (size_t)EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT * 3;
+    signal.get_data = [](size_t, size_t length, float *out_ptr) -> int {
+        std::fill(out_ptr, out_ptr + length, 128.0f);
+        return 0;
+    };
+    ei_impulse_result_t result = {0};
+    const EI_IMPULSE_ERROR r = run_classifier(fi->handle.get(), &signal, &result, false);
+    if (r != EI_IMPULSE_OK) {
+        *err = model->path() + ": probe inference failed: " + std::to_string((int)r);
+        return false;
+    }
+    g_model = std::move(fi);
+    return true;
+#endif
+}
+
+// Part of the frame the model sees, in source pixels: the centre crop with
+// the model's aspect ratio that EI_CLASSIFIER_RESIZE_FIT_SHORTEST keeps
+// (aspect-preserving resize so both dims >= target, then centre crop),
+// or tile (tx, ty) of a tiles x tiles grid over it. Scaling that region to
+// WxH is the same as FIT_SHORTEST's resize-then-crop, and every tile has the
+// model's aspect ratio too, so it needs no further crop.
+static dec::Region model_view(int src_w, int src_h, int W, int H, int tiles, int tx, int ty) {
+    const float scale = std::max((float)W / (float)src_w, (float)H / (float)src_h);
+    const float crop_w = W / scale, crop_h = H / scale;
+    const float x0 = (src_w - crop_w) / 2.0f, y0 = (src_h - crop_h) / 2.0f;
+
+    dec::Region r;
+    r.x = (int)std::round(x0 + crop_w * tx / tiles);
+    r.y = (int)std::round(y0 + crop_h * ty / tiles);
+    r.w = std::max(1, (int)std::round(x0 + crop_w * (tx + 1) / tiles) - r.x);
+    r.h = std::max(1, (int)std::round(y0 + crop_h * (ty + 1) / tiles) - r.y);
+    return r;
+}
+
+// -------------------------
+// Analysis
+// -------------------------
+// The statically allocated arena (EI_CLASSIFIER_ALLOCATION_STATIC), for the
+// memory pools; EON-compiled models do not export its size.
+static int64_t arena_bytes() {
+#if defined(EI_CLASSIFIER_TFLITE_LARGEST_ARENA_SIZE)
+    return EI_CLASSIFIER_TFLITE_LARGEST_ARENA_SIZE;
+#elif defined(EI_CLASSIFIER_TFLITE_ARENA_SIZE)
+    return EI_CLASSIFIER_TFLITE_ARENA_SIZE;
+#else
+    return 0;
+#endif
+}
+
+Result analyze_clip(const Options &requested, io::IoEngine *io, const FrameCallback &on_frame, RepeatCache *repeat,
+                    ThermalGovernor *thermal, MemoryGovernor *memory) {
+    static PoolCharge arena_charge(Pool::Arena, arena_bytes());
+    Result res;
+    if (const ModelFile *m = active_model()) res.model_file = m->path();
+    // The clip runs on the governors' budgets: possibly fewer frames / tiles
+    Options opt = requested;
+    if (thermal) res.thermal = thermal->budget(&opt);
+    if (memory && memory->enabled()) res.memory = memory->budget(&opt);
+    // The budget's reservation goes back however the clip ends
+    struct MemoryRelease {
+        MemoryGovernor *g;
+        MemoryNote *n;
+        ~MemoryRelease() {
+            if (n->reserved_kb) g->finish(n, 0);
+        }
+    } memory_release{memory, &res.memory};
+    double classify_ms = 0;
+    int classify_runs = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    const int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                               std::chrono::system_clock::now().time_since_epoch()).count();
+
+    // Preloaded clips are decoded from memory (libav) - the load also
+    // leaves them in the page cache for the OpenCV fallback
+    io::ClipBuffer clip;
+    const bool in_memory = io && opt.preload;
+    if (in_memory) {
+        std::string err;
+        if (!clip.load(*io, opt.mp4_path, &err)) {
+            res.error = "failed to open mp4";
+            std::cerr << "[ENGINE] " << err << "\n";
+            return res;
+        }
+    }
+    PoolCharge clip_charge(Pool::Clip, (int64_t)clip.size());
+
+    // Sample table for readahead; the clip is streamed through the page
+    // cache, prefetching each sampled frame and dropping what was consumed.
+    Mp4Index index;
+    std::string index_err;
+    const bool indexed = index.load(opt.mp4_path, &index_err);
+    if (!indexed) std::cerr << "[ENGINE] no sample table (" << index_err << "); plain sequential reads\n";
+    ClipReadahead ra;
+    if (!opt.preload) ra.open(opt.mp4_path, indexed ? &index : nullptr);
+
+    dec::SourceOptions so;
+    so.decoder = opt.decoder;
+    so.threads = opt.decode_threads;
+    so.index = indexed ? &index : nullptr;
+    so.memory = in_memory ? &clip : nullptr;
+    so.fidelity = opt.fidelity;
+    // Every tile must still be at least model-input sized after lowres
+    so.min_side = std::max(EI_CLASSIFIER_INPUT_WIDTH, EI_CLASSIFIER_INPUT_HEIGHT) * std::max(1, opt.tiles);
+    std::string src_err;
+    std::unique_ptr<dec::FrameSource> src = dec::open_source(opt.mp4_path, so, &src_err);
+    if (!src) {
+        res.error = "failed to open mp4";
+        std::cerr << "[ENGINE] " << src_err << "\n";
+        return res;
+    }
+
+    // Exact frame count from the sample table; the container's count is
+    // only an estimate (duration * fps) and often 0 on concatenated clips.
+    int total_frames = indexed ? (int)index.sample_count() : src->frame_count();
+    res.decoder = src->name();
+    // Decoder frames, estimated: the picture (yuv420 at the decoded size,
+    // known from the first frame) per frame thread plus the reference and
+    // output frames
+    const int dec_threads = res.decoder == "libav" ? (opt.decode_threads > 0 ? opt.decode_threads
+                                                      : (int)std::max(1u, std::thread::hardware_concurrency()))
+                                                   : 1;
+    PoolCharge dec_charge(Pool::Decoder);
+    int64_t frame_bytes = 0;
+    if (total_frames <= 0) total_frames = 1;
+    res.total_frames = total_frames;
+
+    // Choose frame indices (evenly spaced)
+    const int frames = std::max(1, opt.frames);
+    std::vector<int> idxs;
+    idxs.reserve(frames);
+    if (frames == 1) {
+        idxs.push_back(total_frames / 2);
+    } else {
+        for (int k = 0; k < frames; k++) {
+            int fi = (int)std::round((double)k * (double)(total_frames - 1) / (double)(frames - 1));
+            fi = std::max(0, std::min(total_frames - 1, fi));
+            idxs.push_back(fi);
+        }
+    }
+    if (opt.sampling == Sampling::Keyframe && indexed) {
+        // Targets that share a GOP collapse onto one keyframe
+        for (int &fi : idxs) fi = (int)index.keyframe_before((size_t)fi);
+        idxs.erase(std::unique(idxs.begin(), idxs.end()), idxs.end());
+    }
+
+    auto &dets = res.detections;
+    dets.reserve(64);
+
+    // EI expects 160x160 and resize mode FIT_SHORTEST
+    const int W = EI_CLASSIFIER_INPUT_WIDTH;   // 160
+    const int H = EI_CLASSIFIER_INPUT_HEIGHT;  // 160
+    res.input_w = W;
+    res.input_h = H;
+    const int C = 3;
+
+    std::vector<uint8_t> rgb_u8(W * H * C);
+    std::vector<ei_impulse_result_bounding_box_t> boxes;
+    PoolCharge frames_charge(Pool::Frames, (int64_t)rgb_u8.size());
+    PoolCharge dets_charge(Pool::Detections);
+    const int tiles = std::max(1, opt.tiles);
+
+    // Repeat triggers: the camera's recent results every frame so far is
+    // consistent with, and the hash of every classified input for the cache
+    const bool remember = repeat && opt.repeat_cooldown_ms > 0;
+    std::vector<size_t> repeat_of;
+    if (remember) repeat_of = repeat->candidates(opt, now_ms);
+    std::vector<uint64_t> hashes;
+
+    // Seeking / decoding forward to each target is the FrameSource's job
+    src->plan(idxs);
+    ra.prefetch(idxs.front());
+    for (size_t k = 0; k < idxs.size(); k++) {
+        const int fi = idxs[k];
+        const bool got = src->read(fi);
+        // Next target's bytes load while this frame is classified
+        if (k + 1 < idxs.size()) ra.prefetch(idxs[k + 1]);
+        ra.consumed(fi);
+        if (!got) continue;
+        if (!frame_bytes) {
+            frame_bytes = (int64_t)src->width() * src->height() * 3 / 2;
+            dec_charge.set(frame_bytes * (dec_threads + 2));
+        }
+
+        const size_t first_det = dets.size();
+        for (int tile = 0; tile < tiles * tiles; tile++) {
+            const int tx = tile % tiles, ty = tile / tiles;
+
+            // ✅ Correct preprocessing: FIT_SHORTEST + center crop + RGB,
+            // straight into the contiguous buffer
+            const dec::Region view = model_view(src->width(), src->height(), W, H, tiles, tx, ty);
+            if (!src->rgb(view, W, H, rgb_u8.data())) {
+                res.error = "preprocessing failed";
+                return res;
+            }
+            if (remember) hashes.push_back(RepeatCache::dhash(rgb_u8.data(), W, H));
+
+            // Prepare EI signal (float samples 0..255 are OK for EI image pipeline)
+            signal_t signal;
+            signal.total_length = rgb_u8.size();
+            signal.get_data = [&](size_t offset, size_t length, float *out_ptr) -> int {
+                if (offset + length > rgb_u8.size()) return -1;
+                for (size_t i = 0; i < length; i++) {
+                    out_ptr[i] = (float)rgb_u8[offset + i];
+                }
+                return 0;
+            };
+
+            ei_impulse_result_t result = {0};
+            EI_IMPULSE_ERROR r;
+            {
+                // Copied out under the lock: other threads' clips classify next
+                std::lock_guard<std::mutex> lk(g_classify_mu);
+                const auto c0 = std::chrono::steady_clock::now();
+                r = classify(&signal, &result);
+                classify_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - c0).count();
+                if (r == EI_IMPULSE_OK) boxes.assign(result.bounding_boxes, result.bounding_boxes + result.bounding_boxes_count);
+            }
+            classify_runs++;
+            if (r != EI_IMPULSE_OK) {
+                res.error = "run_classifier failed: " + std::to_string((int)r);
+                return res;
+            }
+
+            // Collect bounding boxes (FOMO outputs bounding_boxes), in
+            // whole-frame model-input coordinates
+            for (const auto &bb : boxes) {
+                if (!bb.label) continue;
+                if (bb.value < opt.threshold) continue;
+                const uint32_t x = (uint32_t)((tx * W + bb.x) / tiles), y = (uint32_t)((ty * H + bb.y) / tiles);
+                const uint32_t w = bb.width / tiles, h = bb.height / tiles;
+                if (!opt.masks.empty()) {
+                    const float cx = (x + w / 2.0f) / W, cy = (y + h / 2.0f) / H;
+                    if (std::any_of(opt.masks.begin(), opt.masks.end(),
+                                    [&](const Zone &z) { return z.contains(cx, cy); })) {
+                        continue;
+                    }
+                }
+
+                std::string lbl(bb.label);
+                if (lbl == "person") res.people++;
+                if (lbl == "car") res.cars++;
+
+                dets.push_back(Detection{
+                    lbl,
+                    bb.value,
+                    x, y, w, h,
+                    fi,
+                    indexed ? index.pts_ms((size_t)fi) : -1
+                });
+            }
+        }
+
+        res.frames_analyzed++;
+
+        if (on_frame) {
+            FrameReport f;
+            f.k = (int)k + 1;
+            f.planned = (int)idxs.size();
+            f.frame_idx = fi;
+            f.t_ms = indexed ? index.pts_ms((size_t)fi) : -1;
+            f.detections.assign(dets.begin() + first_det, dets.end());
+            std::sort(f.detections.begin(), f.detections.end(),
+                      [](const Detection &a, const Detection &b) { return a.conf > b.conf; });
+            on_frame(f);
+        }
+
+        if (!repeat_of.empty()) {
+            const std::vector<uint64_t> frame_hashes(hashes.end() - tiles * tiles, hashes.end());
+            const std::vector<Detection> frame_dets(dets.begin() + first_det, dets.end());
+            repeat_of.erase(std::remove_if(repeat_of.begin(), repeat_of.end(),
+                                           [&](size_t e) {
+                                               return !repeat->frame_matches(e, frame_hashes, frame_dets, W, H);
+                                           }),
+                            repeat_of.end());
+            if (!repeat_of.empty() && res.frames_analyzed >= std::max(1, opt.repeat_confirm)) {
+                // Confirmed: the rest of the clip is the entry's
+                if (repeat->inherit(repeat_of.front(), fi, &res, now_ms)) break;
+                repeat_of.clear();
+            }
+        }
+
+        // Capped: trimmed back to the most confident whenever twice the cap
+        if (opt.max_detections > 0 && dets.size() > 2 * (size_t)opt.max_detections) {
+            std::nth_element(dets.begin(), dets.begin() + opt.max_detections, dets.end(),
+                             [](const Detection &a, const Detection &b) { return a.conf > b.conf; });
+            dets.resize(opt.max_detections);
+        }
+        frames_charge.set((int64_t)(rgb_u8.size() + boxes.capacity() * sizeof(boxes[0])));
+        dets_charge.set((int64_t)(dets.capacity() * sizeof(Detection)));
+    }
+
+    src.reset();
+    dec_charge.set(0);
+    ra.finish();
+
+    // All of them go to the detection store; result_json() keeps the top 25
+    std::sort(dets.begin(), dets.end(), [](const Detection& a, const Detection& b) {
+        return a.conf > b.conf;
+    });
+    if (opt.max_detections > 0 && dets.size() > (size_t)opt.max_detections) dets.resize(opt.max_detections);
+
+    auto t1 = std::chrono::steady_clock::now();
+    res.latency_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
+    res.ok = true;
+    if (remember) repeat->store(opt, res, std::move(hashes), now_ms);
+    if (thermal && classify_runs) thermal->observe((float)(classify_ms / classify_runs));
+    if (res.memory.active) memory->finish(&res.memory, frame_bytes);
+    return res;
+}
+
+// -------------------------
+// Detection store
+// -------------------------
+bool record_detections(ds::DetStore *store, const std::string &camera, const Options &opt,
+                       const Result &res) {
+    char *end = nullptr;
+    int64_t base_ms = std::strtoll(opt.event_id.c_str(), &end, 10);
+    if (!end || *end || base_ms <= 0) {
+        base_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+    for (const auto &d : res.detections) {
+        if (d.inherited) continue;
+        ds::Row r;
+        r.t_ms = base_ms + std::max<int64_t>(d.t_ms, 0);
+        r.camera = camera;
+        r.label = d.label;
+        r.conf = d.conf;
+        r.cx = res.input_w ? (d.x + d.w / 2.0f) / res.input_w : 0.0f;
+        r.cy = res.input_h ? (d.y + d.h / 2.0f) / res.input_h : 0.0f;
+        store->append(r);
+    }
+    return store->flush();
+}
+
+bool parse_zone(const std::string &s, Zone *z) {
+    return std::sscanf(s.c_str(), "%f,%f,%f,%f", &z->x0, &z->y0, &z->x1, &z->y1) == 4 && z->x0 <= z->x1 &&
+           z->y0 <= z->y1;
+}
+
+bool parse_sampling(const std::string &s, Sampling *out) {
+    if (s == "even") *out = Sampling::Even;
+    else if (s == "keyframe") *out = Sampling::Keyframe;
+    else return false;
+    return true;
+}
+
+const char *sampling_name(Sampling s) {
+    return s == Sampling::Keyframe ? "keyframe" : "even";
+}
+
+// -------------------------
+// Result JSON
+// -------------------------
+static std::string thermal_json(const ThermalNote &t) {
+    char buf[256];
+    std::snprintf(buf, sizeof buf,
+                  "{\"heat\":\"%s\",\"temp_c\":%.1f,\"freq_cap\":%.2f,\"throttled\":%s,\"ms_per_run\":%.1f,"
+                  "\"frames\":%d,\"frames_requested\":%d,\"tiles\":%d,\"tiles_requested\":%d,\"fast_decode\":%s,",
+                  heat_name(t.heat), t.sample.temp_c, t.sample.freq_cap, t.sample.throttled ? "true" : "false",
+                  t.ms_per_run, t.frames, t.frames_requested, t.tiles, t.tiles_requested,
+                  t.fast_decode ? "true" : "false");
+    return buf + ("\"reason\":\"" + json_escape(t.reason) + "\"}");
+}
+
+static std::string memory_json(const MemoryNote &m) {
+    char buf[384];
+    std::snprintf(buf, sizeof buf,
+                  "{\"limit_mb\":%d,\"rss_mb_before\":%.1f,\"avail_mb\":%.1f,\"headroom_mb\":%.1f,"
+                  "\"estimate_mb\":%.1f,\"rss_mb\":%.1f,\"peak_rss_mb\":%.1f,\"frames\":%d,\"frames_requested\":%d,"
+                  "\"tiles\":%d,\"tiles_requested\":%d,\"preload_off\":%s,\"fast_decode\":%s,",
+                  m.limit_mb, m.before.rss_kb / 1024.0, m.before.avail_kb / 1024.0, m.headroom_kb / 1024.0,
+                  m.estimate_kb / 1024.0, m.rss_kb / 1024.0, m.peak_rss_kb / 1024.0, m.frames, m.frames_requested,
+                  m.tiles, m.tiles_requested, m.preload_off ? "true" : "false", m.fast_decode ? "true" : "false");
+    std::string o = buf;
+    o += "\"pool_peak_kb\":{";
+    for (int i = 0; i < (int)Pool::Count; i++) {
+        o += std::string(i ? "," : "") + "\"" + pool_name((Pool)i) + "\":" + std::to_string(m.pool_peak[i] / 1024);
+    }
+    return o + "},\"reason\":\"" + json_escape(m.reason) + "\"}";
+}
+
+std::string result_json(const Options &opt, const Result &res) {
+    if (!res.ok) {
+        return "{\n"
+            "  \"event_id\": \"" + json_escape(opt.event_id) + "\",\n"
+            "  \"model\": \"edgeimpulse_fomo_local\",\n"
+            "  \"status\": \"error\",\n"
+            "  \"error\": \"" + json_escape(res.error) + "\"\n"
+            "}\n";
+    }
+
+    const auto &dets = res.detections;
+    const size_t n_dets = std::min<size_t>(dets.size(), 25);
+    std::string body;
+    body.reserve(4096);
+    body += "{\n";
+    body += "  \"event_id\": \"" + json_escape(opt.event_id) + "\",\n";
+    body += "  \"model\": \"edgeimpulse_fomo_local\",\n";
+    if (!res.model_file.empty()) body += "  \"model_file\": \"" + json_escape(res.model_file) + "\",\n";
+    if (res.thermal.active) body += "  \"thermal\": " + thermal_json(res.thermal) + ",\n";
+    if (res.memory.active) body += "  \"memory\": " + memory_json(res.memory) + ",\n";
+    body += "  \"frames_analyzed\": " + std::to_string(res.frames_analyzed) + ",\n";
+    body += "  \"total_frames\": " + std::to_string(res.total_frames) + ",\n";
+    body += "  \"threshold\": " + std::to_string(opt.threshold) + ",\n";
+    body += "  \"sampling\": \"" + std::string(sampling_name(opt.sampling)) + "\",\n";
+    body += "  \"tiles\": " + std::to_string(std::max(1, opt.tiles)) + ",\n";
+    body += "  \"decoder\": \"" + json_escape(res.decoder) + "\",\n";
+    body += "  \"fidelity\": \"" + std::string(dec::fidelity_name(opt.fidelity)) + "\",\n";
+    if (!res.inherited_from.empty()) body += "  \"inherited_from\": \"" + json_escape(res.inherited_from) + "\",\n";
+    body += "  \"summary\": {\"people\": " + std::to_string(res.people) + ", \"cars\": " + std::to_string(res.cars) + "},\n";
+    body += "  \"detections\": [\n";
+    for (size_t i = 0; i < n_dets; i++) {
+        const auto &d = dets[i];
+        body += "    {\"label\":\"" + json_escape(d.label) + "\",\"conf\":" + std::to_string(d.conf) +
+                ",\"bbox\":[" + std::to_string(d.x) + "," + std::to_string(d.y) + "," +
+                               std::to_string(d.w) + "," + std::to_string(d.h) + "]," +
+                "\"frame_idx\":" + std::to_string(d.frame_idx) + ",\"t_ms\":" + std::to_string(d.t_ms) +
+                (d.inherited ? ",\"inherited\":true}" : "}");
+        body += (i + 1 == n_dets) ? "\n" : ",\n";
+    }
+    body += "  ],\n";
+    body += "  \"latency_ms\": " + std::to_string(res.latency_ms) + ",\n";
+    body += "  \"status\": \"ok\"\n";
+    body += "}\n";
+    return body;
+}
+
+// -------------------------
+// Streaming records
+// -------------------------
+static std::string detection_json(const Detection &d) {
+    return "{\"label\":\"" + json_escape(d.label) + "\",\"conf\":" + std::to_string(d.conf) + ",\"bbox\":[" +
+           std::to_string(d.x) + "," + std::to_string(d.y) + "," + std::to_string(d.w) + "," + std::to_string(d.h) +
+           "]}";
+}
+
+std::string frame_json(const Options &opt, const FrameReport &f) {
+    int people = 0, cars = 0;
+    for (const auto &d : f.detections) {
+        if (d.label == "person") people++;
+        if (d.label == "car") cars++;
+    }
+    std::string body = "{\"type\":\"frame\",\"event_id\":\"" + json_escape(opt.event_id) + "\",\"k\":" +
+                       std::to_string(f.k) + ",\"n\":" + std::to_string(f.planned) + ",\"frame_idx\":" +
+                       std::to_string(f.frame_idx) + ",\"t_ms\":" + std::to_string(f.t_ms) + ",\"max_conf\":" +
+                       std::to_string(f.detections.empty() ? 0.0f : f.detections.front().conf) +
+                       ",\"summary\":{\"people\":" + std::to_string(people) + ",\"cars\":" + std::to_string(cars) +
+                       "},\"detections\":[";
+    const size_t n = std::min<size_t>(f.detections.size(), 25);
+    for (size_t i = 0; i < n; i++) {
+        body += (i ? "," : "") + detection_json(f.detections[i]);
+    }
+    body += "]}";
+    return body;
+}
+
+std::string summary_json(const Options &opt, const Result &res, const std::string &out_path, bool wrote) {
+    std::string body = "{\"type\":\"summary\",\"event_id\":\"" + json_escape(opt.event_id) + "\",\"status\":\"" +
+                       (res.ok && wrote ? "ok" : "error") + "\",\"out\":\"" + json_escape(out_path) +
+                       "\",\"wrote\":" + (wrote ? "true" : "false") + ",\"frames_analyzed\":" +
+                       std::to_string(res.frames_analyzed) + ",\"summary\":{\"people\":" +
+                       std::to_string(res.people) + ",\"cars\":" + std::to_string(res.cars) +
+                       "},\"latency_ms\":" + std::to_string(res.latency_ms);
+    if (!res.inherited_from.empty()) body += ",\"inherited_from\":\"" + json_escape(res.inherited_from) + "\"";
+    if (!res.ok) body += ",\"error\":\"" + json_escape(res.error) + "\"";
+    else if (!wrote) body += ",\"error\":\"result write failed\"";
+    body += "}";
+    return body;
+}
+
+}  // namespace engine
@@ -0,0 +1,168 @@
+// ~/ArduinoApps/survillance/cpp_infer/engine.h
+// Clip analysis engine: sample frames from an event clip, run the EI FOMO
+// model on each and aggregate the detections. ei_infer_mp4 is a thin CLI
+// over this; anything that analyses clips in-process links survi_engine.
+//
+// run_classifier() uses the statically allocated tensor arena
+// (EI_CLASSIFIER_ALLOCATION_STATIC), so analyze_clip() serialises the
+// classifications behind one lock. Clips may be analysed on several threads
+// at once (decoding and preprocessing overlap, ei_infer_mp4 --batch), as
+// long as each thread passes its own RepeatCache / ThermalGovernor, or none;
+// a MemoryGovernor may be shared.
+//
+// The model is the compiled-in one unless use_model() selected a .tflite
+// file (model_file.h) with the same input and output tensors.
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frame_source.h"
+#include "io_engine.h"
+#include "memory_budget.h"
+#include "thermal.h"
+
+namespace ds {
+class DetStore;
+}
+
+namespace engine {
+
+class ModelFile;
+class RepeatCache;
+
+// Rectangle in model-input coordinates normalised to [0, 1].
+struct Zone {
+    float x0 = 0, y0 = 0, x1 = 1, y1 = 1;
+    bool contains(float x, float y) const { return x >= x0 && x <= x1 && y >= y0 && y <= y1; }
+};
+
+// How the sampled frames are picked from the clip.
+enum class Sampling {
+    Even,      // evenly spaced over the clip
+    Keyframe,  // evenly spaced targets snapped to their keyframe: no decoding
+               // forward through a GOP, at the cost of less even coverage
+};
+
+struct Options {
+    std::string event_id;
+    std::string mp4_path;
+    int frames = 5;
+    float threshold = 0.50f;
+    Sampling sampling = Sampling::Even;
+    // Each sampled frame is classified as tiles x tiles crops of the model's
+    // view instead of one downscale: small/far objects get more pixels,
+    // inference cost grows with tiles^2. Boxes are mapped back to the
+    // whole-frame model-input coordinates.
+    int tiles = 1;
+    // Pull the whole clip into memory through the IoEngine before decoding
+    // instead of streaming it with readahead hints (fast storage, small clips).
+    bool preload = false;
+    dec::Decoder decoder = dec::Decoder::Auto;
+    int decode_threads = 0;  // libav decoder threads; 0: one per core
+    // Fast: reduced-fidelity decode for inference-only frames (libav);
+    // survi_sweep --fidelity full,fast measures what it costs in accuracy.
+    dec::Fidelity fidelity = dec::Fidelity::Full;
+    // Detections whose box centre falls in one of these are ignored
+    // (per-camera nuisance zones: a road, a neighbour's window).
+    std::vector<Zone> masks;
+    // Repeat triggers (analyze_clip's RepeatCache): an event whose first
+    // repeat_confirm sampled frames match one of this camera's results from
+    // the last repeat_cooldown_ms inherits that result instead of a full pass.
+    std::string camera = "cam0";
+    int repeat_cooldown_ms = 0;  // 0: off
+    int repeat_confirm = 2;
+    // Keep only the most confident detections of the clip (MemoryGovernor
+    // sets it); 0: all of them.
+    int max_detections = 0;
+};
+
+struct Detection {
+    std::string label;
+    float conf = 0.0f;
+    uint32_t x = 0, y = 0, w = 0, h = 0;
+    int frame_idx = 0;
+    int64_t t_ms = -1;  // frame timestamp from the sample table (-1: unknown)
+    bool inherited = false;  // from Result::inherited_from's clip (frame_idx / t_ms are its)
+};
+
+struct Result {
+    bool ok = false;
+    std::string error;  // set when !ok
+    int frames_analyzed = 0;
+    int total_frames = 0;
+    int people = 0;
+    int cars = 0;
+    std::vector<Detection> detections;  // all above threshold, by confidence
+    int input_w = 0, input_h = 0;       // model input size the boxes refer to
+    std::string decoder;                // FrameSource backend that decoded the clip
+    std::string inherited_from;         // event whose result this one reuses (RepeatCache)
+    std::string model_file;             // use_model()'s file; empty: the compiled-in model
+    ThermalNote thermal;                // the budget the clip ran on (analyze_clip's governor)
+    MemoryNote memory;                  // the memory budget, peak RSS and pool high-water marks
+    int latency_ms = 0;
+};
+
+// One analysed frame, reported as soon as it is classified.
+struct FrameReport {
+    int k = 0;          // 1-based position among the sampled frames
+    int planned = 0;    // frames the clip will be sampled at
+    int frame_idx = 0;
+    int64_t t_ms = -1;
+    std::vector<Detection> detections;  // this frame's, by confidence
+};
+using FrameCallback = std::function<void(const FrameReport &)>;
+
+// io: used for Options::preload (one batch of reads into memory, so
+// decoding never stalls on the SD card).
+// on_frame: called on the analysing thread after every classified frame
+// (streaming output); frames that fail to decode are not reported.
+// repeat: recent results to inherit from (Options::repeat_cooldown_ms), and
+// where a full pass is remembered.
+// thermal: scales frames / tiles / fidelity down while the SoC is hot or
+// throttled (thermal.h) and learns the classifier's speed; the clip's
+// frame_idx / sampling then follow the scaled options.
+// memory: applied after thermal; scales preload / decoder threads / fidelity
+// / tiles / frames down until the clip fits the budget (memory_budget.h).
+Result analyze_clip(const Options &opt, io::IoEngine *io = nullptr, const FrameCallback &on_frame = nullptr,
+                    RepeatCache *repeat = nullptr, ThermalGovernor *thermal = nullptr,
+                    MemoryGovernor *memory = nullptr);
+
+// Model for every analyze_clip() from now on: a file whose first input and
+// output tensors match the compiled model's, that also completes one
+// inference (tensor arena large enough, ops compiled in), or nullptr for the
+// compiled-in model. On failure the current model stays. Call it between
+// clips, never while any analyze_clip() runs.
+bool use_model(std::shared_ptr<const ModelFile> model, std::string *err);
+// use_model()'s current file, or nullptr.
+const ModelFile *active_model();
+
+// The runner's result document (what local_infer.py parses); lists the top
+// 25 detections.
+std::string result_json(const Options &opt, const Result &res);
+
+// Streaming records, one line each (no trailing newline):
+//   {"type":"frame", ...}    per FrameReport
+//   {"type":"summary", ...}  after the result file is written (or failed)
+std::string frame_json(const Options &opt, const FrameReport &f);
+std::string summary_json(const Options &opt, const Result &res, const std::string &out_path, bool wrote);
+
+// Every detection of the clip as one block in the detection store (not the
+// inherited ones: they are in it under their own event). Event ids
+// are the trigger time in epoch ms; frame t_ms is relative to the clip start.
+bool record_detections(ds::DetStore *store, const std::string &camera, const Options &opt,
+                       const Result &res);
+
+// "x0,y0,x1,y1" (normalised) -> Zone.
+bool parse_zone(const std::string &s, Zone *z);
+
+// "even" | "keyframe"; false for anything else.
+bool parse_sampling(const std::string &s, Sampling *out);
+const char *sampling_name(Sampling s);
+
+std::string json_escape(const std::string &s);
+
+}  // namespace engine
@@ -0,0 +1,810 @@
+// ~/ArduinoApps/survillance/cpp_infer/event_store.cpp
+// See event_store.h for the on-disk layout. The C ABI at the bottom is what
+// python/event_store.py loads with ctypes.
+
+#include "event_store.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "crc32.h"
+
+namespace es {
+
+// -------------------------
+// On-disk formats
+// -------------------------
+static constexpr uint32_t kWalMagic = 0x56455153;  // "SQEV"
+static constexpr uint32_t kIdxMagic = 0x58495153;  // "SQIX"
+static constexpr uint32_t kIdxVersion = 2;  // 1: no wal_gen (read as generation 0)
+
+enum : uint8_t {
+    REC_DOC = 1,     // u8 name_len, name, body
+    REC_FLAGS = 2,   // u32 set, u32 clear
+    REC_BLOB = 3,    // u8 name_len, name
+    REC_DELETE = 4,  // empty
+    REC_GEN = 5,     // u64 generation; first record of a compacted WAL
+};
+
+#pragma pack(push, 1)
+struct RecHdr {
+    uint32_t magic;
+    uint32_t len;  // payload bytes
+    uint32_t crc;  // over the rest of the header + payload
+    uint8_t type;
+    uint8_t pad[3];
+    uint64_t event_id;
+    int64_t ts_ms;
+};
+
+struct IdxHdr {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint64_t wal_off;  // WAL bytes folded into this snapshot
+    uint64_t wal_gen;  // generation of that WAL (version 2)
+};
+#pragma pack(pop)
+
+static_assert(sizeof(RecHdr) == 32, "RecHdr layout");
+static_assert(sizeof(IdxHdr) == 32, "IdxHdr layout");
+
+// -------------------------
+// Small helpers
+// -------------------------
+static uint32_t record_crc(const RecHdr &h, const uint8_t *payload) {
+    uint32_t c = crc::crc32_update(0, (const uint8_t *)&h.type, sizeof(RecHdr) - offsetof(RecHdr, type));
+    return crc::crc32_update(c, payload, h.len);
+}
+
+static std::string encode_record(uint8_t type, uint64_t event_id, int64_t ts_ms, const std::string &payload) {
+    RecHdr h;
+    std::memset(&h, 0, sizeof(h));
+    h.magic = kWalMagic;
+    h.len = (uint32_t)payload.size();
+    h.type = type;
+    h.event_id = event_id;
+    h.ts_ms = ts_ms;
+    h.crc = record_crc(h, (const uint8_t *)payload.data());
+
+    std::string buf;
+    buf.reserve(sizeof(h) + payload.size());
+    buf.append((const char *)&h, sizeof(h));
+    buf += payload;
+    return buf;
+}
+
+// u8 name_len, name (REC_DOC / REC_BLOB)
+static std::string named(const std::string &name) {
+    std::string p;
+    p += (char)name.size();
+    p += name;
+    return p;
+}
+
+static bool write_all(int fd, const void *buf, size_t n) {
+    const uint8_t *p = (const uint8_t *)buf;
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+static bool pread_all(int fd, void *buf, size_t n, off_t off) {
+    uint8_t *p = (uint8_t *)buf;
+    while (n > 0) {
+        ssize_t r = pread(fd, p, n, off);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        n -= (size_t)r;
+        off += r;
+    }
+    return true;
+}
+
+struct FileLock {
+    int fd;
+    explicit FileLock(int f) : fd(f) { if (fd >= 0) flock(fd, LOCK_EX); }
+    ~FileLock() { if (fd >= 0) flock(fd, LOCK_UN); }
+};
+
+// In BLOB_* bit order
+static const char *const kBlobNames[] = {"clip.mp4", "snapshot.jpg", "snapshot.png", "thumbnail.jpg", "thumbnail.png"};
+static constexpr int kBlobCount = (int)(sizeof(kBlobNames) / sizeof(kBlobNames[0]));
+
+uint32_t blob_bit(const std::string &name) {
+    if (name == "clip.mp4") return BLOB_CLIP;
+    if (name == "snapshot.jpg") return BLOB_SNAPSHOT_JPG;
+    if (name == "snapshot.png") return BLOB_SNAPSHOT_PNG;
+    if (name == "thumbnail.jpg") return BLOB_THUMBNAIL_JPG;
+    if (name == "thumbnail.png") return BLOB_THUMBNAIL_PNG;
+    return 0;
+}
+
+// -------------------------
+// EventStore
+// -------------------------
+EventStore::~EventStore() { close(); }
+
+bool EventStore::open(const std::string &dir, bool read_only, std::string *err) {
+    close();
+    dir_ = dir;
+    read_only_ = read_only;
+
+    if (!read_only) {
+        mkdir(dir.c_str(), 0755);
+        mkdir((dir + "/blobs").c_str(), 0755);
+    }
+
+    const std::string wal = dir + "/events.wal";
+    if (!open_wal_locked()) {
+        if (err) *err = "open " + wal + ": " + std::strerror(errno);
+        return false;
+    }
+    if (!read_only) {
+        lock_fd_ = ::open((dir + "/events.lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (lock_fd_ < 0) {
+            if (err) *err = std::string("open events.lock: ") + std::strerror(errno);
+            close();
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> g(mu_);
+    FileLock fl(lock_fd_);
+    if (!refresh_locked()) {
+        if (err) *err = "failed to replay " + wal;
+        close();
+        return false;
+    }
+    if (!read_only) {
+        // Drop a torn tail left by a crash mid-append.
+        struct stat st;
+        if (fstat(wal_fd_, &st) == 0 && (uint64_t)st.st_size > replayed_off_) {
+            std::cerr << "[STORE] truncating torn WAL tail at " << replayed_off_ << "\n";
+            if (ftruncate(wal_fd_, (off_t)replayed_off_) != 0) {
+                if (err) *err = std::string("truncate: ") + std::strerror(errno);
+                close();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void EventStore::close() {
+    if (idx_map_) munmap(idx_map_, idx_size_);
+    idx_map_ = nullptr;
+    idx_size_ = 0;
+    snap_ = nullptr;
+    snap_count_ = 0;
+    idx_ino_ = 0;
+    idx_mtime_ns_ = 0;
+    if (wal_fd_ >= 0) ::close(wal_fd_);
+    if (lock_fd_ >= 0) ::close(lock_fd_);
+    wal_fd_ = lock_fd_ = -1;
+    wal_ino_ = 0;
+    wal_gen_ = 0;
+    replayed_off_ = 0;
+    overlay_.clear();
+}
+
+// (Re)opens events.wal: at open(), and after a compaction replaced it. The
+// snapshot and overlay belong to the old file and start over.
+bool EventStore::open_wal_locked() {
+    const std::string wal = dir_ + "/events.wal";
+    int fd = ::open(wal.c_str(), read_only_ ? (O_RDONLY | O_CLOEXEC) : (O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC), 0644);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    if (wal_fd_ >= 0) ::close(wal_fd_);
+    wal_fd_ = fd;
+    wal_ino_ = st.st_ino;
+
+    wal_gen_ = 0;
+    RecHdr h;
+    uint64_t gen;
+    if (pread_all(fd, &h, sizeof(h), 0) && h.magic == kWalMagic && h.type == REC_GEN && h.len == sizeof(gen) &&
+        pread_all(fd, &gen, sizeof(gen), sizeof(h)) && record_crc(h, (const uint8_t *)&gen) == h.crc) {
+        wal_gen_ = gen;
+    }
+
+    if (idx_map_) munmap(idx_map_, idx_size_);
+    idx_map_ = nullptr;
+    idx_size_ = 0;
+    snap_ = nullptr;
+    snap_count_ = 0;
+    idx_ino_ = 0;
+    idx_mtime_ns_ = 0;
+    replayed_off_ = 0;
+    overlay_.clear();
+    return true;
+}
+
+bool EventStore::map_index_locked() {
+    const std::string path = dir_ + "/events.idx";
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno == ENOENT;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < offsetof(IdxHdr, wal_gen)) {
+        ::close(fd);
+        return false;
+    }
+    void *m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) return false;
+
+    const IdxHdr *h = (const IdxHdr *)m;
+    const size_t hdr = h->version == 1 ? offsetof(IdxHdr, wal_gen) : sizeof(IdxHdr);
+    if (h->magic != kIdxMagic || (h->version != 1 && h->version != kIdxVersion) ||
+        hdr + h->count * sizeof(IndexRec) > (size_t)st.st_size) {
+        std::cerr << "[STORE] ignoring corrupt " << path << "\n";
+        munmap(m, (size_t)st.st_size);
+        return false;
+    }
+    const uint64_t gen = h->version == 1 ? 0 : h->wal_gen;
+
+    if (idx_map_) munmap(idx_map_, idx_size_);
+    idx_map_ = m;
+    idx_size_ = (size_t)st.st_size;
+    snap_ = (const IndexRec *)((const uint8_t *)m + hdr);
+    snap_count_ = (size_t)h->count;
+    idx_ino_ = st.st_ino;
+    idx_mtime_ns_ = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    replayed_off_ = h->wal_off;
+    overlay_.clear();
+    if (gen != wal_gen_) {
+        // Written for another WAL (crash between a compaction's renames):
+        // the WAL alone has the state
+        std::cerr << "[STORE] " << path << " is for WAL generation " << gen << ", not " << wal_gen_
+                  << "; replaying the WAL\n";
+        snap_ = nullptr;
+        snap_count_ = 0;
+        replayed_off_ = 0;
+    }
+    return true;
+}
+
+// Picks up a newer snapshot and any WAL records appended by other processes.
+bool EventStore::refresh_locked() {
+    struct stat st;
+    // A compaction (here or in another process) renamed a new events.wal in
+    if (stat((dir_ + "/events.wal").c_str(), &st) == 0 && st.st_ino != wal_ino_ && !open_wal_locked()) return false;
+    if (stat((dir_ + "/events.idx").c_str(), &st) == 0) {
+        int64_t mt = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        if (st.st_ino != idx_ino_ || mt != idx_mtime_ns_) {
+            if (!map_index_locked()) return false;
+        }
+    }
+
+    if (fstat(wal_fd_, &st) != 0) return false;
+    const uint64_t end = (uint64_t)st.st_size;
+    if (end <= replayed_off_) return true;
+
+    std::string tail(end - replayed_off_, '\0');
+    if (!pread_all(wal_fd_, &tail[0], tail.size(), (off_t)replayed_off_)) return false;
+
+    size_t pos = 0;
+    while (pos + sizeof(RecHdr) <= tail.size()) {
+        RecHdr h;
+        std::memcpy(&h, tail.data() + pos, sizeof(h));
+        if (h.magic != kWalMagic || pos + sizeof(RecHdr) + h.len > tail.size()) break;
+        const uint8_t *payload = (const uint8_t *)tail.data() + pos + sizeof(RecHdr);
+        if (record_crc(h, payload) != h.crc) break;
+        if (h.type != REC_GEN) {
+            apply_locked(h.type, h.event_id, h.ts_ms, replayed_off_ + pos + sizeof(RecHdr),
+                         std::string((const char *)payload, h.len));
+        }
+        pos += sizeof(RecHdr) + h.len;
+    }
+    replayed_off_ += pos;
+    return true;
+}
+
+const IndexRec *EventStore::snapshot_find(uint64_t event_id) const {
+    const IndexRec *b = snap_, *e = snap_ + snap_count_;
+    const IndexRec *it = std::lower_bound(b, e, event_id,
+        [](const IndexRec &r, uint64_t id) { return r.event_id < id; });
+    return (it != e && it->event_id == event_id) ? it : nullptr;
+}
+
+void EventStore::apply_locked(uint8_t type, uint64_t event_id, int64_t ts_ms, uint64_t payload_off,
+                              const std::string &payload) {
+    auto it = overlay_.find(event_id);
+    if (it == overlay_.end()) {
+        IndexRec r;
+        if (const IndexRec *s = snapshot_find(event_id)) {
+            r = *s;
+        } else {
+            std::memset(&r, 0, sizeof(r));
+            r.event_id = event_id;
+            r.created_ms = ts_ms;
+        }
+        it = overlay_.emplace(event_id, r).first;
+    }
+    IndexRec &r = it->second;
+    if (r.flags & FLAG_DELETED && type != REC_DELETE) {
+        // Id reused after removal: start over.
+        std::memset(&r, 0, sizeof(r));
+        r.event_id = event_id;
+        r.created_ms = ts_ms;
+    }
+    r.updated_ms = std::max(r.updated_ms, ts_ms);
+
+    switch (type) {
+        case REC_DOC: {
+            if (payload.empty()) break;
+            const size_t nl = (uint8_t)payload[0];
+            if (1 + nl > payload.size()) break;
+            const std::string name = payload.substr(1, nl);
+            const uint64_t off = payload_off + 1 + nl;
+            const uint32_t len = (uint32_t)(payload.size() - 1 - nl);
+            if (name == "incident") { r.incident_off = off; r.incident_len = len; }
+            else if (name == "result") { r.result_off = off; r.result_len = len; }
+            break;
+        }
+        case REC_FLAGS: {
+            if (payload.size() < 8) break;
+            uint32_t set, clear;
+            std::memcpy(&set, payload.data(), 4);
+            std::memcpy(&clear, payload.data() + 4, 4);
+            r.flags = (r.flags & ~clear) | set;
+            break;
+        }
+        case REC_BLOB: {
+            if (payload.empty()) break;
+            const size_t nl = (uint8_t)payload[0];
+            if (1 + nl > payload.size()) break;
+            r.blobs |= blob_bit(payload.substr(1, nl));
+            break;
+        }
+        case REC_DELETE:
+            r.flags = FLAG_DELETED;
+            r.blobs = 0;
+            r.incident_len = r.result_len = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+bool EventStore::append(uint8_t type, uint64_t event_id, int64_t ts_ms, const std::string &payload) {
+    if (read_only_ || wal_fd_ < 0) return false;
+    const std::string buf = encode_record(type, event_id, ts_ms, payload);
+
+    std::lock_guard<std::mutex> g(mu_);
+    FileLock fl(lock_fd_);
+    if (!refresh_locked()) return false;
+    // One write per record so a concurrent reader never sees half of one.
+    if (!write_all(wal_fd_, buf.data(), buf.size())) return false;
+    if (!refresh_locked()) return false;
+    if (overlay_.size() >= kCheckpointEvery) checkpoint_locked();
+    return true;
+}
+
+bool EventStore::put_doc(uint64_t event_id, const std::string &name, const std::string &json, int64_t ts_ms) {
+    if (name.empty() || name.size() > 255) return false;
+    return append(REC_DOC, event_id, ts_ms, named(name) + json);
+}
+
+bool EventStore::set_flags(uint64_t event_id, uint32_t set, uint32_t clear, int64_t ts_ms) {
+    std::string p(8, '\0');
+    std::memcpy(&p[0], &set, 4);
+    std::memcpy(&p[4], &clear, 4);
+    return append(REC_FLAGS, event_id, ts_ms, p);
+}
+
+bool EventStore::put_blob(uint64_t event_id, const std::string &name, int64_t ts_ms) {
+    if (!blob_bit(name)) return false;
+    return append(REC_BLOB, event_id, ts_ms, named(name));
+}
+
+bool EventStore::remove(uint64_t event_id, int64_t ts_ms) {
+    return append(REC_DELETE, event_id, ts_ms, std::string());
+}
+
+bool EventStore::checkpoint() {
+    if (read_only_) return false;
+    std::lock_guard<std::mutex> g(mu_);
+    FileLock fl(lock_fd_);
+    if (!refresh_locked()) return false;
+    return checkpoint_locked();
+}
+
+// Folds the overlay into a new events.idx (tmp + fsync + rename) and remaps it.
+bool EventStore::checkpoint_locked() {
+    std::vector<IndexRec> all;
+    all.reserve(snap_count_ + overlay_.size());
+    size_t i = 0;
+    auto it = overlay_.begin();
+    while (i < snap_count_ || it != overlay_.end()) {
+        const IndexRec *r;
+        if (it == overlay_.end() || (i < snap_count_ && snap_[i].event_id < it->first)) {
+            r = &snap_[i++];
+        } else {
+            if (i < snap_count_ && snap_[i].event_id == it->first) i++;
+            r = &it->second;
+            ++it;
+        }
+        if (!(r->flags & FLAG_DELETED)) all.push_back(*r);
+    }
+    compact_locked(&all);  // when due; on failure the old WAL stays
+
+    const std::string path = dir_ + "/events.idx";
+    const std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+
+    IdxHdr h;
+    h.magic = kIdxMagic;
+    h.version = kIdxVersion;
+    h.count = all.size();
+    h.wal_off = replayed_off_;
+    h.wal_gen = wal_gen_;
+    bool ok = write_all(fd, &h, sizeof(h)) &&
+              write_all(fd, all.data(), all.size() * sizeof(IndexRec)) &&
+              fdatasync(fd) == 0;
+    ::close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return map_index_locked();
+}
+
+// Rewrites events.wal as the live events' latest records when it is big and
+// mostly dead (superseded docs, removed events); live's doc offsets move to
+// the new file. The caller holds the flock, so no other process appends.
+bool EventStore::compact_locked(std::vector<IndexRec> *live) {
+    struct stat st;
+    if (fstat(wal_fd_, &st) != 0 || (uint64_t)st.st_size < kCompactMinBytes) return false;
+    uint64_t live_bytes = sizeof(RecHdr) + sizeof(uint64_t);
+    for (const IndexRec &r : *live) live_bytes += 8 * sizeof(RecHdr) + 64 + r.incident_len + r.result_len;
+    if (live_bytes * 2 > (uint64_t)st.st_size) return false;
+
+    const std::string path = dir_ + "/events.wal";
+    const std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+
+    const uint64_t gen = wal_gen_ + 1;
+    std::vector<IndexRec> moved = *live;
+    uint64_t off = 0;
+    bool ok = true;
+    auto put = [&](uint8_t type, uint64_t id, int64_t ts_ms, const std::string &payload) {
+        const std::string rec = encode_record(type, id, ts_ms, payload);
+        ok = ok && write_all(fd, rec.data(), rec.size());
+        off += rec.size();
+    };
+    put(REC_GEN, 0, 0, std::string((const char *)&gen, sizeof(gen)));
+    std::string body;
+    for (IndexRec &r : moved) {
+        // The first record creates the event at created_ms
+        std::string flags(8, '\0');
+        std::memcpy(&flags[0], &r.flags, 4);
+        put(REC_FLAGS, r.event_id, r.created_ms, flags);
+        struct {
+            const char *name;
+            uint64_t *off;
+            uint32_t len;
+        } docs[] = {{"incident", &r.incident_off, r.incident_len}, {"result", &r.result_off, r.result_len}};
+        for (const auto &d : docs) {
+            if (!d.len) continue;
+            if (!read_doc(wal_fd_, *d.off, d.len, &body)) {
+                ok = false;
+                break;
+            }
+            const std::string p = named(d.name);
+            *d.off = off + sizeof(RecHdr) + p.size();
+            put(REC_DOC, r.event_id, r.updated_ms, p + body);
+        }
+        for (int i = 0; i < kBlobCount; i++) {
+            if (r.blobs & (1u << i)) put(REC_BLOB, r.event_id, r.updated_ms, named(kBlobNames[i]));
+        }
+        if (!ok) break;
+    }
+    ok = ok && fdatasync(fd) == 0;
+    ::close(fd);
+    // The WAL goes first: until the index follows, its old generation makes
+    // readers replay the new WAL instead of trusting stale offsets
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    if (!open_wal_locked()) return false;
+    std::cerr << "[STORE] compacted events.wal: " << st.st_size << " -> " << off << " bytes, " << moved.size()
+              << " events\n";
+    replayed_off_ = off;
+    *live = std::move(moved);
+    return true;
+}
+
+bool EventStore::get(uint64_t event_id, IndexRec *out, int *wal_fd) {
+    std::lock_guard<std::mutex> g(mu_);
+    if (!refresh_locked()) return false;
+    auto it = overlay_.find(event_id);
+    const IndexRec *r = (it != overlay_.end()) ? &it->second : snapshot_find(event_id);
+    if (!r || (r->flags & FLAG_DELETED)) return false;
+    if (wal_fd && (*wal_fd = fcntl(wal_fd_, F_DUPFD_CLOEXEC, 0)) < 0) return false;
+    *out = *r;
+    return true;
+}
+
+bool EventStore::read_doc(int wal_fd, uint64_t off, uint32_t len, std::string *out) {
+    if (len == 0) return false;
+    out->assign(len, '\0');
+    return pread_all(wal_fd, &(*out)[0], len, (off_t)off);
+}
+
+std::vector<IndexRec> EventStore::list(uint64_t lo, uint64_t hi, uint32_t need, uint32_t skip,
+                                       size_t limit, bool newest_first) {
+    std::vector<IndexRec> out;
+    std::lock_guard<std::mutex> g(mu_);
+    if (!refresh_locked() || lo > hi) return out;
+
+    auto keep = [&](const IndexRec &r) {
+        if (r.flags & FLAG_DELETED) return false;
+        return (r.flags & need) == need && (r.flags & skip) == 0;
+    };
+    auto by_id = [](const IndexRec &r, uint64_t id) { return r.event_id < id; };
+
+    // Merge the snapshot slice with the overlay slice; overlay wins on ties.
+    const IndexRec *sb = std::lower_bound(snap_, snap_ + snap_count_, lo, by_id);
+    const IndexRec *se = std::lower_bound(sb, snap_ + snap_count_, hi, by_id);
+    if (se != snap_ + snap_count_ && se->event_id == hi) ++se;
+    auto ob = overlay_.lower_bound(lo);
+    auto oe = overlay_.upper_bound(hi);
+
+    if (!newest_first) {
+        const IndexRec *s = sb;
+        auto o = ob;
+        while ((s != se || o != oe) && out.size() < limit) {
+            const IndexRec *r;
+            if (o == oe || (s != se && s->event_id < o->first)) {
+                r = s++;
+            } else {
+                if (s != se && s->event_id == o->first) ++s;
+                r = &o->second;
+                ++o;
+            }
+            if (keep(*r)) out.push_back(*r);
+        }
+    } else {
+        const IndexRec *s = se;
+        auto o = oe;
+        while ((s != sb || o != ob) && out.size() < limit) {
+            const IndexRec *r;
+            auto op = o;
+            if (o != ob) --op;
+            if (o == ob || (s != sb && (s - 1)->event_id > op->first)) {
+                r = --s;
+            } else {
+                if (s != sb && (s - 1)->event_id == op->first) --s;
+                r = &op->second;
+                o = op;
+            }
+            if (keep(*r)) out.push_back(*r);
+        }
+    }
+    return out;
+}
+
+std::vector<IndexRec> EventStore::list_prefix(const std::string &prefix, size_t limit, bool newest_first) {
+    if (prefix.empty()) return list(0, UINT64_MAX, 0, 0, limit, newest_first);
+    if (prefix.size() > 19 || prefix[0] == '0') return {};
+    for (char c : prefix) if (c < '0' || c > '9') return {};
+
+    // A decimal prefix is one contiguous id range per total digit count.
+    const uint64_t p = std::strtoull(prefix.c_str(), nullptr, 10);
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    uint64_t scale = 1;
+    for (size_t digits = prefix.size(); digits <= 19; digits++) {
+        ranges.emplace_back(p * scale, (p + 1) * scale - 1);
+        if (scale > UINT64_MAX / 10 || (p + 1) > UINT64_MAX / (scale * 10)) break;
+        scale *= 10;
+    }
+    if (newest_first) std::reverse(ranges.begin(), ranges.end());
+
+    std::vector<IndexRec> out;
+    for (const auto &r : ranges) {
+        if (out.size() >= limit) break;
+        auto part = list(r.first, r.second, 0, 0, limit - out.size(), newest_first);
+        out.insert(out.end(), part.begin(), part.end());
+    }
+    return out;
+}
+
+std::string EventStore::blob_dir(uint64_t event_id) const {
+    return dir_ + "/blobs/" + std::to_string(event_id);
+}
+
+std::string EventStore::blob_path(uint64_t event_id, const std::string &name) const {
+    return blob_dir(event_id) + "/" + name;
+}
+
+}  // namespace es
+
+// -------------------------
+// C ABI (python/event_store.py)
+// -------------------------
+// Query results come back as malloc'd JSON strings; free them with es_free().
+
+static bool parse_event_id(const char *s, uint64_t *out) {
+    if (!s || !*s) return false;
+    char *end = nullptr;
+    errno = 0;
+    unsigned long long v = std::strtoull(s, &end, 10);
+    if (errno || *end) return false;
+    *out = v;
+    return true;
+}
+
+static std::string json_escape(const std::string &s) {
+    std::string o;
+    o.reserve(s.size() + 8);
+    for (char c : s) {
+        switch (c) {
+            case '\\': o += "\\\\"; break;
+            case '"':  o += "\\\""; break;
+            case '\n': o += "\\n";  break;
+            case '\r': o += "\\r";  break;
+            case '\t': o += "\\t";  break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char b[8];
+                    std::snprintf(b, sizeof(b), "\\u%04x", (unsigned char)c);
+                    o += b;
+                } else {
+                    o += c;
+                }
+        }
+    }
+    return o;
+}
+
+// wal_fd: get()'s, for the docs; -1: without them
+static std::string rec_json(es::EventStore *s, const es::IndexRec &r, int wal_fd) {
+    std::string o = "{\"event_id\":\"" + std::to_string(r.event_id) + "\"";
+    o += ",\"created_ms\":" + std::to_string(r.created_ms);
+    o += ",\"updated_ms\":" + std::to_string(r.updated_ms);
+    o += ",\"done\":" + std::string((r.flags & es::FLAG_DONE) ? "true" : "false");
+    o += ",\"needs_cloud\":" + std::string((r.flags & es::FLAG_NEEDS_CLOUD) ? "true" : "false");
+    o += ",\"uploaded\":" + std::string((r.flags & es::FLAG_UPLOADED) ? "true" : "false");
+    o += ",\"has_incident\":" + std::string(r.incident_len ? "true" : "false");
+    o += ",\"has_result\":" + std::string(r.result_len ? "true" : "false");
+    o += ",\"blob_dir\":\"" + json_escape(s->blob_dir(r.event_id)) + "\"";
+    o += ",\"blobs\":[";
+    bool first = true;
+    for (int i = 0; i < es::kBlobCount; i++) {
+        if (!(r.blobs & (1u << i))) continue;
+        o += first ? "\"" : ",\"";
+        o += es::kBlobNames[i];
+        o += "\"";
+        first = false;
+    }
+    o += "]";
+    if (wal_fd >= 0) {
+        std::string doc;
+        o += ",\"incident\":" + (es::EventStore::read_doc(wal_fd, r.incident_off, r.incident_len, &doc)
+                                      ? doc : std::string("null"));
+        o += ",\"result\":" + (es::EventStore::read_doc(wal_fd, r.result_off, r.result_len, &doc)
+                                    ? doc : std::string("null"));
+    }
+    o += "}";
+    return o;
+}
+
+static char *dup_c(const std::string &s) {
+    char *p = (char *)std::malloc(s.size() + 1);
+    if (p) std::memcpy(p, s.c_str(), s.size() + 1);
+    return p;
+}
+
+static char *list_json(es::EventStore *s, const std::vector<es::IndexRec> &v) {
+    std::string o = "{\"count\":" + std::to_string(v.size()) + ",\"events\":[";
+    for (size_t i = 0; i < v.size(); i++) {
+        if (i) o += ",";
+        o += rec_json(s, v[i], -1);
+    }
+    o += "]}";
+    return dup_c(o);
+}
+
+extern "C" {
+
+void *es_open(const char *dir, int read_only) {
+    auto *s = new es::EventStore();
+    std::string err;
+    if (!s->open(dir ? dir : "", read_only != 0, &err)) {
+        std::cerr << "[STORE] " << err << "\n";
+        delete s;
+        return nullptr;
+    }
+    return s;
+}
+
+void es_close(void *h) { delete (es::EventStore *)h; }
+
+void es_free(char *p) { std::free(p); }
+
+int es_put_doc(void *h, const char *event_id, const char *name, const char *json, size_t len, int64_t ts_ms) {
+    uint64_t id;
+    if (!h || !name || !json || !parse_event_id(event_id, &id)) return -1;
+    return ((es::EventStore *)h)->put_doc(id, name, std::string(json, len), ts_ms) ? 0 : -1;
+}
+
+int es_set_flags(void *h, const char *event_id, uint32_t set, uint32_t clear, int64_t ts_ms) {
+    uint64_t id;
+    if (!h || !parse_event_id(event_id, &id)) return -1;
+    return ((es::EventStore *)h)->set_flags(id, set, clear, ts_ms) ? 0 : -1;
+}
+
+int es_put_blob(void *h, const char *event_id, const char *name, int64_t ts_ms) {
+    uint64_t id;
+    if (!h || !name || !parse_event_id(event_id, &id)) return -1;
+    return ((es::EventStore *)h)->put_blob(id, name, ts_ms) ? 0 : -1;
+}
+
+int es_remove(void *h, const char *event_id, int64_t ts_ms) {
+    uint64_t id;
+    if (!h || !parse_event_id(event_id, &id)) return -1;
+    return ((es::EventStore *)h)->remove(id, ts_ms) ? 0 : -1;
+}
+
+int es_checkpoint(void *h) {
+    return (h && ((es::EventStore *)h)->checkpoint()) ? 0 : -1;
+}
+
+// Creates and returns blobs/<id>/ so callers can write e.g. clip.mp4 in place.
+char *es_blob_dir(void *h, const char *event_id) {
+    uint64_t id;
+    if (!h || !parse_event_id(event_id, &id)) return nullptr;
+    std::string d = ((es::EventStore *)h)->blob_dir(id);
+    mkdir(d.c_str(), 0755);
+    return dup_c(d);
+}
+
+char *es_get(void *h, const char *event_id) {
+    uint64_t id;
+    es::IndexRec r;
+    if (!h || !parse_event_id(event_id, &id)) return nullptr;
+    auto *s = (es::EventStore *)h;
+    int wal_fd = -1;
+    if (!s->get(id, &r, &wal_fd)) return nullptr;
+    char *out = dup_c(rec_json(s, r, wal_fd));
+    ::close(wal_fd);
+    return out;
+}
+
+char *es_list(void *h, uint64_t lo, uint64_t hi, uint32_t need, uint32_t skip, int limit, int newest_first) {
+    if (!h) return nullptr;
+    auto *s = (es::EventStore *)h;
+    return list_json(s, s->list(lo, hi, need, skip, (size_t)std::max(0, limit), newest_first != 0));
+}
+
+char *es_list_prefix(void *h, const char *prefix, int limit, int newest_first) {
+    if (!h) return nullptr;
+    auto *s = (es::EventStore *)h;
+    return list_json(s, s->list_prefix(prefix ? prefix : "", (size_t)std::max(0, limit), newest_first != 0));
+}
+
+}  // extern "C"
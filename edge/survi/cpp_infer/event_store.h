@@ -0,0 +1,141 @@
+// ~/ArduinoApps/survillance/cpp_infer/event_store.h
+// Append-only event store that replaces the per-event directory + marker
+// file layout under events/final/.
+//
+// Layout of <dir>:
+//   events.wal     write-ahead log of state transitions (docs, flags, blobs)
+//   events.idx     sorted snapshot of the latest state per event, mmap'd
+//   blobs/<id>/    large payloads (clip.mp4, snapshots), written in place
+//
+// Event ids are the millisecond start timestamps main.py already uses, so the
+// id order is the time order and one sorted index serves both point lookups
+// and time-range listings in O(log n). Records appended since the last
+// snapshot live in a small in-memory overlay that is folded into a new
+// snapshot every kCheckpointEvery events.
+//
+// Superseded docs and removed events stay in the WAL until a checkpoint finds
+// it over kCompactMinBytes and mostly dead: it is then rewritten with only the
+// live events' latest records (first record: a generation number), renamed
+// over events.wal, and the index is written for the new generation. An index
+// whose generation does not match the WAL's (a crash between the two renames)
+// is ignored and the compact WAL replayed instead. Other processes notice
+// the new inode on their next call and start over from it.
+//
+// Several processes share the store (main.py, the uploader, the media
+// server). Appends take an flock() on events.lock and go out as a single
+// O_APPEND write; readers pick up other processes' records on every call by
+// replaying the WAL tail past the offset they have seen.
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace es {
+
+// Per-event state flags (the old marker files).
+enum : uint32_t {
+    FLAG_DONE        = 1u << 0,   // DONE        analysis finished, uploader may ingest
+    FLAG_NEEDS_CLOUD = 1u << 1,   // NEEDS_CLOUD local result incomplete
+    FLAG_UPLOADED    = 1u << 2,   // SUPABASE_DONE
+    FLAG_DELETED     = 1u << 31,  // tombstone
+};
+
+// Blobs we know about, tracked as a bitmask in the index.
+enum : uint32_t {
+    BLOB_CLIP          = 1u << 0,  // clip.mp4
+    BLOB_SNAPSHOT_JPG  = 1u << 1,
+    BLOB_SNAPSHOT_PNG  = 1u << 2,
+    BLOB_THUMBNAIL_JPG = 1u << 3,
+    BLOB_THUMBNAIL_PNG = 1u << 4,
+};
+
+uint32_t blob_bit(const std::string &name);  // 0 for unknown names
+
+// One fixed-size record per event in events.idx (and in the overlay).
+struct IndexRec {
+    uint64_t event_id;
+    int64_t created_ms;
+    int64_t updated_ms;
+    uint32_t flags;
+    uint32_t blobs;
+    uint64_t incident_off;  // WAL offset of the latest incident doc body
+    uint64_t result_off;    // WAL offset of the latest result doc body
+    uint32_t incident_len;
+    uint32_t result_len;
+};
+
+class EventStore {
+public:
+    static constexpr size_t kCheckpointEvery = 256;
+    static constexpr uint64_t kCompactMinBytes = 8ull << 20;
+
+    EventStore() = default;
+    ~EventStore();
+    EventStore(const EventStore &) = delete;
+    EventStore &operator=(const EventStore &) = delete;
+
+    // read_only: never appends or checkpoints (media server).
+    bool open(const std::string &dir, bool read_only, std::string *err);
+    void close();
+
+    const std::string &dir() const { return dir_; }
+    int wal_fd() const { return wal_fd_; }
+
+    // Writers. `name` is "incident" or "result".
+    bool put_doc(uint64_t event_id, const std::string &name, const std::string &json, int64_t ts_ms);
+    bool set_flags(uint64_t event_id, uint32_t set, uint32_t clear, int64_t ts_ms);
+    bool put_blob(uint64_t event_id, const std::string &name, int64_t ts_ms);
+    bool remove(uint64_t event_id, int64_t ts_ms);
+    bool checkpoint();
+
+    // Readers. wal_fd: a dup() of the WAL that out's doc offsets point into
+    // (the caller closes it), so a compaction in between cannot move them.
+    bool get(uint64_t event_id, IndexRec *out, int *wal_fd = nullptr);
+    static bool read_doc(int wal_fd, uint64_t off, uint32_t len, std::string *out);
+    // Events with lo <= id <= hi, flags & need == need, flags & skip == 0.
+    std::vector<IndexRec> list(uint64_t lo, uint64_t hi, uint32_t need, uint32_t skip,
+                               size_t limit, bool newest_first);
+    // Events whose decimal id starts with `prefix`.
+    std::vector<IndexRec> list_prefix(const std::string &prefix, size_t limit, bool newest_first);
+
+    std::string blob_dir(uint64_t event_id) const;
+    std::string blob_path(uint64_t event_id, const std::string &name) const;
+
+private:
+    bool append(uint8_t type, uint64_t event_id, int64_t ts_ms, const std::string &payload);
+    bool open_wal_locked();
+    bool refresh_locked();
+    bool map_index_locked();
+    void apply_locked(uint8_t type, uint64_t event_id, int64_t ts_ms, uint64_t payload_off,
+                      const std::string &payload);
+    const IndexRec *snapshot_find(uint64_t event_id) const;
+    bool checkpoint_locked();
+    bool compact_locked(std::vector<IndexRec> *live);
+
+    std::string dir_;
+    bool read_only_ = false;
+    int wal_fd_ = -1;
+    int lock_fd_ = -1;
+    ino_t wal_ino_ = 0;
+    uint64_t wal_gen_ = 0;  // 0: never compacted
+
+    // mmap'd events.idx
+    void *idx_map_ = nullptr;
+    size_t idx_size_ = 0;
+    const IndexRec *snap_ = nullptr;
+    size_t snap_count_ = 0;
+    ino_t idx_ino_ = 0;
+    int64_t idx_mtime_ns_ = 0;
+
+    uint64_t replayed_off_ = 0;             // WAL bytes applied so far
+    std::map<uint64_t, IndexRec> overlay_;  // changes since the snapshot
+
+    std::mutex mu_;
+};
+
+}  // namespace es
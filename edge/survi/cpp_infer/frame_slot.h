@@ -0,0 +1,99 @@
+// ~/ArduinoApps/survillance/cpp_infer/frame_slot.h
+// Lock-free single-producer / multi-consumer "latest frame" slot.
+//
+// The producer (one thread) publishes encoded frames; any number of consumers
+// pin the newest one, read it in place for as long as their socket needs, and
+// release it. Nobody ever waits:
+//   - the producer writes into a slot that is neither the latest nor pinned,
+//     and drops the frame if every slot is busy;
+//   - a consumer that is still sending an old frame simply skips whatever was
+//     published meanwhile (slow viewers drop frames, they never queue them).
+//
+// Each slot has one atomic word: bit 31 = producer is writing, low bits =
+// number of consumers pinning it. The producer claims a slot with
+// CAS(0 -> WRITER); consumers pin with fetch_add and back off if WRITER is set.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class FrameSlots {
+public:
+    static constexpr int kSlots = 8;
+
+    struct Frame {
+        std::vector<uint8_t> data;
+        int64_t ts_us = 0;
+        uint64_t seq = 0;
+    };
+
+    // Producer side. Returns false when the frame was dropped because every
+    // slot is pinned by slow consumers.
+    bool publish(const uint8_t *data, size_t n, int64_t ts_us) {
+        const int cur = latest_.load(std::memory_order_acquire);
+        for (int k = 1; k <= kSlots; k++) {
+            const int i = (cur < 0 ? k - 1 : (cur + k) % kSlots);
+            if (i == cur) continue;
+            uint32_t expected = 0;
+            if (!state_[i].compare_exchange_strong(expected, kWriter, std::memory_order_acquire,
+                                                   std::memory_order_relaxed)) {
+                continue;
+            }
+            Frame &f = frames_[i];
+            f.data.resize(n);
+            if (n) std::memcpy(f.data.data(), data, n);
+            f.ts_us = ts_us;
+            f.seq = ++seq_;
+            // Clear only the writer bit: a consumer that pinned this slot
+            // through a stale latest_ meanwhile backs off with its own
+            // fetch_sub, so its count must survive.
+            state_[i].fetch_sub(kWriter, std::memory_order_release);
+            latest_.store(i, std::memory_order_release);
+            return true;
+        }
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Consumer side. Pins the newest frame if its seq is greater than
+    // `after_seq` and returns its slot index, else returns -1.
+    // Every successful acquire must be paired with release().
+    int acquire_latest(uint64_t after_seq) {
+        for (int attempt = 0; attempt < 4; attempt++) {
+            const int i = latest_.load(std::memory_order_acquire);
+            if (i < 0) return -1;
+            const uint32_t s = state_[i].fetch_add(1, std::memory_order_acquire);
+            if (s & kWriter) {
+                // Recycled between our load and the pin; look again.
+                state_[i].fetch_sub(1, std::memory_order_release);
+                continue;
+            }
+            if (frames_[i].seq <= after_seq) {
+                state_[i].fetch_sub(1, std::memory_order_release);
+                return -1;
+            }
+            return i;
+        }
+        return -1;
+    }
+
+    void release(int i) {
+        if (i >= 0) state_[i].fetch_sub(1, std::memory_order_release);
+    }
+
+    // Only valid between acquire_latest() and release().
+    const Frame &frame(int i) const { return frames_[i]; }
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint32_t kWriter = 1u << 31;
+
+    Frame frames_[kSlots];
+    std::atomic<uint32_t> state_[kSlots] = {};
+    std::atomic<int> latest_{-1};
+    uint64_t seq_ = 0;  // producer-only
+    std::atomic<uint64_t> dropped_{0};
+};
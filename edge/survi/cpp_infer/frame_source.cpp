@@ -0,0 +1,50 @@
+// ~/ArduinoApps/survillance/cpp_infer/frame_source.cpp
+// Backend selection; the backends are decode_libav.cpp and decode_cv.cpp.
+
+#include "frame_source.h"
+
+namespace dec {
+
+bool parse_decoder(const std::string &s, Decoder *out) {
+    if (s == "auto") *out = Decoder::Auto;
+    else if (s == "libav") *out = Decoder::Libav;
+    else if (s == "opencv") *out = Decoder::OpenCV;
+    else return false;
+    return true;
+}
+
+bool parse_fidelity(const std::string &s, Fidelity *out) {
+    if (s == "full") *out = Fidelity::Full;
+    else if (s == "fast") *out = Fidelity::Fast;
+    else return false;
+    return true;
+}
+
+const char *fidelity_name(Fidelity f) {
+    return f == Fidelity::Fast ? "fast" : "full";
+}
+
+std::unique_ptr<FrameSource> open_source(const std::string &path, const SourceOptions &opt,
+                                         std::string *err) {
+#ifdef SURVI_HAVE_LIBAV
+    if (opt.decoder != Decoder::OpenCV) {
+        auto src = open_libav(path, opt, err);
+#ifdef SURVI_HAVE_OPENCV_DECODE
+        // Auto falls back for anything libav will not open
+        if (!src && opt.decoder == Decoder::Auto) return open_opencv(path, opt, err);
+#endif
+        return src;
+    }
+#endif
+#ifdef SURVI_HAVE_OPENCV_DECODE
+    if (opt.decoder != Decoder::Libav) return open_opencv(path, opt, err);
+#endif
+#if !defined(SURVI_HAVE_LIBAV) && !defined(SURVI_HAVE_OPENCV_DECODE)
+    (void)path;
+    (void)opt;
+#endif
+    if (err) *err = "decoder not built in";
+    return nullptr;
+}
+
+}  // namespace dec
@@ -0,0 +1,93 @@
+// ~/ArduinoApps/survillance/cpp_infer/frame_source.h
+// Decoded frames for the engine, behind one interface with two backends:
+//   - libav (libavformat + libavcodec + libswscale, SURVI_HAVE_LIBAV): the
+//     decoder's thread count and type are set explicitly, frames stay in the
+//     codec's native pixel format (yuv420p for our mp4v clips) and only the
+//     model's view of them is converted, straight to WxH RGB in one swscale
+//     pass; clips preloaded into an io::ClipBuffer are demuxed from memory
+//     through a custom AVIOContext.
+//   - OpenCV cv::VideoCapture (SURVI_HAVE_OPENCV_DECODE), the fallback:
+//     every frame is converted to full-size BGR first.
+//
+// Fidelity::Fast is the inference profile: frames only ever feed a small
+// classifier input, so the libav decoder may cut corners (see
+// decode_libav.cpp). The OpenCV backend always decodes in full.
+//
+// Frames are addressed by sample number. With an Mp4Index, a target outside
+// the GOP being decoded seeks to its keyframe; without one, frames are
+// decoded sequentially and counted.
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "io_engine.h"
+#include "mp4_index.h"
+
+namespace dec {
+
+enum class Decoder { Auto, Libav, OpenCV };
+enum class Fidelity { Full, Fast };
+
+// "auto" | "libav" | "opencv"; false for anything else.
+bool parse_decoder(const std::string &s, Decoder *out);
+// "full" | "fast"; false for anything else.
+bool parse_fidelity(const std::string &s, Fidelity *out);
+const char *fidelity_name(Fidelity f);
+
+// Rectangle of the current frame in source pixels.
+struct Region {
+    int x = 0, y = 0, w = 0, h = 0;
+};
+
+struct SourceOptions {
+    Decoder decoder = Decoder::Auto;  // Auto: libav when built in, else OpenCV
+    int threads = 0;                  // decoder threads (libav); 0: one per core
+    const Mp4Index *index = nullptr;  // optional, must outlive the source
+    io::ClipBuffer *memory = nullptr; // libav: demux this instead of the file
+    Fidelity fidelity = Fidelity::Full;
+    // Fast: smallest frame side the consumer needs (model input x tiles);
+    // bounds how far lowres may shrink the decoded picture.
+    int min_side = 0;
+};
+
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    virtual const char *name() const = 0;
+
+    // Frame count from the container (an estimate for some files; the
+    // engine prefers Mp4Index::sample_count()). 0 when unknown.
+    virtual int frame_count() const = 0;
+
+    // Every frame read() will be asked for, before the first read(); lets
+    // the decoder drop work on the others (Fidelity::Fast).
+    virtual void plan(const std::vector<int> &targets) { (void)targets; }
+
+    // Decodes frame `fi` and makes it current. Call with increasing targets
+    // for cheap forward decoding; going back costs a seek.
+    virtual bool read(int fi) = 0;
+
+    // Size of the current frame.
+    virtual int width() const = 0;
+    virtual int height() const = 0;
+
+    // `r` of the current frame scaled to W x H, written as packed RGB24 to
+    // out (W * H * 3 bytes).
+    virtual bool rgb(const Region &r, int W, int H, uint8_t *out) = 0;
+};
+
+std::unique_ptr<FrameSource> open_source(const std::string &path, const SourceOptions &opt,
+                                         std::string *err);
+
+#ifdef SURVI_HAVE_LIBAV
+std::unique_ptr<FrameSource> open_libav(const std::string &path, const SourceOptions &opt, std::string *err);
+#endif
+#ifdef SURVI_HAVE_OPENCV_DECODE
+std::unique_ptr<FrameSource> open_opencv(const std::string &path, const SourceOptions &opt, std::string *err);
+#endif
+
+}  // namespace dec
@@ -1,102 +1,162 @@
 // ~/ArduinoApps/survillance/cpp_infer/infer_mp4.cpp
-// Full updated file: FIT_SHORTEST + center crop + BGR->RGB (matches model_metadata.h)
-
-#include <opencv2/opencv.hpp>
+// CLI over engine.cpp: analyse one clip, write the result JSON.
+//
+// --stream / --stream_socket PATH: also emit one JSON line per frame as soon
+// as it is classified, then a summary line once the result file is written
+// (engine::frame_json / summary_json), so the caller can route the event on
+// the first confident frame instead of waiting for the whole clip.
+//
+// --repeat_cache FILE --repeat_cooldown S: a repeat trigger on the same
+// camera inherits the previous result after --repeat_confirm matching frames
+// (repeat_cache.h); FILE carries the camera's recent results between runs.
+//
+// --thermal_budget: fewer frames / tiles and the fast decode profile while the
+// SoC is hot or its clock is capped (thermal.h); "thermal" in the result.
+//
+// --model FILE: run a .tflite model file (mmap'd, model_file.h) instead of the
+// compiled-in one; it must have the compiled model's input and output tensors.
+//
+// --memory_budget_mb N: keep the clip under a memory budget on low-RAM boards
+// by degrading preload / decoder threads / fidelity / tiles / frames instead
+// of failing (memory_budget.h); "memory" in the result has the peak RSS and
+// per-pool high-water marks.
+//
+// --batch manifest.jsonl --jobs N: re-analyse every clip of the manifest in
+// this one process on N workers (batch.h), resumable, instead of one run per
+// clip; the analysis flags apply to every clip.
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cerrno>
 #include <chrono>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <fstream>
 #include <iostream>
-#include <sstream>
+#include <memory>
 #include <string>
-#include <vector>
 
-// Edge Impulse
-#include "../ei/edge-impulse-sdk/classifier/ei_run_classifier.h"
-#include "../ei/model-parameters/model_metadata.h"
-#include "../ei/model-parameters/model_variables.h"
+#include "batch.h"
+#include "det_store.h"
+#include "engine.h"
+#include "io_engine.h"
+#include "model_file.h"
+#include "repeat_cache.h"
 
 // -------------------------
 // Small helpers
 // -------------------------
-static bool write_file(const std::string &path, const std::string &body) {
-    std::ofstream f(path, std::ios::binary);
-    if (!f.is_open()) return false;
-    f.write(body.data(), (std::streamsize)body.size());
-    return true;
+static void usage(const char *argv0) {
+    std::cerr
+        << "Usage:\n"
+        << "  " << argv0 << " --event_id <id> --mp4 <path> --out <path> [--frames N] [--threshold T]\n"
+        << "        [--sampling even|keyframe] [--tiles N] [--decoder auto|libav|opencv] [--decode_threads N]\n"
+        << "        [--fidelity full|fast] [--stream | --stream_socket <path>]\n"
+        << "        [--io auto|uring|threads] [--preload] [--det_store <dir> [--camera <id>]]\n"
+        << "        [--mask x0,y0,x1,y1]...   (normalised; detections centred inside are ignored)\n"
+        << "        [--repeat_cache <file> --repeat_cooldown S [--repeat_confirm N]]   (per camera)\n"
+        << "        [--model <file.tflite>]   (instead of the compiled-in model)\n"
+        << "        [--thermal_budget [--thermal_warm_c C] [--thermal_hot_c C]]   (default 70 / 80)\n"
+        << "        [--memory_budget_mb N [--max_detections N]]   (default cap 512 detections per clip)\n"
+        << "  " << argv0 << " --batch manifest.jsonl [--jobs N] [--out_name NAME | --combined out.jsonl]\n"
+        << "        [analysis flags as above, for every clip; no --stream / --repeat_cache / --det_store / --thermal_budget]\n"
+        << "\n"
+        << "Example:\n"
+        << "  " << argv0 << " --event_id 1772321990476 --mp4 clip.mp4 --out out.json --frames 8 --threshold 0.2\n"
+        << "  " << argv0 << " --batch reanalyse.jsonl --jobs 4 --combined reanalysed.jsonl\n";
 }
 
-static std::string json_escape(const std::string &s) {
-    std::ostringstream o;
-    for (char c : s) {
-        switch (c) {
-            case '\\': o << "\\\\"; break;
-            case '"':  o << "\\\""; break;
-            case '\b': o << "\\b";  break;
-            case '\f': o << "\\f";  break;
-            case '\n': o << "\\n";  break;
-            case '\r': o << "\\r";  break;
-            case '\t': o << "\\t";  break;
-            default:
-                if ((unsigned char)c < 0x20) {
-                    o << "\\u" << std::hex << std::uppercase << (int)c;
-                } else {
-                    o << c;
-                }
-        }
+static void record_detections(const std::string &dir, const std::string &camera,
+                              const engine::Options &opt, const engine::Result &res) {
+    ds::DetStore store;
+    std::string err;
+    if (!store.open(dir, &err)) {
+        std::cerr << "[DETSTORE] " << err << "\n";
+        return;
+    }
+    if (!engine::record_detections(&store, camera, opt, res)) {
+        std::cerr << "[DETSTORE] flush failed in " << dir << "\n";
     }
-    return o.str();
-}
-
-static bool starts_with(const std::string &s, const std::string &p) {
-    return s.size() >= p.size() && s.compare(0, p.size(), p) == 0;
 }
 
-static cv::Mat resize_fit_shortest_center_crop_rgb(const cv::Mat& bgr, int W, int H) {
-    // Matches EI_CLASSIFIER_RESIZE_FIT_SHORTEST:
-    // 1) aspect-preserving resize so both dims >= target
-    // 2) center crop to WxH
-    // 3) BGR -> RGB
-    const int src_w = bgr.cols;
-    const int src_h = bgr.rows;
+// JSON-lines sink for --stream: stdout or a connected unix socket. A reader
+// that goes away only ends the stream; the analysis and result file go on.
+class StreamOut {
+public:
+    ~StreamOut() {
+        if (fd_ > 2) ::close(fd_);
+    }
 
-    const float scale = std::max((float)W / (float)src_w, (float)H / (float)src_h);
-    const int new_w = (int)std::round(src_w * scale);
-    const int new_h = (int)std::round(src_h * scale);
+    bool open_stdout() {
+        fd_ = 1;
+        return true;
+    }
 
-    cv::Mat resized;
-    cv::resize(bgr, resized, cv::Size(new_w, new_h), 0, 0, cv::INTER_AREA);
+    bool open_socket(const std::string &path) {
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd_ < 0) return false;
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        int rc = -1;
+        if (path.size() < sizeof(addr.sun_path)) {
+            std::memcpy(addr.sun_path, path.c_str(), path.size());
+            rc = ::connect(fd_, (sockaddr *)&addr, sizeof(addr));
+        } else {
+            errno = ENAMETOOLONG;
+        }
+        if (rc != 0) {
+            const int e = errno;  // the caller reports it
+            ::close(fd_);
+            fd_ = -1;
+            errno = e;
+            return false;
+        }
+        return true;
+    }
 
-    const int x0 = std::max(0, (new_w - W) / 2);
-    const int y0 = std::max(0, (new_h - H) / 2);
-    cv::Rect roi(x0, y0, W, H);
-    cv::Mat cropped = resized(roi).clone();
+    void line(const std::string &json) {
+        if (fd_ < 0) return;
+        const std::string msg = json + "\n";
+        size_t off = 0;
+        while (off < msg.size()) {
+            const ssize_t w = fd_ == 1 ? ::write(fd_, msg.data() + off, msg.size() - off)
+                                       : ::send(fd_, msg.data() + off, msg.size() - off, MSG_NOSIGNAL);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) {
+                if (fd_ > 2) ::close(fd_);
+                fd_ = -1;
+                return;
+            }
+            off += (size_t)w;
+        }
+    }
 
-    cv::Mat rgb;
-    cv::cvtColor(cropped, rgb, cv::COLOR_BGR2RGB);
-    return rgb;
-}
+    bool active() const { return fd_ >= 0; }
 
-static void usage(const char *argv0) {
-    std::cerr
-        << "Usage:\n"
-        << "  " << argv0 << " --event_id <id> --mp4 <path> --out <path> [--frames N] [--threshold T]\n"
-        << "\n"
-        << "Example:\n"
-        << "  " << argv0 << " --event_id 1772321990476 --mp4 clip.mp4 --out out.json --frames 8 --threshold 0.2\n";
-}
+private:
+    int fd_ = -1;
+};
 
 // -------------------------
 // Main
 // -------------------------
 int main(int argc, char **argv) {
-    std::string event_id;
-    std::string mp4_path;
+    engine::Options opt;
     std::string out_path;
-    int frames = 5;
-    float threshold = 0.50f;
+    std::string det_store_dir, camera = "cam0";
+    io::Backend io_backend = io::Backend::Auto;
+    bool stream = false;
+    std::string stream_socket;
+    std::string repeat_path;
+    std::string model_path;
+    bool thermal_budget = false;
+    engine::ThermalConfig thermal_cfg;
+    engine::MemoryConfig memory_cfg;
+    batch::Config batch_cfg;
 
     for (int i = 1; i < argc; i++) {
         std::string a = argv[i];
@@ -108,11 +168,65 @@ int main(int argc, char **argv) {
             }
         };
 
-        if (a == "--event_id") { need("--event_id"); event_id = argv[++i]; }
-        else if (a == "--mp4") { need("--mp4"); mp4_path = argv[++i]; }
+        if (a == "--event_id") { need("--event_id"); opt.event_id = argv[++i]; }
+        else if (a == "--mp4") { need("--mp4"); opt.mp4_path = argv[++i]; }
         else if (a == "--out") { need("--out"); out_path = argv[++i]; }
-        else if (a == "--frames") { need("--frames"); frames = std::max(1, std::atoi(argv[++i])); }
-        else if (a == "--threshold") { need("--threshold"); threshold = std::stof(argv[++i]); }
+        else if (a == "--frames") { need("--frames"); opt.frames = std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--threshold") { need("--threshold"); opt.threshold = std::stof(argv[++i]); }
+        else if (a == "--sampling") {
+            need("--sampling");
+            if (!engine::parse_sampling(argv[++i], &opt.sampling)) {
+                std::cerr << "Bad --sampling: " << argv[i] << "\n";
+                return 2;
+            }
+        }
+        else if (a == "--tiles") { need("--tiles"); opt.tiles = std::max(1, std::min(4, std::atoi(argv[++i]))); }
+        else if (a == "--decoder") {
+            need("--decoder");
+            if (!dec::parse_decoder(argv[++i], &opt.decoder)) {
+                std::cerr << "Bad --decoder: " << argv[i] << "\n";
+                return 2;
+            }
+        }
+        else if (a == "--fidelity") {
+            need("--fidelity");
+            if (!dec::parse_fidelity(argv[++i], &opt.fidelity)) {
+                std::cerr << "Bad --fidelity: " << argv[i] << "\n";
+                return 2;
+            }
+        }
+        else if (a == "--decode_threads") { need("--decode_threads"); opt.decode_threads = std::max(0, std::atoi(argv[++i])); }
+        else if (a == "--stream") { stream = true; }
+        else if (a == "--stream_socket") { need("--stream_socket"); stream_socket = argv[++i]; }
+        else if (a == "--io") { need("--io"); io_backend = io::parse_backend(argv[++i]); }
+        else if (a == "--preload") { opt.preload = true; }
+        else if (a == "--det_store") { need("--det_store"); det_store_dir = argv[++i]; }
+        else if (a == "--camera") { need("--camera"); camera = argv[++i]; }
+        else if (a == "--repeat_cache") { need("--repeat_cache"); repeat_path = argv[++i]; }
+        else if (a == "--repeat_cooldown") {
+            need("--repeat_cooldown");
+            opt.repeat_cooldown_ms = (int)std::max(0.0, std::atof(argv[++i]) * 1000.0);
+        }
+        else if (a == "--repeat_confirm") { need("--repeat_confirm"); opt.repeat_confirm = std::max(1, std::min(2, std::atoi(argv[++i]))); }
+        else if (a == "--model") { need("--model"); model_path = argv[++i]; }
+        else if (a == "--thermal_budget") { thermal_budget = true; }
+        else if (a == "--thermal_warm_c") { need("--thermal_warm_c"); thermal_cfg.warm_c = std::stof(argv[++i]); }
+        else if (a == "--thermal_hot_c") { need("--thermal_hot_c"); thermal_cfg.hot_c = std::stof(argv[++i]); }
+        else if (a == "--memory_budget_mb") { need("--memory_budget_mb"); memory_cfg.limit_mb = std::max(0, std::atoi(argv[++i])); }
+        else if (a == "--max_detections") { need("--max_detections"); memory_cfg.max_detections = std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--batch") { need("--batch"); batch_cfg.manifest = argv[++i]; }
+        else if (a == "--jobs") { need("--jobs"); batch_cfg.jobs = std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--out_name") { need("--out_name"); batch_cfg.out_name = argv[++i]; }
+        else if (a == "--combined") { need("--combined"); batch_cfg.combined = argv[++i]; }
+        else if (a == "--mask") {
+            need("--mask");
+            engine::Zone z;
+            if (!engine::parse_zone(argv[++i], &z)) {
+                std::cerr << "Bad --mask: " << argv[i] << "\n";
+                return 2;
+            }
+            opt.masks.push_back(z);
+        }
         else if (a == "--help" || a == "-h") { usage(argv[0]); return 0; }
         else {
             std::cerr << "Unknown arg: " << a << "\n";
@@ -121,162 +235,85 @@ int main(int argc, char **argv) {
         }
     }
 
-    if (event_id.empty() || mp4_path.empty() || out_path.empty()) {
+    const bool batch_mode = !batch_cfg.manifest.empty();
+    if (batch_mode ? (stream || !stream_socket.empty() || !repeat_path.empty() || !det_store_dir.empty() || thermal_budget)
+                   : (opt.event_id.empty() || opt.mp4_path.empty() || out_path.empty())) {
         usage(argv[0]);
         return 2;
     }
 
-    auto t0 = std::chrono::steady_clock::now();
-
-    cv::VideoCapture cap(mp4_path);
-    if (!cap.isOpened()) {
-        std::string body = "{\n"
-            "  \"event_id\": \"" + json_escape(event_id) + "\",\n"
-            "  \"model\": \"edgeimpulse_fomo_local\",\n"
-            "  \"status\": \"error\",\n"
-            "  \"error\": \"failed to open mp4\"\n"
-            "}\n";
-        write_file(out_path, body);
-        return 1;
-    }
-
-    int total_frames = (int)cap.get(cv::CAP_PROP_FRAME_COUNT);
-    if (total_frames <= 0) total_frames = 1;
-
-    // Choose frame indices (evenly spaced)
-    std::vector<int> idxs;
-    idxs.reserve(frames);
-    if (frames == 1) {
-        idxs.push_back(total_frames / 2);
-    } else {
-        for (int k = 0; k < frames; k++) {
-            int fi = (int)std::round((double)k * (double)(total_frames - 1) / (double)(frames - 1));
-            fi = std::max(0, std::min(total_frames - 1, fi));
-            idxs.push_back(fi);
-        }
-    }
-
-    // Aggregate results
-    int people = 0;
-    int cars = 0;
-    int analyzed = 0;
-
-    struct Det {
-        std::string label;
-        float conf;
-        uint32_t x, y, w, h;
-        int frame_idx;
-    };
-    std::vector<Det> dets;
-    dets.reserve(64);
-
-    // EI expects 160x160 and resize mode FIT_SHORTEST
-    const int W = EI_CLASSIFIER_INPUT_WIDTH;   // 160
-    const int H = EI_CLASSIFIER_INPUT_HEIGHT;  // 160
-    const int C = 3;
-
-    std::vector<uint8_t> rgb_u8(W * H * C);
-
-    for (int fi : idxs) {
-        cap.set(cv::CAP_PROP_POS_FRAMES, fi);
-
-        cv::Mat frame;
-        if (!cap.read(frame) || frame.empty()) continue;
-
-        // ✅ Correct preprocessing: FIT_SHORTEST + center crop + RGB
-        cv::Mat rgb = resize_fit_shortest_center_crop_rgb(frame, W, H);
-
-        // Copy to contiguous buffer
-        if (!rgb.isContinuous()) rgb = rgb.clone();
-        std::memcpy(rgb_u8.data(), rgb.data, rgb_u8.size());
-
-        // Prepare EI signal (float samples 0..255 are OK for EI image pipeline)
-        signal_t signal;
-        signal.total_length = rgb_u8.size();
-        signal.get_data = [&](size_t offset, size_t length, float *out_ptr) -> int {
-            if (offset + length > rgb_u8.size()) return -1;
-            for (size_t i = 0; i < length; i++) {
-                out_ptr[i] = (float)rgb_u8[offset + i];
-            }
-            return 0;
-        };
-
-        ei_impulse_result_t result = {0};
-        EI_IMPULSE_ERROR r = run_classifier(&signal, &result, false);
-        if (r != EI_IMPULSE_OK) {
-            std::string err = "run_classifier failed: " + std::to_string((int)r);
-            std::string body = "{\n"
-                "  \"event_id\": \"" + json_escape(event_id) + "\",\n"
-                "  \"model\": \"edgeimpulse_fomo_local\",\n"
-                "  \"status\": \"error\",\n"
-                "  \"error\": \"" + json_escape(err) + "\"\n"
-                "}\n";
-            write_file(out_path, body);
+    if (!model_path.empty()) {
+        std::string err;
+        auto model = engine::ModelFile::open(model_path, &err);
+        if (!model || !engine::use_model(model, &err)) {
+            std::cerr << "[MODEL] " << err << "\n";
             return 1;
         }
+    }
 
-        // Debug: is the model producing any boxes?
-        std::cerr << "DEBUG bounding_boxes_count=" << result.bounding_boxes_count << "\n";
-
-        analyzed++;
-
-        // Collect bounding boxes (FOMO outputs bounding_boxes)
-        for (uint32_t i = 0; i < result.bounding_boxes_count; i++) {
-            auto &bb = result.bounding_boxes[i];
-            if (!bb.label) continue;
-            if (bb.value < threshold) continue;
-
-            std::string lbl(bb.label);
-            if (lbl == "person") people++;
-            if (lbl == "car") cars++;
+    if (batch_mode) {
+        batch_cfg.io_backend = io_backend;
+        batch_cfg.memory = memory_cfg;
+        opt.camera = camera;
+        return batch::run(batch_cfg, opt);
+    }
 
-            dets.push_back(Det{
-                lbl,
-                bb.value,
-                bb.x, bb.y, bb.width, bb.height,
-                fi
-            });
+    StreamOut out;
+    if (!stream_socket.empty()) {
+        if (!out.open_socket(stream_socket)) {
+            std::cerr << "[STREAM] cannot connect to " << stream_socket << ": " << std::strerror(errno) << "\n";
         }
+    } else if (stream) {
+        ::signal(SIGPIPE, SIG_IGN);  // reader closed early: write() fails, we carry on
+        out.open_stdout();
+    }
+    engine::FrameCallback on_frame;
+    if (out.active()) on_frame = [&](const engine::FrameReport &f) { out.line(engine::frame_json(opt, f)); };
+
+    opt.camera = camera;
+    std::unique_ptr<engine::RepeatCache> repeat;
+    if (!repeat_path.empty() && opt.repeat_cooldown_ms > 0) {
+        repeat.reset(new engine::RepeatCache());
+        const int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::system_clock::now().time_since_epoch()).count();
+        std::string err;
+        if (!repeat->load(repeat_path, now_ms, opt.repeat_cooldown_ms, &err)) std::cerr << "[REPEAT] " << err << "\n";
     }
 
-    cap.release();
-
-    // Keep output small: top 25 by confidence
-    std::sort(dets.begin(), dets.end(), [](const Det& a, const Det& b) {
-        return a.conf > b.conf;
-    });
-    if (dets.size() > 25) dets.resize(25);
+    auto io = io::make_io_engine(io_backend);
 
-    auto t1 = std::chrono::steady_clock::now();
-    int latency_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
+    std::unique_ptr<engine::ThermalGovernor> thermal;
+    if (thermal_budget) thermal.reset(new engine::ThermalGovernor(thermal_cfg));
+    engine::MemoryGovernor memory(memory_cfg);
 
-    // Write JSON
-    std::string body;
-    body.reserve(4096);
-    body += "{\n";
-    body += "  \"event_id\": \"" + json_escape(event_id) + "\",\n";
-    body += "  \"model\": \"edgeimpulse_fomo_local\",\n";
-    body += "  \"frames_analyzed\": " + std::to_string(analyzed) + ",\n";
-    body += "  \"threshold\": " + std::to_string(threshold) + ",\n";
-    body += "  \"summary\": {\"people\": " + std::to_string(people) + ", \"cars\": " + std::to_string(cars) + "},\n";
-    body += "  \"detections\": [\n";
-    for (size_t i = 0; i < dets.size(); i++) {
-        const auto &d = dets[i];
-        body += "    {\"label\":\"" + json_escape(d.label) + "\",\"conf\":" + std::to_string(d.conf) +
-                ",\"bbox\":[" + std::to_string(d.x) + "," + std::to_string(d.y) + "," +
-                               std::to_string(d.w) + "," + std::to_string(d.h) + "]," +
-                "\"frame_idx\":" + std::to_string(d.frame_idx) + "}";
-        body += (i + 1 == dets.size()) ? "\n" : ",\n";
+    const engine::Result res = engine::analyze_clip(opt, io.get(), on_frame, repeat.get(), thermal.get(), &memory);
+    if (res.thermal.heat != engine::Heat::Cool) {
+        std::cerr << "[THERMAL] " << engine::heat_name(res.thermal.heat) << " (" << res.thermal.reason << "): frames "
+                  << res.thermal.frames_requested << "->" << res.thermal.frames << ", tiles "
+                  << res.thermal.tiles_requested << "->" << res.thermal.tiles << "\n";
+    }
+    if (!res.memory.reason.empty()) {
+        std::cerr << "[MEMORY] " << res.memory.reason << " (headroom " << res.memory.headroom_kb / 1024
+                  << " MB, clip needs ~" << res.memory.estimate_kb / 1024 << " MB)\n";
     }
-    body += "  ],\n";
-    body += "  \"latency_ms\": " + std::to_string(latency_ms) + ",\n";
-    body += "  \"status\": \"ok\"\n";
-    body += "}\n";
+    if (repeat) {
+        std::string err;
+        if (!repeat->save(repeat_path, &err)) std::cerr << "[REPEAT] " << err << "\n";
+    }
+    if (!res.inherited_from.empty()) {
+        std::cerr << "[REPEAT] inherited " << res.inherited_from << " after " << res.frames_analyzed << " frame(s)\n";
+    }
+    if (res.ok && !det_store_dir.empty()) record_detections(det_store_dir, camera, opt, res);
 
-    if (!write_file(out_path, body)) {
+    // tmp + fdatasync + rename: readers never see a half-written result
+    bool wrote = false;
+    io->write_atomic(out_path, engine::result_json(opt, res), [&](bool ok) { wrote = ok; });
+    io->drain();
+    out.line(engine::summary_json(opt, res, out_path, wrote));
+
+    if (!wrote) {
         std::fprintf(stderr, "Failed to write %s\n", out_path.c_str());
         return 1;
     }
-
-    return 0;
+    return res.ok ? 0 : 1;
 }
@@ -0,0 +1,620 @@
+// ~/ArduinoApps/survillance/cpp_infer/inferd.cpp
+// Inference daemon: one engine shared by every camera on the hub.
+//
+// Instead of one ei_infer_mp4 exec per event (model loaded per process,
+// runners fighting over cores), every camera's main.py sends its jobs here
+// over a unix socket. Jobs wait in per-camera queues (drr_queue.h) and one
+// worker runs them in deficit-round-robin order, so a camera with constant
+// motion cannot starve the others, and hub memory is one model + one tensor
+// arena no matter how many cameras are attached.
+//
+// Protocol: one JSON object per line in each direction.
+//   {"op":"analyze", "id":"..", "camera":"cam1", "event_id":"1772..",
+//    "mp4":"/path/clip.mp4", "out":"/path/result.json",
+//    "frames":5, "threshold":0.5, "sampling":"even", "tiles":1,
+//    "fidelity":"full", "stream":false,
+//    "masks":[[x0,y0,x1,y1],...],
+//    "repeat_cooldown_s":0, "repeat_confirm":2,
+//    "preload":false, "det_store":"/path/detections", "model":"/path/m.tflite",
+//    "thermal":false, "memory_budget_mb":0}
+//   -> {"id":"..", "status":"ok"|"error"|"busy", "out":"..", "queue_ms":N,
+//       "latency_ms":N, "inherited_from":"..", "error":".."}
+//   With "stream":true, {"id":..,"type":"frame",..} lines (engine::frame_json)
+//   come first, one per classified frame, then the reply above.
+//   {"op":"stats"} -> per-camera queued / served / rejected / deficit
+//   {"op":"ping"}  -> {"status":"ok"}
+//   {"op":"route", "id":"<event_id>", "brightness":0.4, "blur_var":80,
+//    "frames":5, "tiles":1, "clip_bytes":N, "net_ms":120, "cloud_ok":true,
+//    "cloud_ms":5000, "target_ms":30000}
+//   -> {"id":..,"status":"ok","route":"RUN_LOCAL"|"RUN_CLOUD"|"RECORD_ONLY",
+//       "reason":"..","p_complete":..,"samples":N,"meets_target":true,
+//       "predicted":{"local_ms":..,"local_cost_ms":..,"cloud_ms":..,"cloud_cost_ms":..}}
+//   {"op":"route_outcome", "id":"<event_id>", "route":"RUN_LOCAL",
+//    "complete":true, "actual_ms":N, "brightness":..,"blur_var":..}
+//   -> {"status":"ok", "record":{decision, prediction, actual}} (no record
+//      for an event that was not routed here)
+//   {"op":"upload", "bytes":N, "ms":N} -> {"status":"ok"}
+// "route" is the measured cost model (route_model.h): live classifier time
+// per cost unit and queued work, local COMPLETE rates per brightness / blur
+// bucket (from route_outcome) and upload time per MB (from upload).
+// Every setting travels with the job; the daemon has no per-camera config.
+// Its only per-camera state is the repeat cache (repeat_cache.h): with
+// "repeat_cooldown_s" a repeat trigger inherits the camera's last result.
+// "model" (a .tflite file, model_file.h; default the compiled-in model) is
+// switched between jobs: the file is mmap'd once and shared with every
+// runner using it, and replacing it on disk (write + rename) takes effect
+// at the next job naming it. A replacement that fails validation is logged
+// and the last good version stays in use.
+// "thermal" runs the job on the daemon's thermal budget (thermal.h): one
+// governor for the whole hub, so its hysteresis and classifier timing carry
+// over from job to job.
+// "memory_budget_mb" (> 0) keeps the job under that budget (memory_budget.h):
+// preload, decoder threads, fidelity, tiles and frames are scaled down
+// instead of the daemon being OOM-killed; "memory" in result.json and stats
+// has the peak RSS and per-pool high-water marks.
+// The reply for a job is sent once result.json is durable (same tmp +
+// fdatasync + rename as the runner), so the client can read it straight away.
+// A client that stops reading for 5 s is hung up on rather than holding up
+// everyone else's replies.
+// "busy" means the camera's queue is full: the client runs the job itself.
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "det_store.h"
+#include "drr_queue.h"
+#include "engine.h"
+#include "io_engine.h"
+#include "mini_json.h"
+#include "model_file.h"
+#include "repeat_cache.h"
+#include "route_model.h"
+
+using Clock = std::chrono::steady_clock;
+
+// -------------------------
+// Small helpers
+// -------------------------
+static void usage(const char *argv0) {
+    std::cerr
+        << "Usage:\n"
+        << "  " << argv0 << " [--socket PATH] [--quantum N] [--max_queue N] [--io auto|uring|threads]\n"
+        << "        [--thermal_warm_c C] [--thermal_hot_c C]\n"
+        << "\n"
+        << "  --socket     unix socket to listen on (default /tmp/survi_inferd.sock)\n"
+        << "  --quantum    DRR credit per camera per round, in classifier runs (frames x tiles^2, default 8)\n"
+        << "  --max_queue  jobs queued per camera before replying \"busy\" (default 8)\n"
+        << "  --thermal_warm_c / --thermal_hot_c  heat levels for \"thermal\" jobs (default 70 / 80)\n";
+}
+
+static double ms_between(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+// -------------------------
+// Connections
+// -------------------------
+static const int kSendTimeoutS = 5;  // SO_SNDTIMEO of a client socket
+
+// Shared by the reader thread and every job still in flight from it; the
+// socket closes when the last of them lets go.
+struct Conn {
+    int fd = -1;
+    std::mutex write_mu;
+    bool dead = false;  // a send failed or timed out; guarded by write_mu
+    ~Conn() {
+        if (fd >= 0) ::close(fd);
+    }
+    void reply(const std::string &line) {
+        std::lock_guard<std::mutex> lk(write_mu);
+        if (dead) return;
+        const std::string msg = line + "\n";
+        size_t off = 0;
+        while (off < msg.size()) {
+            const ssize_t w = ::send(fd, msg.data() + off, msg.size() - off, MSG_NOSIGNAL);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) {
+                // Client gone or stuck (maybe mid-line): hang up; the result
+                // file is still written
+                dead = true;
+                ::shutdown(fd, SHUT_RDWR);
+                return;
+            }
+            off += (size_t)w;
+        }
+    }
+};
+
+static std::string reply_json(const std::string &id, const std::string &status, const std::string &extra) {
+    return "{\"id\":\"" + engine::json_escape(id) + "\",\"status\":\"" + status + "\"" + extra + "}";
+}
+
+// -------------------------
+// Jobs
+// -------------------------
+struct Job {
+    std::shared_ptr<Conn> conn;
+    std::string id;
+    std::string camera;
+    std::string out_path;
+    std::string det_store;
+    std::string model;  // .tflite file; empty: compiled-in
+    engine::Options opt;
+    bool stream = false;  // per-frame lines before the reply
+    bool thermal = false;  // scale the job to the SoC's heat
+    int memory_mb = 0;     // memory budget; 0: none
+    Clock::time_point queued;
+};
+
+static bool parse_job(const mj::Value &req, Job *job, std::string *err) {
+    job->id = req.get_str("id");
+    job->camera = req.get_str("camera", "cam0");
+    job->out_path = req.get_str("out");
+    job->det_store = req.get_str("det_store");
+    job->model = req.get_str("model");
+    job->opt.event_id = req.get_str("event_id");
+    job->opt.mp4_path = req.get_str("mp4");
+    job->opt.frames = std::max(1, (int)req.get_num("frames", 5));
+    job->opt.threshold = (float)req.get_num("threshold", 0.5);
+    job->opt.preload = req.get_bool("preload", false);
+    job->stream = req.get_bool("stream", false);
+    job->thermal = req.get_bool("thermal", false);
+    job->memory_mb = std::max(0, (int)req.get_num("memory_budget_mb", 0));
+    job->opt.tiles = std::max(1, std::min(4, (int)req.get_num("tiles", 1)));
+    job->opt.camera = job->camera;
+    job->opt.repeat_cooldown_ms = (int)std::max(0.0, req.get_num("repeat_cooldown_s", 0) * 1000.0);
+    job->opt.repeat_confirm = std::max(1, std::min(2, (int)req.get_num("repeat_confirm", 2)));
+    if (!engine::parse_sampling(req.get_str("sampling", "even"), &job->opt.sampling)) {
+        *err = "sampling: expected \"even\" or \"keyframe\"";
+        return false;
+    }
+    if (!dec::parse_fidelity(req.get_str("fidelity", "full"), &job->opt.fidelity)) {
+        *err = "fidelity: expected \"full\" or \"fast\"";
+        return false;
+    }
+    if (const mj::Value *masks = req.get("masks")) {
+        for (const mj::Value &m : masks->arr) {
+            if (m.type != mj::Value::Array || m.arr.size() != 4) {
+                *err = "masks: expected [[x0,y0,x1,y1],...]";
+                return false;
+            }
+            engine::Zone z;
+            z.x0 = (float)m.arr[0].num;
+            z.y0 = (float)m.arr[1].num;
+            z.x1 = (float)m.arr[2].num;
+            z.y1 = (float)m.arr[3].num;
+            job->opt.masks.push_back(z);
+        }
+    }
+    if (job->opt.event_id.empty() || job->opt.mp4_path.empty() || job->out_path.empty()) {
+        *err = "event_id, mp4 and out are required";
+        return false;
+    }
+    return true;
+}
+
+// -------------------------
+// Daemon
+// -------------------------
+class Daemon {
+public:
+    Daemon(int64_t quantum, size_t max_queue, io::Backend io_backend, const engine::ThermalConfig &thermal)
+        : queue_(quantum, max_queue), io_(io::make_io_engine(io_backend)), thermal_(thermal) {}
+
+    void start_worker() {
+        worker_ = std::thread([this] { run_worker(); });
+        replier_ = std::thread([this] { run_replier(); });
+    }
+
+    void serve_conn(std::shared_ptr<Conn> conn);
+
+private:
+    void run_worker();
+    void post_reply(const std::shared_ptr<Conn> &conn, std::string line);
+    void run_replier();
+    void handle_line(const std::shared_ptr<Conn> &conn, const std::string &line);
+    std::string stats_json();
+    void handle_route(const std::shared_ptr<Conn> &conn, const std::string &op, const mj::Value &req);
+    ds::DetStore *det_store(const std::string &dir);
+    bool select_model(const std::string &path, std::string *err);
+
+    DrrQueue<Job> queue_;
+    std::unique_ptr<io::IoEngine> io_;
+    std::thread worker_;
+
+    // Job replies queued by the I/O completion thread, which must not block
+    // on a client's socket; replier_ sends them.
+    std::mutex reply_mu_;
+    std::condition_variable reply_cv_;
+    std::deque<std::pair<std::shared_ptr<Conn>, std::string>> replies_;
+    std::thread replier_;
+
+    std::mutex stats_mu_;
+    struct CamLatency {
+        uint64_t n = 0;
+        double sum_ms = 0, max_ms = 0;
+    };
+    std::map<std::string, CamLatency> latency_;  // queued -> result durable
+
+    std::map<std::string, std::unique_ptr<ds::DetStore>> det_stores_;  // worker thread only
+    engine::RepeatCache repeat_;                                        // worker thread only
+    engine::ThermalGovernor thermal_;                                   // worker thread only
+    engine::MemoryGovernor memory_;                                     // worker thread only
+
+    // Worker thread only: last good and last rejected version of each file
+    std::map<std::string, std::shared_ptr<const engine::ModelFile>> models_, rejected_;
+    std::string model_name_ = "compiled";  // for stats; guarded by stats_mu_
+    engine::ThermalNote last_thermal_;     // ditto: the last "thermal" job's budget
+    engine::MemoryNote last_memory_;       // ditto: the last budgeted job's memory
+
+    std::mutex route_mu_;
+    route::CostModel route_;                 // guarded by route_mu_
+    std::atomic<int64_t> running_units_{0};  // cost of the job on the worker
+};
+
+ds::DetStore *Daemon::det_store(const std::string &dir) {
+    auto it = det_stores_.find(dir);
+    if (it != det_stores_.end()) return it->second.get();
+    std::unique_ptr<ds::DetStore> s(new ds::DetStore());
+    std::string err;
+    if (!s->open(dir, &err)) {
+        std::cerr << "[INFERD] detection store: " << err << "\n";
+        return nullptr;
+    }
+    return (det_stores_[dir] = std::move(s)).get();
+}
+
+// Makes path ("" = compiled-in) the engine's model for the next job. A file
+// is loaded when first named and again whenever it changed on disk; a
+// version that fails is remembered so it is not retried every job.
+bool Daemon::select_model(const std::string &path, std::string *err) {
+    const engine::ModelFile *cur = engine::active_model();
+    if (path.empty()) {
+        if (cur && !engine::use_model(nullptr, err)) return false;
+        if (cur) thermal_.reset_timing();
+    } else if (!cur || cur->path() != path || cur->stale()) {
+        auto rej = rejected_.find(path);
+        const bool known_bad = rej != rejected_.end() && !rej->second->stale();
+        std::shared_ptr<const engine::ModelFile> m;
+        if (!known_bad && (m = engine::ModelFile::open(path, err)) && engine::use_model(m, err)) {
+            std::cerr << "[INFERD] model " << path << " (" << m->size() << " bytes, " << m->info().input.str()
+                      << " -> " << m->info().output.str() << ")\n";
+            models_[path] = m;
+            rejected_.erase(path);
+            thermal_.reset_timing();
+        } else {
+            if (!known_bad) {
+                std::cerr << "[INFERD] model " << path << " rejected: " << *err << "\n";
+                if (m) rejected_[path] = m;
+            }
+            auto good = models_.find(path);
+            if (good == models_.end()) {
+                if (known_bad) *err = path + ": rejected (see log)";
+                return false;
+            }
+            if (cur != good->second.get()) {
+                if (!engine::use_model(good->second, err)) return false;
+                thermal_.reset_timing();
+            }
+        }
+    }
+    const engine::ModelFile *now = engine::active_model();
+    std::lock_guard<std::mutex> lk(stats_mu_);
+    model_name_ = now ? now->path() : "compiled";
+    return true;
+}
+
+void Daemon::run_worker() {
+    Job job;
+    while (queue_.pop(&job)) {
+        const auto start = Clock::now();
+        engine::FrameCallback on_frame;
+        if (job.stream) {
+            on_frame = [&job](const engine::FrameReport &f) {
+                job.conn->reply("{\"id\":\"" + engine::json_escape(job.id) + "\"," +
+                                engine::frame_json(job.opt, f).substr(1));
+            };
+        }
+        const int64_t units = (int64_t)job.opt.frames * job.opt.tiles * job.opt.tiles;
+        running_units_ = units;
+        engine::Result res;
+        std::string model_err;
+        if (select_model(job.model, &model_err)) {
+            memory_.set_limit_mb(job.memory_mb);
+            res = engine::analyze_clip(job.opt, io_.get(), on_frame, &repeat_, job.thermal ? &thermal_ : nullptr,
+                                       &memory_);
+        } else {
+            res.error = "model: " + model_err;
+        }
+        running_units_ = 0;
+        if (res.ok && res.inherited_from.empty()) {
+            std::lock_guard<std::mutex> lk(route_mu_);
+            route_.observe_job(units, ms_between(job.queued, start), ms_between(start, Clock::now()));
+        }
+        if (res.thermal.active || res.memory.active) {
+            std::lock_guard<std::mutex> lk(stats_mu_);
+            if (res.thermal.active) last_thermal_ = res.thermal;
+            if (res.memory.active) last_memory_ = res.memory;
+        }
+        if (res.ok && !job.det_store.empty()) {
+            if (ds::DetStore *s = det_store(job.det_store)) engine::record_detections(s, job.camera, job.opt, res);
+        }
+
+        // Reply once result.json is durable; runs on the I/O completion thread,
+        // so the reply is only queued there.
+        const double queue_ms = ms_between(job.queued, start);
+        auto conn = job.conn;
+        const std::string id = job.id, out = job.out_path, camera = job.camera;
+        const Clock::time_point queued = job.queued;
+        const bool ok = res.ok;
+        const std::string error = res.error;
+        const std::string inherited = res.inherited_from;
+        io_->write_atomic(out, engine::result_json(job.opt, res), [=](bool wrote) {
+            const double total_ms = ms_between(queued, Clock::now());
+            {
+                std::lock_guard<std::mutex> lk(stats_mu_);
+                CamLatency &l = latency_[camera];
+                l.n++;
+                l.sum_ms += total_ms;
+                l.max_ms = std::max(l.max_ms, total_ms);
+            }
+            std::string extra = ",\"out\":\"" + engine::json_escape(out) + "\",\"queue_ms\":" +
+                                std::to_string((int)queue_ms) + ",\"latency_ms\":" + std::to_string((int)total_ms);
+            if (!inherited.empty()) extra += ",\"inherited_from\":\"" + engine::json_escape(inherited) + "\"";
+            if (!wrote) {
+                post_reply(conn, reply_json(id, "error", extra + ",\"error\":\"result write failed\""));
+            } else if (!ok) {
+                post_reply(conn, reply_json(id, "error", extra + ",\"error\":\"" + engine::json_escape(error) + "\""));
+            } else {
+                post_reply(conn, reply_json(id, "ok", extra));
+            }
+        });
+        job = Job();
+    }
+    io_->drain();
+}
+
+void Daemon::post_reply(const std::shared_ptr<Conn> &conn, std::string line) {
+    {
+        std::lock_guard<std::mutex> lk(reply_mu_);
+        replies_.emplace_back(conn, std::move(line));
+    }
+    reply_cv_.notify_one();
+}
+
+void Daemon::run_replier() {
+    for (;;) {
+        std::pair<std::shared_ptr<Conn>, std::string> r;
+        {
+            std::unique_lock<std::mutex> lk(reply_mu_);
+            reply_cv_.wait(lk, [this] { return !replies_.empty(); });
+            r = std::move(replies_.front());
+            replies_.pop_front();
+        }
+        r.first->reply(r.second);
+    }
+}
+
+std::string Daemon::stats_json() {
+    std::ostringstream o;
+    std::lock_guard<std::mutex> lk(stats_mu_);
+    o << "{\"status\":\"ok\",\"model\":\"" << engine::json_escape(model_name_) << "\"";
+    if (last_thermal_.active) {
+        o << ",\"thermal\":{\"heat\":\"" << engine::heat_name(last_thermal_.heat) << "\",\"temp_c\":"
+          << last_thermal_.sample.temp_c << ",\"reason\":\"" << engine::json_escape(last_thermal_.reason) << "\"}";
+    }
+    if (last_memory_.active) {
+        o << ",\"memory\":{\"limit_mb\":" << last_memory_.limit_mb << ",\"peak_rss_mb\":" << last_memory_.peak_rss_kb / 1024
+          << ",\"reason\":\"" << engine::json_escape(last_memory_.reason) << "\"}";
+    }
+    {
+        std::lock_guard<std::mutex> rlk(route_mu_);
+        o << ",\"route\":" << route_.stats_json();
+    }
+    o << ",\"cameras\":{";
+    bool first = true;
+    for (const auto &kv : queue_.stats()) {
+        const CamLatency &l = latency_[kv.first];
+        o << (first ? "" : ",") << "\"" << engine::json_escape(kv.first) << "\":{\"queued\":" << kv.second.queued
+          << ",\"served\":" << kv.second.served << ",\"rejected\":" << kv.second.rejected
+          << ",\"deficit\":" << kv.second.deficit << ",\"avg_latency_ms\":" << (l.n ? (int)(l.sum_ms / l.n) : 0)
+          << ",\"max_latency_ms\":" << (int)l.max_ms << "}";
+        first = false;
+    }
+    o << "}}";
+    return o.str();
+}
+
+void Daemon::handle_route(const std::shared_ptr<Conn> &conn, const std::string &op, const mj::Value &req) {
+    const std::string id = req.get_str("id");
+    if (op == "upload") {
+        std::lock_guard<std::mutex> lk(route_mu_);
+        route_.observe_upload(req.get_num("bytes", 0), req.get_num("ms", 0));
+        conn->reply(reply_json(id, "ok", ""));
+        return;
+    }
+    const int bucket = route::quality_bucket((float)req.get_num("brightness", 0.5), (float)req.get_num("blur_var", 100));
+    if (op == "route_outcome") {
+        std::string record;
+        bool known;
+        {
+            std::lock_guard<std::mutex> lk(route_mu_);
+            known = route_.outcome(id, req.get_str("route", "RUN_LOCAL"), req.get_bool("complete", false),
+                                   req.get_num("actual_ms", 0), req.get("brightness") ? bucket : -1, &record);
+        }
+        conn->reply(reply_json(id, "ok", known ? ",\"record\":" + record : ""));
+        return;
+    }
+
+    route::Request r;
+    r.id = id;
+    r.brightness = (float)req.get_num("brightness", 0.5);
+    r.blur_var = (float)req.get_num("blur_var", 100);
+    const int64_t tiles = std::max(1, std::min(4, (int)req.get_num("tiles", 1)));
+    r.units = std::max(1, (int)req.get_num("frames", 5)) * tiles * tiles;
+    r.queued_units = queue_.queued_cost() + running_units_;
+    r.clip_bytes = std::max(0.0, req.get_num("clip_bytes", 0));
+    r.net_ms = req.get_num("net_ms", -1);
+    r.cloud_ok = req.get_bool("cloud_ok", false);
+    r.cloud_ms = std::max(0.0, req.get_num("cloud_ms", r.cloud_ms));
+    r.target_ms = std::max(1.0, req.get_num("target_ms", r.target_ms));
+    route::Decision d;
+    {
+        std::lock_guard<std::mutex> lk(route_mu_);
+        d = route_.decide(r);
+    }
+    std::ostringstream o;
+    o << ",\"route\":\"" << d.route << "\",\"reason\":\"" << engine::json_escape(d.reason)
+      << "\",\"p_complete\":" << d.p_complete << ",\"samples\":" << d.samples
+      << ",\"meets_target\":" << (d.meets_target ? "true" : "false") << ",\"predicted\":{\"local_ms\":"
+      << (int)d.local.ms << ",\"local_cost_ms\":" << (int)d.local.cost_ms << ",\"cloud_ms\":" << (int)d.cloud.ms
+      << ",\"cloud_cost_ms\":" << (int)d.cloud.cost_ms << ",\"queued_units\":" << r.queued_units << "}";
+    conn->reply(reply_json(id, "ok", o.str()));
+}
+
+void Daemon::handle_line(const std::shared_ptr<Conn> &conn, const std::string &line) {
+    mj::Value req;
+    std::string err;
+    if (!mj::parse(line, &req, &err) || req.type != mj::Value::Object) {
+        conn->reply(reply_json("", "error", ",\"error\":\"" + engine::json_escape("bad request: " + err) + "\""));
+        return;
+    }
+    const std::string op = req.get_str("op", "analyze");
+    if (op == "ping") {
+        conn->reply(reply_json(req.get_str("id"), "ok", ""));
+        return;
+    }
+    if (op == "stats") {
+        conn->reply(stats_json());
+        return;
+    }
+    if (op == "route" || op == "route_outcome" || op == "upload") {
+        handle_route(conn, op, req);
+        return;
+    }
+    if (op != "analyze") {
+        conn->reply(reply_json(req.get_str("id"), "error", ",\"error\":\"unknown op\""));
+        return;
+    }
+
+    Job job;
+    if (!parse_job(req, &job, &err)) {
+        conn->reply(reply_json(job.id, "error", ",\"error\":\"" + engine::json_escape(err) + "\""));
+        return;
+    }
+    job.conn = conn;
+    job.queued = Clock::now();
+    const std::string id = job.id, camera = job.camera;
+    const int64_t cost = (int64_t)job.opt.frames * job.opt.tiles * job.opt.tiles;
+    if (!queue_.push(camera, cost, std::move(job))) {
+        conn->reply(reply_json(id, "busy", ""));
+    }
+}
+
+void Daemon::serve_conn(std::shared_ptr<Conn> conn) {
+    std::string buf;
+    char chunk[4096];
+    for (;;) {
+        const ssize_t n = ::recv(conn->fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        buf.append(chunk, (size_t)n);
+        if (buf.size() > (1 << 20)) return;  // no sane request is this long
+        size_t nl;
+        while ((nl = buf.find('\n')) != std::string::npos) {
+            const std::string line = buf.substr(0, nl);
+            buf.erase(0, nl + 1);
+            if (!line.empty()) handle_line(conn, line);
+        }
+    }
+}
+
+// -------------------------
+// Main
+// -------------------------
+int main(int argc, char **argv) {
+    std::string sock_path = "/tmp/survi_inferd.sock";
+    int64_t quantum = 8;
+    size_t max_queue = 8;
+    io::Backend io_backend = io::Backend::Auto;
+    engine::ThermalConfig thermal;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto need = [&](const char *flag) {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << flag << "\n";
+                usage(argv[0]);
+                std::exit(2);
+            }
+        };
+
+        if (a == "--socket") { need("--socket"); sock_path = argv[++i]; }
+        else if (a == "--quantum") { need("--quantum"); quantum = std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--max_queue") { need("--max_queue"); max_queue = (size_t)std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--io") { need("--io"); io_backend = io::parse_backend(argv[++i]); }
+        else if (a == "--thermal_warm_c") { need("--thermal_warm_c"); thermal.warm_c = std::stof(argv[++i]); }
+        else if (a == "--thermal_hot_c") { need("--thermal_hot_c"); thermal.hot_c = std::stof(argv[++i]); }
+        else if (a == "--help" || a == "-h") { usage(argv[0]); return 0; }
+        else {
+            std::cerr << "Unknown arg: " << a << "\n";
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    const int lfd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (lfd < 0 || sock_path.size() >= sizeof(addr.sun_path)) {
+        std::fprintf(stderr, "socket %s: %s\n", sock_path.c_str(), lfd < 0 ? std::strerror(errno) : "path too long");
+        return 1;
+    }
+    std::memcpy(addr.sun_path, sock_path.c_str(), sock_path.size() + 1);
+    ::unlink(sock_path.c_str());  // stale socket from a previous run
+    if (::bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(lfd, 64) != 0) {
+        std::fprintf(stderr, "listen on %s: %s\n", sock_path.c_str(), std::strerror(errno));
+        return 1;
+    }
+
+    Daemon d(quantum, max_queue, io_backend, thermal);
+    d.start_worker();
+    std::cerr << "[INFERD] " << sock_path << "  quantum=" << quantum << "  max_queue=" << max_queue << "\n";
+
+    for (;;) {
+        const int cfd = ::accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::perror("accept");
+            return 1;
+        }
+        struct timeval tv = {kSendTimeoutS, 0};
+        ::setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        auto conn = std::make_shared<Conn>();
+        conn->fd = cfd;
+        std::thread([&d, conn] { d.serve_conn(conn); }).detach();
+    }
+}
@@ -0,0 +1,587 @@
+// ~/ArduinoApps/survillance/cpp_infer/io_engine.cpp
+// See io_engine.h.
+
+#include "io_engine.h"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace io {
+
+// -------------------------
+// Shared helpers
+// -------------------------
+namespace {
+
+// Unique per write so concurrent writes to one path never share a tmp file.
+std::string tmp_path(const std::string &path) {
+    static std::atomic<uint64_t> seq{0};
+    return path + ".tmp" + std::to_string(::getpid()) + "." + std::to_string(seq.fetch_add(1));
+}
+
+// Synchronous fallback for one durable write (thread pool, or a kernel whose
+// io_uring lacks RENAMEAT).
+bool write_atomic_sync(const std::string &path, const std::string &body) {
+    const std::string tmp = tmp_path(path);
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    size_t off = 0;
+    while (off < body.size()) {
+        const ssize_t n = ::write(fd, body.data() + off, body.size() - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        off += (size_t)n;
+    }
+    const bool ok = off == body.size() && ::fdatasync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+int32_t pread_full(int fd, uint8_t *buf, uint32_t len, uint64_t off) {
+    uint32_t got = 0;
+    while (got < len) {
+        const ssize_t n = ::pread(fd, buf + got, len - got, (off_t)(off + got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -errno;
+        if (n == 0) break;
+        got += (uint32_t)n;
+    }
+    return (int32_t)got;
+}
+
+// Counts outstanding operations and lets callers wait for zero.
+class Pending {
+public:
+    void add(int n = 1) {
+        std::lock_guard<std::mutex> lk(mu_);
+        n_ += n;
+    }
+    void done(int n = 1) {
+        std::lock_guard<std::mutex> lk(mu_);
+        n_ -= n;
+        if (n_ == 0) cv_.notify_all();
+    }
+    void wait() {
+        std::unique_lock<std::mutex> lk(mu_);
+        cv_.wait(lk, [&] { return n_ == 0; });
+    }
+
+private:
+    std::mutex mu_;
+    std::condition_variable cv_;
+    int n_ = 0;
+};
+
+}  // namespace
+
+// -------------------------
+// Thread-pool backend
+// -------------------------
+class ThreadIo final : public IoEngine {
+public:
+    explicit ThreadIo(int threads) {
+        for (int i = 0; i < std::max(1, threads); i++) workers_.emplace_back([this] { run(); });
+    }
+
+    ~ThreadIo() override {
+        drain();
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto &t : workers_) t.join();
+    }
+
+    const char *name() const override { return "threads"; }
+
+    void read_batch(std::vector<ReadReq> &reqs) override {
+        Pending batch;
+        batch.add((int)reqs.size());
+        for (auto &r : reqs) {
+            ReadReq *rp = &r;
+            post([rp, &batch] {
+                rp->res = pread_full(rp->fd, rp->buf, rp->len, rp->off);
+                batch.done();
+            });
+        }
+        batch.wait();
+    }
+
+    void write_atomic(const std::string &path, std::string body, std::function<void(bool)> done) override {
+        writes_.add();
+        post([this, path, body = std::move(body), done = std::move(done)] {
+            const bool ok = write_atomic_sync(path, body);
+            if (done) done(ok);
+            writes_.done();
+        });
+    }
+
+    void drain() override { writes_.wait(); }
+
+private:
+    void post(std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            q_.push_back(std::move(fn));
+        }
+        cv_.notify_one();
+    }
+
+    void run() {
+        for (;;) {
+            std::function<void()> fn;
+            {
+                std::unique_lock<std::mutex> lk(mu_);
+                cv_.wait(lk, [&] { return stop_ || !q_.empty(); });
+                if (q_.empty()) return;
+                fn = std::move(q_.front());
+                q_.pop_front();
+            }
+            fn();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> q_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    Pending writes_;
+};
+
+// -------------------------
+// io_uring backend
+// -------------------------
+class UringIo final : public IoEngine {
+public:
+    static constexpr unsigned kEntries = 64;
+
+    static std::unique_ptr<UringIo> create(std::string *err) {
+        std::unique_ptr<UringIo> u(new UringIo());
+        if (!u->setup(err)) return nullptr;
+        return u;
+    }
+
+    ~UringIo() override {
+        drain();
+        if (reaper_.joinable()) {
+            stop_.store(true);
+            {
+                std::unique_lock<std::mutex> lk(sq_mu_);
+                wait_slots_locked(lk, 1);
+                push_locked(IORING_OP_NOP, -1, nullptr, 0, 0, nullptr, 0);
+                submit_locked(1);
+            }
+            reaper_.join();
+        }
+        if (sqes_) ::munmap(sqes_, sqes_size_);
+        if (cq_map_ && cq_map_ != sq_map_) ::munmap(cq_map_, cq_size_);
+        if (sq_map_) ::munmap(sq_map_, sq_size_);
+        if (ring_fd_ >= 0) ::close(ring_fd_);
+    }
+
+    const char *name() const override { return "io_uring"; }
+
+    void read_batch(std::vector<ReadReq> &reqs) override {
+        Pending batch;
+        std::vector<Op> ops(reqs.size());
+        batch.add((int)reqs.size());
+        size_t i = 0;
+        while (i < reqs.size()) {
+            Refused refused;
+            {
+                std::unique_lock<std::mutex> lk(sq_mu_);
+                wait_slots_locked(lk, 1);
+                unsigned n = 0;
+                for (; i < reqs.size() && in_flight_ < kEntries; i++, n++) {
+                    ReadReq &r = reqs[i];
+                    ops[i].kind = Op::READ;
+                    ops[i].read = &r;
+                    ops[i].batch = &batch;
+                    push_locked(IORING_OP_READ, r.fd, r.buf, r.len, r.off, &ops[i], 0);
+                }
+                refused = submit_locked(n);
+            }
+            complete_refused(refused);
+        }
+        batch.wait();
+
+        // Short reads (e.g. a file still being appended) finish synchronously.
+        for (auto &r : reqs) {
+            if (r.res >= 0 && (uint32_t)r.res < r.len) {
+                const int32_t more = pread_full(r.fd, r.buf + r.res, r.len - (uint32_t)r.res, r.off + (uint32_t)r.res);
+                if (more > 0) r.res += more;
+            }
+        }
+    }
+
+    void write_atomic(const std::string &path, std::string body, std::function<void(bool)> done) override {
+        auto *w = new WriteOp();
+        w->path = path;
+        w->tmp = tmp_path(path);
+        w->body = std::move(body);
+        w->done = std::move(done);
+        w->fd = ::open(w->tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        writes_.add();
+        if (w->fd < 0 || w->body.size() > UINT32_MAX) {
+            finish_write(w, false);
+            return;
+        }
+
+        w->ops[0].kind = w->ops[1].kind = w->ops[2].kind = Op::WRITE_STEP;
+        for (auto &op : w->ops) op.write = w;
+        w->steps_left = renameat_ok_ ? 3 : 2;
+
+        std::unique_lock<std::mutex> lk(sq_mu_);
+        wait_slots_locked(lk, (unsigned)w->steps_left);
+        push_locked(IORING_OP_WRITE, w->fd, w->body.data(), (uint32_t)w->body.size(), 0, &w->ops[0], IOSQE_IO_LINK);
+        push_locked(IORING_OP_FSYNC, w->fd, nullptr, 0, 0, &w->ops[1], renameat_ok_ ? IOSQE_IO_LINK : 0);
+        if (renameat_ok_) {
+            io_uring_sqe *sqe = push_locked(IORING_OP_RENAMEAT, AT_FDCWD, w->tmp.c_str(), AT_FDCWD, 0, &w->ops[2], 0);
+            sqe->addr2 = (uint64_t)(uintptr_t)w->path.c_str();
+        }
+        const Refused refused = submit_locked((unsigned)w->steps_left);
+        lk.unlock();
+        complete_refused(refused);
+    }
+
+    void drain() override { writes_.wait(); }
+
+private:
+    struct WriteOp;
+
+    struct Op {
+        enum Kind { READ, WRITE_STEP } kind = READ;
+        ReadReq *read = nullptr;
+        Pending *batch = nullptr;
+        WriteOp *write = nullptr;
+    };
+
+    // SQEs io_uring_enter did not take, and its errno
+    struct Refused {
+        std::vector<Op *> ops;
+        int err = 0;
+    };
+
+    struct WriteOp {
+        std::string path, tmp, body;
+        std::function<void(bool)> done;
+        int fd = -1;
+        int steps_left = 0;
+        bool ok = true;
+        Op ops[3];
+    };
+
+    UringIo() = default;
+
+    static int sys_setup(unsigned entries, io_uring_params *p) {
+        return (int)::syscall(__NR_io_uring_setup, entries, p);
+    }
+
+    int sys_enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return (int)::syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, nullptr, 0);
+    }
+
+    bool setup(std::string *err) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        ring_fd_ = sys_setup(kEntries, &p);
+        if (ring_fd_ < 0) {
+            if (err) *err = std::string("io_uring_setup: ") + std::strerror(errno);
+            return false;
+        }
+        sq_size_ = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+        cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+
+        sq_map_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                         IORING_OFF_SQ_RING);
+        if (sq_map_ == MAP_FAILED) {
+            sq_map_ = nullptr;
+            if (err) *err = std::string("mmap sq ring: ") + std::strerror(errno);
+            return false;
+        }
+        if (single) {
+            cq_map_ = sq_map_;
+        } else {
+            cq_map_ = ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                             IORING_OFF_CQ_RING);
+            if (cq_map_ == MAP_FAILED) {
+                cq_map_ = nullptr;
+                if (err) *err = std::string("mmap cq ring: ") + std::strerror(errno);
+                return false;
+            }
+        }
+        sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+        void *s = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                         IORING_OFF_SQES);
+        if (s == MAP_FAILED) {
+            if (err) *err = std::string("mmap sqes: ") + std::strerror(errno);
+            return false;
+        }
+        sqes_ = (io_uring_sqe *)s;
+
+        auto *sq = (uint8_t *)sq_map_;
+        sq_tail_ = (std::atomic<uint32_t> *)(sq + p.sq_off.tail);
+        sq_mask_ = *(uint32_t *)(sq + p.sq_off.ring_mask);
+        sq_array_ = (uint32_t *)(sq + p.sq_off.array);
+        auto *cq = (uint8_t *)cq_map_;
+        cq_head_ = (std::atomic<uint32_t> *)(cq + p.cq_off.head);
+        cq_tail_ = (std::atomic<uint32_t> *)(cq + p.cq_off.tail);
+        cq_mask_ = *(uint32_t *)(cq + p.cq_off.ring_mask);
+        cqes_ = (io_uring_cqe *)(cq + p.cq_off.cqes);
+
+        renameat_ok_ = probe_renameat();
+        reaper_ = std::thread([this] { reap(); });
+        return true;
+    }
+
+    // RENAMEAT needs 5.11+; older rings fall back to a synchronous rename
+    // after the linked write+fsync.
+    bool probe_renameat() {
+        const size_t len = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        std::vector<uint8_t> buf(len, 0);
+        auto *probe = (io_uring_probe *)buf.data();
+        if (::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+        return probe->last_op >= IORING_OP_RENAMEAT &&
+               (probe->ops[IORING_OP_RENAMEAT].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    void wait_slots_locked(std::unique_lock<std::mutex> &lk, unsigned n) {
+        slots_cv_.wait(lk, [&] { return in_flight_ + n <= kEntries; });
+    }
+
+    io_uring_sqe *push_locked(uint8_t opcode, int fd, const void *addr, uint32_t len, uint64_t off, Op *op,
+                              uint8_t flags) {
+        const uint32_t tail = sq_tail_->load(std::memory_order_relaxed) + pushed_;
+        const uint32_t idx = tail & sq_mask_;
+        io_uring_sqe *sqe = &sqes_[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)addr;
+        sqe->len = len;
+        sqe->off = off;
+        sqe->flags = flags;
+        sqe->user_data = (uint64_t)(uintptr_t)op;
+        if (opcode == IORING_OP_FSYNC) sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        sq_array_[idx] = idx;
+        pushed_++;
+        in_flight_++;
+        return sqe;
+    }
+
+    // What the kernel refuses is taken back off the SQ ring (without SQPOLL
+    // nothing else consumes it) and out of in_flight_; the caller completes
+    // it with the error once sq_mu_ is released (callbacks may submit).
+    Refused submit_locked(unsigned n) {
+        sq_tail_->store(sq_tail_->load(std::memory_order_relaxed) + pushed_, std::memory_order_release);
+        pushed_ = 0;
+        Refused refused;
+        while (n > 0) {
+            const int r = sys_enter(n, 0, 0);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) {
+                refused.err = r < 0 ? errno : EBUSY;
+                std::cerr << "[IO] io_uring_enter: " << std::strerror(refused.err) << " (" << n
+                          << " op(s) failed)\n";
+                const uint32_t tail = sq_tail_->load(std::memory_order_relaxed);
+                for (uint32_t k = tail - n; k != tail; k++) {
+                    refused.ops.push_back((Op *)(uintptr_t)sqes_[sq_array_[k & sq_mask_]].user_data);
+                }
+                sq_tail_->store(tail - n, std::memory_order_release);
+                in_flight_ -= n;
+                break;
+            }
+            n -= (unsigned)r;
+        }
+        return refused;
+    }
+
+    void complete_refused(const Refused &refused) {
+        if (refused.ops.empty()) return;
+        for (Op *op : refused.ops) complete(op, -refused.err);
+        slots_cv_.notify_all();
+    }
+
+    void reap() {
+        for (;;) {
+            uint32_t head = cq_head_->load(std::memory_order_relaxed);
+            const uint32_t tail = cq_tail_->load(std::memory_order_acquire);
+            if (head == tail) {
+                if (stop_.load() && in_flight_snapshot() == 0) return;
+                const int r = sys_enter(0, 1, IORING_ENTER_GETEVENTS);
+                if (r < 0 && errno != EINTR) {
+                    std::cerr << "[IO] io_uring wait: " << std::strerror(errno) << "\n";
+                    return;
+                }
+                continue;
+            }
+            unsigned reaped = 0;
+            for (; head != tail; head++, reaped++) {
+                const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+                complete((Op *)(uintptr_t)cqe.user_data, cqe.res);
+            }
+            cq_head_->store(head, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lk(sq_mu_);
+                in_flight_ -= reaped;
+            }
+            slots_cv_.notify_all();
+        }
+    }
+
+    unsigned in_flight_snapshot() {
+        std::lock_guard<std::mutex> lk(sq_mu_);
+        return in_flight_;
+    }
+
+    void complete(Op *op, int32_t res) {
+        if (!op) return;  // shutdown NOP
+        if (op->kind == Op::READ) {
+            op->read->res = res;
+            op->batch->done();
+            return;
+        }
+        WriteOp *w = op->write;
+        if (op == &w->ops[0] && (res < 0 || (size_t)res != w->body.size())) w->ok = false;
+        if (res < 0) w->ok = false;  // failed step, or -ECANCELED after one
+        if (--w->steps_left > 0) return;
+
+        bool ok = w->ok;
+        if (ok && !renameat_ok_) ok = ::rename(w->tmp.c_str(), w->path.c_str()) == 0;
+        finish_write(w, ok);
+    }
+
+    void finish_write(WriteOp *w, bool ok) {
+        if (w->fd >= 0) ::close(w->fd);
+        if (!ok) ::unlink(w->tmp.c_str());
+        if (w->done) w->done(ok);
+        delete w;
+        writes_.done();
+    }
+
+    int ring_fd_ = -1;
+    void *sq_map_ = nullptr;
+    void *cq_map_ = nullptr;
+    size_t sq_size_ = 0, cq_size_ = 0, sqes_size_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    std::atomic<uint32_t> *sq_tail_ = nullptr;
+    uint32_t sq_mask_ = 0;
+    uint32_t *sq_array_ = nullptr;
+    std::atomic<uint32_t> *cq_head_ = nullptr;
+    std::atomic<uint32_t> *cq_tail_ = nullptr;
+    uint32_t cq_mask_ = 0;
+    io_uring_cqe *cqes_ = nullptr;
+    bool renameat_ok_ = false;
+
+    std::mutex sq_mu_;  // guards the SQ ring, pushed_ and in_flight_
+    std::condition_variable slots_cv_;
+    uint32_t pushed_ = 0;
+    unsigned in_flight_ = 0;
+
+    std::thread reaper_;
+    std::atomic<bool> stop_{false};
+    Pending writes_;
+};
+
+// -------------------------
+// Factory
+// -------------------------
+std::unique_ptr<IoEngine> make_io_engine(Backend want, int threads) {
+    if (want != Backend::Threads) {
+        std::string err;
+        if (auto u = UringIo::create(&err)) return u;
+        std::cerr << "[IO] io_uring unavailable (" << err << "); using thread pool\n";
+    }
+    return std::unique_ptr<IoEngine>(new ThreadIo(threads));
+}
+
+Backend parse_backend(const std::string &s) {
+    if (s == "uring") return Backend::Uring;
+    if (s == "threads") return Backend::Threads;
+    return Backend::Auto;
+}
+
+// -------------------------
+// ClipBuffer
+// -------------------------
+bool ClipBuffer::load(IoEngine &io, const std::string &path, std::string *err) {
+    pos_ = 0;
+    data_.clear();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (err) *err = "open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        if (err) *err = "stat " + path + ": " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    data_.resize((size_t)st.st_size);
+
+    std::vector<ReadReq> reqs;
+    for (uint64_t off = 0; off < data_.size(); off += kChunk) {
+        ReadReq r;
+        r.fd = fd;
+        r.off = off;
+        r.len = (uint32_t)std::min<uint64_t>(kChunk, data_.size() - off);
+        r.buf = data_.data() + off;
+        reqs.push_back(r);
+    }
+    io.read_batch(reqs);
+    ::close(fd);
+
+    for (const auto &r : reqs) {
+        if (r.res < 0 || (uint32_t)r.res != r.len) {
+            if (err) *err = "read " + path + ": " + (r.res < 0 ? std::strerror(-r.res) : "short read");
+            data_.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+int ClipBuffer::read(uint8_t *dst, int n) {
+    if (pos_ >= data_.size()) return -1;  // EOF
+    const size_t k = std::min((size_t)std::max(0, n), data_.size() - pos_);
+    std::memcpy(dst, data_.data() + pos_, k);
+    pos_ += k;
+    return (int)k;
+}
+
+int64_t ClipBuffer::seek(int64_t off, int whence) {
+    if (whence == 0x10000) return (int64_t)data_.size();  // AVSEEK_SIZE
+    int64_t base = 0;
+    if (whence == SEEK_CUR) base = (int64_t)pos_;
+    else if (whence == SEEK_END) base = (int64_t)data_.size();
+    const int64_t p = base + off;
+    if (p < 0 || p > (int64_t)data_.size()) return -1;
+    pos_ = (size_t)p;
+    return p;
+}
+
+}  // namespace io
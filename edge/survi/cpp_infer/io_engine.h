@@ -0,0 +1,80 @@
+// ~/ArduinoApps/survillance/cpp_infer/io_engine.h
+// Asynchronous file I/O for the analysis engine.
+//
+// Two backends behind one interface:
+//   - io_uring (raw syscalls, no liburing): reads are submitted as one batch
+//     of IORING_OP_READ into caller buffers; durable writes go out as a linked
+//     WRITE -> FSYNC(DATASYNC) -> RENAMEAT chain, so a result file appears
+//     under its final name only once its bytes are on the card.
+//   - a small thread pool doing pread / write+fdatasync+rename, used when the
+//     kernel has no io_uring (or it is blocked by seccomp / sysctl).
+//
+// Completions are reaped on a background thread, so neither the decode loop
+// nor the caller of write_atomic() ever waits on SD-card latency; drain()
+// waits for every pending write before exit.
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace io {
+
+struct ReadReq {
+    int fd = -1;
+    uint64_t off = 0;
+    uint32_t len = 0;
+    uint8_t *buf = nullptr;
+    int32_t res = 0;  // bytes read, or -errno
+};
+
+class IoEngine {
+public:
+    virtual ~IoEngine() = default;
+
+    virtual const char *name() const = 0;
+
+    // Issues every read in one batch and returns when all have completed.
+    virtual void read_batch(std::vector<ReadReq> &reqs) = 0;
+
+    // Writes `body` to a tmp file next to `path`, fdatasyncs it and renames it over
+    // `path`. Returns immediately; `done` (optional) runs on the completion
+    // thread with the outcome.
+    virtual void write_atomic(const std::string &path, std::string body,
+                              std::function<void(bool ok)> done = nullptr) = 0;
+
+    // Blocks until every write_atomic() issued so far has completed.
+    virtual void drain() = 0;
+};
+
+enum class Backend { Auto, Uring, Threads };
+
+// Backend::Auto tries io_uring first and falls back to the thread pool.
+std::unique_ptr<IoEngine> make_io_engine(Backend want = Backend::Auto, int threads = 2);
+
+Backend parse_backend(const std::string &s);  // "auto" | "uring" | "threads"
+
+// A whole file read through the engine into one preallocated buffer, in
+// kChunk-sized requests submitted together.
+class ClipBuffer {
+public:
+    static constexpr uint32_t kChunk = 256 * 1024;
+
+    bool load(IoEngine &io, const std::string &path, std::string *err);
+
+    const uint8_t *data() const { return data_.data(); }
+    size_t size() const { return data_.size(); }
+
+    // read/seek over the buffer with the semantics of an AVIOContext's
+    // read_packet / seek callbacks (see the libav decode backend).
+    int read(uint8_t *dst, int n);
+    int64_t seek(int64_t off, int whence);  // whence: SEEK_SET/CUR/END, or 0x10000 (AVSEEK_SIZE)
+
+private:
+    std::vector<uint8_t> data_;
+    size_t pos_ = 0;
+};
+
+}  // namespace io
@@ -0,0 +1,1020 @@
+// ~/ArduinoApps/survillance/cpp_infer/media_server.cpp
+// Static media server for finalised event packages.
+//
+// main.py keeps the live state / listing endpoints and redirects the byte-heavy
+// ones here:
+//   /events/<id>.mp4            clip.mp4
+//   /events/<id>.json           incident.json
+//   /events/<id>.result.json    result.json
+//   /events/<id>/<snapshot>     snapshot.jpg|png, thumbnail.jpg|png
+//
+// With --frames_fd it also fans out the live view. main.py encodes each frame
+// once and writes it to that fd; every viewer is served from the same bytes:
+//   /video.mjpg                 multipart/x-mixed-replace stream
+//   /frame.jpg                  latest single JPEG
+//
+// Single epoll thread, non-blocking sockets, HTTP/1.1 keep-alive, file bodies
+// go out with sendfile() so the bytes never pass through user space.
+// Supports single byte ranges (Range / If-Range) and conditional GETs
+// (If-None-Match / If-Modified-Since).
+//
+// With --store the packages come from the event store instead of the
+// directory tree: incident/result JSON is sendfile()'d straight out of the
+// WAL, clips and snapshots from the store's blob directories.
+//
+// With --detections it answers aggregate queries over the detection store:
+//   /detections?from=&to=&camera=&label=&min_conf=&zone=x0,y0,x1,y1&bucket=
+// (times in epoch ms, zone normalised, bucket in ms for a histogram).
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "det_store.h"
+#include "event_store.h"
+#include "frame_slot.h"
+
+// -------------------------
+// Small helpers
+// -------------------------
+static bool starts_with(const std::string &s, const std::string &p) {
+    return s.size() >= p.size() && s.compare(0, p.size(), p) == 0;
+}
+
+static bool ends_with(const std::string &s, const std::string &p) {
+    return s.size() >= p.size() && s.compare(s.size() - p.size(), p.size(), p) == 0;
+}
+
+static std::string lower(std::string s) {
+    for (auto &c : s) c = (char)std::tolower((unsigned char)c);
+    return s;
+}
+
+static std::string trim(const std::string &s) {
+    size_t a = s.find_first_not_of(" \t");
+    if (a == std::string::npos) return "";
+    size_t b = s.find_last_not_of(" \t");
+    return s.substr(a, b - a + 1);
+}
+
+static std::string url_decode(const std::string &s) {
+    std::string o;
+    o.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '%' && i + 2 < s.size() &&
+            std::isxdigit((unsigned char)s[i + 1]) && std::isxdigit((unsigned char)s[i + 2])) {
+            o += (char)std::strtol(s.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        } else {
+            o += s[i];
+        }
+    }
+    return o;
+}
+
+static int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// RFC 7231 IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+static std::string http_date(time_t t) {
+    char buf[64];
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+static bool parse_http_date(const std::string &s, time_t *out) {
+    struct tm tm;
+    std::memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(s.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end) return false;
+    *out = timegm(&tm);
+    return true;
+}
+
+static const char *content_type_for(const std::string &path) {
+    if (ends_with(path, ".mp4"))  return "video/mp4";
+    if (ends_with(path, ".json")) return "application/json";
+    if (ends_with(path, ".jpg"))  return "image/jpeg";
+    if (ends_with(path, ".png"))  return "image/png";
+    return "application/octet-stream";
+}
+
+// Event ids are millisecond timestamps today; accept anything that cannot
+// escape the events tree.
+static bool safe_event_id(const std::string &id) {
+    if (id.empty() || id.size() > 128) return false;
+    if (id == "." || id == "..") return false;
+    for (char c : id) {
+        if (!(std::isalnum((unsigned char)c) || c == '-' || c == '_' || c == '.')) return false;
+    }
+    return true;
+}
+
+static void usage(const char *argv0) {
+    std::cerr
+        << "Usage:\n"
+        << "  " << argv0 << " --root <events_dir> [--host H] [--port P] [--idle_timeout S] [--store DIR] [--frames_fd FD]\n"
+        << "        [--detections DIR]\n"
+        << "\n"
+        << "  --store      serve packages from the event store at DIR (read-only)\n"
+        << "  --detections answer /detections queries from the detection store at DIR\n"
+        << "  --frames_fd  read live JPEG frames from FD, each prefixed by\n"
+        << "               <u32 length><i64 timestamp_us> (little endian)\n"
+        << "\n"
+        << "Example:\n"
+        << "  " << argv0 << " --root ./events --port 8082 --frames_fd 0\n";
+}
+
+// -------------------------
+// Server state
+// -------------------------
+struct Config {
+    std::string root = "./events";
+    std::string host = "0.0.0.0";
+    int port = 8082;
+    int idle_timeout_s = 15;
+    int frames_fd = -1;        // live JPEG feed; -1 disables /video.mjpg
+    std::string store_dir;     // event store; empty = per-event directories
+    std::string det_dir;       // detection store; empty disables /detections
+};
+
+struct Conn {
+    int fd = -1;
+    std::string in;            // unparsed request bytes
+    std::string out;           // pending response head (or small body)
+    size_t out_off = 0;
+    int file_fd = -1;          // body being sent with sendfile()
+    off_t file_off = 0;
+    off_t file_end = 0;        // exclusive
+    bool keep_alive = true;
+    bool peer_closed = false;  // client shut down its write side
+    int64_t last_active_ms = 0;
+
+    // Live view: body is read in place from a pinned FrameSlots slot.
+    int slot = -1;
+    size_t slot_off = 0;
+    bool streaming = false;    // /video.mjpg, never returns to request parsing
+    uint64_t last_seq = 0;     // newest frame already sent to this client
+};
+
+struct Request {
+    std::string method;
+    std::string path;
+    std::string version;
+    std::unordered_map<std::string, std::string> headers;  // lower-cased keys
+};
+
+static Config g_cfg;
+static int g_epfd = -1;
+static std::unordered_map<int, Conn> g_conns;
+
+static es::EventStore g_store;
+static bool g_use_store = false;
+
+static ds::DetStore g_dets;
+
+static FrameSlots g_frames;
+static int g_wake_fd = -1;     // eventfd, bumped by the frame reader per frame
+
+// -------------------------
+// Package lookup
+// -------------------------
+
+// Same search order as main.py::_find_pkg: uploaded first, then final.
+static std::string find_pkg_file(const std::string &event_id, const std::string &file) {
+    static const char *kBuckets[] = {"uploaded", "final"};
+    for (const char *b : kBuckets) {
+        std::string dir = g_cfg.root + "/" + b + "/" + event_id;
+        struct stat st;
+        if (stat((dir + "/incident.json").c_str(), &st) != 0) continue;
+        return dir + "/" + file;
+    }
+    return "";
+}
+
+// Splits a request path into (event id, package file name). Returns false
+// when the path is not one we serve.
+static bool parse_event_path(const std::string &path, std::string *eid, std::string *file) {
+    static const char *kPrefix = "/events/";
+    if (!starts_with(path, kPrefix)) return false;
+    std::string rest = url_decode(path.substr(std::strlen(kPrefix)));
+
+    // /events/<id>/<snapshot>
+    size_t slash = rest.find('/');
+    if (slash != std::string::npos) {
+        *eid = rest.substr(0, slash);
+        *file = rest.substr(slash + 1);
+        if (*file != "snapshot.jpg" && *file != "snapshot.png" &&
+            *file != "thumbnail.jpg" && *file != "thumbnail.png") return false;
+        return safe_event_id(*eid);
+    }
+
+    struct Suffix { const char *ext; const char *file; };
+    static const Suffix kSuffixes[] = {
+        {".result.json", "result.json"},   // must be checked before ".json"
+        {".json",        "incident.json"},
+        {".mp4",         "clip.mp4"},
+    };
+    for (const auto &sfx : kSuffixes) {
+        if (!ends_with(rest, sfx.ext)) continue;
+        *eid = rest.substr(0, rest.size() - std::strlen(sfx.ext));
+        *file = sfx.file;
+        return safe_event_id(*eid);
+    }
+    return false;
+}
+
+// A byte range of some open file that makes up a response body.
+struct Body {
+    int fd = -1;
+    off_t base = 0;
+    off_t size = 0;
+    time_t mtime = 0;
+    std::string etag;
+    const char *ctype = "application/octet-stream";
+};
+
+static bool open_file_body(const std::string &file, Body *b) {
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+    // Validators: size + mtime is enough here, packages are rewritten via
+    // tempfile + rename which always bumps mtime.
+    char etag_buf[64];
+    std::snprintf(etag_buf, sizeof(etag_buf), "\"%llx-%llx\"",
+                  (unsigned long long)st.st_size,
+                  (unsigned long long)st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec);
+    b->fd = fd;
+    b->base = 0;
+    b->size = st.st_size;
+    b->mtime = st.st_mtime;
+    b->etag = etag_buf;
+    b->ctype = content_type_for(file);
+    return true;
+}
+
+// Docs are immutable once appended, so the WAL file (compaction makes a new
+// one) and their offset in it are a strong ETag.
+static bool open_store_body(const std::string &eid, const std::string &file, Body *b) {
+    uint64_t id = std::strtoull(eid.c_str(), nullptr, 10);
+    es::IndexRec r;
+
+    if (file == "incident.json" || file == "result.json") {
+        int fd = -1;
+        if (!g_store.get(id, &r, &fd)) return false;
+        const bool inc = (file == "incident.json");
+        const uint64_t off = inc ? r.incident_off : r.result_off;
+        const uint32_t len = inc ? r.incident_len : r.result_len;
+        struct stat st;
+        if (len == 0 || fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        char etag_buf[64];
+        std::snprintf(etag_buf, sizeof(etag_buf), "\"w%llx-%llx-%x\"", (unsigned long long)st.st_ino,
+                      (unsigned long long)off, len);
+        b->fd = fd;
+        b->base = (off_t)off;
+        b->size = (off_t)len;
+        b->mtime = (time_t)(r.updated_ms / 1000);
+        b->etag = etag_buf;
+        b->ctype = "application/json";
+        return true;
+    }
+    if (!g_store.get(id, &r) || !(r.blobs & es::blob_bit(file))) return false;
+    return open_file_body(g_store.blob_path(id, file), b);
+}
+
+static bool open_body(const std::string &path, Body *b) {
+    std::string eid, file;
+    if (!parse_event_path(path, &eid, &file)) return false;
+    if (g_use_store) {
+        for (char ch : eid) if (!std::isdigit((unsigned char)ch)) return false;
+        return open_store_body(eid, file, b);
+    }
+    std::string f = find_pkg_file(eid, file);
+    return !f.empty() && open_file_body(f, b);
+}
+
+// -------------------------
+// Response building
+// -------------------------
+static const char *status_text(int code) {
+    switch (code) {
+        case 200: return "OK";
+        case 206: return "Partial Content";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 416: return "Range Not Satisfiable";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default:  return "Unknown";
+    }
+}
+
+static std::string head_line(int code) {
+    return "HTTP/1.1 " + std::to_string(code) + " " + status_text(code) + "\r\n";
+}
+
+static std::string common_headers(const Conn &c) {
+    std::string h;
+    h += "Date: " + http_date(std::time(nullptr)) + "\r\n";
+    h += "Server: survi_media_server\r\n";
+    // main.py redirects here from another port, so browsers treat us as a
+    // different origin.
+    h += "Access-Control-Allow-Origin: *\r\n";
+    h += c.keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    return h;
+}
+
+static void queue_simple(Conn &c, int code, const std::string &body, bool head_only) {
+    std::string r = head_line(code) + common_headers(c);
+    r += "Content-Type: text/plain\r\n";
+    r += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    if (!head_only) r += body;
+    c.out += r;
+}
+
+// Parses a single "bytes=" range against `size`. Returns 0 when there is no
+// usable range (serve the whole file), 1 on success, -1 when unsatisfiable.
+// Multi-range requests are answered with the full body, which RFC 7233 allows.
+static int parse_range(const std::string &v, off_t size, off_t *a, off_t *b) {
+    std::string s = trim(v);
+    if (!starts_with(s, "bytes=")) return 0;
+    s = s.substr(6);
+    if (s.find(',') != std::string::npos) return 0;
+    size_t dash = s.find('-');
+    if (dash == std::string::npos) return 0;
+    std::string lo = trim(s.substr(0, dash));
+    std::string hi = trim(s.substr(dash + 1));
+    char *e = nullptr;
+    if (lo.empty()) {
+        // suffix range: last N bytes
+        if (hi.empty()) return 0;
+        long long n = std::strtoll(hi.c_str(), &e, 10);
+        if (*e || n <= 0) return n == 0 ? -1 : 0;
+        *a = std::max<off_t>(0, size - (off_t)n);
+        *b = size - 1;
+    } else {
+        long long x = std::strtoll(lo.c_str(), &e, 10);
+        if (*e || x < 0) return 0;
+        if (x >= size) return -1;
+        *a = (off_t)x;
+        if (hi.empty()) {
+            *b = size - 1;
+        } else {
+            long long y = std::strtoll(hi.c_str(), &e, 10);
+            if (*e || y < x) return 0;
+            *b = std::min<off_t>((off_t)y, size - 1);
+        }
+    }
+    return size > 0 ? 1 : -1;
+}
+
+// "k1=v1&k2=v2" -> value of `key` (url-decoded), or "" when absent.
+static std::string query_param(const std::string &qs, const std::string &key) {
+    size_t p = 0;
+    while (p <= qs.size()) {
+        size_t amp = qs.find('&', p);
+        if (amp == std::string::npos) amp = qs.size();
+        const std::string kv = qs.substr(p, amp - p);
+        const size_t eq = kv.find('=');
+        if (kv.substr(0, eq) == key) return eq == std::string::npos ? "" : url_decode(kv.substr(eq + 1));
+        p = amp + 1;
+    }
+    return "";
+}
+
+static void queue_detections(Conn &c, const std::string &qs, bool head_only) {
+    ds::Query q;
+    const std::string from = query_param(qs, "from"), to = query_param(qs, "to");
+    const std::string bucket = query_param(qs, "bucket"), min_conf = query_param(qs, "min_conf");
+    const std::string zone = query_param(qs, "zone");
+    if (!from.empty()) q.from_ms = std::strtoll(from.c_str(), nullptr, 10);
+    if (!to.empty()) q.to_ms = std::strtoll(to.c_str(), nullptr, 10);
+    if (!bucket.empty()) q.bucket_ms = std::max(0LL, std::strtoll(bucket.c_str(), nullptr, 10));
+    if (!min_conf.empty()) q.min_conf = std::strtof(min_conf.c_str(), nullptr);
+    q.camera = query_param(qs, "camera");
+    q.label = query_param(qs, "label");
+    if (!zone.empty() && std::sscanf(zone.c_str(), "%f,%f,%f,%f", &q.zx0, &q.zy0, &q.zx1, &q.zy1) != 4) {
+        queue_simple(c, 400, "zone must be x0,y0,x1,y1\n", head_only);
+        return;
+    }
+    q.has_zone = !zone.empty();
+
+    ds::QueryResult res;
+    if (!g_dets.query(q, &res)) {
+        queue_simple(c, 500, "Detection store unavailable\n", head_only);
+        return;
+    }
+    const std::string body = ds::query_json(q, res) + "\n";
+    std::string r = head_line(200) + common_headers(c);
+    r += "Content-Type: application/json; charset=utf-8\r\n";
+    r += "Cache-Control: no-store\r\n";
+    r += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    if (!head_only) r += body;
+    c.out += r;
+}
+
+static void handle_request(Conn &c, const Request &req) {
+    const bool head_only = (req.method == "HEAD");
+    if (req.method != "GET" && !head_only) {
+        c.keep_alive = false;
+        queue_simple(c, 405, "Method not allowed\n", false);
+        return;
+    }
+
+    std::string path = req.path;
+    std::string qs;
+    size_t q = path.find('?');
+    if (q != std::string::npos) {
+        qs = path.substr(q + 1);
+        path.resize(q);
+    }
+
+    if (path == "/health") {
+        std::string body = "{\"ok\": true}\n";
+        std::string r = head_line(200) + common_headers(c);
+        r += "Content-Type: application/json; charset=utf-8\r\n";
+        r += "Cache-Control: no-store\r\n";
+        r += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+        if (!head_only) r += body;
+        c.out += r;
+        return;
+    }
+
+    if (path == "/detections") {
+        if (g_cfg.det_dir.empty()) {
+            queue_simple(c, 404, "Not found\n", head_only);
+            return;
+        }
+        queue_detections(c, qs, head_only);
+        return;
+    }
+
+    if (path == "/video.mjpg" || path == "/frame.jpg") {
+        if (g_cfg.frames_fd < 0) {
+            queue_simple(c, 404, "Not found\n", head_only);
+            return;
+        }
+        if (path == "/video.mjpg") {
+            c.out += head_line(200) + common_headers(c) +
+                     "Age: 0\r\n"
+                     "Cache-Control: no-store, private\r\n"
+                     "Pragma: no-cache\r\n"
+                     "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n\r\n";
+            if (!head_only) {
+                c.streaming = true;
+                // Keep the kernel backlog to a frame or two so a slow viewer
+                // falls behind by dropping frames, not by buffering them.
+                int sndbuf = 128 * 1024;
+                setsockopt(c.fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+            }
+            return;
+        }
+        int i = g_frames.acquire_latest(0);
+        if (i < 0) {
+            queue_simple(c, 503, "No frame yet\n", head_only);
+            return;
+        }
+        const FrameSlots::Frame &f = g_frames.frame(i);
+        c.out += head_line(200) + common_headers(c) +
+                 "Content-Type: image/jpeg\r\n"
+                 "Cache-Control: no-store\r\n"
+                 "Content-Length: " + std::to_string(f.data.size()) + "\r\n\r\n";
+        if (head_only) {
+            g_frames.release(i);
+        } else {
+            c.slot = i;
+            c.slot_off = 0;
+        }
+        return;
+    }
+
+    Body body;
+    if (!open_body(path, &body)) {
+        queue_simple(c, 404, "Not found\n", head_only);
+        return;
+    }
+    const int fd = body.fd;
+    const std::string &etag = body.etag;
+    const std::string last_mod = http_date(body.mtime);
+
+    auto hdr = [&](const char *k) -> const std::string * {
+        auto it = req.headers.find(k);
+        return it == req.headers.end() ? nullptr : &it->second;
+    };
+
+    bool not_modified = false;
+    if (const std::string *inm = hdr("if-none-match")) {
+        not_modified = (trim(*inm) == "*" || inm->find(etag) != std::string::npos);
+    } else if (const std::string *ims = hdr("if-modified-since")) {
+        time_t t;
+        if (parse_http_date(trim(*ims), &t) && body.mtime <= t) not_modified = true;
+    }
+
+    std::string validators;
+    validators += "ETag: " + etag + "\r\n";
+    validators += "Last-Modified: " + last_mod + "\r\n";
+    validators += "Cache-Control: no-cache\r\n";
+    validators += "Accept-Ranges: bytes\r\n";
+
+    if (not_modified) {
+        close(fd);
+        c.out += head_line(304) + common_headers(c) + validators + "\r\n";
+        return;
+    }
+
+    off_t a = 0, b = body.size - 1;
+    int range = 0;
+    if (const std::string *rv = hdr("range")) {
+        range = parse_range(*rv, body.size, &a, &b);
+        // If-Range: only honour the range when the client's copy is current.
+        if (const std::string *ir = hdr("if-range")) {
+            if (trim(*ir) != etag && trim(*ir) != last_mod) range = 0;
+        }
+        if (range == 0) { a = 0; b = body.size - 1; }
+    }
+
+    if (range < 0) {
+        close(fd);
+        std::string r = head_line(416) + common_headers(c) + validators;
+        r += "Content-Range: bytes */" + std::to_string((long long)body.size) + "\r\n";
+        r += "Content-Length: 0\r\n\r\n";
+        c.out += r;
+        return;
+    }
+
+    const off_t len = (body.size == 0) ? 0 : (b - a + 1);
+    std::string r = head_line(range > 0 ? 206 : 200) + common_headers(c) + validators;
+    r += std::string("Content-Type: ") + body.ctype + "\r\n";
+    r += "Content-Length: " + std::to_string((long long)len) + "\r\n";
+    if (range > 0) {
+        r += "Content-Range: bytes " + std::to_string((long long)a) + "-" + std::to_string((long long)b) +
+             "/" + std::to_string((long long)body.size) + "\r\n";
+    }
+    r += "\r\n";
+    c.out += r;
+
+    if (head_only || len == 0) {
+        close(fd);
+        return;
+    }
+    c.file_fd = fd;
+    c.file_off = body.base + a;
+    c.file_end = body.base + a + len;
+}
+
+// Parses one request from c.in. Returns 1 when a request was consumed,
+// 0 when more bytes are needed, -1 on a malformed request.
+static int parse_request(Conn &c, Request *req) {
+    size_t end = c.in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        return c.in.size() > 16 * 1024 ? -1 : 0;
+    }
+    std::string head = c.in.substr(0, end);
+    c.in.erase(0, end + 4);
+
+    size_t eol = head.find("\r\n");
+    std::string line = head.substr(0, eol);
+    size_t s1 = line.find(' ');
+    size_t s2 = line.rfind(' ');
+    if (s1 == std::string::npos || s2 == s1) return -1;
+    req->method = line.substr(0, s1);
+    req->path = line.substr(s1 + 1, s2 - s1 - 1);
+    req->version = line.substr(s2 + 1);
+    if (!starts_with(req->version, "HTTP/1.")) return -1;
+
+    size_t pos = (eol == std::string::npos) ? head.size() : eol + 2;
+    while (pos < head.size()) {
+        size_t e = head.find("\r\n", pos);
+        if (e == std::string::npos) e = head.size();
+        std::string h = head.substr(pos, e - pos);
+        size_t colon = h.find(':');
+        if (colon != std::string::npos) {
+            req->headers[lower(trim(h.substr(0, colon)))] = trim(h.substr(colon + 1));
+        }
+        pos = e + 2;
+    }
+
+    // We never read request bodies; refuse them rather than desync the stream.
+    auto cl = req->headers.find("content-length");
+    if (cl != req->headers.end() && std::atoll(cl->second.c_str()) > 0) return -1;
+    if (req->headers.count("transfer-encoding")) return -1;
+
+    std::string conn = lower(req->headers.count("connection") ? req->headers["connection"] : "");
+    if (req->version == "HTTP/1.0") {
+        c.keep_alive = (conn.find("keep-alive") != std::string::npos);
+    } else {
+        c.keep_alive = (conn.find("close") == std::string::npos);
+    }
+    return 1;
+}
+
+// -------------------------
+// Connection I/O
+// -------------------------
+static void close_conn(int fd) {
+    auto it = g_conns.find(fd);
+    if (it != g_conns.end()) {
+        if (it->second.file_fd >= 0) close(it->second.file_fd);
+        g_frames.release(it->second.slot);
+        g_conns.erase(it);
+    }
+    epoll_ctl(g_epfd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+}
+
+static void set_interest(Conn &c, bool want_write) {
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = (c.peer_closed ? 0u : (uint32_t)(EPOLLIN | EPOLLRDHUP)) | (want_write ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.fd = c.fd;
+    epoll_ctl(g_epfd, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+static bool response_pending(const Conn &c) {
+    return c.out_off < c.out.size() || c.file_fd >= 0 || c.slot >= 0;
+}
+
+// Queues the next multipart part for a /video.mjpg client if a newer frame
+// than the last one it got has been published. Returns false if there is none.
+static bool next_stream_frame(Conn &c) {
+    int i = g_frames.acquire_latest(c.last_seq);
+    if (i < 0) return false;
+    const FrameSlots::Frame &f = g_frames.frame(i);
+    // The CRLF closing the previous part rides in front of the next boundary.
+    if (c.last_seq) c.out += "\r\n";
+    c.out += "--frame\r\n"
+             "Content-Type: image/jpeg\r\n"
+             "Content-Length: " + std::to_string(f.data.size()) + "\r\n"
+             "X-Timestamp: " + std::to_string((double)f.ts_us / 1e6) + "\r\n\r\n";
+    c.slot = i;
+    c.slot_off = 0;
+    c.last_seq = f.seq;
+    return true;
+}
+
+// Flushes as much of the current response as the socket accepts.
+// Returns false when the connection must be closed.
+static bool flush_conn(Conn &c) {
+    while (c.out_off < c.out.size()) {
+        ssize_t n = send(c.fd, c.out.data() + c.out_off, c.out.size() - c.out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        c.out_off += (size_t)n;
+    }
+    c.out.clear();
+    c.out_off = 0;
+
+    if (c.slot >= 0) {
+        const std::vector<uint8_t> &d = g_frames.frame(c.slot).data;
+        while (c.slot_off < d.size()) {
+            ssize_t n = send(c.fd, d.data() + c.slot_off, d.size() - c.slot_off, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+                if (errno == EINTR) continue;
+                return false;
+            }
+            c.slot_off += (size_t)n;
+        }
+        g_frames.release(c.slot);
+        c.slot = -1;
+    }
+
+    while (c.file_fd >= 0 && c.file_off < c.file_end) {
+        size_t want = (size_t)std::min<off_t>(c.file_end - c.file_off, 1 << 20);
+        ssize_t n = sendfile(c.fd, c.file_fd, &c.file_off, want);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return false;  // file shrank underneath us
+    }
+    if (c.file_fd >= 0) {
+        close(c.file_fd);
+        c.file_fd = -1;
+    }
+    return true;
+}
+
+// Handles buffered requests (pipelining) until one is still in flight.
+static bool pump_conn(Conn &c) {
+    for (;;) {
+        if (!flush_conn(c)) return false;
+        if (response_pending(c)) {
+            set_interest(c, true);
+            return true;
+        }
+        if (c.streaming) {
+            if (next_stream_frame(c)) continue;
+            if (c.peer_closed) return false;
+            set_interest(c, false);
+            return true;
+        }
+        if (!c.keep_alive) return false;
+
+        Request req;
+        int r = parse_request(c, &req);
+        if (r < 0) {
+            c.keep_alive = false;
+            queue_simple(c, 400, "Bad request\n", false);
+            continue;
+        }
+        if (r == 0) {
+            if (c.peer_closed) return false;
+            set_interest(c, false);
+            return true;
+        }
+        handle_request(c, req);
+    }
+}
+
+// Most unparsed bytes a connection may buffer (pipelined requests queue up
+// here while a response is in flight); a client past it is dropped.
+static const size_t kMaxInBytes = 64 * 1024;
+
+static void on_readable(Conn &c) {
+    char buf[8192];
+    for (;;) {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            if (c.streaming) continue;  // viewers have nothing more to say
+            c.in.append(buf, (size_t)n);
+            if (c.in.size() > kMaxInBytes) {
+                close_conn(c.fd);
+                return;
+            }
+            continue;
+        }
+        if (n == 0) {
+            // Peer half-closed; answer what is already buffered, then drop.
+            c.peer_closed = true;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        close_conn(c.fd);
+        return;
+    }
+    c.last_active_ms = now_ms();
+    if (c.streaming) {
+        if (c.peer_closed) close_conn(c.fd);
+        return;
+    }
+    // Do not start new requests while a response is in flight.
+    if (response_pending(c)) {
+        if (c.peer_closed) set_interest(c, true);
+        return;
+    }
+    if (!pump_conn(c)) close_conn(c.fd);
+}
+
+// -------------------------
+// Live frame feed
+// -------------------------
+static bool read_full(int fd, void *buf, size_t n) {
+    uint8_t *p = (uint8_t *)buf;
+    while (n > 0) {
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        n -= (size_t)r;
+    }
+    return true;
+}
+
+// Producer thread: <u32 len><i64 ts_us><len bytes of JPEG>, little endian.
+// Any JPEG works, e.g. the annotated frame main.py already encodes for its
+// FrameRingQueue, or a camera's native MJPEG payload.
+static void frame_reader(int fd) {
+    std::vector<uint8_t> buf;
+    for (;;) {
+        uint8_t hdr[12];
+        if (!read_full(fd, hdr, sizeof(hdr))) break;
+        uint32_t len;
+        int64_t ts_us;
+        std::memcpy(&len, hdr, 4);
+        std::memcpy(&ts_us, hdr + 4, 8);
+        if (len > 16u * 1024u * 1024u) {
+            std::cerr << "[MEDIA] bad frame length " << len << "; closing feed\n";
+            break;
+        }
+        buf.resize(len);
+        if (!read_full(fd, buf.data(), len)) break;
+        if (g_frames.publish(buf.data(), len, ts_us)) {
+            uint64_t one = 1;
+            (void)!write(g_wake_fd, &one, sizeof(one));
+        }
+    }
+    std::cerr << "[MEDIA] frame feed closed\n";
+}
+
+static int open_listener(const Config &cfg) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)cfg.port);
+    if (inet_pton(AF_INET, cfg.host.c_str(), &addr.sin_addr) != 1) {
+        close(fd);
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// -------------------------
+// Main
+// -------------------------
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto need = [&](const char *flag) {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << flag << "\n";
+                usage(argv[0]);
+                std::exit(2);
+            }
+        };
+
+        if (a == "--root") { need("--root"); g_cfg.root = argv[++i]; }
+        else if (a == "--host") { need("--host"); g_cfg.host = argv[++i]; }
+        else if (a == "--port") { need("--port"); g_cfg.port = std::atoi(argv[++i]); }
+        else if (a == "--idle_timeout") { need("--idle_timeout"); g_cfg.idle_timeout_s = std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--store") { need("--store"); g_cfg.store_dir = argv[++i]; }
+        else if (a == "--detections") { need("--detections"); g_cfg.det_dir = argv[++i]; }
+        else if (a == "--frames_fd") { need("--frames_fd"); g_cfg.frames_fd = std::atoi(argv[++i]); }
+        else if (a == "--help" || a == "-h") { usage(argv[0]); return 0; }
+        else {
+            std::cerr << "Unknown arg: " << a << "\n";
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!g_cfg.store_dir.empty()) {
+        std::string err;
+        if (!g_store.open(g_cfg.store_dir, true, &err)) {
+            std::fprintf(stderr, "event store: %s\n", err.c_str());
+            return 1;
+        }
+        g_use_store = true;
+    }
+
+    if (!g_cfg.det_dir.empty()) {
+        std::string err;
+        if (!g_dets.open(g_cfg.det_dir, &err)) {
+            std::fprintf(stderr, "detection store: %s\n", err.c_str());
+            return 1;
+        }
+    }
+
+    int lfd = open_listener(g_cfg);
+    if (lfd < 0) {
+        std::fprintf(stderr, "listen on %s:%d failed: %s\n", g_cfg.host.c_str(), g_cfg.port, std::strerror(errno));
+        return 1;
+    }
+
+    g_epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = lfd;
+    epoll_ctl(g_epfd, EPOLL_CTL_ADD, lfd, &ev);
+
+    if (g_cfg.frames_fd >= 0) {
+        g_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ev.events = EPOLLIN;
+        ev.data.fd = g_wake_fd;
+        epoll_ctl(g_epfd, EPOLL_CTL_ADD, g_wake_fd, &ev);
+        std::thread(frame_reader, g_cfg.frames_fd).detach();
+    }
+
+    std::cerr << "[MEDIA] http://" << g_cfg.host << ":" << g_cfg.port << "  root=" << g_cfg.root << "\n";
+
+    std::vector<struct epoll_event> events(256);
+    int64_t last_sweep = now_ms();
+    for (;;) {
+        int n = epoll_wait(g_epfd, events.data(), (int)events.size(), 1000);
+        if (n < 0 && errno != EINTR) {
+            std::perror("epoll_wait");
+            return 1;
+        }
+
+        for (int k = 0; k < n; k++) {
+            int fd = events[k].data.fd;
+            uint32_t e = events[k].events;
+
+            if (fd == lfd) {
+                for (;;) {
+                    int cfd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (cfd < 0) break;
+                    int one = 1;
+                    setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    Conn c;
+                    c.fd = cfd;
+                    c.last_active_ms = now_ms();
+                    g_conns[cfd] = std::move(c);
+                    struct epoll_event cev;
+                    std::memset(&cev, 0, sizeof(cev));
+                    cev.events = EPOLLIN | EPOLLRDHUP;
+                    cev.data.fd = cfd;
+                    epoll_ctl(g_epfd, EPOLL_CTL_ADD, cfd, &cev);
+                }
+                continue;
+            }
+
+            if (fd == g_wake_fd) {
+                uint64_t cnt;
+                (void)!read(g_wake_fd, &cnt, sizeof(cnt));
+                // New frame: start it on every viewer that is not mid-send.
+                std::vector<int> dead;
+                for (auto &kv : g_conns) {
+                    Conn &sc = kv.second;
+                    if (!sc.streaming || response_pending(sc)) continue;
+                    if (!pump_conn(sc)) dead.push_back(kv.first);
+                }
+                for (int dfd : dead) close_conn(dfd);
+                continue;
+            }
+
+            auto it = g_conns.find(fd);
+            if (it == g_conns.end()) continue;
+            Conn &c = it->second;
+
+            if (e & (EPOLLERR | EPOLLHUP)) {
+                close_conn(fd);
+                continue;
+            }
+            if (e & EPOLLOUT) {
+                c.last_active_ms = now_ms();
+                if (!pump_conn(c)) {
+                    close_conn(fd);
+                    continue;
+                }
+            }
+            if (e & (EPOLLIN | EPOLLRDHUP)) {
+                on_readable(c);
+            }
+        }
+
+        // Drop idle keep-alive connections.
+        int64_t t = now_ms();
+        if (t - last_sweep >= 1000) {
+            last_sweep = t;
+            std::vector<int> idle;
+            for (auto &kv : g_conns) {
+                if (kv.second.streaming) continue;
+                if (t - kv.second.last_active_ms > (int64_t)g_cfg.idle_timeout_s * 1000) idle.push_back(kv.first);
+            }
+            for (int fd : idle) close_conn(fd);
+        }
+    }
+}
@@ -0,0 +1,196 @@
+// ~/ArduinoApps/survillance/cpp_infer/memory_budget.cpp
+// See memory_budget.h.
+
+#include "memory_budget.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "engine.h"
+
+namespace engine {
+
+namespace {
+
+std::atomic<int64_t> g_bytes[(int)Pool::Count];
+std::atomic<int64_t> g_peak[(int)Pool::Count];
+
+// Detections one classifier run adds at most, for the estimate
+constexpr int64_t kBoxesPerRun = 10;
+
+// "Key:   1234 kB" lines of /proc files -> kB
+int64_t proc_kb(const std::string &path, const std::string &key) {
+    std::ifstream f(path);
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.compare(0, key.size(), key) == 0 && line.size() > key.size() && line[key.size()] == ':') {
+            return std::strtoll(line.c_str() + key.size() + 1, nullptr, 10);
+        }
+    }
+    return -1;
+}
+
+// cgroup v2 byte counter in kB; -1 for "max" or a missing file
+int64_t cgroup_kb(const std::string &path) {
+    std::ifstream f(path);
+    std::string s;
+    if (!f || !std::getline(f, s) || s.empty() || s == "max") return -1;
+    return std::strtoll(s.c_str(), nullptr, 10) / 1024;
+}
+
+int decoder_threads(const Options &opt) {
+    return opt.decode_threads > 0 ? opt.decode_threads : (int)std::max(1u, std::thread::hardware_concurrency());
+}
+
+}  // namespace
+
+const char *pool_name(Pool p) {
+    switch (p) {
+        case Pool::Clip: return "clip";
+        case Pool::Decoder: return "decoder";
+        case Pool::Frames: return "frames";
+        case Pool::Detections: return "detections";
+        case Pool::Arena: return "tensor_arena";
+        default: return "?";
+    }
+}
+
+void pool_charge(Pool p, int64_t bytes) {
+    if (!bytes) return;
+    const int64_t cur = g_bytes[(int)p].fetch_add(bytes) + bytes;
+    int64_t peak = g_peak[(int)p].load();
+    while (cur > peak && !g_peak[(int)p].compare_exchange_weak(peak, cur)) {
+    }
+}
+
+int64_t pool_bytes(Pool p) { return g_bytes[(int)p].load(); }
+int64_t pool_peak(Pool p) { return g_peak[(int)p].load(); }
+
+void reset_pool_peaks() {
+    for (int i = 0; i < (int)Pool::Count; i++) g_peak[i].store(g_bytes[i].load());
+}
+
+MemorySample read_memory(const std::string &proc_root, const std::string &cgroup_root) {
+    MemorySample s;
+    s.rss_kb = proc_kb(proc_root + "/self/status", "VmRSS");
+    s.peak_kb = proc_kb(proc_root + "/self/status", "VmHWM");
+    s.avail_kb = proc_kb(proc_root + "/meminfo", "MemAvailable");
+
+    // cgroup v2: "0::/system.slice/survi.service"
+    std::ifstream f(proc_root + "/self/cgroup");
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.compare(0, 3, "0::") != 0) continue;
+        std::string dir = cgroup_root + line.substr(3);
+        while (!dir.empty() && dir.back() == '/') dir.pop_back();
+        s.cgroup_max_kb = cgroup_kb(dir + "/memory.max");
+        if (s.cgroup_max_kb >= 0) s.cgroup_used_kb = cgroup_kb(dir + "/memory.current");
+    }
+    return s;
+}
+
+// -------------------------
+// Governor
+// -------------------------
+int64_t MemoryGovernor::estimate_kb(const Options &opt, int64_t clip_bytes) const {
+    const int64_t frame_kb = opt.fidelity == dec::Fidelity::Fast ? frame_kb_ / 4 : frame_kb_;
+    const int64_t decoder = frame_kb * (decoder_threads(opt) + 2);
+    const int64_t clip = opt.preload ? clip_bytes / 1024 : 0;
+    const int64_t tiles = std::max(1, opt.tiles);
+    const int64_t dets = (int64_t)std::max(1, opt.frames) * tiles * tiles * kBoxesPerRun * (int64_t)sizeof(Detection);
+    return decoder + clip + dets / 1024 + 1;
+}
+
+MemoryNote MemoryGovernor::budget(Options *opt) {
+    std::lock_guard<std::mutex> lk(mu_);
+    MemoryNote n;
+    n.active = true;
+    n.limit_mb = cfg_.limit_mb;
+    n.frames_requested = opt->frames;
+    n.tiles_requested = opt->tiles;
+
+    // "5": reset VmHWM. Only while idle: the peaks are process-wide, and
+    // other clips may be running
+    if (in_flight_ == 0) {
+        std::ofstream(proc_ + "/self/clear_refs") << "5";
+        reset_pool_peaks();
+    }
+    n.before = read_memory(proc_, cgroup_);
+
+    // What the clips in flight already hold counts in RSS; what they were
+    // promised beyond that is reserved_kb_ (over-counted, never under)
+    int64_t headroom = (int64_t)cfg_.limit_mb * 1024 - std::max<int64_t>(0, n.before.rss_kb);
+    if (n.before.avail_kb >= 0) headroom = std::min(headroom, n.before.avail_kb - (int64_t)cfg_.reserve_mb * 1024);
+    if (n.before.cgroup_max_kb >= 0 && n.before.cgroup_used_kb >= 0) {
+        headroom = std::min(headroom, n.before.cgroup_max_kb - n.before.cgroup_used_kb);
+    }
+    headroom -= reserved_kb_;
+    n.headroom_kb = headroom;
+    if (cfg_.max_detections > 0) {
+        opt->max_detections = opt->max_detections > 0 ? std::min(opt->max_detections, cfg_.max_detections)
+                                                       : cfg_.max_detections;
+    }
+
+    struct stat st;
+    const int64_t clip_bytes = opt->preload && ::stat(opt->mp4_path.c_str(), &st) == 0 ? (int64_t)st.st_size : 0;
+    n.estimate_kb = estimate_kb(*opt, clip_bytes);
+
+    // Over the budget already: nothing fits, every step is taken
+    const bool over = headroom <= 0;
+    auto fits = [&] { return !over && estimate_kb(*opt, clip_bytes) <= headroom; };
+    std::vector<std::string> steps;
+    if (!fits() && opt->preload) {
+        opt->preload = false;
+        n.preload_off = true;
+        steps.push_back("no preload");
+    }
+    if (!fits() && decoder_threads(*opt) > 1) {
+        opt->decode_threads = n.decode_threads = 1;
+        steps.push_back("1 decode thread");
+    }
+    if (!fits() && opt->fidelity == dec::Fidelity::Full) {
+        opt->fidelity = dec::Fidelity::Fast;
+        n.fast_decode = true;
+        steps.push_back("fast decode");
+    }
+    if (!fits() && opt->tiles > 1) {
+        opt->tiles = 1;
+        steps.push_back("1 tile");
+    }
+    const int frames0 = opt->frames;
+    while (!fits() && opt->frames > 1) opt->frames = std::max(1, opt->frames / 2);
+    if (opt->frames != frames0) steps.push_back("frames " + std::to_string(frames0) + "->" + std::to_string(opt->frames));
+
+    for (size_t i = 0; i < steps.size(); i++) n.reason += (i ? ", " : "") + steps[i];
+    if (over) n.reason = "over budget" + (n.reason.empty() ? std::string() : ": " + n.reason);
+    n.frames = opt->frames;
+    n.tiles = opt->tiles;
+    n.lowres = opt->fidelity == dec::Fidelity::Fast;
+    n.reserved_kb = estimate_kb(*opt, clip_bytes);
+    reserved_kb_ += n.reserved_kb;
+    in_flight_++;
+    return n;
+}
+
+void MemoryGovernor::finish(MemoryNote *note, int64_t frame_bytes) {
+    std::lock_guard<std::mutex> lk(mu_);
+    reserved_kb_ -= note->reserved_kb;
+    note->reserved_kb = 0;
+    in_flight_--;
+
+    const MemorySample s = read_memory(proc_, cgroup_);
+    note->rss_kb = s.rss_kb;
+    note->peak_rss_kb = s.peak_kb;
+    for (int i = 0; i < (int)Pool::Count; i++) note->pool_peak[i] = pool_peak((Pool)i);
+
+    // This clip's own decoded size, not the shared Decoder pool's peak
+    if (frame_bytes > 0) frame_kb_ = std::max<int64_t>(1, (note->lowres ? frame_bytes * 4 : frame_bytes) / 1024);
+}
+
+}  // namespace engine
@@ -0,0 +1,131 @@
+// ~/ArduinoApps/survillance/cpp_infer/memory_budget.h
+// Hard memory budget for low-RAM hubs (512 MB - 1 GB).
+//
+// The capture loop's JPEG ring, the Python interpreter and the runner share
+// the board's RAM, and an OOM kill loses the event being analysed. With a
+// budget, the governor reads before each clip
+//   /proc/self/status                 VmRSS (the peak is reset through
+//                                     /proc/self/clear_refs while no clip
+//                                     is in flight)
+//   /proc/meminfo                     MemAvailable: the rest of the board
+//   /sys/fs/cgroup/memory.max         cgroup v2 limit and usage, when the
+//   /sys/fs/cgroup/memory.current     service runs under a tighter one
+// and estimates what the clip will add: the preloaded file, the decoder's
+// frames (decoded size x (threads + 2), learned from the last clip) and the
+// detections. What does not fit is degraded instead of failed, one step at
+// a time until it does: stream instead of preload, one decoder thread, the
+// fast (lowres) decode, one tile, then half the frames down to one. Already
+// over the budget, every step is taken.
+//
+// One governor may be shared by clips analysed at once (ei_infer_mp4
+// --batch): each clip's estimate stays reserved until it finishes, and the
+// next clip only gets the headroom left after the reservations.
+//
+// analyze_clip() charges what it holds to process-wide pools (preloaded clip,
+// decoder estimate, frame buffers, detections, tensor arena); the peak RSS
+// and each pool's high-water mark go into result.json ("memory"); with clips
+// in parallel they cover all of them since the governor was last idle. A clip
+// keeps at most MemoryConfig::max_detections detections (the most
+// confident), which also caps the detection store's rows per event.
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace engine {
+
+struct Options;
+
+enum class Pool { Clip = 0, Decoder, Frames, Detections, Arena, Count };
+const char *pool_name(Pool p);
+
+// Process-wide bytes held per pool and the high-water mark since the last
+// reset_pool_peaks().
+void pool_charge(Pool p, int64_t bytes);  // negative: release
+int64_t pool_bytes(Pool p);
+int64_t pool_peak(Pool p);
+void reset_pool_peaks();
+
+// Scoped charge that can be resized.
+class PoolCharge {
+public:
+    explicit PoolCharge(Pool p, int64_t bytes = 0) : pool_(p) { set(bytes); }
+    ~PoolCharge() { set(0); }
+    PoolCharge(const PoolCharge &) = delete;
+    PoolCharge &operator=(const PoolCharge &) = delete;
+
+    void set(int64_t bytes) {
+        pool_charge(pool_, bytes - bytes_);
+        bytes_ = bytes;
+    }
+
+private:
+    Pool pool_;
+    int64_t bytes_ = 0;
+};
+
+struct MemorySample {
+    int64_t rss_kb = -1;       // VmRSS
+    int64_t peak_kb = -1;      // VmHWM
+    int64_t avail_kb = -1;     // MemAvailable
+    int64_t cgroup_max_kb = -1, cgroup_used_kb = -1;  // -1: none / unlimited
+};
+
+MemorySample read_memory(const std::string &proc_root = "/proc", const std::string &cgroup_root = "/sys/fs/cgroup");
+
+struct MemoryConfig {
+    int limit_mb = 0;              // 0: no budget
+    int reserve_mb = 32;           // MemAvailable kept free for the rest of the board
+    int max_detections = 512;      // per clip, under a budget
+};
+
+// What a budget did to one clip (Result::memory).
+struct MemoryNote {
+    bool active = false;
+    int limit_mb = 0;
+    MemorySample before;
+    int64_t headroom_kb = 0;       // what the clip may add
+    int64_t estimate_kb = 0;       // what it would have added as requested
+    int64_t reserved_kb = 0;       // held for the clip until finish()
+    int frames_requested = 0, tiles_requested = 0;
+    int frames = 0, tiles = 0;
+    bool preload_off = false, fast_decode = false;
+    bool lowres = false;           // the clip decodes lowres (by request or budget)
+    int decode_threads = 0;        // 0: unchanged
+    std::string reason;            // steps taken, e.g. "no preload, 1 decode thread"
+    // After the clip
+    int64_t rss_kb = -1, peak_rss_kb = -1;
+    int64_t pool_peak[(int)Pool::Count] = {};
+};
+
+class MemoryGovernor {
+public:
+    explicit MemoryGovernor(const MemoryConfig &cfg = MemoryConfig(), const std::string &proc_root = "/proc",
+                            const std::string &cgroup_root = "/sys/fs/cgroup")
+        : cfg_(cfg), proc_(proc_root), cgroup_(cgroup_root) {}
+
+    // Between clips only
+    void set_limit_mb(int mb) { cfg_.limit_mb = mb; }
+    bool enabled() const { return cfg_.limit_mb > 0; }
+
+    // Reads the process / board, scales opt down until the clip's estimate
+    // fits what the clips in flight left, and reserves it. Thread-safe.
+    MemoryNote budget(Options *opt);
+    // Returns the reservation, reads the peak RSS and pool high-water marks
+    // and learns the decoded frame size (bytes; 0: none decoded) for the
+    // next estimate. Call it once per budget(), however the clip ended.
+    void finish(MemoryNote *note, int64_t frame_bytes);
+
+private:
+    int64_t estimate_kb(const Options &opt, int64_t clip_bytes) const;
+
+    std::mutex mu_;
+    MemoryConfig cfg_;
+    std::string proc_, cgroup_;
+    int64_t frame_kb_ = 3 * 1024;  // one full-fidelity decoded frame (1080p yuv420 until measured)
+    int64_t reserved_kb_ = 0;      // estimates of the clips in flight
+    int in_flight_ = 0;
+};
+
+}  // namespace engine
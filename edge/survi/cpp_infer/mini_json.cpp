@@ -0,0 +1,197 @@
+// ~/ArduinoApps/survillance/cpp_infer/mini_json.cpp
+// See mini_json.h.
+
+#include "mini_json.h"
+
+#include <cstdlib>
+
+namespace mj {
+
+const Value *Value::get(const std::string &key) const {
+    if (type != Object) return nullptr;
+    for (const auto &kv : obj) {
+        if (kv.first == key) return &kv.second;
+    }
+    return nullptr;
+}
+
+std::string Value::get_str(const std::string &key, const std::string &def) const {
+    const Value *v = get(key);
+    return (v && v->type == String) ? v->str : def;
+}
+
+double Value::get_num(const std::string &key, double def) const {
+    const Value *v = get(key);
+    return (v && v->type == Number) ? v->num : def;
+}
+
+bool Value::get_bool(const std::string &key, bool def) const {
+    const Value *v = get(key);
+    return (v && v->type == Bool) ? v->b : def;
+}
+
+// -------------------------
+// Parser
+// -------------------------
+namespace {
+
+struct Parser {
+    const std::string &s;
+    size_t i = 0;
+    std::string err;
+    int depth = 0;
+
+    explicit Parser(const std::string &text) : s(text) {}
+
+    bool fail(const char *what) {
+        if (err.empty()) err = std::string(what) + " at offset " + std::to_string(i);
+        return false;
+    }
+
+    void ws() {
+        while (i < s.size() && (s[i] == ' ' || s[i] == '\t' || s[i] == '\n' || s[i] == '\r')) i++;
+    }
+
+    bool lit(const char *word) {
+        size_t n = 0;
+        while (word[n]) n++;
+        if (s.compare(i, n, word) != 0) return fail("bad literal");
+        i += n;
+        return true;
+    }
+
+    static void put_utf8(std::string &o, unsigned cp) {
+        if (cp < 0x80) {
+            o += (char)cp;
+        } else if (cp < 0x800) {
+            o += (char)(0xC0 | (cp >> 6));
+            o += (char)(0x80 | (cp & 0x3F));
+        } else {
+            o += (char)(0xE0 | (cp >> 12));
+            o += (char)(0x80 | ((cp >> 6) & 0x3F));
+            o += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool string(std::string *out) {
+        if (s[i] != '"') return fail("expected string");
+        i++;
+        while (i < s.size() && s[i] != '"') {
+            char c = s[i++];
+            if (c != '\\') {
+                *out += c;
+                continue;
+            }
+            if (i >= s.size()) break;
+            c = s[i++];
+            switch (c) {
+                case '"': case '\\': case '/': *out += c; break;
+                case 'b': *out += '\b'; break;
+                case 'f': *out += '\f'; break;
+                case 'n': *out += '\n'; break;
+                case 'r': *out += '\r'; break;
+                case 't': *out += '\t'; break;
+                case 'u': {
+                    if (i + 4 > s.size()) return fail("short \\u escape");
+                    char *end = nullptr;
+                    const std::string hex = s.substr(i, 4);
+                    const unsigned cp = (unsigned)std::strtoul(hex.c_str(), &end, 16);
+                    if (*end) return fail("bad \\u escape");
+                    put_utf8(*out, cp);
+                    i += 4;
+                    break;
+                }
+                default: return fail("bad escape");
+            }
+        }
+        if (i >= s.size()) return fail("unterminated string");
+        i++;
+        return true;
+    }
+
+    bool value(Value *v) {
+        if (++depth > 32) return fail("nesting too deep");
+        ws();
+        if (i >= s.size()) return fail("unexpected end");
+        bool ok = true;
+        const char c = s[i];
+        if (c == '{') {
+            v->type = Value::Object;
+            i++;
+            ws();
+            if (i < s.size() && s[i] == '}') {
+                i++;
+            } else {
+                for (;;) {
+                    ws();
+                    std::string key;
+                    if (i >= s.size() || !string(&key)) { ok = fail("expected key"); break; }
+                    ws();
+                    if (i >= s.size() || s[i] != ':') { ok = fail("expected ':'"); break; }
+                    i++;
+                    v->obj.emplace_back(std::move(key), Value());
+                    if (!value(&v->obj.back().second)) { ok = false; break; }
+                    ws();
+                    if (i < s.size() && s[i] == ',') { i++; continue; }
+                    if (i < s.size() && s[i] == '}') { i++; break; }
+                    ok = fail("expected ',' or '}'");
+                    break;
+                }
+            }
+        } else if (c == '[') {
+            v->type = Value::Array;
+            i++;
+            ws();
+            if (i < s.size() && s[i] == ']') {
+                i++;
+            } else {
+                for (;;) {
+                    v->arr.emplace_back();
+                    if (!value(&v->arr.back())) { ok = false; break; }
+                    ws();
+                    if (i < s.size() && s[i] == ',') { i++; continue; }
+                    if (i < s.size() && s[i] == ']') { i++; break; }
+                    ok = fail("expected ',' or ']'");
+                    break;
+                }
+            }
+        } else if (c == '"') {
+            v->type = Value::String;
+            ok = string(&v->str);
+        } else if (c == 't' || c == 'f') {
+            v->type = Value::Bool;
+            v->b = (c == 't');
+            ok = lit(v->b ? "true" : "false");
+        } else if (c == 'n') {
+            v->type = Value::Null;
+            ok = lit("null");
+        } else {
+            char *end = nullptr;
+            v->type = Value::Number;
+            v->num = std::strtod(s.c_str() + i, &end);
+            if (end == s.c_str() + i) {
+                ok = fail("unexpected character");
+            } else {
+                i = (size_t)(end - s.c_str());
+            }
+        }
+        depth--;
+        return ok;
+    }
+};
+
+}  // namespace
+
+bool parse(const std::string &text, Value *out, std::string *err) {
+    Parser p(text);
+    *out = Value();
+    bool ok = p.value(out);
+    if (ok) {
+        p.ws();
+        if (p.i != text.size()) ok = p.fail("trailing data");
+    }
+    if (!ok && err) *err = p.err;
+    return ok;
+}
+
+}  // namespace mj
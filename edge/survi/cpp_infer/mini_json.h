@@ -0,0 +1,33 @@
+// ~/ArduinoApps/survillance/cpp_infer/mini_json.h
+// Just enough JSON to read one-line requests (survi_inferd): objects,
+// arrays, strings (with \uXXXX for the BMP), numbers, true/false/null.
+// Writing stays hand-rolled with json_escape(), like the rest of cpp_infer.
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mj {
+
+struct Value {
+    enum Type { Null, Bool, Number, String, Array, Object } type = Null;
+    bool b = false;
+    double num = 0;
+    std::string str;
+    std::vector<Value> arr;
+    std::vector<std::pair<std::string, Value>> obj;
+
+    // Object member or nullptr.
+    const Value *get(const std::string &key) const;
+
+    // Typed member lookups with a default for missing / mistyped members.
+    std::string get_str(const std::string &key, const std::string &def = "") const;
+    double get_num(const std::string &key, double def = 0) const;
+    bool get_bool(const std::string &key, bool def = false) const;
+};
+
+// Whole input must be one value (surrounding whitespace allowed).
+bool parse(const std::string &text, Value *out, std::string *err);
+
+}  // namespace mj
@@ -0,0 +1,183 @@
+// ~/ArduinoApps/survillance/cpp_infer/model_file.cpp
+// See model_file.h.
+
+#include "model_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace engine {
+
+namespace {
+
+// TFLite schema field numbers we read
+constexpr int kModelSubgraphs = 2;
+constexpr int kSubgraphTensors = 0, kSubgraphInputs = 1, kSubgraphOutputs = 2;
+constexpr int kTensorShape = 0, kTensorType = 1;
+
+// Little-endian FlatBuffer reads; every offset is checked against the size.
+struct FlatBuf {
+    const uint8_t *p;
+    size_t n;
+
+    template <class T>
+    bool get(size_t off, T *v) const {
+        if (off > n || n - off < sizeof(T)) return false;
+        std::memcpy(v, p + off, sizeof(T));
+        return true;
+    }
+
+    // uoffset at pos -> absolute position
+    bool deref(size_t pos, size_t *out) const {
+        uint32_t o;
+        if (!get(pos, &o) || (size_t)o >= n - pos) return false;
+        *out = pos + o;
+        return true;
+    }
+
+    // Position of field i of the table at t; 0 if the field is absent.
+    bool field(size_t t, int i, size_t *pos) const {
+        int32_t so;
+        if (!get(t, &so)) return false;
+        const int64_t vt = (int64_t)t - so;
+        uint16_t vsize, fo = 0;
+        if (vt < 0 || !get((size_t)vt, &vsize)) return false;
+        if (4 + 2 * i + 2 <= vsize && !get((size_t)vt + 4 + 2 * i, &fo)) return false;
+        *pos = fo ? t + fo : 0;
+        return true;
+    }
+
+    // Vector of 4-byte elements (int32s or table offsets) in field i.
+    bool vec(size_t t, int i, size_t *elems, uint32_t *len) const {
+        size_t f, v;
+        if (!field(t, i, &f)) return false;
+        if (!f) {
+            *len = 0;
+            return true;
+        }
+        if (!deref(f, &v) || !get(v, len)) return false;
+        *elems = v + 4;
+        return *len <= (n - *elems) / 4;
+    }
+
+    bool tensor(size_t sg, int32_t index, TensorInfo *out) const {
+        size_t tensors, t, f;
+        uint32_t count;
+        if (!vec(sg, kSubgraphTensors, &tensors, &count) || index < 0 || (uint32_t)index >= count) return false;
+        if (!deref(tensors + 4 * (size_t)index, &t)) return false;
+
+        int8_t type = 0;  // schema default FLOAT32
+        if (!field(t, kTensorType, &f) || (f && !get(f, &type))) return false;
+        out->type = type;
+
+        size_t dims;
+        uint32_t rank;
+        if (!vec(t, kTensorShape, &dims, &rank)) return false;
+        out->shape.resize(rank);
+        for (uint32_t d = 0; d < rank; d++) {
+            if (!get(dims + 4 * d, &out->shape[d])) return false;
+        }
+        return true;
+    }
+};
+
+const char *type_name(int type) {
+    switch (type) {
+        case 0: return "float32";
+        case 1: return "float16";
+        case 2: return "int32";
+        case 3: return "uint8";
+        case 4: return "int64";
+        case 7: return "int16";
+        case 9: return "int8";
+        default: return "type?";
+    }
+}
+
+int64_t mtime_ns(const struct stat &st) {
+    return (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+}  // namespace
+
+std::string TensorInfo::str() const {
+    std::string s = std::string(type_name(type)) + "[";
+    for (size_t i = 0; i < shape.size(); i++) s += (i ? "," : "") + std::to_string(shape[i]);
+    return s + "]";
+}
+
+bool read_tflite_info(const uint8_t *p, size_t n, ModelInfo *out, std::string *err) {
+    const FlatBuf fb{p, n};
+    if (n < 8 || std::memcmp(p + 4, "TFL3", 4) != 0) {
+        *err = "not a TFLite model (no TFL3 identifier)";
+        return false;
+    }
+    size_t model, subgraphs, sg;
+    uint32_t n_subgraphs, n_in, n_out;
+    size_t ins, outs;
+    if (!fb.deref(0, &model) || !fb.vec(model, kModelSubgraphs, &subgraphs, &n_subgraphs) || n_subgraphs == 0 ||
+        !fb.deref(subgraphs, &sg) || !fb.vec(sg, kSubgraphInputs, &ins, &n_in) ||
+        !fb.vec(sg, kSubgraphOutputs, &outs, &n_out) || n_in == 0 || n_out == 0) {
+        *err = "malformed TFLite model (subgraph)";
+        return false;
+    }
+    int32_t in0, out0;
+    if (!fb.get(ins, &in0) || !fb.get(outs, &out0) || !fb.tensor(sg, in0, &out->input) ||
+        !fb.tensor(sg, out0, &out->output)) {
+        *err = "malformed TFLite model (tensors)";
+        return false;
+    }
+    out->inputs = n_in;
+    out->outputs = n_out;
+    return true;
+}
+
+std::shared_ptr<const ModelFile> ModelFile::open(const std::string &path, std::string *err) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        *err = path + ": " + std::strerror(errno);
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        *err = path + ": empty or unreadable";
+        ::close(fd);
+        return nullptr;
+    }
+    void *m = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) {
+        *err = path + ": mmap: " + std::strerror(errno);
+        return nullptr;
+    }
+
+    std::shared_ptr<ModelFile> f(new ModelFile());
+    f->path_ = path;
+    f->data_ = (const uint8_t *)m;
+    f->size_ = (size_t)st.st_size;
+    f->dev_ = st.st_dev;
+    f->ino_ = st.st_ino;
+    f->mtime_ns_ = mtime_ns(st);
+    if (!read_tflite_info(f->data_, f->size_, &f->info_, err)) {
+        *err = path + ": " + *err;
+        return nullptr;
+    }
+    return f;
+}
+
+ModelFile::~ModelFile() {
+    if (data_) ::munmap((void *)data_, size_);
+}
+
+bool ModelFile::stale() const {
+    struct stat st;
+    if (::stat(path_.c_str(), &st) != 0) return true;
+    return st.st_dev != dev_ || st.st_ino != ino_ || (size_t)st.st_size != size_ || mtime_ns(st) != mtime_ns_;
+}
+
+}  // namespace engine
@@ -0,0 +1,71 @@
+// ~/ArduinoApps/survillance/cpp_infer/model_file.h
+// A .tflite model read from disk instead of compiled in (tflite-model/*.cpp).
+//
+// The file is mmap'd read-only and shared, so every runner and the daemon
+// use the same page-cache copy of the weights, and pages are only faulted in
+// as the interpreter touches them. The FlatBuffer is walked just far enough
+// to read the first subgraph's input and output tensors (type and shape);
+// engine::use_model() compares those with the compiled model before it runs
+// anything from the file.
+//
+// Updating a model: write the new file next to the old one and rename() it
+// over. Open mappings keep the old inode alive; stale() tells a long-lived
+// owner (survi_inferd) that the path now names a different file.
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace engine {
+
+struct TensorInfo {
+    int type = -1;           // TFLite TensorType: 0 float32, 3 uint8, 9 int8, ...
+    std::vector<int> shape;  // e.g. 1,160,160,3
+    bool operator==(const TensorInfo &o) const { return type == o.type && shape == o.shape; }
+    bool operator!=(const TensorInfo &o) const { return !(*this == o); }
+    std::string str() const;  // "int8[1,160,160,3]"
+};
+
+struct ModelInfo {
+    size_t inputs = 0, outputs = 0;  // tensors in the first subgraph's lists
+    TensorInfo input, output;        // the first of each
+};
+
+// Bounds-checked walk of a TFLite FlatBuffer (identifier "TFL3").
+bool read_tflite_info(const uint8_t *p, size_t n, ModelInfo *out, std::string *err);
+
+class ModelFile {
+public:
+    // mmap + read_tflite_info; nullptr with *err on failure.
+    static std::shared_ptr<const ModelFile> open(const std::string &path, std::string *err);
+    ~ModelFile();
+
+    ModelFile(const ModelFile &) = delete;
+    ModelFile &operator=(const ModelFile &) = delete;
+
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string &path() const { return path_; }
+    const ModelInfo &info() const { return info_; }
+
+    // path() now names another file (or a modified one, or none).
+    bool stale() const;
+
+private:
+    ModelFile() = default;
+
+    std::string path_;
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    ModelInfo info_;
+    dev_t dev_ = 0;
+    ino_t ino_ = 0;
+    int64_t mtime_ns_ = 0;
+};
+
+}  // namespace engine
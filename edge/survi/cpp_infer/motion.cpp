@@ -0,0 +1,40 @@
+// ~/ArduinoApps/survillance/cpp_infer/motion.cpp
+// See motion.h.
+
+#include "motion.h"
+
+MotionDetector::MotionDetector(const MotionParams &p) : p_(p) {
+    if (p_.background) {
+        bgm::BgConfig cfg;
+        cfg.min_diff = (float)p_.pixel_thresh;
+        bg_.reset(new bgm::BackgroundModel(cfg));
+    }
+}
+
+MotionResult MotionDetector::update(const cv::Mat &bgr) {
+    MotionResult r;
+    cv::cvtColor(bgr, gray_, cv::COLOR_BGR2GRAY);
+    cv::GaussianBlur(gray_, gray_, cv::Size(9, 9), 0);
+    if (bg_) {
+        mask_.create(gray_.size(), CV_8UC1);
+        if (bg_->update(gray_.data, gray_.cols, gray_.rows, gray_.step, mask_.data, mask_.step) == 0) return r;
+    } else {
+        if (prev_.empty() || prev_.size() != gray_.size()) {
+            gray_.copyTo(prev_);
+            return r;
+        }
+        cv::absdiff(prev_, gray_, diff_);
+        cv::threshold(diff_, mask_, p_.pixel_thresh, 255, cv::THRESH_BINARY);
+    }
+    cv::dilate(mask_, mask_, cv::Mat(), cv::Point(-1, -1), p_.dilate_iters);
+    cv::findContours(mask_, contours_, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    for (const auto &c : contours_) {
+        const double area = cv::contourArea(c);
+        if (area < p_.area_min) continue;
+        r.boxes.push_back(cv::boundingRect(c));
+        r.total_area += (int)area;
+    }
+    r.motion = !r.boxes.empty();
+    if (!bg_) std::swap(prev_, gray_);
+    return r;
+}
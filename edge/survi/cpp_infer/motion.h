@@ -0,0 +1,46 @@
+// ~/ArduinoApps/survillance/cpp_infer/motion.h
+// Frame-difference motion detector, the same steps and defaults as the
+// capture loop in main.py (motion_* keys in config.json):
+//   gray -> GaussianBlur 9x9 -> absdiff(prev) -> threshold -> dilate
+//   -> external contours with area >= area_min
+// With `background` the absdiff/threshold step is replaced by the adaptive
+// background model (bg_model.h); dilate and the area gating are unchanged.
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "bg_model.h"
+
+struct MotionParams {
+    int pixel_thresh = 25;
+    int dilate_iters = 2;
+    int area_min = 1200;
+    bool background = false;  // bg_model.h instead of frame difference
+};
+
+struct MotionResult {
+    bool motion = false;
+    std::vector<cv::Rect> boxes;
+    int total_area = 0;
+};
+
+class MotionDetector {
+public:
+    explicit MotionDetector(const MotionParams &p = MotionParams());
+
+    // First frame only primes the reference: no motion.
+    MotionResult update(const cv::Mat &bgr);
+    void reset() {
+        prev_.release();
+        if (bg_) bg_->reset();
+    }
+
+private:
+    MotionParams p_;
+    std::unique_ptr<bgm::BackgroundModel> bg_;
+    cv::Mat prev_, gray_, diff_, mask_;
+    std::vector<std::vector<cv::Point>> contours_;
+};
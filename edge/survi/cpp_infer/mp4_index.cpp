@@ -0,0 +1,356 @@
+// ~/ArduinoApps/survillance/cpp_infer/mp4_index.cpp
+// See mp4_index.h. Box layouts per ISO/IEC 14496-12.
+
+#include "mp4_index.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+
+// -------------------------
+// Small helpers
+// -------------------------
+static uint32_t be32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static uint64_t be64(const uint8_t *p) { return (uint64_t)be32(p) << 32 | be32(p + 4); }
+
+static bool pread_all(int fd, void *buf, size_t n, uint64_t off) {
+    size_t got = 0;
+    while (got < n) {
+        const ssize_t r = ::pread(fd, (uint8_t *)buf + got, n - got, (off_t)(off + got));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        got += (size_t)r;
+    }
+    return true;
+}
+
+// Walks the child boxes of an in-memory container.
+struct BoxIter {
+    const uint8_t *p;
+    size_t n;
+    size_t pos = 0;
+
+    // Next child: type and payload. False at the end or on a malformed box.
+    bool next(uint32_t *type, const uint8_t **payload, size_t *len) {
+        if (pos + 8 > n) return false;
+        uint64_t size = be32(p + pos);
+        *type = be32(p + pos + 4);
+        size_t hdr = 8;
+        if (size == 1) {
+            if (pos + 16 > n) return false;
+            size = be64(p + pos + 8);
+            hdr = 16;
+        } else if (size == 0) {
+            size = n - pos;
+        }
+        if (size < hdr || size > n - pos) return false;
+        *payload = p + pos + hdr;
+        *len = (size_t)size - hdr;
+        pos += (size_t)size;
+        return true;
+    }
+};
+
+static constexpr uint32_t fourcc(const char (&s)[5]) {
+    return (uint32_t)s[0] << 24 | (uint32_t)s[1] << 16 | (uint32_t)s[2] << 8 | (uint32_t)s[3];
+}
+
+// -------------------------
+// Mp4Index
+// -------------------------
+bool Mp4Index::load(const std::string &path, std::string *err) {
+    offsets_.clear();
+    sizes_.clear();
+    pts_.clear();
+    order_.clear();
+    sync_.clear();
+    timescale_ = 0;
+    end_pts_ = 0;
+    data_begin_ = data_end_ = 0;
+
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (err) *err = "open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        if (err) *err = "stat " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    const uint64_t file_size = (uint64_t)st.st_size;
+
+    // Top-level boxes: only headers are read until moov.
+    std::vector<uint8_t> moov;
+    uint64_t off = 0;
+    while (off + 8 <= file_size) {
+        uint8_t h[16];
+        if (!pread_all(fd, h, 8, off)) break;
+        uint64_t size = be32(h);
+        const uint32_t type = be32(h + 4);
+        uint64_t hdr = 8;
+        if (size == 1) {
+            if (!pread_all(fd, h + 8, 8, off + 8)) break;
+            size = be64(h + 8);
+            hdr = 16;
+        } else if (size == 0) {
+            size = file_size - off;
+        }
+        if (size < hdr || off + size > file_size) break;
+
+        if (type == fourcc("mdat")) {
+            if (!data_end_) data_begin_ = off + hdr;
+            data_end_ = off + size;
+        } else if (type == fourcc("moov")) {
+            if (size - hdr > (64u << 20)) break;  // not one of our clips
+            moov.resize((size_t)(size - hdr));
+            if (!pread_all(fd, moov.data(), moov.size(), off + hdr)) moov.clear();
+        }
+        off += size;
+    }
+    ::close(fd);
+
+    if (moov.empty()) {
+        if (err) *err = "no moov box in " + path;
+        return false;
+    }
+    return parse_moov(moov, err);
+}
+
+bool Mp4Index::parse_moov(const std::vector<uint8_t> &moov, std::string *err) {
+    BoxIter top{moov.data(), moov.size()};
+    uint32_t type;
+    const uint8_t *p;
+    size_t n;
+    while (top.next(&type, &p, &n)) {
+        if (type != fourcc("trak")) continue;
+        BoxIter trak{p, n};
+        const uint8_t *tp;
+        size_t tn;
+        while (trak.next(&type, &tp, &tn)) {
+            if (type != fourcc("mdia")) continue;
+
+            bool video = false;
+            uint32_t timescale = 0;
+            const uint8_t *stbl = nullptr;
+            size_t stbl_n = 0;
+            BoxIter mdia{tp, tn};
+            const uint8_t *mp;
+            size_t mn;
+            while (mdia.next(&type, &mp, &mn)) {
+                if (type == fourcc("hdlr") && mn >= 12) {
+                    video = be32(mp + 8) == fourcc("vide");
+                } else if (type == fourcc("mdhd") && mn >= 4) {
+                    // v0: times are 32-bit; v1: 64-bit
+                    const size_t at = mp[0] == 1 ? 20 : 12;
+                    if (mn >= at + 4) timescale = be32(mp + at);
+                } else if (type == fourcc("minf")) {
+                    BoxIter minf{mp, mn};
+                    const uint8_t *sp;
+                    size_t sn;
+                    while (minf.next(&type, &sp, &sn)) {
+                        if (type == fourcc("stbl")) {
+                            stbl = sp;
+                            stbl_n = sn;
+                        }
+                    }
+                }
+            }
+            if (video && stbl) return parse_stbl(stbl, stbl_n, timescale, err);
+        }
+    }
+    if (err) *err = "no video track";
+    return false;
+}
+
+bool Mp4Index::parse_stbl(const uint8_t *stbl, size_t stbl_n, uint32_t timescale, std::string *err) {
+    const uint8_t *stsz = nullptr, *stsc = nullptr, *stco = nullptr;
+    const uint8_t *stts = nullptr, *ctts = nullptr, *stss = nullptr;
+    size_t stsz_n = 0, stsc_n = 0, stco_n = 0, stts_n = 0, ctts_n = 0, stss_n = 0;
+    bool co64 = false;
+
+    BoxIter it{stbl, stbl_n};
+    uint32_t type;
+    const uint8_t *p;
+    size_t n;
+    while (it.next(&type, &p, &n)) {
+        if (type == fourcc("stsz")) { stsz = p; stsz_n = n; }
+        else if (type == fourcc("stsc")) { stsc = p; stsc_n = n; }
+        else if (type == fourcc("stco")) { stco = p; stco_n = n; co64 = false; }
+        else if (type == fourcc("co64")) { stco = p; stco_n = n; co64 = true; }
+        else if (type == fourcc("stts")) { stts = p; stts_n = n; }
+        else if (type == fourcc("ctts")) { ctts = p; ctts_n = n; }
+        else if (type == fourcc("stss")) { stss = p; stss_n = n; }
+    }
+    if (!stsz || !stsc || !stco || stsz_n < 12 || stsc_n < 8 || stco_n < 8) {
+        if (err) *err = "incomplete sample table";
+        return false;
+    }
+
+    // stsz: version/flags, sample_size, sample_count, [entry_size...]
+    const uint32_t fixed = be32(stsz + 4);
+    const uint32_t count = be32(stsz + 8);
+    if (fixed == 0 && stsz_n < 12 + (size_t)count * 4) {
+        if (err) *err = "truncated stsz";
+        return false;
+    }
+    sizes_.resize(count);
+    for (uint32_t i = 0; i < count; i++) sizes_[i] = fixed ? fixed : be32(stsz + 12 + 4 * i);
+
+    // stco / co64: version/flags, entry_count, offsets
+    const uint32_t chunks = be32(stco + 4);
+    const size_t width = co64 ? 8 : 4;
+    if (stco_n < 8 + (size_t)chunks * width) {
+        if (err) *err = "truncated chunk offsets";
+        return false;
+    }
+
+    // stsc: version/flags, entry_count, {first_chunk, samples_per_chunk, desc}
+    const uint32_t runs = be32(stsc + 4);
+    if (stsc_n < 8 + (size_t)runs * 12 || runs == 0) {
+        if (err) *err = "truncated stsc";
+        return false;
+    }
+
+    offsets_.resize(count);
+    uint32_t sample = 0;
+    for (uint32_t r = 0; r < runs && sample < count; r++) {
+        const uint8_t *e = stsc + 8 + 12 * r;
+        const uint32_t first = be32(e);
+        const uint32_t per_chunk = be32(e + 4);
+        const uint32_t last = (r + 1 < runs) ? be32(stsc + 8 + 12 * (r + 1)) : chunks + 1;
+        if (first == 0) break;
+        for (uint32_t c = first; c < last && c <= chunks && sample < count; c++) {
+            uint64_t off = co64 ? be64(stco + 8 + 8 * (c - 1)) : be32(stco + 8 + 4 * (c - 1));
+            for (uint32_t k = 0; k < per_chunk && sample < count; k++, sample++) {
+                offsets_[sample] = off;
+                off += sizes_[sample];
+            }
+        }
+    }
+    if (sample != count) {
+        if (err) *err = "sample table does not cover every sample";
+        offsets_.clear();
+        sizes_.clear();
+        return false;
+    }
+
+    timescale_ = timescale ? timescale : 1000;
+    if (!parse_timing(stts, stts_n, ctts, ctts_n, err) || !parse_sync(stss, stss_n, err)) {
+        offsets_.clear();
+        sizes_.clear();
+        pts_.clear();
+        order_.clear();
+        sync_.clear();
+        return false;
+    }
+    return true;
+}
+
+bool Mp4Index::parse_timing(const uint8_t *stts, size_t stts_n, const uint8_t *ctts, size_t ctts_n,
+                            std::string *err) {
+    const size_t count = sizes_.size();
+    pts_.assign(count, 0);
+    if (!stts || stts_n < 8) {
+        if (err) *err = "missing stts";
+        return false;
+    }
+
+    // stts: version/flags, entry_count, {sample_count, sample_delta} (decode times)
+    const uint32_t runs = be32(stts + 4);
+    if (stts_n < 8 + (size_t)runs * 8) {
+        if (err) *err = "truncated stts";
+        return false;
+    }
+    int64_t t = 0;
+    uint32_t delta = 0;
+    size_t s = 0;
+    for (uint32_t r = 0; r < runs && s < count; r++) {
+        const uint32_t n = be32(stts + 8 + 8 * r);
+        delta = be32(stts + 12 + 8 * r);
+        for (uint32_t k = 0; k < n && s < count; k++, s++) {
+            pts_[s] = t;
+            t += delta;
+        }
+    }
+    for (; s < count; s++) {  // short table: extend with the last delta
+        pts_[s] = t;
+        t += delta;
+    }
+    end_pts_ = t;
+
+    // ctts (optional): {sample_count, sample_offset} added to decode times.
+    // Offsets are signed in version 1 and in practice in version 0 as well.
+    if (ctts && ctts_n >= 8) {
+        const uint32_t cruns = be32(ctts + 4);
+        if (ctts_n < 8 + (size_t)cruns * 8) {
+            if (err) *err = "truncated ctts";
+            return false;
+        }
+        s = 0;
+        for (uint32_t r = 0; r < cruns && s < count; r++) {
+            const uint32_t n = be32(ctts + 8 + 8 * r);
+            const int32_t off = (int32_t)be32(ctts + 12 + 8 * r);
+            for (uint32_t k = 0; k < n && s < count; k++, s++) pts_[s] += off;
+        }
+    }
+
+    // Presentation order. With B-frames (ctts reordering) it differs from
+    // the sample order, and the clip ends with the last frame shown.
+    order_.resize(count);
+    std::iota(order_.begin(), order_.end(), 0u);
+    std::stable_sort(order_.begin(), order_.end(), [this](uint32_t a, uint32_t b) { return pts_[a] < pts_[b]; });
+    if (count) end_pts_ = std::max(end_pts_, pts_[order_.back()] + (int64_t)delta);
+    return true;
+}
+
+bool Mp4Index::parse_sync(const uint8_t *stss, size_t stss_n, std::string *err) {
+    sync_.clear();
+    if (!stss) return true;  // no stss: every sample is a sync sample
+    if (stss_n < 8) {
+        if (err) *err = "truncated stss";
+        return false;
+    }
+    // stss: version/flags, entry_count, 1-based sample numbers
+    const uint32_t n = be32(stss + 4);
+    if (stss_n < 8 + (size_t)n * 4) {
+        if (err) *err = "truncated stss";
+        return false;
+    }
+    sync_.assign(sizes_.size(), 0);
+    for (uint32_t i = 0; i < n; i++) {
+        const uint32_t k = be32(stss + 8 + 4 * i);
+        if (k >= 1 && k <= sync_.size()) sync_[k - 1] = 1;
+    }
+    if (!sync_.empty()) sync_[0] = 1;  // decoding always starts somewhere
+    return true;
+}
+
+int64_t Mp4Index::pts_ms(size_t i) const {
+    return pts_[i] * 1000 / (int64_t)timescale_;
+}
+
+int64_t Mp4Index::duration_ms() const {
+    return timescale_ ? end_pts_ * 1000 / (int64_t)timescale_ : 0;
+}
+
+size_t Mp4Index::sample_at(int64_t t) const {
+    const auto it = std::upper_bound(order_.begin(), order_.end(), t,
+                                     [this](int64_t v, uint32_t s) { return v < pts_[s]; });
+    return order_[it == order_.begin() ? 0 : (size_t)(it - order_.begin()) - 1];
+}
+
+size_t Mp4Index::keyframe_before(size_t i) const {
+    if (sync_.empty()) return i;
+    while (i > 0 && !sync_[i]) i--;
+    return i;
+}
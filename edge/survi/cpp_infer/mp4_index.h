@@ -0,0 +1,65 @@
+// ~/ArduinoApps/survillance/cpp_infer/mp4_index.h
+// Minimal MP4 sample-table reader for the first video track of a clip.
+//
+// Only the box headers and the moov payload are read (a few KB for our
+// clips); no demuxer, no decoding. From the sample table we get:
+//   stsz/stsc/stco(co64)  byte range of every sample (readahead targets)
+//   stts/ctts + mdhd      presentation timestamp of every sample
+//   stss                  keyframes (where a seek has to start decoding)
+// cv::CAP_PROP_FRAME_COUNT is unreliable on our concatenated mp4v clips, so
+// the engine samples, seeks and prefetches from this instead.
+//
+// Frames are numbered by sample (decode order). Our own recordings (OpenCV
+// mp4v, stream-copy concat) have no B-frames, so that is also presentation
+// order; for clips that reorder, presented(k) maps the k-th frame shown
+// back to its sample.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Mp4Index {
+public:
+    bool load(const std::string &path, std::string *err);
+
+    size_t sample_count() const { return sizes_.size(); }
+    uint64_t sample_offset(size_t i) const { return offsets_[i]; }
+    uint32_t sample_size(size_t i) const { return sizes_[i]; }
+
+    int64_t pts_ms(size_t i) const;
+    // Raw presentation time in mdhd timescale units (a demuxer's stream
+    // time base), and the sample shown at raw pts `t` (the last one at or
+    // before it).
+    int64_t pts(size_t i) const { return pts_[i]; }
+    uint32_t timescale() const { return timescale_; }
+    size_t sample_at(int64_t t) const;
+    // Sample shown k-th (what a decoder returns as its k-th frame).
+    size_t presented(size_t k) const { return order_[k]; }
+    int64_t duration_ms() const;
+    bool is_keyframe(size_t i) const { return sync_.empty() || sync_[i]; }
+    // Nearest keyframe at or before sample i.
+    size_t keyframe_before(size_t i) const;
+
+    // Byte range [begin, end) of the media data (mdat payload) we have seen.
+    uint64_t data_begin() const { return data_begin_; }
+    uint64_t data_end() const { return data_end_; }
+
+private:
+    bool parse_moov(const std::vector<uint8_t> &moov, std::string *err);
+    bool parse_stbl(const uint8_t *p, size_t n, uint32_t timescale, std::string *err);
+
+    bool parse_timing(const uint8_t *stts, size_t stts_n, const uint8_t *ctts, size_t ctts_n,
+                      std::string *err);
+    bool parse_sync(const uint8_t *stss, size_t stss_n, std::string *err);
+
+    std::vector<uint64_t> offsets_;
+    std::vector<uint32_t> sizes_;
+    std::vector<int64_t> pts_;   // in timescale_ units
+    std::vector<uint32_t> order_;  // sample numbers sorted by pts
+    std::vector<uint8_t> sync_;  // empty: every sample is a keyframe
+    uint32_t timescale_ = 0;
+    int64_t end_pts_ = 0;        // pts of the last sample + its duration
+    uint64_t data_begin_ = 0;
+    uint64_t data_end_ = 0;
+};
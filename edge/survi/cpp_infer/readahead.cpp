@@ -0,0 +1,61 @@
+// ~/ArduinoApps/survillance/cpp_infer/readahead.cpp
+// See readahead.h.
+
+#include "readahead.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+static constexpr uint64_t kPage = 4096;
+
+bool ClipReadahead::open(const std::string &path, const Mp4Index *index) {
+    finish();
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) return false;
+    index_ = (index && index->sample_count()) ? index : nullptr;
+    dropped_to_ = index_ ? index_->data_begin() : 0;
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return true;
+}
+
+void ClipReadahead::range_for(int frame, uint64_t *begin, uint64_t *end) const {
+    const size_t n = index_->sample_count();
+    const size_t last = std::min((size_t)std::max(frame, 0), n - 1);
+    const size_t first = index_->keyframe_before(last);
+    *begin = index_->sample_offset(first);
+    *end = index_->sample_offset(last) + index_->sample_size(last);
+}
+
+void ClipReadahead::advise(uint64_t begin, uint64_t end, int advice) {
+    if (fd_ < 0 || end <= begin) return;
+    ::posix_fadvise(fd_, (off_t)begin, (off_t)(end - begin), advice);
+}
+
+void ClipReadahead::prefetch(int frame) {
+    if (!index_ || frame < 0) return;
+    uint64_t b, e;
+    range_for(frame, &b, &e);
+    advise(b & ~(kPage - 1), e, POSIX_FADV_WILLNEED);
+}
+
+void ClipReadahead::consumed(int frame) {
+    if (!index_ || frame < 0) return;
+    uint64_t b, e;
+    range_for(frame, &b, &e);
+    // Whole pages strictly below what the decoder may still read.
+    const uint64_t to = b & ~(kPage - 1);
+    if (to > dropped_to_) {
+        advise(dropped_to_, to, POSIX_FADV_DONTNEED);
+        dropped_to_ = to;
+    }
+}
+
+void ClipReadahead::finish() {
+    if (fd_ < 0) return;
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd_);
+    fd_ = -1;
+    index_ = nullptr;
+}
@@ -0,0 +1,51 @@
+// ~/ArduinoApps/survillance/cpp_infer/readahead.h
+// Page-cache policy for reading an event clip once.
+//
+// A clip is read by the engine exactly once, at a handful of sampled frames,
+// on boards with 1-2 GB of RAM that also hold the Python process, the model
+// and the recent segments. So:
+//   - POSIX_FADV_SEQUENTIAL on open (bigger kernel readahead window);
+//   - POSIX_FADV_WILLNEED on the byte range of the next sampled frame
+//     (from the MP4 sample table), issued while the current frame is still
+//     being decoded and classified;
+//   - POSIX_FADV_DONTNEED on the media data already consumed, and on the
+//     whole file once done, so the clip does not push anything else out.
+//
+// The hints apply to the file's page cache, so they steer the decoder's own
+// reads even though it opens the file separately.
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "mp4_index.h"
+
+class ClipReadahead {
+public:
+    ClipReadahead() = default;
+    ~ClipReadahead() { finish(); }
+    ClipReadahead(const ClipReadahead &) = delete;
+    ClipReadahead &operator=(const ClipReadahead &) = delete;
+
+    // index may be null (no sample table): only SEQUENTIAL / final DONTNEED.
+    bool open(const std::string &path, const Mp4Index *index);
+
+    // WILLNEED the bytes needed to decode sample `frame`: from the keyframe
+    // at or before it up to the frame itself.
+    void prefetch(int frame);
+
+    // Frames up to `frame` are decoded: DONTNEED media data before the range
+    // the decoder still needs for it.
+    void consumed(int frame);
+
+    // DONTNEED the whole clip and close.
+    void finish();
+
+private:
+    void range_for(int frame, uint64_t *begin, uint64_t *end) const;
+    void advise(uint64_t begin, uint64_t end, int advice);
+
+    int fd_ = -1;
+    const Mp4Index *index_ = nullptr;
+    uint64_t dropped_to_ = 0;  // media data below this has been DONTNEED'd
+};
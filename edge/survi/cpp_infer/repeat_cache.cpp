@@ -0,0 +1,230 @@
+// ~/ArduinoApps/survillance/cpp_infer/repeat_cache.cpp
+// See repeat_cache.h. File format, one record per line:
+//   E <camera> <event_id> <t_ms> <chain> <threshold> <tiles> <frames_analyzed> <total_frames>
+//     <people> <cars> <input_w> <input_h> <n_hashes> <n_detections>
+//   H <hash hex> ...                      (n_hashes of them)
+//   D <conf> <x> <y> <w> <h> <frame_idx> <t_ms> <label>   (n_detections lines)
+
+#include "repeat_cache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace engine {
+
+namespace {
+
+constexpr size_t kMaxDetections = 256;  // per entry; the result is sorted by confidence
+
+bool has_space(const std::string &s) {
+    return s.empty() || std::any_of(s.begin(), s.end(), [](char c) { return std::isspace((unsigned char)c); });
+}
+
+}  // namespace
+
+// -------------------------
+// Matching
+// -------------------------
+uint64_t RepeatCache::dhash(const uint8_t *rgb, int W, int H) {
+    // 9x8 cells of luma (BT.601 integer weights)
+    uint32_t cell[8][9];
+    for (int cy = 0; cy < 8; cy++) {
+        const int y0 = cy * H / 8, y1 = std::max(y0 + 1, (cy + 1) * H / 8);
+        for (int cx = 0; cx < 9; cx++) {
+            const int x0 = cx * W / 9, x1 = std::max(x0 + 1, (cx + 1) * W / 9);
+            uint64_t sum = 0;
+            for (int y = y0; y < y1; y++) {
+                const uint8_t *p = rgb + ((size_t)y * W + x0) * 3;
+                for (int x = x0; x < x1; x++, p += 3) sum += 77u * p[0] + 150u * p[1] + 29u * p[2];
+            }
+            cell[cy][cx] = (uint32_t)(sum / ((uint64_t)(y1 - y0) * (x1 - x0)));
+        }
+    }
+    uint64_t h = 0;
+    for (int cy = 0; cy < 8; cy++) {
+        for (int cx = 0; cx < 8; cx++) h = (h << 1) | (cell[cy][cx] < cell[cy][cx + 1] ? 1u : 0u);
+    }
+    return h;
+}
+
+std::vector<size_t> RepeatCache::candidates(const Options &opt, int64_t now_ms) const {
+    std::vector<size_t> out;
+    if (opt.repeat_cooldown_ms <= 0) return out;
+    for (size_t i = 0; i < entries_.size(); i++) {
+        const Entry &e = entries_[i];
+        if (e.camera != opt.camera || e.tiles != std::max(1, opt.tiles)) continue;
+        if (std::fabs(e.threshold - opt.threshold) > 1e-4f) continue;
+        if (now_ms - e.t_ms > opt.repeat_cooldown_ms || e.chain >= cfg_.max_chain) continue;
+        out.push_back(i);
+    }
+    std::stable_sort(out.begin(), out.end(),
+                     [&](size_t a, size_t b) { return entries_[a].t_ms > entries_[b].t_ms; });
+    return out;
+}
+
+bool RepeatCache::frame_matches(size_t i, const std::vector<uint64_t> &hashes, const std::vector<Detection> &dets,
+                                int W, int H) const {
+    const Entry &e = entries_[i];
+    const size_t n = hashes.size();
+    if (!n || e.hashes.size() < n || e.hashes.size() % n) return false;
+
+    // Same scene as one of the entry's frames
+    bool scene = false;
+    for (size_t f = 0; f < e.hashes.size() && !scene; f += n) {
+        int bits = 0;
+        for (size_t t = 0; t < n; t++) bits += __builtin_popcountll(hashes[t] ^ e.hashes[f + t]);
+        scene = bits <= cfg_.max_hash_dist * (int)n;
+    }
+    if (!scene) return false;
+
+    // Nothing the entry did not already track
+    const float tol2 = cfg_.track_dist * cfg_.track_dist;
+    for (const Detection &d : dets) {
+        const float cx = (d.x + d.w / 2.0f) / W, cy = (d.y + d.h / 2.0f) / H;
+        const bool known = std::any_of(e.result.detections.begin(), e.result.detections.end(), [&](const Detection &t) {
+            if (t.label != d.label) return false;
+            const float dx = (t.x + t.w / 2.0f) / e.result.input_w - cx;
+            const float dy = (t.y + t.h / 2.0f) / e.result.input_h - cy;
+            return dx * dx + dy * dy <= tol2;
+        });
+        if (!known) return false;
+    }
+    return true;
+}
+
+bool RepeatCache::inherit(size_t i, int last_frame, Result *res, int64_t now_ms) {
+    Entry &e = entries_[i];
+    if (res->detections.empty() != e.result.detections.empty()) return false;
+    // The confirmation frames' own detections stand for the entry's over
+    // the same stretch; only what it saw after them is added
+    for (Detection d : e.result.detections) {
+        if (d.frame_idx <= last_frame) continue;
+        if (d.label == "person") res->people++;
+        if (d.label == "car") res->cars++;
+        d.inherited = true;
+        res->detections.push_back(std::move(d));
+    }
+    res->inherited_from = e.event_id;
+    e.t_ms = now_ms;
+    e.chain++;
+    return true;
+}
+
+void RepeatCache::store(const Options &opt, const Result &res, std::vector<uint64_t> hashes, int64_t now_ms) {
+    if (!res.ok || !res.inherited_from.empty() || hashes.empty() || opt.repeat_cooldown_ms <= 0) return;
+
+    // The camera's expired entries go, and the oldest beyond max_entries
+    size_t kept = 0;
+    entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+                                  [&](const Entry &e) {
+                                      if (e.camera != opt.camera) return false;
+                                      return now_ms - e.t_ms > opt.repeat_cooldown_ms ||
+                                             ++kept >= cfg_.max_entries;
+                                  }),
+                   entries_.end());
+
+    Entry e;
+    e.camera = opt.camera;
+    e.event_id = opt.event_id;
+    e.t_ms = now_ms;
+    e.threshold = opt.threshold;
+    e.tiles = std::max(1, opt.tiles);
+    e.hashes = std::move(hashes);
+    e.result = res;
+    if (e.result.detections.size() > kMaxDetections) e.result.detections.resize(kMaxDetections);
+    entries_.insert(entries_.begin(), std::move(e));
+}
+
+// -------------------------
+// File
+// -------------------------
+bool RepeatCache::load(const std::string &path, int64_t now_ms, int64_t max_age_ms, std::string *err) {
+    entries_.clear();
+    std::ifstream in(path);
+    if (!in) return true;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        std::string tag;
+        Entry e;
+        size_t n_hashes = 0, n_dets = 0;
+        ls >> tag >> e.camera >> e.event_id >> e.t_ms >> e.chain >> e.threshold >> e.tiles >>
+            e.result.frames_analyzed >> e.result.total_frames >> e.result.people >> e.result.cars >>
+            e.result.input_w >> e.result.input_h >> n_hashes >> n_dets;
+        if (tag != "E" || !ls || e.tiles < 1 || e.result.input_w <= 0 || e.result.input_h <= 0 ||
+            n_dets > kMaxDetections) {
+            break;
+        }
+
+        if (!std::getline(in, line)) break;
+        std::istringstream hs(line);
+        hs >> tag;
+        std::string hex;
+        while (hs >> hex) e.hashes.push_back(std::strtoull(hex.c_str(), nullptr, 16));
+        if (tag != "H" || e.hashes.size() != n_hashes) break;
+
+        for (size_t k = 0; k < n_dets && std::getline(in, line); k++) {
+            std::istringstream dl(line);
+            Detection d;
+            dl >> tag >> d.conf >> d.x >> d.y >> d.w >> d.h >> d.frame_idx >> d.t_ms;
+            std::getline(dl >> std::ws, d.label);
+            if (tag != "D" || !dl || d.label.empty()) break;
+            e.result.detections.push_back(std::move(d));
+        }
+        if (e.result.detections.size() != n_dets) break;
+
+        e.result.ok = true;
+        if (now_ms - e.t_ms <= max_age_ms) entries_.push_back(std::move(e));
+    }
+    if (!in.eof()) {
+        entries_.clear();
+        if (err) *err = "malformed cache file " + path;
+        return false;
+    }
+    return true;
+}
+
+bool RepeatCache::save(const std::string &path, std::string *err) const {
+    std::ostringstream o;
+    for (const Entry &e : entries_) {
+        if (has_space(e.camera) || has_space(e.event_id)) continue;
+        const Result &r = e.result;
+        o << "E " << e.camera << ' ' << e.event_id << ' ' << e.t_ms << ' ' << e.chain << ' ' << e.threshold << ' '
+          << e.tiles << ' ' << r.frames_analyzed << ' ' << r.total_frames << ' ' << r.people << ' ' << r.cars << ' '
+          << r.input_w << ' ' << r.input_h << ' ' << e.hashes.size() << ' ' << r.detections.size() << "\nH";
+        char hex[24];
+        for (uint64_t h : e.hashes) {
+            std::snprintf(hex, sizeof hex, " %016llx", (unsigned long long)h);
+            o << hex;
+        }
+        o << '\n';
+        for (const Detection &d : r.detections) {
+            o << "D " << d.conf << ' ' << d.x << ' ' << d.y << ' ' << d.w << ' ' << d.h << ' ' << d.frame_idx << ' '
+              << d.t_ms << ' ' << d.label << '\n';
+        }
+    }
+
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::trunc);
+        f << o.str();
+        if (!f.flush()) {
+            if (err) *err = "cannot write " + tmp;
+            return false;
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        if (err) *err = "rename " + tmp + ": " + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace engine
@@ -0,0 +1,90 @@
+// ~/ArduinoApps/survillance/cpp_infer/repeat_cache.h
+// Recent results per camera, so repeat triggers (someone loitering in view
+// sets off an event every few seconds) can inherit the last full analysis
+// instead of redoing it.
+//
+// An entry is one full pass: a 64-bit difference hash of every classified
+// model input (the scene), the result with the centroid of every detection
+// (the tracks), and when it was made. analyze_clip() checks a new event's
+// sampled frames against the camera's entries younger than
+// Options::repeat_cooldown_ms as they are classified. A frame matches an
+// entry when
+//   - its hash is within max_hash_dist bits of one of the entry's frames
+//     (per tile, on average), and
+//   - every detection in it is within track_dist of one of the entry's
+//     centroids with the same label: nothing new has appeared.
+// Once Options::repeat_confirm frames in a row match one entry, and they
+// found something iff the entry did, the event gets that result (its own
+// frames' detections, plus the entry's from later frames marked inherited)
+// and the rest of the clip is not decoded. Inheriting refreshes the entry, at most max_chain
+// times, so sustained activity still gets a full pass every few events.
+//
+// Lives as long as its owner: survi_inferd keeps one for every camera it
+// serves; ei_infer_mp4 --repeat_cache loads and saves one per run (a small
+// text file, one per camera). Not thread safe, like analyze_clip().
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+
+namespace engine {
+
+struct RepeatConfig {
+    int max_hash_dist = 10;    // differing bits of 64
+    float track_dist = 0.10f;  // centroid distance, fraction of the model input
+    int max_chain = 3;         // inherits per full pass
+    size_t max_entries = 4;    // per camera
+};
+
+class RepeatCache {
+public:
+    struct Entry {
+        std::string camera;
+        std::string event_id;
+        int64_t t_ms = 0;  // wall clock of the full pass or its last inherit
+        int chain = 0;     // inherits since the full pass
+        float threshold = 0;
+        int tiles = 1;
+        std::vector<uint64_t> hashes;  // tiles^2 per classified frame, in order
+        Result result;
+    };
+
+    explicit RepeatCache(const RepeatConfig &cfg = RepeatConfig()) : cfg_(cfg) {}
+
+    // Missing file: empty cache, true. Entries older than max_age_ms are dropped.
+    bool load(const std::string &path, int64_t now_ms, int64_t max_age_ms, std::string *err);
+    // tmp + rename; a lost cache only costs full passes.
+    bool save(const std::string &path, std::string *err) const;
+
+    // Entries opt's event may inherit from (same camera, threshold and
+    // tiles, within the cooldown, chain not used up), most recent first.
+    std::vector<size_t> candidates(const Options &opt, int64_t now_ms) const;
+
+    // One classified frame against entry i: its tiles' hashes and its
+    // detections (model-input coordinates, input W x H).
+    bool frame_matches(size_t i, const std::vector<uint64_t> &hashes, const std::vector<Detection> &dets, int W,
+                       int H) const;
+
+    // Completes res (the confirmation frames so far, up to frame last_frame)
+    // from entry i's detections after last_frame; false, res untouched, when
+    // one of the two found objects and the other did not.
+    bool inherit(size_t i, int last_frame, Result *res, int64_t now_ms);
+
+    // Remembers a full pass (hashes as collected by analyze_clip).
+    void store(const Options &opt, const Result &res, std::vector<uint64_t> hashes, int64_t now_ms);
+
+    const std::vector<Entry> &entries() const { return entries_; }
+
+    // Difference hash of a packed RGB24 image: luma box-averaged to 9x8,
+    // one bit per horizontal neighbour pair.
+    static uint64_t dhash(const uint8_t *rgb, int W, int H);
+
+private:
+    RepeatConfig cfg_;
+    std::vector<Entry> entries_;  // newest full pass first
+};
+
+}  // namespace engine
@@ -0,0 +1,153 @@
+// ~/ArduinoApps/survillance/cpp_infer/replay.cpp
+// See replay.h.
+
+#include "replay.h"
+#include "mp4_index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace replay {
+
+static bool ends_with_ci(const std::string &s, const std::string &suffix) {
+    if (s.size() < suffix.size()) return false;
+    for (size_t i = 0; i < suffix.size(); i++) {
+        if (std::tolower((unsigned char)s[s.size() - suffix.size() + i]) != suffix[i]) return false;
+    }
+    return true;
+}
+
+// -------------------------
+// Sources
+// -------------------------
+class VideoSource : public Source {
+public:
+    VideoSource(const std::string &path, double fps) : fps_(fps) {
+        std::string err;
+        if (index_.load(path, &err) && index_.sample_count()) indexed_ = true;
+        cap_.open(path, cv::CAP_ANY);
+    }
+    bool ok() const override { return cap_.isOpened(); }
+
+    bool next(cv::Mat &frame, int64_t *offset_us) override {
+        if (!cap_.read(frame) || frame.empty()) {
+            duration_us = indexed_ ? index_.duration_ms() * 1000 : frame_us(n_);
+            return false;
+        }
+        // cap_ returns frames in presentation order, the index is in
+        // decode order
+        *offset_us = (indexed_ && (size_t)n_ < index_.sample_count())
+                         ? index_.pts_ms(index_.presented((size_t)n_)) * 1000
+                         : frame_us(n_);
+        n_++;
+        return true;
+    }
+
+private:
+    int64_t frame_us(int64_t i) const { return (int64_t)((double)i * 1e6 / fps_); }
+
+    cv::VideoCapture cap_;
+    Mp4Index index_;
+    bool indexed_ = false;
+    double fps_;
+    int64_t n_ = 0;
+};
+
+// Concatenated JPEGs (what a V4L2 MJPG capture or `ffmpeg -f mjpeg` writes):
+// frames are split on SOI / EOI markers and decoded one at a time.
+class MjpegSource : public Source {
+public:
+    MjpegSource(const std::string &path, double fps) : fps_(fps) {
+        std::ifstream f(path, std::ios::binary);
+        if (f) data_.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    }
+    bool ok() const override { return !data_.empty(); }
+
+    bool next(cv::Mat &frame, int64_t *offset_us) override {
+        for (;;) {
+            const size_t soi = find(pos_, 0xD8);
+            if (soi == std::string::npos) break;
+            const size_t eoi = find(soi + 2, 0xD9);
+            if (eoi == std::string::npos) break;
+            pos_ = eoi + 2;
+            std::vector<uint8_t> jpg(data_.begin() + soi, data_.begin() + pos_);
+            frame = cv::imdecode(jpg, cv::IMREAD_COLOR);
+            if (frame.empty()) continue;  // corrupt frame: skip it, keep the clock
+            *offset_us = (int64_t)((double)n_ * 1e6 / fps_);
+            n_++;
+            return true;
+        }
+        duration_us = (int64_t)((double)n_ * 1e6 / fps_);
+        return false;
+    }
+
+private:
+    // Offset of the next 0xFF <marker> at or after `from`.
+    size_t find(size_t from, uint8_t marker) const {
+        for (size_t i = from; i + 1 < data_.size(); i++) {
+            if ((uint8_t)data_[i] == 0xFF && (uint8_t)data_[i + 1] == marker) return i;
+        }
+        return std::string::npos;
+    }
+
+    std::string data_;
+    size_t pos_ = 0;
+    double fps_;
+    int64_t n_ = 0;
+};
+
+std::unique_ptr<Source> open_source(const std::string &path, double fps) {
+    std::unique_ptr<Source> src;
+    if (ends_with_ci(path, ".mjpg") || ends_with_ci(path, ".mjpeg")) {
+        src.reset(new MjpegSource(path, fps));
+    } else {
+        src.reset(new VideoSource(path, fps));
+    }
+    if (!src->ok()) src.reset();
+    return src;
+}
+
+// -------------------------
+// Playlist
+// -------------------------
+Playlist::Playlist(std::vector<std::string> files, double fps, int loops, size_t first)
+    : files_(std::move(files)), fps_(fps), loops_(loops), pos_(files_.empty() ? 0 : first % files_.size()) {}
+
+bool Playlist::open_next() {
+    while (!files_.empty() && failed_run_ < files_.size()) {
+        if (loops_ > 0 && opened_ >= files_.size() * (size_t)loops_) return false;
+        const std::string &path = files_[pos_];
+        pos_ = (pos_ + 1) % files_.size();
+        opened_++;
+        cur_ = open_source(path, fps_);
+        if (cur_) {
+            failed_run_ = 0;
+            last_off_us_ = 0;
+            return true;
+        }
+        failed_run_++;
+        std::cerr << "[REPLAY] cannot open " << path << "\n";
+    }
+    return false;
+}
+
+bool Playlist::next(cv::Mat &frame, int64_t *pos_us) {
+    for (;;) {
+        if (!cur_ && !open_next()) return false;
+        int64_t off = 0;
+        if (cur_->next(frame, &off)) {
+            last_off_us_ = off;
+            *pos_us = base_us_ + off;
+            frames_++;
+            return true;
+        }
+        // Next file starts one frame after this one ends.
+        base_us_ += std::max<int64_t>(cur_->duration_us, last_off_us_ + (int64_t)(1e6 / fps_));
+        cur_.reset();
+    }
+}
+
+}  // namespace replay
@@ -0,0 +1,60 @@
+// ~/ArduinoApps/survillance/cpp_infer/replay.h
+// Recorded MP4 / MJPEG files as a frame source with a deterministic clock.
+//
+// Used by survi_replay (virtual camera for main.py) and survi_bench
+// (simulated cameras). Frame positions come from the MP4 sample table
+// (stts/ctts, see mp4_index.h) or, for MJPEG and files without one,
+// frame_index / fps; a playlist of files is one continuous timeline.
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace replay {
+
+// One file, frame by frame: next() fills `frame` and its offset from the
+// start of the file (us). `duration_us` is valid once next() returned false.
+class Source {
+public:
+    virtual ~Source() = default;
+    virtual bool ok() const = 0;
+    virtual bool next(cv::Mat &frame, int64_t *offset_us) = 0;
+    int64_t duration_us = 0;
+};
+
+// .mjpg / .mjpeg: concatenated JPEGs; anything else through cv::VideoCapture.
+// Null when the file cannot be opened.
+std::unique_ptr<Source> open_source(const std::string &path, double fps);
+
+// The files in order, `loops` times (0 = forever), on one timeline: each file
+// starts one frame after the previous one ends.
+class Playlist {
+public:
+    Playlist(std::vector<std::string> files, double fps, int loops, size_t first = 0);
+
+    // Next frame and its position from the start of the playlist (us).
+    // False when every loop has been played (or no file opens).
+    bool next(cv::Mat &frame, int64_t *pos_us);
+
+    uint64_t frames() const { return frames_; }
+
+private:
+    bool open_next();
+
+    std::vector<std::string> files_;
+    double fps_;
+    int loops_;
+    size_t pos_;       // index into files_ of the next file to open
+    size_t opened_ = 0;
+    size_t failed_run_ = 0;  // consecutive files that did not open
+    std::unique_ptr<Source> cur_;
+    int64_t base_us_ = 0;
+    int64_t last_off_us_ = 0;
+    uint64_t frames_ = 0;
+};
+
+}  // namespace replay
@@ -0,0 +1,173 @@
+// ~/ArduinoApps/survillance/cpp_infer/replay_source.cpp
+// Virtual camera: replays recorded MP4 / MJPEG files into the capture loop.
+//
+// main.py (replay_files in config.json, or REPLAY_FILES) spawns this instead
+// of opening V4L2 and reads decoded frames from its stdout, so the whole
+// motion -> event -> concat -> analysis path can be load-tested on a dev
+// machine without a camera.
+//
+// Timestamps are deterministic: frame time = --t0 + position in the replay,
+// where the position comes from the MP4 sample table (stts/ctts, see
+// mp4_index.h) or, for MJPEG and files without one, frame_index / --fps.
+// The capture loop uses these instead of the wall clock, so event ids and
+// segment boundaries are the same on every run with the same --t0. Decoding
+// and the clock live in replay.h.
+//
+// --rate paces delivery against the wall clock (1 = real time, 4 = 4x);
+// --rate 0 delivers as fast as the reader consumes (pipe backpressure).
+//
+// Output, per frame (little endian):
+//   u32 magic 'SRF1'  u32 width  u32 height  u32 reserved
+//   i64 ts_us         u64 seq
+//   width * height * 3 bytes BGR
+// EOF on stdout means the replay is over.
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "replay.h"
+
+// -------------------------
+// Wire format
+// -------------------------
+static constexpr uint32_t kFrameMagic = 0x31465253;  // "SRF1"
+
+#pragma pack(push, 1)
+struct FrameHdr {
+    uint32_t magic;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+    int64_t ts_us;
+    uint64_t seq;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(FrameHdr) == 32, "FrameHdr layout");
+
+// -------------------------
+// Small helpers
+// -------------------------
+static void usage(const char *argv0) {
+    std::cerr
+        << "Usage:\n"
+        << "  " << argv0 << " [--rate R] [--fps F] [--loops N] [--t0 EPOCH_S] [--width W --height H] file...\n"
+        << "\n"
+        << "  file      .mp4 (or anything OpenCV opens) or .mjpg/.mjpeg (concatenated JPEGs)\n"
+        << "  --rate    playback speed vs. real time; 0 = as fast as the reader takes frames\n"
+        << "  --fps     frame rate for MJPEG and for MP4s without a sample table (default 15)\n"
+        << "  --loops   play the file list N times (default 1, 0 = forever)\n"
+        << "  --t0      timestamp of the first frame, epoch seconds (default: now)\n"
+        << "  --width/--height  resize frames before sending (default: source size)\n"
+        << "\n"
+        << "Example:\n"
+        << "  " << argv0 << " --rate 4 --t0 1700000000 --width 640 --height 360 walk.mp4 cars.mjpg\n";
+}
+
+static bool write_all(int fd, const void *p, size_t n) {
+    const uint8_t *b = (const uint8_t *)p;
+    while (n > 0) {
+        const ssize_t w = ::write(fd, b, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        b += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+// -------------------------
+// Main
+// -------------------------
+int main(int argc, char **argv) {
+    double rate = 1.0, fps = 15.0, t0_s = -1.0;
+    int loops = 1, out_w = 0, out_h = 0;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto need = [&](const char *flag) {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << flag << "\n";
+                usage(argv[0]);
+                std::exit(2);
+            }
+        };
+
+        if (a == "--rate") { need("--rate"); rate = std::max(0.0, std::atof(argv[++i])); }
+        else if (a == "--fps") { need("--fps"); fps = std::atof(argv[++i]); }
+        else if (a == "--loops") { need("--loops"); loops = std::max(0, std::atoi(argv[++i])); }
+        else if (a == "--t0") { need("--t0"); t0_s = std::atof(argv[++i]); }
+        else if (a == "--width") { need("--width"); out_w = std::max(0, std::atoi(argv[++i])); }
+        else if (a == "--height") { need("--height"); out_h = std::max(0, std::atoi(argv[++i])); }
+        else if (a == "--help" || a == "-h") { usage(argv[0]); return 0; }
+        else if (!a.empty() && a[0] == '-') {
+            std::cerr << "Unknown arg: " << a << "\n";
+            usage(argv[0]);
+            return 2;
+        }
+        else files.push_back(a);
+    }
+    if (files.empty() || fps <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);  // reader gone: write() fails and we stop
+
+    const auto wall0 = std::chrono::steady_clock::now();
+    if (t0_s < 0) {
+        t0_s = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+    const int64_t t0_us = (int64_t)(t0_s * 1e6);
+
+    replay::Playlist playlist(files, fps, loops);
+    uint64_t seq = 0;
+    int64_t pos_us = 0;
+    cv::Mat frame, sized;
+    while (playlist.next(frame, &pos_us)) {
+        if (rate > 0) {
+            std::this_thread::sleep_until(wall0 + std::chrono::microseconds((int64_t)(pos_us / rate)));
+        }
+        const cv::Mat *out = &frame;
+        if (out_w > 0 && out_h > 0 && (frame.cols != out_w || frame.rows != out_h)) {
+            cv::resize(frame, sized, cv::Size(out_w, out_h), 0, 0, cv::INTER_AREA);
+            out = &sized;
+        }
+        FrameHdr h;
+        std::memset(&h, 0, sizeof(h));
+        h.magic = kFrameMagic;
+        h.width = (uint32_t)out->cols;
+        h.height = (uint32_t)out->rows;
+        h.ts_us = t0_us + pos_us;
+        h.seq = seq++;
+        bool ok = write_all(STDOUT_FILENO, &h, sizeof(h));
+        for (int r = 0; ok && r < out->rows; r++) {
+            ok = write_all(STDOUT_FILENO, out->ptr<uint8_t>(r), (size_t)out->cols * 3);
+        }
+        if (!ok) {
+            std::cerr << "[REPLAY] reader closed after " << seq << " frames\n";
+            return 0;
+        }
+    }
+
+    const double wall_s =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+    std::cerr << "[REPLAY] done  frames=" << seq << "  media_s=" << pos_us / 1e6 << "  wall_s=" << wall_s
+              << "  fps=" << (wall_s > 0 ? seq / wall_s : 0.0) << "\n";
+    return 0;
+}
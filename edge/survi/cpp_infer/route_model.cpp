@@ -0,0 +1,182 @@
+// ~/ArduinoApps/survillance/cpp_infer/route_model.cpp
+// See route_model.h.
+
+#include "route_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+#include "engine.h"  // json_escape
+
+namespace route {
+
+namespace {
+
+// Priors until the histograms have data
+constexpr double kDefaultUnitMs = 200.0;         // one frame x tile, decode + classify
+constexpr double kDefaultUploadMsPerMb = 4000.0; // ~2 Mbit/s uplink
+// Uploads smaller than this measure the round trip, not the uplink
+constexpr double kMinUploadBytes = 64 * 1024;
+// RECORD_ONLY: this many local outcomes in the bucket, below this rate
+constexpr uint64_t kRecordOnlyMinSamples = 20;
+constexpr double kRecordOnlyRate = 0.05;
+constexpr size_t kMaxPending = 512;
+
+const char *kRoutes[] = {"RUN_LOCAL", "RUN_CLOUD", "RECORD_ONLY"};
+
+}  // namespace
+
+// -------------------------
+// Hist
+// -------------------------
+void Hist::add(double v) {
+    if (!(v >= 0)) return;
+    int i = v <= kLo ? 0 : (int)(std::log(v / kLo) / std::log(kStep));
+    i = std::max(0, std::min(kBuckets - 1, i));
+    b_[i]++;
+    n_++;
+}
+
+double Hist::quantile(double q, double dflt) const {
+    if (!n_) return dflt;
+    const uint64_t want = std::max<uint64_t>(1, (uint64_t)std::ceil(q * (double)n_));
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; i++) {
+        seen += b_[i];
+        if (seen >= want) return kLo * std::pow(kStep, i + 1);
+    }
+    return kLo * std::pow(kStep, kBuckets);
+}
+
+int quality_bucket(float brightness, float blur_var) {
+    const float b_edges[] = {0.10f, 0.20f, 0.35f};
+    const float v_edges[] = {30.0f, 60.0f, 150.0f};
+    int b = 0, v = 0;
+    while (b < 3 && brightness >= b_edges[b]) b++;
+    while (v < 3 && blur_var >= v_edges[v]) v++;
+    return b * 4 + v;
+}
+
+// -------------------------
+// CostModel
+// -------------------------
+double CostModel::upload_ms(double bytes, double net_ms, double q) const {
+    return std::max(0.0, net_ms) + bytes / 1e6 * upload_ms_mb_.quantile(q, kDefaultUploadMsPerMb);
+}
+
+Decision CostModel::decide(const Request &r) {
+    Decision d;
+    const int bucket = quality_bucket(r.brightness, r.blur_var);
+    const Bucket &k = buckets_[bucket];
+    const double p = (double)(k.complete + 1) / (double)(k.total + 2);  // Laplace prior: 0.5 when unknown
+    d.p_complete = p;
+    d.samples = k.total;
+
+    const double u50 = unit_ms_.quantile(0.5, kDefaultUnitMs);
+    const double u90 = unit_ms_.quantile(0.9, kDefaultUnitMs * 1.5);
+    const double units = (double)std::max<int64_t>(1, r.units), ahead = (double)std::max<int64_t>(0, r.queued_units);
+    d.local.stage_ms = (ahead + units) * u50;
+    d.local.ms = (ahead + units) * u90;
+    d.local.cost_ms = units * u50;
+
+    if (r.cloud_ok) {
+        const double up50 = upload_ms(r.clip_bytes, r.net_ms, 0.5), up90 = upload_ms(r.clip_bytes, r.net_ms, 0.9);
+        d.cloud.stage_ms = up50;
+        d.cloud.ms = up90 + r.cloud_ms;
+        d.cloud.cost_ms = up50;
+        // An incomplete local pass is escalated: the upload and the cloud wait follow it
+        d.local.ms += (1 - p) * (up90 + r.cloud_ms);
+        d.local.cost_ms += (1 - p) * up50;
+    } else {
+        d.cloud.ms = d.cloud.cost_ms = d.cloud.stage_ms = -1;
+    }
+
+    const bool local_ok = d.local.ms <= r.target_ms;
+    const bool cloud_ok = r.cloud_ok && d.cloud.ms <= r.target_ms;
+    std::ostringstream why;
+    if (!r.cloud_ok && k.total >= kRecordOnlyMinSamples && p < kRecordOnlyRate) {
+        d.route = kRoutes[2];
+        why << "local completes " << (int)(p * 100) << "% here, no cloud";
+    } else if (local_ok && (!cloud_ok || d.local.cost_ms <= d.cloud.cost_ms)) {
+        d.route = kRoutes[0];
+        why << (cloud_ok ? "cheaper" : r.cloud_ok ? "cloud over target" : "no cloud");
+        d.meets_target = true;
+    } else if (cloud_ok) {
+        d.route = kRoutes[1];
+        why << (local_ok ? "cheaper" : "local over target");
+        d.meets_target = true;
+    } else {
+        d.route = (r.cloud_ok && d.cloud.ms < d.local.ms) ? kRoutes[1] : kRoutes[0];
+        why << "none within target, fastest";
+    }
+    d.reason = why.str();
+
+    if (!r.id.empty()) {
+        if (pending_.find(r.id) == pending_.end()) pending_order_.push_back(r.id);
+        pending_[r.id] = Pending{d, bucket};
+        while (pending_order_.size() > kMaxPending) {
+            pending_.erase(pending_order_.front());
+            pending_order_.pop_front();
+        }
+    }
+    decided_++;
+    std::cerr << "[ROUTE] " << r.id << " " << d.route << " (" << d.reason << ") local " << (int)d.local.ms << " ms / "
+              << (int)d.local.cost_ms << " cost, cloud " << (int)d.cloud.ms << " ms / " << (int)d.cloud.cost_ms
+              << " cost, p_complete " << p << "\n";
+    return d;
+}
+
+void CostModel::observe_job(int64_t units, double queue_ms, double service_ms) {
+    queue_ms_.add(queue_ms);
+    if (units > 0) unit_ms_.add(service_ms / (double)units);
+}
+
+void CostModel::observe_upload(double bytes, double ms) {
+    if (bytes >= kMinUploadBytes && ms > 0) upload_ms_mb_.add(ms / (bytes / 1e6));
+}
+
+bool CostModel::outcome(const std::string &id, const std::string &route, bool complete, double actual_ms, int bucket,
+                        std::string *json) {
+    auto it = pending_.find(id);
+    if (it != pending_.end()) bucket = it->second.bucket;
+    if (route == kRoutes[0] && bucket >= 0 && bucket < 16) {
+        buckets_[bucket].total++;
+        if (complete) buckets_[bucket].complete++;
+    }
+    if (it == pending_.end()) return false;
+
+    const Decision d = it->second.d;
+    pending_.erase(it);
+    pending_order_.erase(std::find(pending_order_.begin(), pending_order_.end(), id));
+    const double predicted = route == kRoutes[1] ? d.cloud.stage_ms : d.local.stage_ms;
+    resolved_++;
+    abs_err_ms_ += std::fabs(predicted - actual_ms);
+    std::cerr << "[ROUTE] " << id << " " << route << " predicted " << (int)predicted << " ms, actual " << (int)actual_ms
+              << " ms" << (route == kRoutes[0] ? (complete ? ", complete" : ", incomplete") : "") << "\n";
+
+    std::ostringstream o;
+    o << "{\"event_id\":\"" << engine::json_escape(id) << "\",\"decided\":\"" << d.route << "\",\"reason\":\""
+      << engine::json_escape(d.reason) << "\",\"route\":\"" << engine::json_escape(route)
+      << "\",\"p_complete\":" << d.p_complete << ",\"samples\":" << d.samples
+      << ",\"predicted\":{\"local_ms\":" << (int)d.local.ms << ",\"local_cost_ms\":" << (int)d.local.cost_ms
+      << ",\"cloud_ms\":" << (int)d.cloud.ms << ",\"cloud_cost_ms\":" << (int)d.cloud.cost_ms
+      << ",\"stage_ms\":" << (int)predicted << "},\"actual_ms\":" << (int)actual_ms
+      << ",\"complete\":" << (complete ? "true" : "false") << "}";
+    *json = o.str();
+    return true;
+}
+
+std::string CostModel::stats_json() const {
+    std::ostringstream o;
+    o << "{\"decided\":" << decided_ << ",\"resolved\":" << resolved_
+      << ",\"mean_abs_err_ms\":" << (resolved_ ? (int)(abs_err_ms_ / (double)resolved_) : 0)
+      << ",\"unit_ms_p50\":" << (int)unit_ms_.quantile(0.5, -1) << ",\"queue_ms_p90\":" << (int)queue_ms_.quantile(0.9, -1)
+      << ",\"upload_ms_per_mb_p50\":" << (int)upload_ms_mb_.quantile(0.5, -1) << ",\"local_complete\":[";
+    for (int i = 0; i < 16; i++) o << (i ? "," : "") << "[" << buckets_[i].complete << "," << buckets_[i].total << "]";
+    o << "]}";
+    return o.str();
+}
+
+}  // namespace route
@@ -0,0 +1,119 @@
+// ~/ArduinoApps/survillance/cpp_infer/route_model.h
+// Measured cost model for main.py's LOCAL / CLOUD / RECORD_ONLY decision.
+//
+// main.py's static router sends every dark or blurry event to the cloud and
+// every high-CPU moment likewise, whatever local analysis would cost or
+// achieve right now. survi_inferd sees what the static thresholds can't:
+//   - how long a job's cost unit (one frame x tile, the DRR cost) takes,
+//     and how much work is queued ahead of a new event
+//   - how often a local pass comes back COMPLETE for a given brightness /
+//     blur bucket (main.py reports each local outcome)
+//   - how long clip uploads take per MB (uploader_worker.py reports them)
+// CostModel::decide() turns those into a predicted latency (to a final
+// result) and cost (hub-busy ms: classifier time plus upload time) per
+// route, and picks the cheapest route whose p90 latency meets the target;
+// if none does, the fastest. An incomplete local pass is priced with its
+// expected cloud escalation. RECORD_ONLY is left for scenes the local model
+// has (with enough samples) practically never completed when there is no
+// cloud to send them to.
+//
+// Every decision is kept until its outcome arrives; outcome() logs the
+// predicted against the actual time of the route's hub stage (queue +
+// analysis for RUN_LOCAL, the upload for RUN_CLOUD) and returns the pair.
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+
+namespace route {
+
+// Log-spaced histogram of positive values (ms): bucket i holds
+// [kLo * kStep^i, kLo * kStep^(i+1)), the last one everything above.
+class Hist {
+public:
+    void add(double v);
+    // Upper edge of the bucket holding quantile q; dflt while empty.
+    double quantile(double q, double dflt) const;
+    uint64_t count() const { return n_; }
+
+private:
+    static constexpr int kBuckets = 64;
+    static constexpr double kLo = 0.5, kStep = 1.25;
+    uint64_t b_[kBuckets] = {};
+    uint64_t n_ = 0;
+};
+
+// 4 x 4 brightness / Laplacian-variance buckets around main.py's defaults
+// (brightness_min 0.20, blur_var_min 60).
+int quality_bucket(float brightness, float blur_var);
+
+struct Request {
+    std::string id;              // event id; the outcome refers to it
+    float brightness = 0.5f;     // mean gray / 255 over the event start
+    float blur_var = 100.0f;     // Laplacian variance
+    int64_t units = 5;           // frames * tiles^2
+    int64_t queued_units = 0;    // filled in by the daemon
+    double clip_bytes = 0;
+    double net_ms = -1;          // cloud health RTT, -1 unknown
+    bool cloud_ok = false;       // cloud configured and reachable
+    double cloud_ms = 5000;      // cloud verification time after upload
+    double target_ms = 30000;    // latency to a final result
+};
+
+struct Estimate {
+    double ms = 0;        // p90 latency to a final result
+    double cost_ms = 0;   // expected hub-busy ms
+    double stage_ms = 0;  // median of the hub's own part: queue + analysis, or the upload
+};
+
+struct Decision {
+    std::string route = "RUN_LOCAL";  // RUN_LOCAL | RUN_CLOUD | RECORD_ONLY
+    std::string reason;
+    double p_complete = 0;  // local COMPLETE rate for this bucket
+    uint64_t samples = 0;   // local outcomes behind it
+    Estimate local, cloud;  // cloud.ms < 0: not available
+    bool meets_target = false;
+};
+
+class CostModel {
+public:
+    Decision decide(const Request &r);
+
+    // Every finished daemon job: queue wait and service time.
+    void observe_job(int64_t units, double queue_ms, double service_ms);
+    // A finished upload (uploader_worker.py).
+    void observe_upload(double bytes, double ms);
+    // How a decided event went: actual_ms of its hub stage; complete only
+    // counts for RUN_LOCAL. Returns false for an unknown id; otherwise *json
+    // is the decision, its prediction and the actual, for a route log.
+    // bucket (quality_bucket, -1: none) lets an outcome without a decision
+    // (an event the static router placed) still count towards the rates.
+    bool outcome(const std::string &id, const std::string &route, bool complete, double actual_ms, int bucket,
+                 std::string *json);
+
+    std::string stats_json() const;
+
+private:
+    struct Bucket {
+        uint64_t complete = 0, total = 0;
+    };
+    struct Pending {
+        Decision d;
+        int bucket = 0;
+    };
+
+    double upload_ms(double bytes, double net_ms, double q) const;
+
+    Hist unit_ms_;       // service ms per cost unit
+    Hist queue_ms_;      // queue wait
+    Hist upload_ms_mb_;  // upload ms per MB
+    Bucket buckets_[16];
+    std::map<std::string, Pending> pending_;
+    std::deque<std::string> pending_order_;  // oldest first, for the cap
+    uint64_t decided_ = 0, resolved_ = 0;
+    double abs_err_ms_ = 0;  // sum |predicted - actual| over resolved
+};
+
+}  // namespace route
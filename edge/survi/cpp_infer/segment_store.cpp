@@ -0,0 +1,381 @@
+// ~/ArduinoApps/survillance/cpp_infer/segment_store.cpp
+// See segment_store.h. The C ABI at the bottom is what
+// python/segment_buffer.py loads with ctypes.
+
+#include "segment_store.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace ss {
+
+// -------------------------
+// SHA-256 (FIPS 180-4)
+// -------------------------
+namespace {
+
+const uint32_t kK[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+struct Sha256 {
+    uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                     0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    uint8_t buf[64];
+    size_t buf_len = 0;
+    uint64_t total = 0;
+
+    void block(const uint8_t *p) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+                   (uint32_t)p[4 * i + 2] << 8 | (uint32_t)p[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+        for (int i = 0; i < 64; i++) {
+            const uint32_t t1 = k + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + kK[i] + w[i];
+            const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            k = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+    }
+
+    void update(const uint8_t *p, size_t n) {
+        total += n;
+        if (buf_len) {
+            const size_t take = std::min(n, sizeof(buf) - buf_len);
+            std::memcpy(buf + buf_len, p, take);
+            buf_len += take;
+            p += take;
+            n -= take;
+            if (buf_len < sizeof(buf)) return;
+            block(buf);
+            buf_len = 0;
+        }
+        for (; n >= 64; p += 64, n -= 64) block(p);
+        std::memcpy(buf, p, n);
+        buf_len = n;
+    }
+
+    std::string hex() {
+        const uint64_t bits = total * 8;
+        const uint8_t pad = 0x80, zero = 0;
+        update(&pad, 1);
+        while (buf_len != 56) update(&zero, 1);
+        uint8_t len[8];
+        for (int i = 0; i < 8; i++) len[i] = (uint8_t)(bits >> (56 - 8 * i));
+        update(len, 8);
+        static const char *digits = "0123456789abcdef";
+        std::string out;
+        out.reserve(64);
+        for (uint32_t v : h) {
+            for (int s = 28; s >= 0; s -= 4) out += digits[(v >> s) & 0xF];
+        }
+        return out;
+    }
+};
+
+bool valid_hash(const std::string &h) {
+    if (h.size() != 64) return false;
+    for (char c : h) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    }
+    return true;
+}
+
+bool mkdir_p(const std::string &d) {
+    return mkdir(d.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+}  // namespace
+
+std::string sha256_file(const std::string &path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return {};
+    Sha256 sha;
+    std::vector<uint8_t> buf(1 << 16);
+    for (;;) {
+        const ssize_t n = ::read(fd, buf.data(), buf.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            ::close(fd);
+            return {};
+        }
+        if (n == 0) break;
+        sha.update(buf.data(), (size_t)n);
+    }
+    ::close(fd);
+    return sha.hex();
+}
+
+// -------------------------
+// SegmentStore
+// -------------------------
+bool SegmentStore::open(const std::string &dir, std::string *err) {
+    std::lock_guard<std::mutex> lk(mu_);
+    dir_ = dir;
+    while (dir_.size() > 1 && dir_.back() == '/') dir_.pop_back();
+    if (!mkdir_p(dir_) || !mkdir_p(dir_ + "/objects")) {
+        if (err) *err = "cannot create " + dir_ + "/objects: " + std::strerror(errno);
+        return false;
+    }
+
+    refs_.clear();
+    std::ifstream in(dir_ + "/refs.tsv");
+    std::string hash;
+    uint32_t count;
+    while (in >> hash >> count) {
+        if (valid_hash(hash) && count) refs_[hash].persistent = count;
+    }
+
+    const int n = gc_locked();
+    if (n) std::cerr << "[SEGSTORE] swept " << n << " unreferenced segments\n";
+    return true;
+}
+
+std::string SegmentStore::object_path(const std::string &hash) const {
+    return dir_ + "/objects/" + hash.substr(0, 2) + "/" + hash + ".mp4";
+}
+
+bool SegmentStore::ingest(const std::string &src, std::string *hash, std::string *path) {
+    const std::string h = sha256_file(src);
+    if (h.empty()) return false;
+    const std::string dst = object_path(h);
+
+    std::lock_guard<std::mutex> lk(mu_);
+    struct stat st;
+    if (::stat(dst.c_str(), &st) == 0) {
+        // Identical bytes already stored; the new file is redundant.
+        ::unlink(src.c_str());
+    } else {
+        mkdir_p(dir_ + "/objects/" + h.substr(0, 2));
+        if (::rename(src.c_str(), dst.c_str()) != 0) {
+            std::cerr << "[SEGSTORE] rename " << src << " -> " << dst << ": " << std::strerror(errno) << "\n";
+            return false;
+        }
+    }
+    refs_[h].transient++;
+    if (hash) *hash = h;
+    if (path) *path = dst;
+    return true;
+}
+
+bool SegmentStore::ref(const std::string &hash, bool persistent) {
+    return ref_many({hash}, persistent) == 1;
+}
+
+bool SegmentStore::unref(const std::string &hash, bool persistent) {
+    return unref_many({hash}, persistent) == 1;
+}
+
+size_t SegmentStore::ref_many(const std::vector<std::string> &hashes, bool persistent) {
+    std::lock_guard<std::mutex> lk(mu_);
+    size_t n = 0;
+    for (const auto &h : hashes) n += ref_locked(h, persistent) ? 1 : 0;
+    if (persistent && n && !save_refs_locked()) {
+        std::cerr << "[SEGSTORE] cannot write refs.tsv: " << std::strerror(errno) << "\n";
+    }
+    return n;
+}
+
+size_t SegmentStore::unref_many(const std::vector<std::string> &hashes, bool persistent) {
+    std::lock_guard<std::mutex> lk(mu_);
+    size_t n = 0;
+    for (const auto &h : hashes) n += unref_locked(h, persistent) ? 1 : 0;
+    if (persistent && n && !save_refs_locked()) {
+        std::cerr << "[SEGSTORE] cannot write refs.tsv: " << std::strerror(errno) << "\n";
+    }
+    // Delete after refs.tsv is durable so a crash never leaves a persistent
+    // ref pointing at a missing object.
+    for (const auto &h : hashes) maybe_delete_locked(h);
+    return n;
+}
+
+bool SegmentStore::ref_locked(const std::string &hash, bool persistent) {
+    if (!valid_hash(hash)) return false;
+    auto it = refs_.find(hash);
+    struct stat st;
+    // Refuse to resurrect an object that was already collected.
+    if (it == refs_.end() && ::stat(object_path(hash).c_str(), &st) != 0) return false;
+    Refs &r = refs_[hash];
+    (persistent ? r.persistent : r.transient)++;
+    return true;
+}
+
+bool SegmentStore::unref_locked(const std::string &hash, bool persistent) {
+    auto it = refs_.find(hash);
+    if (it == refs_.end()) return false;
+    uint32_t &n = persistent ? it->second.persistent : it->second.transient;
+    if (n == 0) return false;
+    n--;
+    return true;
+}
+
+int SegmentStore::gc() {
+    std::lock_guard<std::mutex> lk(mu_);
+    return gc_locked();
+}
+
+int SegmentStore::gc_locked() {
+    int removed = 0;
+    const std::string objects = dir_ + "/objects";
+    DIR *top = ::opendir(objects.c_str());
+    if (!top) return 0;
+    while (dirent *fan = ::readdir(top)) {
+        if (fan->d_name[0] == '.') continue;
+        const std::string sub = objects + "/" + fan->d_name;
+        DIR *d = ::opendir(sub.c_str());
+        if (!d) continue;
+        while (dirent *e = ::readdir(d)) {
+            std::string name = e->d_name;
+            if (name.size() != 68 || name.compare(64, 4, ".mp4") != 0) continue;
+            const std::string h = name.substr(0, 64);
+            auto it = refs_.find(h);
+            if (it != refs_.end() && (it->second.transient || it->second.persistent)) continue;
+            if (::unlink((sub + "/" + name).c_str()) == 0) removed++;
+            if (it != refs_.end()) refs_.erase(it);
+        }
+        ::closedir(d);
+    }
+    ::closedir(top);
+    return removed;
+}
+
+size_t SegmentStore::object_count() {
+    std::lock_guard<std::mutex> lk(mu_);
+    return refs_.size();
+}
+
+uint64_t SegmentStore::bytes_on_disk() {
+    std::lock_guard<std::mutex> lk(mu_);
+    uint64_t total = 0;
+    struct stat st;
+    for (const auto &kv : refs_) {
+        if (::stat(object_path(kv.first).c_str(), &st) == 0) total += (uint64_t)st.st_size;
+    }
+    return total;
+}
+
+void SegmentStore::maybe_delete_locked(const std::string &hash) {
+    auto it = refs_.find(hash);
+    if (it == refs_.end() || it->second.transient || it->second.persistent) return;
+    refs_.erase(it);
+    ::unlink(object_path(hash).c_str());
+}
+
+// refs.tsv only changes when an event package is retained or dropped, so a
+// full rewrite (tmp + fsync + rename) stays cheap.
+bool SegmentStore::save_refs_locked() {
+    std::string body;
+    for (const auto &kv : refs_) {
+        if (!kv.second.persistent) continue;
+        body += kv.first;
+        body += ' ';
+        body += std::to_string(kv.second.persistent);
+        body += '\n';
+    }
+    const std::string tmp = dir_ + "/refs.tsv.tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    size_t off = 0;
+    while (off < body.size()) {
+        const ssize_t n = ::write(fd, body.data() + off, body.size() - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ::close(fd);
+            return false;
+        }
+        off += (size_t)n;
+    }
+    const bool ok = ::fdatasync(fd) == 0;
+    ::close(fd);
+    return ok && ::rename(tmp.c_str(), (dir_ + "/refs.tsv").c_str()) == 0;
+}
+
+}  // namespace ss
+
+// -------------------------
+// C ABI (python/segment_buffer.py)
+// -------------------------
+extern "C" {
+
+void *ss_open(const char *dir) {
+    auto *s = new ss::SegmentStore();
+    std::string err;
+    if (!s->open(dir ? dir : "", &err)) {
+        std::cerr << "[SEGSTORE] " << err << "\n";
+        delete s;
+        return nullptr;
+    }
+    return s;
+}
+
+void ss_close(void *h) { delete (ss::SegmentStore *)h; }
+
+// Writes the 64-char hash (plus NUL) into hash_out. 0 on success.
+int ss_ingest(void *h, const char *src, char *hash_out) {
+    std::string hash;
+    if (!h || !src || !hash_out || !((ss::SegmentStore *)h)->ingest(src, &hash, nullptr)) return -1;
+    std::memcpy(hash_out, hash.c_str(), hash.size() + 1);
+    return 0;
+}
+
+// `hashes`: one or more hashes separated by '\n'. Returns how many were applied.
+static std::vector<std::string> split_hashes(const char *hashes) {
+    std::vector<std::string> out;
+    std::string cur;
+    for (const char *p = hashes; *p; p++) {
+        if (*p == '\n') {
+            if (!cur.empty()) out.push_back(cur);
+            cur.clear();
+        } else {
+            cur += *p;
+        }
+    }
+    if (!cur.empty()) out.push_back(cur);
+    return out;
+}
+
+int ss_ref(void *h, const char *hashes, int persistent) {
+    if (!h || !hashes) return -1;
+    return (int)((ss::SegmentStore *)h)->ref_many(split_hashes(hashes), persistent != 0);
+}
+
+int ss_unref(void *h, const char *hashes, int persistent) {
+    if (!h || !hashes) return -1;
+    return (int)((ss::SegmentStore *)h)->unref_many(split_hashes(hashes), persistent != 0);
+}
+
+int ss_gc(void *h) { return h ? ((ss::SegmentStore *)h)->gc() : -1; }
+
+uint64_t ss_object_count(void *h) { return h ? ((ss::SegmentStore *)h)->object_count() : 0; }
+
+uint64_t ss_bytes_on_disk(void *h) { return h ? ((ss::SegmentStore *)h)->bytes_on_disk() : 0; }
+
+}  // extern "C"
@@ -0,0 +1,70 @@
+// ~/ArduinoApps/survillance/cpp_infer/segment_store.h
+// Content-addressed, refcounted store for the 1 s recording segments.
+//
+// Layout of <dir>:
+//   objects/<h0h1>/<sha256>.mp4   one file per distinct segment
+//   refs.tsv                      "<sha256> <count>" for event references
+//
+// A segment is ingested once (hashed, renamed into objects/) and then only
+// referenced by hash: the live ring holds a transient ref while the segment
+// is inside its window, an in-progress event holds transient refs on its
+// preroll/body segments, and a finalised event package holds persistent refs
+// through its segments.json manifest. When the last ref goes away the object
+// is deleted, which replaces SegmentRingBuffer's pin/unpin bookkeeping.
+//
+// Only persistent refs survive a restart (refs.tsv is rewritten when they
+// change, i.e. once per event); open() sweeps every object without one.
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ss {
+
+class SegmentStore {
+public:
+    bool open(const std::string &dir, std::string *err);
+
+    // Hashes `src`, moves it into objects/ (or drops it if an identical
+    // object already exists) and takes one transient ref.
+    bool ingest(const std::string &src, std::string *hash, std::string *path);
+
+    bool ref(const std::string &hash, bool persistent);
+    // Drops a ref; deletes the object when none are left.
+    bool unref(const std::string &hash, bool persistent);
+    // Batch forms (one refs.tsv rewrite for a whole event manifest).
+    // Return the number of hashes that were applied.
+    size_t ref_many(const std::vector<std::string> &hashes, bool persistent);
+    size_t unref_many(const std::vector<std::string> &hashes, bool persistent);
+
+    std::string object_path(const std::string &hash) const;
+    // Deletes every object without refs. Returns the number removed.
+    int gc();
+
+    size_t object_count();
+    uint64_t bytes_on_disk();
+
+private:
+    struct Refs {
+        uint32_t transient = 0;
+        uint32_t persistent = 0;
+    };
+
+    bool ref_locked(const std::string &hash, bool persistent);
+    bool unref_locked(const std::string &hash, bool persistent);
+    int gc_locked();
+    bool save_refs_locked();
+    void maybe_delete_locked(const std::string &hash);
+
+    std::string dir_;
+    std::unordered_map<std::string, Refs> refs_;
+    std::mutex mu_;
+};
+
+// SHA-256 of a file as 64 lowercase hex chars; empty on read error.
+std::string sha256_file(const std::string &path);
+
+}  // namespace ss
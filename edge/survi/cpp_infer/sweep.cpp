@@ -0,0 +1,457 @@
+// ~/ArduinoApps/survillance/cpp_infer/sweep.cpp
+// Accuracy-vs-cost sweep of the runner settings over a labelled clip corpus.
+//
+// Runs the engine over every clip for each combination of frames x sampling
+// x tiles x decode fidelity, then scores each threshold against the clip
+// labels:
+//
+//   recall / precision   over (clip, label) pairs: a label counts as found
+//                        when any detection of it is >= threshold
+//   completion_rate      clips main.py would close locally (_is_complete: no
+//                        detection, or max confidence >= --complete_thresh)
+//   escalation_rate      the rest, i.e. events that would go to the cloud
+//   recall_with_cloud    recall if escalated clips are taken as found (the
+//                        cloud model sees them)
+//   latency_ms           analyze_clip time per clip, mean and p95
+//
+// and marks the Pareto-optimal configurations on (recall up, precision up,
+// escalation down, mean latency down). Threshold only filters detections,
+// so the engine runs once per frames x sampling x tiles x fidelity at the
+// lowest threshold and every threshold is scored from that run.
+//
+// Reduced-fidelity (fast) configurations are also compared clip by clip
+// with the same configuration decoded in full ("vs_full"): the share of
+// clips whose found-label set and local/cloud decision are unchanged, and
+// the recall / precision deltas. within_tolerance means every one of those
+// differs by at most --tolerance.
+//
+// Corpus: JSON lines, {"mp4": "clip.mp4", "labels": ["person"]}; labels are
+// what is actually in the clip ([] for a negative), relative paths are taken
+// from the manifest's directory.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+#include "mini_json.h"
+
+// -------------------------
+// Options
+// -------------------------
+struct SweepOptions {
+    std::string corpus_path;
+    std::vector<int> frames = {1, 3, 5, 8};
+    std::vector<float> thresholds = {0.3f, 0.4f, 0.5f, 0.6f, 0.7f};
+    std::vector<engine::Sampling> sampling = {engine::Sampling::Even};
+    std::vector<int> tiles = {1};
+    std::vector<dec::Fidelity> fidelity = {dec::Fidelity::Full};
+    double tolerance = 0.02;        // fast vs full: max disagreement / delta
+    float complete_thresh = 0.70f;  // config.json complete_confidence_thresh
+    std::set<std::string> labels;   // empty: score every label
+    std::string out_path;           // empty: stdout
+};
+
+static void usage(const char *argv0) {
+    std::cerr
+        << "Usage:\n"
+        << "  " << argv0 << " --corpus corpus.jsonl [--frames 1,3,5,8] [--thresholds 0.3,0.5,0.7]\n"
+        << "        [--sampling even,keyframe] [--tiles 1,2] [--fidelity full,fast] [--tolerance D]\n"
+        << "        [--complete_thresh T]\n"
+        << "        [--labels person,car] [--out report.json]\n"
+        << "\n"
+        << "  --corpus           one {\"mp4\": path, \"labels\": [...]} per line\n"
+        << "  --complete_thresh  confidence that closes an event locally (default 0.70)\n"
+        << "  --labels           only score these labels (default: all)\n"
+        << "  --tolerance        fast decode vs full: allowed disagreement (default 0.02)\n"
+        << "\n"
+        << "Example:\n"
+        << "  " << argv0 << " --corpus clips/corpus.jsonl --frames 3,5,8 --tiles 1,2 --out sweep.json\n";
+}
+
+// -------------------------
+// Small helpers
+// -------------------------
+static std::vector<std::string> split_csv(const std::string &s) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return -1;
+    std::sort(v.begin(), v.end());
+    const size_t i = (size_t)std::min<double>(v.size() - 1, std::round(p / 100.0 * (v.size() - 1)));
+    return v[i];
+}
+
+struct Clip {
+    std::string mp4;
+    std::set<std::string> labels;
+};
+
+static bool load_corpus(const std::string &path, std::vector<Clip> *clips, std::string *err) {
+    std::ifstream f(path);
+    if (!f) {
+        *err = "cannot open " + path;
+        return false;
+    }
+    const size_t slash = path.rfind('/');
+    const std::string dir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    std::string line;
+    int lineno = 0;
+    while (std::getline(f, line)) {
+        lineno++;
+        if (line.find_first_not_of(" \t\r") == std::string::npos || line[0] == '#') continue;
+        mj::Value v;
+        std::string perr;
+        if (!mj::parse(line, &v, &perr)) {
+            *err = path + ":" + std::to_string(lineno) + ": " + perr;
+            return false;
+        }
+        Clip c;
+        c.mp4 = v.get_str("mp4");
+        if (c.mp4.empty()) {
+            *err = path + ":" + std::to_string(lineno) + ": missing \"mp4\"";
+            return false;
+        }
+        if (c.mp4[0] != '/') c.mp4 = dir + c.mp4;
+        if (const mj::Value *labels = v.get("labels")) {
+            for (const mj::Value &l : labels->arr) {
+                if (l.type == mj::Value::String) c.labels.insert(l.str);
+            }
+        }
+        clips->push_back(std::move(c));
+    }
+    if (clips->empty()) {
+        *err = path + ": no clips";
+        return false;
+    }
+    return true;
+}
+
+// -------------------------
+// Scoring
+// -------------------------
+struct Config {
+    int frames = 0;
+    float threshold = 0;
+    engine::Sampling sampling = engine::Sampling::Even;
+    int tiles = 1;
+    dec::Fidelity fidelity = dec::Fidelity::Full;
+
+    double recall = 0, precision = 0, completion = 0, escalation = 0, recall_with_cloud = 0;
+    double lat_mean = 0, lat_p95 = 0;
+    int tp = 0, fp = 0, fn = 0, errors = 0;
+    bool pareto = false;
+
+    // Per clip: labels found, and whether it closed locally
+    std::vector<std::set<std::string>> found;
+    std::vector<bool> complete;
+
+    // Fast configurations against the same one decoded in full
+    bool has_full = false;
+    double agreement = 0, recall_delta = 0, precision_delta = 0;
+    bool within_tolerance = false;
+};
+
+// One engine pass (all clips, lowest threshold) scored at `threshold`.
+static Config score(const SweepOptions &opt, const std::vector<Clip> &clips,
+                    const std::vector<engine::Result> &runs, float threshold) {
+    Config c;
+    c.threshold = threshold;
+    int complete = 0, found_or_escalated = 0;
+    std::vector<double> lat;
+    for (size_t i = 0; i < clips.size(); i++) {
+        const engine::Result &r = runs[i];
+        std::set<std::string> truth;
+        for (const auto &l : clips[i].labels) {
+            if (opt.labels.empty() || opt.labels.count(l)) truth.insert(l);
+        }
+        c.found.emplace_back();
+        c.complete.push_back(false);
+        if (!r.ok) {
+            // Failed runs escalate; nothing was found locally
+            c.errors++;
+            c.fn += (int)truth.size();
+            found_or_escalated += (int)truth.size();
+            continue;
+        }
+        lat.push_back(r.latency_ms);
+
+        std::set<std::string> found;
+        float max_conf = 0;
+        bool any = false;
+        for (const auto &d : r.detections) {
+            if (d.conf < threshold) continue;
+            any = true;
+            max_conf = std::max(max_conf, d.conf);
+            if (opt.labels.empty() || opt.labels.count(d.label)) found.insert(d.label);
+        }
+        const bool is_complete = !any || max_conf >= opt.complete_thresh;
+        if (is_complete) complete++;
+        c.found.back() = found;
+        c.complete.back() = is_complete;
+
+        for (const auto &l : truth) {
+            const bool hit = found.count(l) > 0;
+            if (hit) c.tp++;
+            else c.fn++;
+            if (hit || !is_complete) found_or_escalated++;
+        }
+        for (const auto &l : found) {
+            if (!truth.count(l)) c.fp++;
+        }
+    }
+
+    const int positives = c.tp + c.fn;
+    c.recall = positives ? (double)c.tp / positives : 1.0;
+    c.precision = (c.tp + c.fp) ? (double)c.tp / (c.tp + c.fp) : 1.0;
+    c.recall_with_cloud = positives ? (double)found_or_escalated / positives : 1.0;
+    c.completion = (double)complete / clips.size();
+    c.escalation = 1.0 - c.completion;
+    double sum = 0;
+    for (double l : lat) sum += l;
+    c.lat_mean = lat.empty() ? -1 : sum / lat.size();
+    c.lat_p95 = percentile(lat, 95);
+    return c;
+}
+
+static void compare_to_full(const SweepOptions &opt, const Config &full, Config *fast) {
+    size_t same = 0;
+    for (size_t i = 0; i < fast->found.size(); i++) {
+        if (fast->found[i] == full.found[i] && fast->complete[i] == full.complete[i]) same++;
+    }
+    fast->has_full = true;
+    fast->agreement = fast->found.empty() ? 1.0 : (double)same / fast->found.size();
+    fast->recall_delta = fast->recall - full.recall;
+    fast->precision_delta = fast->precision - full.precision;
+    fast->within_tolerance = 1.0 - fast->agreement <= opt.tolerance &&
+                             std::fabs(fast->recall_delta) <= opt.tolerance &&
+                             std::fabs(fast->precision_delta) <= opt.tolerance;
+}
+
+// a at least as good as b everywhere and strictly better somewhere.
+static bool dominates(const Config &a, const Config &b) {
+    const bool ge = a.recall >= b.recall && a.precision >= b.precision && a.escalation <= b.escalation &&
+                    a.lat_mean <= b.lat_mean;
+    const bool gt = a.recall > b.recall || a.precision > b.precision || a.escalation < b.escalation ||
+                    a.lat_mean < b.lat_mean;
+    return ge && gt;
+}
+
+static std::string config_json(const Config &c) {
+    std::ostringstream o;
+    o << "    {\"frames\": " << c.frames << ", \"threshold\": " << c.threshold << ", \"sampling\": \""
+      << engine::sampling_name(c.sampling) << "\", \"tiles\": " << c.tiles << ", \"fidelity\": \""
+      << dec::fidelity_name(c.fidelity) << "\", \"pareto\": " << (c.pareto ? "true" : "false")
+      << ",\n     \"recall\": " << c.recall << ", \"precision\": " << c.precision
+      << ", \"completion_rate\": " << c.completion << ", \"escalation_rate\": " << c.escalation
+      << ", \"recall_with_cloud\": " << c.recall_with_cloud
+      << ",\n     \"latency_ms\": {\"mean\": " << c.lat_mean << ", \"p95\": " << c.lat_p95 << "}"
+      << ", \"tp\": " << c.tp << ", \"fp\": " << c.fp << ", \"fn\": " << c.fn << ", \"errors\": " << c.errors;
+    if (c.has_full) {
+        o << ",\n     \"vs_full\": {\"agreement\": " << c.agreement << ", \"recall_delta\": " << c.recall_delta
+          << ", \"precision_delta\": " << c.precision_delta
+          << ", \"within_tolerance\": " << (c.within_tolerance ? "true" : "false") << "}";
+    }
+    o << "}";
+    return o.str();
+}
+
+// -------------------------
+// Main
+// -------------------------
+int main(int argc, char **argv) {
+    SweepOptions opt;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto need = [&](const char *flag) {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << flag << "\n";
+                usage(argv[0]);
+                std::exit(2);
+            }
+        };
+
+        if (a == "--corpus") { need("--corpus"); opt.corpus_path = argv[++i]; }
+        else if (a == "--frames") {
+            need("--frames");
+            opt.frames.clear();
+            for (const auto &s : split_csv(argv[++i])) opt.frames.push_back(std::max(1, std::atoi(s.c_str())));
+        }
+        else if (a == "--thresholds") {
+            need("--thresholds");
+            opt.thresholds.clear();
+            for (const auto &s : split_csv(argv[++i])) opt.thresholds.push_back(std::strtof(s.c_str(), nullptr));
+        }
+        else if (a == "--sampling") {
+            need("--sampling");
+            opt.sampling.clear();
+            for (const auto &s : split_csv(argv[++i])) {
+                engine::Sampling m;
+                if (!engine::parse_sampling(s, &m)) {
+                    std::cerr << "Bad --sampling: " << s << "\n";
+                    return 2;
+                }
+                opt.sampling.push_back(m);
+            }
+        }
+        else if (a == "--tiles") {
+            need("--tiles");
+            opt.tiles.clear();
+            for (const auto &s : split_csv(argv[++i])) opt.tiles.push_back(std::max(1, std::min(4, std::atoi(s.c_str()))));
+        }
+        else if (a == "--fidelity") {
+            need("--fidelity");
+            opt.fidelity.clear();
+            for (const auto &s : split_csv(argv[++i])) {
+                dec::Fidelity f;
+                if (!dec::parse_fidelity(s, &f)) {
+                    std::cerr << "Bad --fidelity: " << s << "\n";
+                    return 2;
+                }
+                opt.fidelity.push_back(f);
+            }
+        }
+        else if (a == "--tolerance") { need("--tolerance"); opt.tolerance = std::atof(argv[++i]); }
+        else if (a == "--complete_thresh") { need("--complete_thresh"); opt.complete_thresh = std::stof(argv[++i]); }
+        else if (a == "--labels") {
+            need("--labels");
+            for (const auto &s : split_csv(argv[++i])) opt.labels.insert(s);
+        }
+        else if (a == "--out") { need("--out"); opt.out_path = argv[++i]; }
+        else if (a == "--help" || a == "-h") { usage(argv[0]); return 0; }
+        else {
+            std::cerr << "Unknown arg: " << a << "\n";
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (opt.corpus_path.empty() || opt.frames.empty() || opt.thresholds.empty() || opt.sampling.empty() ||
+        opt.tiles.empty() || opt.fidelity.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<Clip> clips;
+    std::string err;
+    if (!load_corpus(opt.corpus_path, &clips, &err)) {
+        std::cerr << "[SWEEP] " << err << "\n";
+        return 2;
+    }
+    const float min_thresh = *std::min_element(opt.thresholds.begin(), opt.thresholds.end());
+
+    // Untimed pass over the first clip: model init and page cache, so the
+    // first configuration is not charged for them
+    {
+        engine::Options warm;
+        warm.event_id = "warmup";
+        warm.mp4_path = clips.front().mp4;
+        warm.frames = 1;
+        engine::analyze_clip(warm);
+    }
+
+    std::vector<Config> configs;
+    for (int tiles : opt.tiles) {
+        for (engine::Sampling sampling : opt.sampling) {
+            for (int frames : opt.frames) {
+                for (dec::Fidelity fidelity : opt.fidelity) {
+                    std::cerr << "[SWEEP] frames=" << frames << " sampling=" << engine::sampling_name(sampling)
+                              << " tiles=" << tiles << " fidelity=" << dec::fidelity_name(fidelity) << " over "
+                              << clips.size() << " clip(s)\n";
+                    std::vector<engine::Result> runs;
+                    runs.reserve(clips.size());
+                    for (size_t i = 0; i < clips.size(); i++) {
+                        engine::Options eo;
+                        eo.event_id = "sweep" + std::to_string(i);
+                        eo.mp4_path = clips[i].mp4;
+                        eo.frames = frames;
+                        eo.threshold = min_thresh;
+                        eo.sampling = sampling;
+                        eo.tiles = tiles;
+                        eo.fidelity = fidelity;
+                        runs.push_back(engine::analyze_clip(eo));
+                        if (!runs.back().ok) {
+                            std::cerr << "[SWEEP]   " << clips[i].mp4 << ": " << runs.back().error << "\n";
+                        }
+                    }
+                    for (float t : opt.thresholds) {
+                        Config c = score(opt, clips, runs, t);
+                        c.frames = frames;
+                        c.sampling = sampling;
+                        c.tiles = tiles;
+                        c.fidelity = fidelity;
+                        configs.push_back(std::move(c));
+                    }
+                }
+            }
+        }
+    }
+
+    for (auto &fast : configs) {
+        if (fast.fidelity == dec::Fidelity::Full) continue;
+        for (const auto &full : configs) {
+            if (full.fidelity == dec::Fidelity::Full && full.frames == fast.frames &&
+                full.sampling == fast.sampling && full.tiles == fast.tiles && full.threshold == fast.threshold) {
+                compare_to_full(opt, full, &fast);
+                break;
+            }
+        }
+    }
+
+    for (auto &c : configs) {
+        c.pareto = std::none_of(configs.begin(), configs.end(), [&](const Config &o) { return dominates(o, c); });
+    }
+
+    std::cerr << "[SWEEP] Pareto-optimal:\n"
+              << "  frames thresh sampling tiles fidelity  recall precision escalate  mean_ms  p95_ms\n";
+    for (const auto &c : configs) {
+        if (!c.pareto) continue;
+        char line[160];
+        std::snprintf(line, sizeof line, "  %6d %6.2f %8s %5d %8s  %6.3f %9.3f %8.3f  %7.0f %7.0f\n", c.frames,
+                      c.threshold, engine::sampling_name(c.sampling), c.tiles, dec::fidelity_name(c.fidelity),
+                      c.recall, c.precision, c.escalation, c.lat_mean, c.lat_p95);
+        std::cerr << line;
+    }
+
+    std::ostringstream o;
+    o << "{\n  \"corpus\": \"" << engine::json_escape(opt.corpus_path) << "\", \"clips\": " << clips.size()
+      << ", \"complete_thresh\": " << opt.complete_thresh << ", \"tolerance\": " << opt.tolerance
+      << ",\n  \"pareto\": [";
+    bool first = true;
+    for (size_t i = 0; i < configs.size(); i++) {
+        if (!configs[i].pareto) continue;
+        o << (first ? "" : ", ") << i;
+        first = false;
+    }
+    o << "],\n  \"configs\": [\n";
+    for (size_t i = 0; i < configs.size(); i++) {
+        o << config_json(configs[i]) << (i + 1 < configs.size() ? ",\n" : "\n");
+    }
+    o << "  ]\n}\n";
+
+    if (opt.out_path.empty()) {
+        std::cout << o.str();
+    } else {
+        std::ofstream f(opt.out_path);
+        f << o.str();
+        if (!f) {
+            std::cerr << "Failed to write " << opt.out_path << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
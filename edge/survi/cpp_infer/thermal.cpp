@@ -0,0 +1,167 @@
+// ~/ArduinoApps/survillance/cpp_infer/thermal.cpp
+// See thermal.h.
+
+#include "thermal.h"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+#include "engine.h"
+
+namespace engine {
+
+namespace {
+
+bool read_long(const std::string &path, long long *v, int base = 10) {
+    std::ifstream f(path);
+    std::string s;
+    if (!f || !std::getline(f, s) || s.empty()) return false;
+    char *end = nullptr;
+    *v = std::strtoll(s.c_str(), &end, base);
+    return end != s.c_str();
+}
+
+std::string read_line(const std::string &path) {
+    std::ifstream f(path);
+    std::string s;
+    std::getline(f, s);
+    return s;
+}
+
+// Entries of dir starting with prefix.
+std::vector<std::string> list(const std::string &dir, const std::string &prefix) {
+    std::vector<std::string> out;
+    DIR *d = ::opendir(dir.c_str());
+    if (!d) return out;
+    while (struct dirent *e = ::readdir(d)) {
+        const std::string name = e->d_name;
+        if (name.compare(0, prefix.size(), prefix) == 0) out.push_back(dir + "/" + name);
+    }
+    ::closedir(d);
+    return out;
+}
+
+bool cpu_zone(const std::string &type) {
+    for (const char *k : {"cpu", "soc", "apss", "cluster", "x86_pkg", "tsens"}) {
+        if (type.find(k) != std::string::npos) return true;
+    }
+    return false;
+}
+
+std::string fmt1(const char *f, double v) {
+    char buf[48];
+    std::snprintf(buf, sizeof buf, f, v);
+    return buf;
+}
+
+}  // namespace
+
+const char *heat_name(Heat h) {
+    return h == Heat::Hot ? "hot" : h == Heat::Warm ? "warm" : "cool";
+}
+
+ThermalSample read_thermal(const std::string &sys_root) {
+    ThermalSample s;
+
+    // Hottest CPU-ish zone; every zone if none is recognisably the CPU
+    float cpu_max = -1, any_max = -1;
+    for (const std::string &z : list(sys_root + "/class/thermal", "thermal_zone")) {
+        long long mc;
+        if (!read_long(z + "/temp", &mc) || mc <= -50000 || mc > 200000) continue;
+        const float c = (float)mc / 1000.0f;
+        any_max = std::max(any_max, c);
+        if (cpu_zone(read_line(z + "/type"))) cpu_max = std::max(cpu_max, c);
+    }
+    s.temp_c = cpu_max >= 0 ? cpu_max : any_max;
+
+    for (const std::string &cd : list(sys_root + "/class/thermal", "cooling_device")) {
+        long long st;
+        const std::string type = read_line(cd + "/type");
+        const bool cpu = type.find("cpufreq") != std::string::npos || type.find("cpu") != std::string::npos ||
+                         type == "Processor";
+        if (cpu && read_long(cd + "/cur_state", &st) && st > 0) s.throttled = true;
+    }
+
+    for (const std::string &p : list(sys_root + "/devices/system/cpu/cpufreq", "policy")) {
+        long long cur_max, hw_max;
+        if (!read_long(p + "/scaling_max_freq", &cur_max) || !read_long(p + "/cpuinfo_max_freq", &hw_max) ||
+            hw_max <= 0)
+            continue;
+        const float r = (float)cur_max / (float)hw_max;
+        s.freq_cap = s.freq_cap < 0 ? r : std::min(s.freq_cap, r);
+    }
+
+    // Raspberry Pi firmware: 0x2 arm frequency capped, 0x4 throttled, 0x8 soft temp limit
+    long long fw;
+    if (read_long(sys_root + "/devices/platform/soc/soc:firmware/get_throttled", &fw, 16) && (fw & 0xE)) {
+        s.throttled = true;
+    }
+    return s;
+}
+
+// -------------------------
+// Governor
+// -------------------------
+Heat ThermalGovernor::decide(const ThermalSample &s, std::string *reason) {
+    Heat h = Heat::Cool;
+    if (s.temp_c >= 0) {
+        const bool was_hot = level_ == Heat::Hot, was_warm = level_ != Heat::Cool;
+        if (s.temp_c >= cfg_.hot_c || (was_hot && s.temp_c >= cfg_.hot_c - cfg_.hysteresis_c)) h = Heat::Hot;
+        else if (s.temp_c >= cfg_.warm_c || (was_warm && s.temp_c >= cfg_.warm_c - cfg_.hysteresis_c)) h = Heat::Warm;
+        if (h != Heat::Cool) *reason = fmt1("temp %.1fC", s.temp_c);
+    }
+
+    // A capped clock is at least Warm, and Hot on top of a warm SoC
+    const bool capped = s.freq_cap >= 0 && s.freq_cap < cfg_.freq_cap;
+    if (s.throttled || capped) {
+        h = h == Heat::Cool ? Heat::Warm : Heat::Hot;
+        const std::string why = capped ? fmt1("freq capped %.2f", s.freq_cap) : std::string("throttled");
+        *reason = reason->empty() ? why : *reason + ", " + why;
+    }
+
+    if (h == Heat::Cool && ewma_ms_ > 0 && best_ms_ > 0 && ewma_ms_ > cfg_.slow_factor * best_ms_) {
+        h = Heat::Warm;
+        *reason = fmt1("slow %.1fx", ewma_ms_ / best_ms_);
+    }
+    return h;
+}
+
+ThermalNote ThermalGovernor::budget(Options *opt) {
+    ThermalNote n;
+    n.active = true;
+    n.sample = read_thermal(root_);
+    n.ms_per_run = ewma_ms_;
+    n.frames_requested = opt->frames;
+    n.tiles_requested = opt->tiles;
+    level_ = decide(n.sample, &n.reason);
+    n.heat = level_;
+
+    if (level_ == Heat::Warm) {
+        // ~60% of the frames (never below 2 unless fewer were asked for), one tile level less
+        opt->frames = std::max(std::min(opt->frames, 2), (opt->frames * 3 + 4) / 5);
+        opt->tiles = std::max(1, opt->tiles - 1);
+    } else if (level_ == Heat::Hot) {
+        opt->frames = std::min(opt->frames, std::max(2, opt->frames / 3));
+        opt->tiles = 1;
+    }
+    if (level_ != Heat::Cool && opt->fidelity == dec::Fidelity::Full) {
+        opt->fidelity = dec::Fidelity::Fast;
+        n.fast_decode = true;
+    }
+    n.frames = opt->frames;
+    n.tiles = opt->tiles;
+    return n;
+}
+
+void ThermalGovernor::observe(float ms_per_run) {
+    if (ms_per_run <= 0) return;
+    ewma_ms_ = ewma_ms_ < 0 ? ms_per_run : 0.7f * ewma_ms_ + 0.3f * ms_per_run;
+    best_ms_ = best_ms_ < 0 ? ewma_ms_ : std::min(best_ms_, ewma_ms_);
+}
+
+}  // namespace engine
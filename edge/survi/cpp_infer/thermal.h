@@ -0,0 +1,85 @@
+// ~/ArduinoApps/survillance/cpp_infer/thermal.h
+// Thermal / frequency-aware inference budget.
+//
+// On a fanless box a burst of events heats the SoC until the kernel or
+// firmware caps the CPU clock, and every classifier run gets slower while
+// the load (what main.py's cpu_high check sees) looks the same. Before each
+// clip, the governor reads
+//   /sys/class/thermal/thermal_zone*/temp             SoC temperature
+//   /sys/class/thermal/cooling_device*/cur_state      cpufreq cooling active
+//   /sys/devices/system/cpu/cpufreq/policy*/          clock cap (scaling_max
+//                                                     vs cpuinfo_max)
+//   /sys/devices/platform/soc/soc:firmware/get_throttled   (Raspberry Pi)
+// plus its own measure of classifier time against the fastest it has seen,
+// and picks a heat level with hysteresis. analyze_clip() then runs the clip
+// on a smaller budget: fewer sampled frames, fewer tiles, the fast decode
+// profile. The decision goes into result.json ("thermal"), so a thin result
+// can be told apart from a quiet scene.
+//
+// Missing files just remove that signal; with none of them the level stays
+// Cool unless classifier time alone shows the slowdown.
+#pragma once
+
+#include <string>
+
+namespace engine {
+
+struct Options;
+
+enum class Heat { Cool = 0, Warm = 1, Hot = 2 };
+const char *heat_name(Heat h);
+
+struct ThermalConfig {
+    float warm_c = 70.0f;        // Warm at or above
+    float hot_c = 80.0f;         // Hot at or above
+    float hysteresis_c = 5.0f;   // a level is left this far below its threshold
+    float freq_cap = 0.90f;      // scaling_max / cpuinfo_max below this: capped
+    float slow_factor = 2.0f;    // classifier time this many x the best seen: slowed
+};
+
+struct ThermalSample {
+    float temp_c = -1;    // hottest CPU/SoC zone; -1: unknown
+    float freq_cap = -1;  // lowest scaling_max / cpuinfo_max over policies; -1: unknown
+    bool throttled = false;  // cooling device engaged or firmware throttling
+};
+
+ThermalSample read_thermal(const std::string &sys_root = "/sys");
+
+// What a budget did to one clip (Result::thermal).
+struct ThermalNote {
+    bool active = false;  // a governor was consulted
+    Heat heat = Heat::Cool;
+    ThermalSample sample;
+    float ms_per_run = -1;       // smoothed classifier time when decided
+    int frames_requested = 0, tiles_requested = 0;
+    int frames = 0, tiles = 0;   // what ran
+    bool fast_decode = false;    // fidelity switched to fast
+    std::string reason;          // e.g. "temp 82.1C", "freq capped 0.60", "slow 2.4x"
+};
+
+class ThermalGovernor {
+public:
+    explicit ThermalGovernor(const ThermalConfig &cfg = ThermalConfig(), const std::string &sys_root = "/sys")
+        : cfg_(cfg), root_(sys_root) {}
+
+    // Reads sysfs, updates the level and scales opt down for it.
+    ThermalNote budget(Options *opt);
+
+    // Classifier time of a finished clip, ms per run.
+    void observe(float ms_per_run);
+    // Forget the timings (another model: its speed is a new baseline).
+    void reset_timing() { best_ms_ = ewma_ms_ = -1; }
+
+    Heat level() const { return level_; }
+
+private:
+    Heat decide(const ThermalSample &s, std::string *reason);
+
+    ThermalConfig cfg_;
+    std::string root_;
+    Heat level_ = Heat::Cool;
+    float best_ms_ = -1;  // fastest smoothed classifier time
+    float ewma_ms_ = -1;
+};
+
+}  // namespace engine
@@ -0,0 +1,50 @@
+// ~/ArduinoApps/survillance/cpp_infer/token_bucket.h
+// Byte-rate cap shared by every transfer of the upload agent.
+//
+// Tokens are bytes. The bucket refills at `rate` bytes/s up to `burst`;
+// take() hands out at most what is there. The caller (a libcurl read
+// callback) sends what it got and pauses when it got nothing, so all
+// concurrent uploads together stay under the cap and the camera's live
+// stream keeps the rest of the uplink. rate 0: no cap.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TokenBucket(double rate_bytes_s = 0, double burst_bytes = 0)
+        : rate_(rate_bytes_s), burst_(std::max(burst_bytes, rate_bytes_s / 4)), tokens_(burst_), last_(Clock::now()) {}
+
+    bool limited() const { return rate_ > 0; }
+    // Most tokens there can ever be: never wait for more than this.
+    size_t burst() const { return (size_t)burst_; }
+
+    size_t take(size_t want) {
+        if (!limited()) return want;
+        refill();
+        const size_t got = std::min(want, (size_t)tokens_);
+        tokens_ -= (double)got;
+        return got;
+    }
+
+    // Seconds until `bytes` tokens are available (0 when they are).
+    double wait_s(size_t bytes) {
+        if (!limited()) return 0;
+        refill();
+        return tokens_ >= (double)bytes ? 0 : ((double)bytes - tokens_) / rate_;
+    }
+
+private:
+    void refill() {
+        const Clock::time_point now = Clock::now();
+        tokens_ = std::min(burst_, tokens_ + rate_ * std::chrono::duration<double>(now - last_).count());
+        last_ = now;
+    }
+
+    double rate_, burst_, tokens_;
+    Clock::time_point last_;
+};
@@ -0,0 +1,690 @@
+// ~/ArduinoApps/survillance/cpp_infer/upload_agent.cpp
+// Upload agent: drains uploader_worker.py's spool (upload_job.h) to Supabase.
+//
+// uploader_worker.py on its own pushes one event at a time with blocking
+// requests and whole-file media POSTs, so a backlog after an outage drains
+// slowly and a clip cut off half way starts again from byte zero. Here:
+//   - one libcurl multi handle runs up to --concurrency requests at once,
+//     one per event, so several events move together
+//   - media go up through Supabase's resumable (tus) endpoint in --chunk_mb
+//     chunks; every confirmed chunk is checkpointed, and after a restart or
+//     a dropped connection the agent asks the server for the offset (HEAD)
+//     and continues from there
+//   - a free slot goes to the ready event with the highest priority (the
+//     incident's threat score), then the oldest
+//   - one token bucket (token_bucket.h) caps the bytes/s of all transfers
+//     together (--max_kbps), so uploads never take the whole uplink from
+//     the live stream
+//   - network errors, 408/429 and 5xx back off per event (1 s doubling to
+//     60 s); other 4xx fail the event (<id>.failed.json)
+//
+// Steps per event: insert the incident row (REST) -> per media file: create
+// the tus upload, PATCH its chunks, insert the incident_media row -> write
+// <id>.done.json. Each insert is preceded by a lookup of the row (incident by
+// local_event_id, media by incident_id + storage_url) on the first try and
+// after any failed attempt, so a lost reply never duplicates a row; no
+// unique constraint is needed on either table. Every endpoint hangs off
+// --url, so the agent runs the same against a local HTTP stand-in for the
+// storage and REST APIs.
+//
+// Env (same as uploader_worker.py): SUPABASE_URL, SUPABASE_SERVICE_ROLE_KEY,
+// SUPABASE_STORAGE_BUCKET, SUPABASE_INCIDENTS_TABLE.
+
+#include <curl/curl.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "mini_json.h"
+#include "token_bucket.h"
+#include "upload_job.h"
+
+using Clock = std::chrono::steady_clock;
+
+static std::atomic<bool> g_stop{false};
+
+// --once gives up on an event after this many failures in a row
+constexpr int kOnceMaxFailures = 5;
+
+// -------------------------
+// Small helpers
+// -------------------------
+static void usage(const char *argv0) {
+    std::cerr
+        << "Usage:\n"
+        << "  " << argv0 << " [--spool DIR] [--url URL] [--bucket NAME] [--concurrency N]\n"
+        << "        [--chunk_mb MB] [--max_kbps KBPS] [--poll_s S] [--once]\n"
+        << "\n"
+        << "  --spool        job directory shared with uploader_worker.py (default ./events/upload_spool)\n"
+        << "  --url          API base (default $SUPABASE_URL); http://127.0.0.1:PORT for a stand-in\n"
+        << "  --concurrency  requests in flight, one per event (default 3)\n"
+        << "  --chunk_mb     resumable upload chunk (default 6, what Supabase expects)\n"
+        << "  --max_kbps     cap on all uploads together, kbit/s (default 0: none)\n"
+        << "  --once         exit once the spool is drained (instead of polling it)\n";
+}
+
+static const char *env_or(const char *name, const char *def) {
+    const char *v = std::getenv(name);
+    return v && *v ? v : def;
+}
+
+static double ms_between(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+static std::string base64(const std::string &s) {
+    static const char *tbl = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string o;
+    size_t i = 0;
+    for (; i + 2 < s.size(); i += 3) {
+        const uint32_t v = ((uint8_t)s[i] << 16) | ((uint8_t)s[i + 1] << 8) | (uint8_t)s[i + 2];
+        o += tbl[v >> 18];
+        o += tbl[(v >> 12) & 63];
+        o += tbl[(v >> 6) & 63];
+        o += tbl[v & 63];
+    }
+    if (i < s.size()) {
+        const uint32_t v = ((uint8_t)s[i] << 16) | (i + 1 < s.size() ? (uint8_t)s[i + 1] << 8 : 0);
+        o += tbl[v >> 18];
+        o += tbl[(v >> 12) & 63];
+        o += i + 1 < s.size() ? tbl[(v >> 6) & 63] : '=';
+        o += '=';
+    }
+    return o;
+}
+
+// Scheme + host of a URL, for a relative Location header.
+static std::string origin(const std::string &url) {
+    const size_t p = url.find("://");
+    const size_t slash = p == std::string::npos ? std::string::npos : url.find('/', p + 3);
+    return slash == std::string::npos ? url : url.substr(0, slash);
+}
+
+// -------------------------
+// Agent
+// -------------------------
+struct AgentConfig {
+    std::string spool = "./events/upload_spool";
+    std::string url, key, bucket, incidents_table;
+    int concurrency = 3;
+    size_t chunk = 6 << 20;
+    double max_kbps = 0;
+    double poll_s = 2.0;
+    bool once = false;
+};
+
+enum class Step { FindIncident, InsertIncident, Create, Head, Patch, FindMedia, InsertMedia, Done };
+
+static const char *step_name(Step s) {
+    switch (s) {
+        case Step::FindIncident: return "incident lookup";
+        case Step::InsertIncident: return "incident";
+        case Step::Create: return "create";
+        case Step::Head: return "head";
+        case Step::Patch: return "patch";
+        case Step::FindMedia: return "media lookup";
+        case Step::InsertMedia: return "media";
+        default: return "done";
+    }
+}
+
+static bool is_incident_step(Step s) { return s == Step::FindIncident || s == Step::InsertIncident; }
+
+struct Task {
+    up::Job job;
+    Clock::time_point not_before;
+    int failures = 0;
+    bool busy = false;
+    // The lookup found no row: the next request may insert it. Cleared
+    // when that insert starts, so a retry looks again.
+    bool incident_missing = false;
+    int media_missing = -1;  // index into job.media
+};
+
+class Agent;
+
+struct Request {
+    Agent *agent = nullptr;
+    Task *task = nullptr;
+    Step step = Step::Done;
+    size_t media = 0;
+    CURL *h = nullptr;
+    curl_slist *hdrs = nullptr;
+    std::string body, resp;
+    std::string location;      // response headers
+    int64_t upload_offset = -1;
+    int fd = -1;               // PATCH body: [off, end) of the file, from start
+    int64_t start = 0, off = 0, end = 0;
+    bool paused = false;
+    Clock::time_point t0;
+
+    ~Request() {
+        if (h) curl_easy_cleanup(h);
+        if (hdrs) curl_slist_free_all(hdrs);
+        if (fd >= 0) ::close(fd);
+    }
+};
+
+class Agent {
+public:
+    explicit Agent(const AgentConfig &cfg)
+        : cfg_(cfg), bucket_(cfg.max_kbps * 1000.0 / 8.0), multi_(curl_multi_init()) {}
+    ~Agent() { curl_multi_cleanup(multi_); }
+
+    int run();
+
+private:
+    friend size_t read_body(char *, size_t, size_t, void *);
+
+    void scan();
+    Task *pick();
+    bool gave_up() const;
+    Step next_step(Task *t, size_t *media);
+    void start(Task *t);
+    void finish(Request *r, CURLcode rc);
+    void retry(Task *t, const std::string &why);
+    void drop(Task *t, const std::string &error, bool done);
+    std::string public_url(const up::Media &m) const;
+    std::string rest_url(const std::string &table, const std::string &query) const;
+
+    AgentConfig cfg_;
+    TokenBucket bucket_;
+    CURLM *multi_;
+    std::map<std::string, std::unique_ptr<Task>> tasks_;  // by event id
+    std::map<CURL *, std::unique_ptr<Request>> inflight_;
+    std::set<std::string> bad_;  // job files that did not load
+};
+
+size_t read_body(char *buf, size_t size, size_t n, void *ud) {
+    Request *r = (Request *)ud;
+    const size_t want = std::min(size * n, (size_t)(r->end - r->off));
+    if (!want) return 0;
+    const size_t got = r->agent->bucket_.take(want);
+    if (!got) {
+        r->paused = true;
+        return CURL_READFUNC_PAUSE;
+    }
+    const ssize_t k = ::pread(r->fd, buf, got, r->off);
+    if (k <= 0) return CURL_READFUNC_ABORT;
+    r->off += k;
+    return (size_t)k;
+}
+
+// libcurl rewinds the body when it resends on a reused connection
+static int seek_body(void *ud, curl_off_t offset, int origin) {
+    Request *r = (Request *)ud;
+    if (origin != SEEK_SET || offset < 0 || r->start + offset > r->end) return CURL_SEEKFUNC_CANTSEEK;
+    r->off = r->start + offset;
+    return CURL_SEEKFUNC_OK;
+}
+
+static size_t write_body(char *p, size_t size, size_t n, void *ud) {
+    std::string *s = (std::string *)ud;
+    if (s->size() < (1 << 20)) s->append(p, size * n);
+    return size * n;
+}
+
+static size_t read_header(char *p, size_t size, size_t n, void *ud) {
+    Request *r = (Request *)ud;
+    std::string line(p, size * n);
+    const size_t colon = line.find(':');
+    if (colon != std::string::npos) {
+        std::string name = line.substr(0, colon), value = line.substr(colon + 1);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t\r\n") + 1);
+        if (name == "location") r->location = value;
+        else if (name == "upload-offset") r->upload_offset = std::atoll(value.c_str());
+    }
+    return size * n;
+}
+
+void Agent::scan() {
+    for (const std::string &path : up::list_jobs(cfg_.spool)) {
+        if (bad_.count(path)) continue;
+        const size_t slash = path.rfind('/');
+        const std::string id = path.substr(slash + 1, path.size() - slash - 1 - strlen(".job.json"));
+        if (tasks_.count(id)) continue;
+        std::unique_ptr<Task> t(new Task());
+        std::string err;
+        if (!up::load_job(path, &t->job, &err)) {
+            std::cerr << "[UPLOAD] " << path << ": " << err << "\n";
+            bad_.insert(path);
+            continue;
+        }
+        t->not_before = Clock::now();
+        tasks_[id] = std::move(t);
+    }
+}
+
+Task *Agent::pick() {
+    const Clock::time_point now = Clock::now();
+    Task *best = nullptr;
+    for (auto &kv : tasks_) {
+        Task *t = kv.second.get();
+        if (t->busy || t->not_before > now) continue;
+        if (!best || t->job.priority > best->job.priority ||
+            (t->job.priority == best->job.priority && t->job.created_ms < best->job.created_ms)) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+// --once: done when the spool is empty or every event left keeps failing
+bool Agent::gave_up() const {
+    for (const auto &kv : tasks_) {
+        if (kv.second->failures < kOnceMaxFailures) return false;
+    }
+    return true;
+}
+
+std::string Agent::public_url(const up::Media &m) const {
+    return cfg_.url + "/storage/v1/object/public/" + cfg_.bucket + "/" + m.storage_path;
+}
+
+// query: "" or "col=eq.value&..." with values already escaped
+std::string Agent::rest_url(const std::string &table, const std::string &query) const {
+    return cfg_.url + "/rest/v1/" + table + (query.empty() ? "" : "?" + query);
+}
+
+static std::string url_escape(const std::string &s) {
+    char *e = curl_easy_escape(nullptr, s.data(), (int)s.size());
+    const std::string out = e ? e : "";
+    curl_free(e);
+    return out;
+}
+
+Step Agent::next_step(Task *t, size_t *media) {
+    if (t->job.incident_db_id.empty()) {
+        return t->incident_missing || t->job.local_event_id.empty() ? Step::InsertIncident : Step::FindIncident;
+    }
+    for (size_t i = 0; i < t->job.media.size(); i++) {
+        up::Media &m = t->job.media[i];
+        if (m.size < 0 || m.inserted) continue;
+        *media = i;
+        if (!m.uploaded) {
+            if (m.location.empty()) return Step::Create;
+            if (m.offset < 0) return Step::Head;
+            return Step::Patch;
+        }
+        return t->media_missing == (int)i ? Step::InsertMedia : Step::FindMedia;
+    }
+    return Step::Done;
+}
+
+void Agent::start(Task *t) {
+    std::unique_ptr<Request> r(new Request());
+    r->agent = this;
+    r->task = t;
+    r->step = next_step(t, &r->media);
+    if (r->step == Step::Done) {
+        drop(t, "", true);
+        return;
+    }
+    r->h = curl_easy_init();
+    r->t0 = Clock::now();
+    CURL *h = r->h;
+    const std::string auth = cfg_.key;
+    r->hdrs = curl_slist_append(r->hdrs, ("apikey: " + auth).c_str());
+    r->hdrs = curl_slist_append(r->hdrs, ("Authorization: Bearer " + auth).c_str());
+    r->hdrs = curl_slist_append(r->hdrs, "Expect:");
+    curl_easy_setopt(h, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(h, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, write_body);
+    curl_easy_setopt(h, CURLOPT_WRITEDATA, &r->resp);
+    curl_easy_setopt(h, CURLOPT_HEADERFUNCTION, read_header);
+    curl_easy_setopt(h, CURLOPT_HEADERDATA, r.get());
+    curl_easy_setopt(h, CURLOPT_PRIVATE, r.get());
+
+    const up::Job &job = t->job;
+    up::Media *m = is_incident_step(r->step) ? nullptr : &t->job.media[r->media];
+    const std::string tus = cfg_.url + "/storage/v1/upload/resumable";
+    switch (r->step) {
+        case Step::FindIncident:
+        case Step::FindMedia:
+            r->body = r->step == Step::FindIncident
+                          ? rest_url(cfg_.incidents_table,
+                                     "select=id&limit=1&local_event_id=eq." + url_escape(job.local_event_id))
+                          : rest_url("incident_media", "select=id&limit=1&incident_id=eq." +
+                                                           url_escape(job.incident_db_id) +
+                                                           "&storage_url=eq." + url_escape(public_url(*m)));
+            curl_easy_setopt(h, CURLOPT_URL, r->body.c_str());
+            curl_easy_setopt(h, CURLOPT_HTTPGET, 1L);
+            curl_easy_setopt(h, CURLOPT_TIMEOUT, 30L);
+            break;
+        case Step::InsertIncident:
+        case Step::InsertMedia:
+            // A retry of either looks the row up first
+            if (r->step == Step::InsertIncident) {
+                t->incident_missing = false;
+            } else {
+                t->media_missing = -1;
+            }
+            r->body = r->step == Step::InsertIncident
+                          ? job.incident_body
+                          : "[{\"incident_id\":" + up::quote(job.incident_db_id) +
+                                ",\"media_type\":" + up::quote(m->media_type) + ",\"storage_url\":" +
+                                up::quote(public_url(*m)) + ",\"content_type\":" + up::quote(m->content_type) + "}]";
+            r->hdrs = curl_slist_append(r->hdrs, "Content-Type: application/json");
+            r->hdrs = curl_slist_append(r->hdrs, "Prefer: return=representation");
+            // libcurl replays a request whose reused connection dies before
+            // any reply; an insert must fail instead and be looked up
+            curl_easy_setopt(h, CURLOPT_FRESH_CONNECT, 1L);
+            curl_easy_setopt(h, CURLOPT_URL,
+                             rest_url(r->step == Step::InsertIncident ? cfg_.incidents_table : "incident_media", "")
+                                 .c_str());
+            curl_easy_setopt(h, CURLOPT_POSTFIELDS, r->body.c_str());
+            curl_easy_setopt(h, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)r->body.size());
+            curl_easy_setopt(h, CURLOPT_TIMEOUT, 30L);
+            break;
+        case Step::Create:
+            r->hdrs = curl_slist_append(r->hdrs, "Tus-Resumable: 1.0.0");
+            r->hdrs = curl_slist_append(r->hdrs, "x-upsert: true");
+            r->hdrs = curl_slist_append(r->hdrs, ("Upload-Length: " + std::to_string(m->size)).c_str());
+            r->hdrs = curl_slist_append(
+                r->hdrs, ("Upload-Metadata: bucketName " + base64(cfg_.bucket) + ",objectName " +
+                          base64(m->storage_path) + ",contentType " + base64(m->content_type))
+                             .c_str());
+            curl_easy_setopt(h, CURLOPT_URL, tus.c_str());
+            curl_easy_setopt(h, CURLOPT_POSTFIELDS, "");
+            curl_easy_setopt(h, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)0);
+            curl_easy_setopt(h, CURLOPT_TIMEOUT, 30L);
+            break;
+        case Step::Head:
+            r->hdrs = curl_slist_append(r->hdrs, "Tus-Resumable: 1.0.0");
+            curl_easy_setopt(h, CURLOPT_URL, m->location.c_str());
+            curl_easy_setopt(h, CURLOPT_NOBODY, 1L);
+            curl_easy_setopt(h, CURLOPT_TIMEOUT, 30L);
+            break;
+        case Step::Patch:
+            r->fd = ::open(m->path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (r->fd < 0) {
+                drop(t, "open " + m->path + ": " + std::strerror(errno), false);
+                return;
+            }
+            r->start = r->off = m->offset;
+            r->end = std::min<int64_t>(m->size, m->offset + (int64_t)cfg_.chunk);
+            r->hdrs = curl_slist_append(r->hdrs, "Tus-Resumable: 1.0.0");
+            r->hdrs = curl_slist_append(r->hdrs, "Content-Type: application/offset+octet-stream");
+            r->hdrs = curl_slist_append(r->hdrs, ("Upload-Offset: " + std::to_string(m->offset)).c_str());
+            curl_easy_setopt(h, CURLOPT_URL, m->location.c_str());
+            curl_easy_setopt(h, CURLOPT_UPLOAD, 1L);
+            curl_easy_setopt(h, CURLOPT_CUSTOMREQUEST, "PATCH");
+            curl_easy_setopt(h, CURLOPT_READFUNCTION, read_body);
+            curl_easy_setopt(h, CURLOPT_READDATA, r.get());
+            curl_easy_setopt(h, CURLOPT_SEEKFUNCTION, seek_body);
+            curl_easy_setopt(h, CURLOPT_SEEKDATA, r.get());
+            curl_easy_setopt(h, CURLOPT_INFILESIZE_LARGE, (curl_off_t)(r->end - r->off));
+            // Paused by the bucket is not stalled; a dead link is
+            curl_easy_setopt(h, CURLOPT_LOW_SPEED_LIMIT, 1L);
+            curl_easy_setopt(h, CURLOPT_LOW_SPEED_TIME, 120L);
+            break;
+        default:
+            break;
+    }
+    curl_easy_setopt(h, CURLOPT_HTTPHEADER, r->hdrs);
+    t->busy = true;
+    curl_multi_add_handle(multi_, h);
+    inflight_[h] = std::move(r);
+}
+
+void Agent::retry(Task *t, const std::string &why) {
+    t->failures++;
+    const int backoff_s = std::min(60, 1 << std::min(t->failures - 1, 6));
+    t->not_before = Clock::now() + std::chrono::seconds(backoff_s);
+    std::cerr << "[UPLOAD] " << t->job.id << ": " << why << " (retry in " << backoff_s << " s)\n";
+}
+
+void Agent::drop(Task *t, const std::string &error, bool done) {
+    const std::string id = t->job.id;
+    if (done) {
+        if (!up::finish_job(t->job, cfg_.url + "/storage/v1/object/public/" + cfg_.bucket)) {
+            // Keep the task, but not in a tight pick() / start() loop
+            retry(t, "cannot write outcome");
+            return;
+        }
+        std::cerr << "[UPLOAD] " << id << " done\n";
+    } else {
+        std::cerr << "[UPLOAD] " << id << " failed: " << error << "\n";
+        if (!up::fail_job(t->job, error)) {
+            retry(t, "cannot write outcome");
+            return;
+        }
+    }
+    tasks_.erase(id);
+}
+
+void Agent::finish(Request *r, CURLcode rc) {
+    Task *t = r->task;
+    t->busy = false;
+    long code = 0;
+    curl_easy_getinfo(r->h, CURLINFO_RESPONSE_CODE, &code);
+    const double ms = ms_between(r->t0, Clock::now());
+    up::Media *m = is_incident_step(r->step) ? nullptr : &t->job.media[r->media];
+    if (m && r->step != Step::FindMedia && r->step != Step::InsertMedia) m->ms += ms;
+
+    const std::string what = std::string(step_name(r->step)) + (m ? " " + m->storage_path : "");
+    if (rc != CURLE_OK) {
+        if (r->step == Step::Patch && m) m->offset = -1;  // some bytes may have landed
+        retry(t, what + ": " + curl_easy_strerror(rc));
+        return;
+    }
+    if (code == 408 || code == 429 || code >= 500) {
+        if (r->step == Step::Patch && m) m->offset = -1;
+        retry(t, what + ": HTTP " + std::to_string(code));
+        return;
+    }
+    if ((code == 404 || code == 410) && (r->step == Step::Head || r->step == Step::Patch)) {
+        // The server forgot the upload (expired): start the file again
+        m->location.clear();
+        m->offset = -1;
+        up::save_checkpoint(t->job);
+        retry(t, what + ": upload expired, restarting file");
+        return;
+    }
+    if (code == 409 && r->step == Step::Patch) {
+        m->offset = -1;  // offset mismatch: ask
+        t->not_before = Clock::now();
+        return;
+    }
+    if (code < 200 || code >= 300) {
+        drop(t, what + ": HTTP " + std::to_string(code) + " " + r->resp.substr(0, 300), false);
+        return;
+    }
+
+    switch (r->step) {
+        case Step::FindIncident:
+        case Step::InsertIncident:
+        case Step::FindMedia: {
+            mj::Value v;
+            std::string err;
+            if (!mj::parse(r->resp, &v, &err) || v.type != mj::Value::Array) {
+                drop(t, what + ": reply is not a row list", false);
+                return;
+            }
+            if (v.arr.empty()) {
+                if (r->step == Step::InsertIncident) {
+                    drop(t, "incident insert: no row in reply", false);
+                    return;
+                }
+                if (r->step == Step::FindIncident) {
+                    t->incident_missing = true;
+                } else {
+                    t->media_missing = (int)r->media;
+                }
+                break;
+            }
+            if (r->step == Step::FindMedia) {
+                m->inserted = true;  // written by an attempt whose reply was lost
+                break;
+            }
+            const mj::Value *id = v.arr[0].get("id");
+            if (!id || (id->type != mj::Value::String && id->type != mj::Value::Number)) {
+                drop(t, what + ": no id in reply", false);
+                return;
+            }
+            t->job.incident_db_id = id->type == mj::Value::String ? id->str : std::to_string((int64_t)id->num);
+            std::cerr << "[UPLOAD] " << t->job.id << " incident " << t->job.incident_db_id
+                      << (r->step == Step::FindIncident ? " (already there)" : "") << "\n";
+            break;
+        }
+        case Step::Create:
+            if (r->location.empty()) {
+                drop(t, what + ": no Location", false);
+                return;
+            }
+            m->location = r->location[0] == '/' ? origin(cfg_.url) + r->location : r->location;
+            m->offset = 0;
+            m->uploaded = m->size == 0;
+            break;
+        case Step::Head:
+        case Step::Patch:
+            if (r->upload_offset < 0) {
+                drop(t, what + ": no Upload-Offset", false);
+                return;
+            }
+            m->offset = r->upload_offset;
+            m->uploaded = m->offset >= m->size;
+            break;
+        case Step::InsertMedia:
+            m->inserted = true;
+            break;
+        default:
+            break;
+    }
+    t->failures = 0;
+    if (!up::save_checkpoint(t->job)) std::cerr << "[UPLOAD] " << t->job.id << ": checkpoint write failed\n";
+}
+
+int Agent::run() {
+    std::cerr << "[UPLOAD] spool " << cfg_.spool << ", " << cfg_.concurrency << " concurrent, chunk "
+              << (cfg_.chunk >> 10) << " KB, cap " << (cfg_.max_kbps > 0 ? std::to_string((int)cfg_.max_kbps) + " kbit/s" : "none")
+              << "\n";
+    Clock::time_point next_scan = Clock::now();
+    while (!g_stop) {
+        const Clock::time_point now = Clock::now();
+        if (now >= next_scan) {
+            scan();
+            next_scan = now + std::chrono::milliseconds((int)(cfg_.poll_s * 1000));
+        }
+        while ((int)inflight_.size() < cfg_.concurrency) {
+            Task *t = pick();
+            if (!t) break;
+            start(t);
+        }
+        if (cfg_.once && inflight_.empty() && !pick() && gave_up()) break;
+
+        int running = 0;
+        curl_multi_perform(multi_, &running);
+        int left = 0;
+        while (CURLMsg *msg = curl_multi_info_read(multi_, &left)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL *h = msg->easy_handle;
+            const CURLcode rc = msg->data.result;
+            curl_multi_remove_handle(multi_, h);
+            auto it = inflight_.find(h);
+            if (it == inflight_.end()) continue;
+            std::unique_ptr<Request> r = std::move(it->second);
+            inflight_.erase(it);
+            finish(r.get(), rc);
+        }
+
+        // Resume transfers the bucket paused once it has a useful amount again
+        // (at a low cap the whole burst is less than one 16 KiB read)
+        int wait_ms = 200;
+        for (auto &kv : inflight_) {
+            Request *r = kv.second.get();
+            if (!r->paused) continue;
+            const double w = bucket_.wait_s(
+                std::min<size_t>({16384, bucket_.burst(), (size_t)(r->end - r->off)}));
+            if (w <= 0) {
+                r->paused = false;
+                curl_easy_pause(r->h, CURLPAUSE_CONT);
+                wait_ms = 0;
+            } else {
+                wait_ms = std::min(wait_ms, std::max(1, (int)(w * 1000)));
+            }
+        }
+        if (inflight_.empty()) {
+            // Idle: sleep until the next scan or backoff expiry
+            Clock::time_point wake = next_scan;
+            for (auto &kv : tasks_) wake = std::min(wake, kv.second->not_before);
+            wait_ms = std::max(0, std::min(1000, (int)ms_between(Clock::now(), wake)));
+        }
+        curl_multi_poll(multi_, nullptr, 0, wait_ms, nullptr);
+    }
+    // Whatever is in flight is simply cut; the checkpoints hold the last confirmed state
+    for (auto &kv : inflight_) curl_multi_remove_handle(multi_, kv.first);
+    inflight_.clear();
+    return 0;
+}
+
+// -------------------------
+// Main
+// -------------------------
+int main(int argc, char **argv) {
+    AgentConfig cfg;
+    cfg.url = env_or("SUPABASE_URL", "");
+    cfg.key = env_or("SUPABASE_SERVICE_ROLE_KEY", "");
+    cfg.bucket = env_or("SUPABASE_STORAGE_BUCKET", "incidents");
+    cfg.incidents_table = env_or("SUPABASE_INCIDENTS_TABLE", "incidents");
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto need = [&](const char *flag) {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << flag << "\n";
+                usage(argv[0]);
+                std::exit(2);
+            }
+        };
+
+        if (a == "--spool") { need("--spool"); cfg.spool = argv[++i]; }
+        else if (a == "--url") { need("--url"); cfg.url = argv[++i]; }
+        else if (a == "--bucket") { need("--bucket"); cfg.bucket = argv[++i]; }
+        else if (a == "--concurrency") { need("--concurrency"); cfg.concurrency = std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--chunk_mb") { need("--chunk_mb"); cfg.chunk = (size_t)(std::max(0.0625, std::atof(argv[++i])) * (1 << 20)); }
+        else if (a == "--max_kbps") { need("--max_kbps"); cfg.max_kbps = std::max(0.0, std::atof(argv[++i])); }
+        else if (a == "--poll_s") { need("--poll_s"); cfg.poll_s = std::max(0.1, std::atof(argv[++i])); }
+        else if (a == "--once") { cfg.once = true; }
+        else if (a == "--help" || a == "-h") { usage(argv[0]); return 0; }
+        else {
+            std::cerr << "Unknown arg: " << a << "\n";
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    while (!cfg.url.empty() && cfg.url.back() == '/') cfg.url.pop_back();
+    if (cfg.url.empty()) {
+        std::cerr << "No API URL: set SUPABASE_URL or pass --url\n";
+        return 2;
+    }
+
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = [](int) { g_stop = true; };
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    int rc;
+    {
+        Agent agent(cfg);
+        rc = agent.run();
+    }
+    curl_global_cleanup();
+    return rc;
+}
@@ -0,0 +1,197 @@
+// ~/ArduinoApps/survillance/cpp_infer/upload_job.cpp
+// See upload_job.h.
+
+#include "upload_job.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "mini_json.h"
+
+namespace up {
+
+namespace {
+
+bool ends_with(const std::string &s, const std::string &p) {
+    return s.size() >= p.size() && s.compare(s.size() - p.size(), p.size(), p) == 0;
+}
+
+std::string path_for(const Job &job, const char *suffix) { return job.dir + "/" + job.id + suffix; }
+
+bool read_file(const std::string &path, std::string *out) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return false;
+    std::ostringstream o;
+    o << f.rdbuf();
+    *out = o.str();
+    return true;
+}
+
+// tmp + fdatasync + rename
+bool write_durable(const std::string &path, const std::string &body) {
+    const std::string tmp = path + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    size_t off = 0;
+    while (off < body.size()) {
+        const ssize_t n = ::write(fd, body.data() + off, body.size() - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        off += (size_t)n;
+    }
+    const bool ok = off == body.size() && ::fdatasync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+void remove_inputs(const Job &job) {
+    ::unlink(path_for(job, ".ckpt.json").c_str());
+    ::unlink(path_for(job, ".job.json").c_str());
+}
+
+}  // namespace
+
+std::string quote(const std::string &s) {
+    std::string o = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '\\': o += "\\\\"; break;
+            case '"':  o += "\\\""; break;
+            case '\n': o += "\\n";  break;
+            case '\r': o += "\\r";  break;
+            case '\t': o += "\\t";  break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)c);
+                    o += buf;
+                } else {
+                    o += c;
+                }
+        }
+    }
+    return o + "\"";
+}
+
+std::vector<std::string> list_jobs(const std::string &spool) {
+    std::vector<std::string> out;
+    DIR *d = ::opendir(spool.c_str());
+    if (!d) return out;
+    while (struct dirent *e = ::readdir(d)) {
+        const std::string name = e->d_name;
+        if (ends_with(name, ".job.json")) out.push_back(spool + "/" + name);
+    }
+    ::closedir(d);
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+bool load_job(const std::string &path, Job *job, std::string *err) {
+    std::string text;
+    mj::Value v;
+    if (!read_file(path, &text) || !mj::parse(text, &v, err) || v.type != mj::Value::Object) {
+        if (err->empty()) *err = "unreadable";
+        return false;
+    }
+    const size_t slash = path.rfind('/');
+    job->dir = slash == std::string::npos ? "." : path.substr(0, slash);
+    job->id = v.get_str("event_id");
+    job->priority = (int)v.get_num("priority", 0);
+    job->created_ms = (int64_t)v.get_num("created_ms", 0);
+    job->incident_body = v.get_str("incident_body");
+    job->incident_db_id = v.get_str("incident_db_id");
+    mj::Value rows;
+    std::string rows_err;
+    if (mj::parse(job->incident_body, &rows, &rows_err) && rows.type == mj::Value::Array && !rows.arr.empty()) {
+        job->local_event_id = rows.arr[0].get_str("local_event_id");
+    }
+    if (job->id.empty() || job->id.find('/') != std::string::npos || job->incident_body.empty() ||
+        path != path_for(*job, ".job.json")) {
+        *err = "event_id (matching the file name) and incident_body are required";
+        return false;
+    }
+    if (const mj::Value *media = v.get("media")) {
+        for (const mj::Value &m : media->arr) {
+            Media x;
+            x.path = m.get_str("path");
+            x.storage_path = m.get_str("storage_path");
+            x.content_type = m.get_str("content_type", "application/octet-stream");
+            x.media_type = m.get_str("media_type");
+            struct stat st;
+            if (::stat(x.path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) x.size = st.st_size;
+            if (!x.storage_path.empty()) job->media.push_back(x);
+        }
+    }
+
+    // Checkpoint: media entries line up with the job's
+    mj::Value ck;
+    std::string ck_err;
+    if (read_file(path_for(*job, ".ckpt.json"), &text) && mj::parse(text, &ck, &ck_err)) {
+        job->incident_db_id = ck.get_str("incident_db_id", job->incident_db_id);
+        if (const mj::Value *media = ck.get("media")) {
+            for (size_t i = 0; i < media->arr.size() && i < job->media.size(); i++) {
+                const mj::Value &m = media->arr[i];
+                Media &x = job->media[i];
+                x.location = m.get_str("location");
+                x.uploaded = m.get_bool("uploaded", false);
+                x.inserted = m.get_bool("inserted", false);
+                x.ms = m.get_num("ms", 0);
+                x.offset = -1;  // the server's word counts after a restart
+            }
+        }
+    }
+    return true;
+}
+
+bool save_checkpoint(const Job &job) {
+    std::ostringstream o;
+    o << "{\"incident_db_id\":" << quote(job.incident_db_id) << ",\"media\":[";
+    for (size_t i = 0; i < job.media.size(); i++) {
+        const Media &m = job.media[i];
+        o << (i ? "," : "") << "{\"location\":" << quote(m.location) << ",\"offset\":" << m.offset
+          << ",\"uploaded\":" << (m.uploaded ? "true" : "false") << ",\"inserted\":" << (m.inserted ? "true" : "false")
+          << ",\"ms\":" << (int64_t)m.ms << "}";
+    }
+    o << "]}\n";
+    return write_durable(path_for(job, ".ckpt.json"), o.str());
+}
+
+bool finish_job(const Job &job, const std::string &public_base) {
+    std::ostringstream o;
+    o << "{\"event_id\":" << quote(job.id) << ",\"incident_db_id\":" << quote(job.incident_db_id) << ",\"media\":[";
+    for (size_t i = 0; i < job.media.size(); i++) {
+        const Media &m = job.media[i];
+        o << (i ? "," : "") << "{\"storage_path\":" << quote(m.storage_path)
+          << ",\"media_type\":" << quote(m.media_type) << ",\"url\":" << quote(public_base + "/" + m.storage_path)
+          << ",\"bytes\":" << m.size << ",\"ms\":" << (int64_t)m.ms
+          << ",\"skipped\":" << (m.size < 0 ? "true" : "false") << "}";
+    }
+    o << "]}\n";
+    if (!write_durable(path_for(job, ".done.json"), o.str())) return false;
+    remove_inputs(job);
+    return true;
+}
+
+bool fail_job(const Job &job, const std::string &error) {
+    if (!write_durable(path_for(job, ".failed.json"),
+                       "{\"event_id\":" + quote(job.id) + ",\"error\":" + quote(error) +
+                           ",\"incident_db_id\":" + quote(job.incident_db_id) + "}\n")) {
+        return false;
+    }
+    remove_inputs(job);
+    return true;
+}
+
+}  // namespace up
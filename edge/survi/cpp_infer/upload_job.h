@@ -0,0 +1,74 @@
+// ~/ArduinoApps/survillance/cpp_infer/upload_job.h
+// Spool files of the upload agent (upload_agent.cpp).
+//
+// uploader_worker.py builds the incident row and the media list exactly as
+// it does for its own uploads, and hands them over as one file per event:
+//   <spool>/<event_id>.job.json
+//     {"event_id":"..", "priority":<threat score>, "created_ms":N,
+//      "incident_body":"[{...}]",            row(s) as the POST body text
+//      "incident_db_id":"..",                optional: row of an earlier attempt
+//      "media":[{"path":"/abs/clip.mp4", "storage_path":"<id>/clip.mp4",
+//                "content_type":"video/mp4", "media_type":"clip"}, ...]}
+// The agent never edits it. Its progress goes to
+//   <spool>/<event_id>.ckpt.json
+//     {"incident_db_id":"..", "media":[{"location":"<tus upload url>",
+//      "offset":N, "uploaded":true, "inserted":true, "ms":N}, ...]}
+// rewritten (tmp + fdatasync + rename) after every step and every chunk, so
+// a restarted agent continues each file from the last confirmed chunk. Before
+// inserting a row the agent looks for it (the incident by its local_event_id,
+// a media row by incident_id + storage_url), so a reply lost after the server
+// committed, or a crash before the checkpoint, never makes a second one. The
+// outcome is one of
+//   <spool>/<event_id>.done.json    {"event_id", "incident_db_id",
+//                                    "media":[{"storage_path", "media_type",
+//                                    "url", "bytes", "ms", "skipped"}]}
+//   <spool>/<event_id>.failed.json  {"event_id", "error", "incident_db_id"}
+// after which the job and checkpoint files are removed; uploader_worker.py
+// picks the outcome up (markers, store flags, clip cleanup) and deletes it.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace up {
+
+struct Media {
+    std::string path, storage_path, content_type, media_type;
+    int64_t size = -1;        // -1: file missing (skipped)
+    // checkpoint
+    std::string location;     // tus upload URL once created
+    int64_t offset = -1;      // bytes the server confirmed; -1: ask it (HEAD)
+    bool uploaded = false;
+    bool inserted = false;    // incident_media row written
+    double ms = 0;            // transfer time so far, over restarts
+};
+
+struct Job {
+    std::string id;
+    std::string dir;          // spool directory
+    int priority = 0;         // higher first
+    int64_t created_ms = 0;   // then older first
+    std::string incident_body;
+    std::string local_event_id;  // of the incident row, for its lookup
+    std::vector<Media> media;
+    // checkpoint
+    std::string incident_db_id;
+};
+
+// *.job.json in spool, sorted by name.
+std::vector<std::string> list_jobs(const std::string &spool);
+
+// Reads the job and, if present, its checkpoint.
+bool load_job(const std::string &path, Job *job, std::string *err);
+
+bool save_checkpoint(const Job &job);
+
+// Writes the outcome file and removes the job and checkpoint files.
+bool finish_job(const Job &job, const std::string &public_base);
+bool fail_job(const Job &job, const std::string &error);
+
+// "..." with JSON escapes.
+std::string quote(const std::string &s);
+
+}  // namespace up
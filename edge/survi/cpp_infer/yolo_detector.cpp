@@ -0,0 +1,335 @@
+// ~/ArduinoApps/survillance/cpp_infer/yolo_detector.cpp
+// See yolo_detector.h. Pre/postprocessing follows Ultralytics predict():
+// letterbox to input x input (pad 114, centred), RGB 0..1, and class-aware
+// NMS over the best class per anchor.
+
+#include "yolo_detector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace yolo {
+
+namespace {
+
+constexpr float kPad = 114.0f / 255.0f;
+constexpr float kClassOffset = 7680.0f;  // Ultralytics max_wh: boxes of different classes never overlap
+
+double ms_between(std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+}  // namespace
+
+// -------------------------
+// Frame checks
+// -------------------------
+// One pass: per-pixel channel sum (is_low_light's float mean), its uint8
+// truncation (compute_quality_score's gray) and the absolute difference to
+// the row above.
+FrameChecks check_frame(const cv::Mat &bgr) {
+    FrameChecks c;
+    const int w = bgr.cols, h = bgr.rows;
+    if (w <= 0 || h <= 0) return c;
+
+    std::vector<uint8_t> gray(w), prev(w);
+    uint64_t sum3 = 0, sum_gray = 0, sum_diff = 0;
+    for (int y = 0; y < h; y++) {
+        const uint8_t *p = bgr.ptr<uint8_t>(y);
+        uint32_t row3 = 0, row_gray = 0;
+        for (int x = 0; x < w; x++) {
+            const uint32_t s = (uint32_t)p[3 * x] + p[3 * x + 1] + p[3 * x + 2];
+            row3 += s;
+            gray[x] = (uint8_t)(s / 3);
+            row_gray += gray[x];
+        }
+        sum3 += row3;
+        sum_gray += row_gray;
+        if (y) {
+            uint32_t row_diff = 0;
+            for (int x = 0; x < w; x++) row_diff += (uint32_t)std::abs((int)gray[x] - (int)prev[x]);
+            sum_diff += row_diff;
+        }
+        gray.swap(prev);
+    }
+
+    const double n = (double)w * h;
+    c.brightness = (float)(sum3 / (3.0 * n));
+    c.dark = c.brightness < 60.0f;
+
+    const double diff_mean = h > 1 ? sum_diff / ((double)(h - 1) * w) : 0.0;
+    const int blur_score = std::min((int)(diff_mean * 10), 50);
+    const double gray_mean = sum_gray / n;
+    const int brightness_score = gray_mean < 30 ? 5 : gray_mean < 60 ? 20 : gray_mean < 220 ? 50 : 20;
+    c.quality = blur_score + brightness_score;
+    return c;
+}
+
+// Gamma and contrast are both per-byte maps, so they fold into one table
+// once the gamma-corrected luma mean (PIL's "L") is known; sharpness is PIL's
+// SMOOTH 3x3 blended at 2.0, i.e. 2 * pixel - smoothed, borders unchanged.
+cv::Mat enhance_low_light(const cv::Mat &bgr) {
+    static const std::vector<uint8_t> gamma = [] {
+        std::vector<uint8_t> t(256);
+        for (int i = 0; i < 256; i++) t[i] = (uint8_t)(std::pow(i / 255.0, 1.0 / 0.6) * 255.0);
+        return t;
+    }();
+
+    const int w = bgr.cols, h = bgr.rows;
+    cv::Mat out(h, w, CV_8UC3);
+    if (w <= 0 || h <= 0) return out;
+
+    uint64_t sum_l = 0;
+    for (int y = 0; y < h; y++) {
+        const uint8_t *p = bgr.ptr<uint8_t>(y);
+        uint32_t row_l = 0;
+        for (int x = 0; x < w; x++) {
+            const uint32_t b = gamma[p[3 * x]], g = gamma[p[3 * x + 1]], r = gamma[p[3 * x + 2]];
+            row_l += (r * 19595 + g * 38470 + b * 7471 + 0x8000) >> 16;
+        }
+        sum_l += row_l;
+    }
+    const int mean = (int)(sum_l / ((double)w * h) + 0.5);
+    uint8_t lut[256];
+    for (int i = 0; i < 256; i++) {
+        const float v = mean + 1.5f * (gamma[i] - mean);
+        lut[i] = v <= 0.0f ? 0 : v >= 255.0f ? 255 : (uint8_t)v;
+    }
+
+    cv::Mat contrast(h, w, CV_8UC3);
+    for (int y = 0; y < h; y++) {
+        const uint8_t *p = bgr.ptr<uint8_t>(y);
+        uint8_t *q = contrast.ptr<uint8_t>(y);
+        for (int i = 0; i < 3 * w; i++) q[i] = lut[p[i]];
+    }
+
+    contrast.copyTo(out);
+    if (w < 3 || h < 3) return out;
+    const int n = 3 * w;
+    for (int y = 1; y + 1 < h; y++) {
+        const uint8_t *r0 = contrast.ptr<uint8_t>(y - 1), *r1 = contrast.ptr<uint8_t>(y),
+                      *r2 = contrast.ptr<uint8_t>(y + 1);
+        uint8_t *q = out.ptr<uint8_t>(y);
+        for (int i = 3; i < n - 3; i++) {
+            const int s = r0[i - 3] + r0[i] + r0[i + 3] + r1[i - 3] + 5 * r1[i] + r1[i + 3] + r2[i - 3] + r2[i] +
+                          r2[i + 3];
+            const int v = 2 * r1[i] - (s + 6) / 13;
+            q[i] = (uint8_t)std::min(255, std::max(0, v));
+        }
+    }
+    return out;
+}
+
+// -------------------------
+// Detector
+// -------------------------
+BatchDetector::~BatchDetector() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    ready_cv_.notify_all();
+    space_cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+bool BatchDetector::open(const DetectorConfig &cfg, std::string *err) {
+    cfg_ = cfg;
+    cfg_.max_batch = std::max(1, cfg_.max_batch);
+    cfg_.max_pending = std::max(cfg_.max_pending, (size_t)cfg_.max_batch);
+    if (cfg_.threads > 0) cv::setNumThreads(cfg_.threads);
+
+    try {
+        net_ = cv::dnn::readNetFromONNX(cfg_.model_path);
+        net_.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+        net_.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+    } catch (const cv::Exception &e) {
+        if (err) *err = "load " + cfg_.model_path + ": " + e.what();
+        return false;
+    }
+    if (net_.empty()) {
+        if (err) *err = "load " + cfg_.model_path + ": empty network";
+        return false;
+    }
+
+    // A fixed-batch export rejects a batch of two (or answers for one)
+    if (cfg_.max_batch > 1) {
+        bool batched = true;
+        try {
+            const int dims[4] = {2, 3, cfg_.input, cfg_.input};
+            net_.setInput(cv::Mat(4, dims, CV_32F, cv::Scalar(kPad)));
+            const cv::Mat out = net_.forward();
+            batched = out.dims == 3 && out.size[0] == 2;
+        } catch (const cv::Exception &) {
+            batched = false;
+        }
+        if (!batched) {
+            std::cerr << "[YOLO] " << cfg_.model_path << " has a fixed batch size; one frame per forward pass\n";
+            cfg_.max_batch = 1;
+        }
+    }
+
+    thread_ = std::thread([this] { run(); });
+    return true;
+}
+
+void BatchDetector::preprocess(const cv::Mat &bgr, Item *it) const {
+    const int S = cfg_.input;
+    it->w = bgr.cols;
+    it->h = bgr.rows;
+    it->scale = std::min((float)S / bgr.cols, (float)S / bgr.rows);
+    const int nw = (int)std::round(bgr.cols * it->scale), nh = (int)std::round(bgr.rows * it->scale);
+    const int left = (int)std::round((S - nw) / 2.0 - 0.1), top = (int)std::round((S - nh) / 2.0 - 0.1);
+    it->pad_x = (float)left;
+    it->pad_y = (float)top;
+
+    cv::Mat resized = bgr;
+    if (nw != bgr.cols || nh != bgr.rows) cv::resize(bgr, resized, cv::Size(nw, nh), 0, 0, cv::INTER_LINEAR);
+
+    // Planar RGB, pad colour around the picture
+    const size_t plane = (size_t)S * S;
+    it->chw.assign(3 * plane, kPad);
+    float *r = it->chw.data(), *g = r + plane, *b = g + plane;
+    for (int y = 0; y < nh; y++) {
+        const uint8_t *p = resized.ptr<uint8_t>(y);
+        const size_t row = (size_t)(y + top) * S + left;
+        for (int x = 0; x < nw; x++) {
+            b[row + x] = p[3 * x] * (1.0f / 255.0f);
+            g[row + x] = p[3 * x + 1] * (1.0f / 255.0f);
+            r[row + x] = p[3 * x + 2] * (1.0f / 255.0f);
+        }
+    }
+}
+
+std::future<FrameResult> BatchDetector::submit(const cv::Mat &bgr) {
+    Item it;
+    preprocess(bgr, &it);
+    std::future<FrameResult> f = it.done.get_future();
+
+    std::unique_lock<std::mutex> lk(mu_);
+    space_cv_.wait(lk, [&] { return stop_ || queue_.size() < cfg_.max_pending; });
+    if (stop_) {
+        it.done.set_value(FrameResult());
+        return f;
+    }
+    it.queued = Clock::now();
+    queue_.push_back(std::move(it));
+    lk.unlock();
+    ready_cv_.notify_one();
+    return f;
+}
+
+void BatchDetector::run() {
+    std::vector<Item> batch;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lk(mu_);
+            ready_cv_.wait(lk, [&] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) return;  // stopping, nothing left
+            // The oldest frame waits at most max_delay_ms for company
+            const auto deadline = queue_.front().queued + std::chrono::milliseconds(cfg_.max_delay_ms);
+            ready_cv_.wait_until(lk, deadline,
+                                 [&] { return stop_ || queue_.size() >= (size_t)cfg_.max_batch; });
+            const size_t n = std::min(queue_.size(), (size_t)cfg_.max_batch);
+            for (size_t i = 0; i < n; i++) {
+                batch.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+        }
+        space_cv_.notify_all();
+        infer(batch);
+        batch.clear();
+    }
+}
+
+void BatchDetector::infer(std::vector<Item> &batch) {
+    const auto t0 = Clock::now();
+    const int n = (int)batch.size(), S = cfg_.input;
+    const size_t per = (size_t)3 * S * S;
+    const int dims[4] = {n, 3, S, S};
+    cv::Mat blob(4, dims, CV_32F);
+    for (int i = 0; i < n; i++) std::memcpy(blob.ptr<float>() + i * per, batch[i].chw.data(), per * sizeof(float));
+
+    std::vector<FrameResult> results(n);
+    try {
+        net_.setInput(blob);
+        const cv::Mat out = net_.forward();
+        // [n, 4 + classes, anchors]; some exports transpose the last two
+        if (out.dims == 3 && out.size[0] == n) {
+            const bool transposed = out.size[1] > out.size[2];
+            const int channels = transposed ? out.size[2] : out.size[1];
+            const int anchors = transposed ? out.size[1] : out.size[2];
+            for (int i = 0; i < n; i++) {
+                results[i].boxes =
+                    postprocess(out.ptr<float>() + (size_t)i * channels * anchors, channels, anchors, transposed, batch[i]);
+                results[i].ok = true;
+            }
+        } else {
+            std::cerr << "[YOLO] unexpected output shape (dims=" << out.dims << ")\n";
+        }
+    } catch (const cv::Exception &e) {
+        std::cerr << "[YOLO] forward failed: " << e.what() << "\n";
+    }
+
+    const auto t1 = Clock::now();
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stats_.frames += (uint64_t)n;
+        stats_.batches++;
+        stats_.infer_ms += ms_between(t0, t1);
+        for (const Item &it : batch) stats_.wait_ms += ms_between(it.queued, t0);
+    }
+    for (int i = 0; i < n; i++) batch[i].done.set_value(std::move(results[i]));
+}
+
+std::vector<Box> BatchDetector::postprocess(const float *out, int channels, int anchors, bool transposed,
+                                            const Item &it) const {
+    auto at = [&](int c, int a) { return transposed ? out[(size_t)a * channels + c] : out[(size_t)c * anchors + a]; };
+
+    std::vector<cv::Rect2d> rects;
+    std::vector<float> scores;
+    std::vector<int> classes;
+    for (int a = 0; a < anchors; a++) {
+        int best = 4;
+        for (int c = 5; c < channels; c++) {
+            if (at(c, a) > at(best, a)) best = c;
+        }
+        const float score = at(best, a);
+        if (score < cfg_.conf) continue;
+        const float off = (best - 4) * kClassOffset;
+        const float cx = at(0, a), cy = at(1, a), w = at(2, a), h = at(3, a);
+        rects.emplace_back(cx - w / 2 + off, cy - h / 2 + off, w, h);
+        scores.push_back(score);
+        classes.push_back(best - 4);
+    }
+
+    std::vector<int> keep;
+    cv::dnn::NMSBoxes(rects, scores, cfg_.conf, cfg_.iou, keep);
+    if ((int)keep.size() > cfg_.max_det) keep.resize(cfg_.max_det);
+
+    std::vector<Box> boxes;
+    boxes.reserve(keep.size());
+    for (int k : keep) {
+        const float off = classes[k] * kClassOffset;
+        const cv::Rect2d &r = rects[k];
+        Box b;
+        b.class_id = classes[k];
+        b.conf = scores[k];
+        b.x0 = std::min((float)it.w, std::max(0.0f, ((float)r.x - off - it.pad_x) / it.scale));
+        b.y0 = std::min((float)it.h, std::max(0.0f, ((float)r.y - off - it.pad_y) / it.scale));
+        b.x1 = std::min((float)it.w, std::max(0.0f, ((float)(r.x + r.width) - off - it.pad_x) / it.scale));
+        b.y1 = std::min((float)it.h, std::max(0.0f, ((float)(r.y + r.height) - off - it.pad_y) / it.scale));
+        boxes.push_back(b);
+    }
+    return boxes;
+}
+
+DetectorStats BatchDetector::stats() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return stats_;
+}
+
+}  // namespace yolo
@@ -0,0 +1,128 @@
+// ~/ArduinoApps/survillance/cpp_infer/yolo_detector.h
+// YOLOv8 (ONNX export, OpenCV DNN on the CPU) with dynamic batching, for
+// survi_yolo_server - the cloud-verification stage that model/cloudModel.py
+// otherwise runs frame by frame through Ultralytics.
+//
+// Callers (one thread per clip) submit() frames: letterboxing to the model
+// input and the float CHW conversion happen on the caller's thread, then the
+// frame waits in one queue shared by every clip. The inference thread takes
+// up to max_batch frames at a time, waiting at most max_delay_ms after the
+// oldest one arrived for the batch to fill, and runs them as one forward
+// pass. Boxes come back per frame, NMS'd per class, in frame coordinates.
+//
+// The model must be exported with a dynamic batch axis:
+//   yolo export model=yolov8n.pt format=onnx dynamic=True opset=12
+// A fixed-batch export still works, one frame per forward pass.
+//
+// Also here: cloudModel.py's per-frame checks (is_low_light,
+// compute_quality_score, enhance_frame) as single passes over the BGR
+// bytes, written to auto-vectorize.
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/dnn.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace yolo {
+
+// -------------------------
+// Frame checks (cloudModel.py semantics)
+// -------------------------
+struct FrameChecks {
+    float brightness = 0;  // mean of the per-pixel channel mean
+    bool dark = false;     // is_low_light(): brightness < 60
+    int quality = 0;       // compute_quality_score(): vertical-gradient blur + brightness bins
+};
+
+FrameChecks check_frame(const cv::Mat &bgr);
+
+// enhance_frame(): gamma 0.6, PIL Contrast(1.5), PIL Sharpness(2.0).
+cv::Mat enhance_low_light(const cv::Mat &bgr);
+
+// -------------------------
+// Batched detector
+// -------------------------
+struct Box {
+    int class_id = 0;
+    float conf = 0;
+    float x0 = 0, y0 = 0, x1 = 0, y1 = 0;  // frame pixels
+};
+
+struct FrameResult {
+    bool ok = false;  // false: the forward pass failed
+    std::vector<Box> boxes;
+};
+
+struct DetectorConfig {
+    std::string model_path;
+    int input = 640;          // square model input
+    int max_batch = 8;
+    int max_delay_ms = 10;    // longest the oldest queued frame waits for a fuller batch
+    size_t max_pending = 32;  // queued frames before submit() blocks (memory bound)
+    float conf = 0.25f;       // Ultralytics predict() defaults
+    float iou = 0.70f;
+    int max_det = 300;
+    int threads = 0;          // OpenCV threads; 0: OpenCV's default
+};
+
+struct DetectorStats {
+    uint64_t frames = 0;
+    uint64_t batches = 0;
+    double infer_ms = 0;  // total forward + postprocess time
+    double wait_ms = 0;   // total time frames spent queued
+};
+
+class BatchDetector {
+public:
+    ~BatchDetector();
+
+    // Loads the model, probes whether it takes batches (max_batch drops to
+    // 1 if not) and starts the inference thread.
+    bool open(const DetectorConfig &cfg, std::string *err);
+
+    // Queues one BGR frame; blocks while max_pending frames are waiting.
+    std::future<FrameResult> submit(const cv::Mat &bgr);
+
+    DetectorStats stats() const;
+    const DetectorConfig &config() const { return cfg_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Item {
+        std::vector<float> chw;  // 3 x input x input, RGB, 0..1
+        float scale = 1, pad_x = 0, pad_y = 0;
+        int w = 0, h = 0;
+        Clock::time_point queued;
+        std::promise<FrameResult> done;
+    };
+
+    void run();
+    void infer(std::vector<Item> &batch);
+    void preprocess(const cv::Mat &bgr, Item *it) const;
+    std::vector<Box> postprocess(const float *out, int channels, int anchors, bool transposed,
+                                 const Item &it) const;
+
+    DetectorConfig cfg_;
+    cv::dnn::Net net_;
+
+    mutable std::mutex mu_;
+    std::condition_variable ready_cv_;  // queue gained a frame / stopping
+    std::condition_variable space_cv_;  // queue lost frames
+    std::deque<Item> queue_;
+    bool stop_ = false;
+    DetectorStats stats_;
+
+    std::thread thread_;
+};
+
+}  // namespace yolo
@@ -0,0 +1,645 @@
+// ~/ArduinoApps/survillance/cpp_infer/yolo_server.cpp
+// Cloud-verification stage as a C++ CPU inference server: analyses whole
+// clips like model/cloudModel.py's analyze_video_file() (low-light
+// enhancement, quality score, threat score and summary) with the exported
+// yolov8n, batching frames from every clip in flight (yolo_detector.h).
+// By default only sampled frames are inferred - densely around motion, the
+// edge runner's detections and live tracks, sparsely elsewhere - and boxes
+// are propagated to the frames in between (clip_sampler.h).
+// Runs next to the hub as a stand-in for the cloud service, or on the cloud
+// host behind the scanner (cloudModel.py --yolo-server).
+//
+// Two front ends, same analysis:
+//   unix socket, one JSON object per line in each direction
+//     {"op":"analyze", "id":"..", "mp4":"/path/clip.mp4",
+//      "sampling":"sampled"|"every", "hints_ms":[t_ms of edge detections]}
+//       -> {"id":"..", "status":"ok"|"error", "latency_ms":N, "analysis":{..}, "error":".."}
+//     {"op":"stats"} -> frames / batches / mean batch / infer and queue time
+//     {"op":"ping"}  -> {"status":"ok"}
+//   HTTP (--http PORT, Connection: close)
+//     POST /analyze  body {"mp4":"/path", ..} (application/json) or the clip bytes
+//     GET  /stats    GET /healthz
+// "analysis" has the keys analyze_video_file() returns (threat_score,
+// quality_score, confidence_score, route_mode, summary_cloud, detections)
+// plus "frames" and "frames_inferred"; propagated detections carry
+// "tracked":true.
+//
+// Each connection is served on its own thread, so concurrent clips are just
+// concurrent connections; their frames meet in the detector's batch queue.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "clip_sampler.h"
+#include "mini_json.h"
+#include "motion.h"
+#include "yolo_detector.h"
+
+using Clock = std::chrono::steady_clock;
+
+// -------------------------
+// Small helpers
+// -------------------------
+static void usage(const char *argv0) {
+    std::cerr
+        << "Usage:\n"
+        << "  " << argv0 << " --model yolov8n.onnx [--socket PATH] [--http PORT [--host ADDR]]\n"
+        << "        [--max_batch N] [--max_delay_ms N] [--max_pending N] [--threads N] [--conf T]\n"
+        << "        [--sampling sampled|every] [--sparse_stride N] [--dense_stride N] [--hint_window_ms N]\n"
+        << "\n"
+        << "  --model         ONNX export with a dynamic batch axis\n"
+        << "                  (yolo export model=yolov8n.pt format=onnx dynamic=True opset=12)\n"
+        << "  --socket        unix socket to listen on (default /tmp/survi_yolo.sock; \"\" for none)\n"
+        << "  --http          also serve HTTP on this port (default off), bound to --host (127.0.0.1)\n"
+        << "  --max_batch     frames per forward pass (default 8)\n"
+        << "  --max_delay_ms  longest a frame waits for a fuller batch (default 10)\n"
+        << "  --max_pending   frames queued before clip readers block (default 32)\n"
+        << "  --threads       OpenCV threads (default: OpenCV's choice)\n"
+        << "  --conf          minimum confidence of a reported detection (default 0.35)\n"
+        << "  --max_upload_mb largest clip accepted as an HTTP body (default 256)\n"
+        << "  --sampling      default for requests without \"sampling\": sampled (default) or every frame\n"
+        << "  --sparse_stride frames between samples with nothing going on (default 15)\n"
+        << "  --dense_stride  ... around motion, edge detections and live tracks (default 3)\n"
+        << "  --hint_window_ms how close to an edge detection counts as around it (default 1500)\n";
+}
+
+static std::string json_escape(const std::string &s) {
+    std::string o;
+    o.reserve(s.size() + 8);
+    for (char c : s) {
+        switch (c) {
+            case '\\': o += "\\\\"; break;
+            case '"':  o += "\\\""; break;
+            case '\n': o += "\\n";  break;
+            case '\r': o += "\\r";  break;
+            case '\t': o += "\\t";  break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof buf, "\\u%04x", (unsigned char)c);
+                    o += buf;
+                } else {
+                    o += c;
+                }
+        }
+    }
+    return o;
+}
+
+static std::string fmt(const char *f, double v) {
+    char buf[32];
+    std::snprintf(buf, sizeof buf, f, v);
+    return buf;
+}
+
+static double ms_between(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+static bool send_all(int fd, const std::string &s) {
+    size_t off = 0;
+    while (off < s.size()) {
+        const ssize_t w = ::send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        off += (size_t)w;
+    }
+    return true;
+}
+
+// -------------------------
+// Clip analysis (cloudModel.py analyze_video_file)
+// -------------------------
+// COCO ids cloudModel.py tracks
+struct Tracked {
+    const char *label;
+    const char *category;
+};
+
+static const Tracked *tracked(int class_id) {
+    static const std::map<int, Tracked> classes = {
+        {0, {"person", "person"}},   {15, {"cat", "animal"}},       {16, {"dog", "animal"}},
+        {17, {"horse", "animal"}},   {18, {"sheep", "animal"}},     {19, {"cow", "animal"}},
+        {20, {"elephant", "animal"}}, {21, {"bear", "animal"}},     {22, {"zebra", "animal"}},
+        {2, {"car", "vehicle"}},     {3, {"motorcycle", "vehicle"}}, {5, {"bus", "vehicle"}},
+        {6, {"train", "vehicle"}},   {7, {"truck", "vehicle"}},
+    };
+    auto it = classes.find(class_id);
+    return it == classes.end() ? nullptr : &it->second;
+}
+
+struct Detection {
+    const Tracked *cls;
+    int class_id;
+    float conf;
+    long x0, y0, x1, y1;
+    bool tracked;  // propagated between sampled frames
+};
+
+static int threat_score(const std::vector<Detection> &dets, bool dark) {
+    int score = 0;
+    for (const auto &d : dets) {
+        const std::string cat = d.cls->category;
+        if (cat == "person") score += 30;
+        else if (cat == "vehicle") score += 15;
+        else if (cat == "animal") score += 10;
+    }
+    if (dark) score += 15;
+    return std::min(score, 100);
+}
+
+// The boxes cloudModel.py keeps: tracked classes at min_conf or above.
+static std::vector<yolo::Box> kept_boxes(const yolo::FrameResult &r, float min_conf) {
+    std::vector<yolo::Box> out;
+    for (const yolo::Box &b : r.boxes) {
+        if (tracked(b.class_id) && b.conf >= min_conf) out.push_back(b);
+    }
+    return out;
+}
+
+struct ClipRequest {
+    std::string path;
+    bool every_frame = false;       // analyze_video_file() as is: no sampling
+    std::vector<int64_t> hints_ms;  // edge detections (result.json t_ms)
+};
+
+// Sampled frames go to the detector as soon as they are decoded (and
+// checked / enhanced); results are collected as they complete, so a clip
+// keeps the batch queue fed instead of waiting out each forward pass.
+// Motion runs on a copy reduced to kMotionWidth, area threshold scaled to
+// match. Without sampling every frame is a sample and nothing is propagated.
+static constexpr int kMotionWidth = 320;
+
+static bool analyze_clip(yolo::BatchDetector &det, const ClipRequest &req, const yolo::SamplerConfig &scfg,
+                         float min_conf, std::string *json, std::string *err) {
+    cv::VideoCapture cap(req.path);
+    if (!cap.isOpened()) {
+        *err = "could not open " + req.path;
+        return false;
+    }
+    const double fps = cap.get(cv::CAP_PROP_FPS);
+
+    struct Sample {
+        int frame;
+        std::future<yolo::FrameResult> fut;
+        std::vector<yolo::Box> boxes;
+    };
+    std::vector<Sample> samples;
+    size_t collected = 0;
+    bool live = false;  // the newest collected sample had boxes
+    bool failed = false;
+    auto collect = [&](bool wait) {
+        while (collected < samples.size()) {
+            Sample &s = samples[collected];
+            if (!wait && s.fut.wait_for(std::chrono::seconds(0)) != std::future_status::ready) break;
+            const yolo::FrameResult r = s.fut.get();
+            failed |= !r.ok;
+            s.boxes = kept_boxes(r, min_conf);
+            live = !s.boxes.empty();
+            collected++;
+        }
+    };
+
+    yolo::FrameSampler sampler(scfg, req.hints_ms);
+    std::unique_ptr<MotionDetector> motion;
+    cv::Mat frame, last, small;
+    std::vector<int> qualities;
+    int n = 0;
+    auto submit = [&](const cv::Mat &f, int idx) {
+        const yolo::FrameChecks c = yolo::check_frame(f);
+        qualities.push_back(c.quality);
+        samples.push_back(Sample{idx, det.submit(c.dark ? yolo::enhance_low_light(f) : f), {}});
+    };
+    while (cap.read(frame)) {
+        bool moving = false;
+        if (!req.every_frame) {
+            if (!motion) {
+                MotionParams mp;
+                const double k = frame.cols > kMotionWidth ? (double)kMotionWidth / frame.cols : 1.0;
+                mp.area_min = std::max(1, (int)(mp.area_min * k * k));
+                motion.reset(new MotionDetector(mp));
+            }
+            if (frame.cols > kMotionWidth) {
+                cv::resize(frame, small, cv::Size(kMotionWidth, std::max(1, frame.rows * kMotionWidth / frame.cols)),
+                           0, 0, cv::INTER_AREA);
+                moving = motion->update(small).motion;
+            } else {
+                moving = motion->update(frame).motion;
+            }
+            collect(false);
+        }
+        const int64_t t_ms = fps > 0 ? (int64_t)(n * 1000.0 / fps) : -1;
+        if (req.every_frame || sampler.want(n, t_ms, moving, live)) submit(frame, n);
+        else std::swap(frame, last);  // kept in case it is the final frame
+        n++;
+    }
+    cap.release();
+    // The last frame closes the final gap
+    if (n > 0 && sampler.last_sampled() != n - 1 && !req.every_frame) submit(last, n - 1);
+    collect(true);
+    if (failed) {
+        *err = "inference failed";
+        return false;
+    }
+
+    std::vector<std::pair<int, std::vector<yolo::Box>>> keyed;
+    keyed.reserve(samples.size());
+    for (auto &s : samples) keyed.emplace_back(s.frame, std::move(s.boxes));
+    std::vector<Detection> dets;
+    for (const auto &frame_boxes : yolo::propagate_tracks(keyed, n, scfg.match_iou)) {
+        for (const yolo::TrackedBox &tb : frame_boxes) {
+            const yolo::Box &b = tb.box;
+            dets.push_back(Detection{tracked(b.class_id), b.class_id, b.conf, std::lround(b.x0), std::lround(b.y0),
+                                     std::lround(b.x1), std::lround(b.y1), tb.propagated});
+        }
+    }
+
+    // Quality is the sampled frames' average (every frame without sampling)
+    const int frames = n;
+    const std::string counts_json = ",\"frames\":" + std::to_string(frames) +
+                                    ",\"frames_inferred\":" + std::to_string(samples.size());
+    double q_sum = 0;
+    for (int q : qualities) q_sum += q;
+    const int avg_quality = qualities.empty() ? 50 : (int)(q_sum / qualities.size());
+
+    std::string o = "{";
+    if (dets.empty()) {
+        o += "\"threat_score\":0,\"quality_score\":" + std::to_string(avg_quality) +
+             ",\"confidence_score\":0.0,\"route_mode\":\"CLOUD\",\"summary_cloud\":\"Cloud analysis complete. "
+             "No persons, animals, or vehicles detected.\",\"detections\":[]" +
+             counts_json + "}";
+        *json = o;
+        return true;
+    }
+
+    double conf_sum = 0;
+    for (const auto &d : dets) conf_sum += std::round(d.conf * 1000.0) / 1000.0;
+    const double avg_conf = conf_sum / dets.size();
+    const bool dark_clip = avg_quality < 40;
+    const int threat = threat_score(dets, dark_clip);
+
+    // Label counts in first-seen order, like the Python dict
+    std::vector<std::pair<std::string, int>> counts;
+    for (const auto &d : dets) {
+        auto it = std::find_if(counts.begin(), counts.end(), [&](const std::pair<std::string, int> &p) {
+            return p.first == d.cls->label;
+        });
+        if (it == counts.end()) counts.emplace_back(d.cls->label, 1);
+        else it->second++;
+    }
+    std::string parts;
+    for (size_t i = 0; i < counts.size(); i++) {
+        parts += (i ? ", " : "") + std::to_string(counts[i].second) + "\xc3\x97 " + counts[i].first;
+    }
+    const std::string summary = std::string("Cloud analysis complete") + (dark_clip ? " [LOW-LIGHT]" : "") +
+                                ". Detected across " + std::to_string(frames) + " frames: " + parts +
+                                ". Threat score: " + std::to_string(threat) + "/100. Avg confidence: " +
+                                fmt("%.2f", avg_conf) + ".";
+
+    o += "\"threat_score\":" + std::to_string(threat) + ",\"quality_score\":" + std::to_string(avg_quality) +
+         ",\"confidence_score\":" + fmt("%.4f", avg_conf) + ",\"route_mode\":\"CLOUD\",\"summary_cloud\":\"" +
+         json_escape(summary) + "\"" + counts_json + ",\"detections\":[";
+    for (size_t i = 0; i < dets.size(); i++) {
+        const Detection &d = dets[i];
+        o += std::string(i ? "," : "") + "{\"label\":\"" + d.cls->label + "\",\"category\":\"" + d.cls->category +
+             "\",\"confidence\":" + fmt("%.3f", d.conf) + ",\"bbox\":[" + std::to_string(d.x0) + "," +
+             std::to_string(d.y0) + "," + std::to_string(d.x1) + "," + std::to_string(d.y1) +
+             "],\"class_id\":" + std::to_string(d.class_id) + (d.tracked ? ",\"tracked\":true}" : "}");
+    }
+    o += "]}";
+    *json = o;
+    return true;
+}
+
+// -------------------------
+// Server
+// -------------------------
+struct Server {
+    yolo::BatchDetector det;
+    float min_conf = 0.35f;
+    size_t max_upload = (size_t)256 << 20;
+    yolo::SamplerConfig sampler;
+    bool every_frame = false;  // --sampling every: the default for requests without "sampling"
+
+    // {"mp4", "sampling":"sampled"|"every", "hints_ms":[..]}
+    ClipRequest clip_request(const mj::Value &req, const std::string &path) const {
+        ClipRequest c;
+        c.path = path;
+        const std::string mode = req.get_str("sampling");
+        c.every_frame = mode.empty() ? every_frame : mode == "every";
+        if (const mj::Value *h = req.get("hints_ms")) {
+            for (const mj::Value &v : h->arr) {
+                if (v.type == mj::Value::Number && v.num >= 0) c.hints_ms.push_back((int64_t)v.num);
+            }
+        }
+        return c;
+    }
+
+    std::string stats_json() const {
+        const yolo::DetectorStats s = det.stats();
+        return "{\"status\":\"ok\",\"frames\":" + std::to_string(s.frames) + ",\"batches\":" +
+               std::to_string(s.batches) + ",\"mean_batch\":" +
+               fmt("%.2f", s.batches ? (double)s.frames / s.batches : 0.0) + ",\"max_batch\":" +
+               std::to_string(det.config().max_batch) + ",\"infer_ms_per_frame\":" +
+               fmt("%.2f", s.frames ? s.infer_ms / s.frames : 0.0) + ",\"queue_ms_per_frame\":" +
+               fmt("%.2f", s.frames ? s.wait_ms / s.frames : 0.0) + "}";
+    }
+
+    // Reply members after the id: status, latency_ms, then analysis or error
+    std::string analyze(const ClipRequest &req) {
+        const auto t0 = Clock::now();
+        std::string analysis, err;
+        const bool ok = analyze_clip(det, req, sampler, min_conf, &analysis, &err);
+        const std::string lat = std::to_string((int)ms_between(t0, Clock::now()));
+        if (!ok) {
+            std::cerr << "[YOLO] " << req.path << ": " << err << "\n";
+            return "\"status\":\"error\",\"latency_ms\":" + lat + ",\"error\":\"" + json_escape(err) + "\"";
+        }
+        return "\"status\":\"ok\",\"latency_ms\":" + lat + ",\"analysis\":" + analysis;
+    }
+
+    void serve_socket(int fd);
+    void serve_http(int fd);
+};
+
+void Server::serve_socket(int fd) {
+    std::string buf;
+    char chunk[4096];
+    for (;;) {
+        const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || buf.size() > (1 << 20)) break;
+        buf.append(chunk, (size_t)n);
+        size_t nl;
+        while ((nl = buf.find('\n')) != std::string::npos) {
+            const std::string line = buf.substr(0, nl);
+            buf.erase(0, nl + 1);
+            if (line.empty()) continue;
+
+            mj::Value req;
+            std::string err, reply;
+            if (!mj::parse(line, &req, &err) || req.type != mj::Value::Object) {
+                reply = "{\"status\":\"error\",\"error\":\"" + json_escape("bad request: " + err) + "\"}";
+            } else {
+                const std::string id = json_escape(req.get_str("id"));
+                const std::string op = req.get_str("op", "analyze");
+                if (op == "ping") reply = "{\"id\":\"" + id + "\",\"status\":\"ok\"}";
+                else if (op == "stats") reply = stats_json();
+                else if (op != "analyze") reply = "{\"id\":\"" + id + "\",\"status\":\"error\",\"error\":\"unknown op\"}";
+                else if (req.get_str("mp4").empty()) reply = "{\"id\":\"" + id + "\",\"status\":\"error\",\"error\":\"mp4 is required\"}";
+                else reply = "{\"id\":\"" + id + "\"," + analyze(clip_request(req, req.get_str("mp4"))) + "}";
+            }
+            if (!send_all(fd, reply + "\n")) {
+                ::close(fd);
+                return;
+            }
+        }
+    }
+    ::close(fd);
+}
+
+static std::string http_response(int code, const char *text, const std::string &body) {
+    return "HTTP/1.1 " + std::to_string(code) + " " + text +
+           "\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) +
+           "\r\nConnection: close\r\n\r\n" + body;
+}
+
+void Server::serve_http(int fd) {
+    std::string buf;
+    char chunk[65536];
+    size_t head_end = std::string::npos;
+    while ((head_end = buf.find("\r\n\r\n")) == std::string::npos) {
+        const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || buf.size() > (64 << 10)) {
+            ::close(fd);
+            return;
+        }
+        buf.append(chunk, (size_t)n);
+    }
+
+    std::string method, target, content_type;
+    size_t content_length = 0;
+    {
+        const std::string head = buf.substr(0, head_end);
+        const size_t eol = head.find("\r\n");
+        const std::string start = head.substr(0, eol);
+        const size_t sp1 = start.find(' '), sp2 = start.find(' ', sp1 + 1);
+        if (sp1 != std::string::npos) method = start.substr(0, sp1);
+        if (sp2 != std::string::npos) target = start.substr(sp1 + 1, sp2 - sp1 - 1);
+        size_t pos = eol;
+        while (pos != std::string::npos && pos < head.size()) {
+            const size_t next = head.find("\r\n", pos + 2);
+            std::string line = head.substr(pos + 2, next == std::string::npos ? std::string::npos : next - pos - 2);
+            const size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                std::string key = line.substr(0, colon), val = line.substr(colon + 1);
+                std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+                val.erase(0, val.find_first_not_of(" \t"));
+                if (key == "content-length") content_length = std::strtoull(val.c_str(), nullptr, 10);
+                else if (key == "content-type") content_type = val;
+            }
+            pos = next;
+        }
+    }
+
+    std::string reply;
+    if (method == "GET" && target == "/healthz") {
+        reply = http_response(200, "OK", "{\"status\":\"ok\"}");
+    } else if (method == "GET" && target == "/stats") {
+        reply = http_response(200, "OK", stats_json());
+    } else if (method == "POST" && target == "/analyze") {
+        if (content_length > max_upload) {
+            reply = http_response(413, "Payload Too Large", "{\"status\":\"error\",\"error\":\"clip too large\"}");
+        } else {
+            std::string body = buf.substr(head_end + 4);
+            while (body.size() < content_length) {
+                const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                body.append(chunk, (size_t)n);
+            }
+            if (body.size() < content_length) {
+                ::close(fd);
+                return;
+            }
+            body.resize(content_length);
+
+            mj::Value req;
+            std::string err;
+            if (content_type.compare(0, 16, "application/json") == 0) {
+                if (!mj::parse(body, &req, &err) || req.get_str("mp4").empty()) {
+                    reply = http_response(400, "Bad Request", "{\"status\":\"error\",\"error\":\"expected {\\\"mp4\\\":path}\"}");
+                } else {
+                    reply = http_response(200, "OK", "{" + analyze(clip_request(req, req.get_str("mp4"))) + "}");
+                }
+            } else {
+                // The clip itself: decoded from a temp file like the scanner's download
+                char tmp[] = "/tmp/survi_yolo_XXXXXX.mp4";
+                const int tfd = ::mkstemps(tmp, 4);
+                bool wrote = tfd >= 0;
+                for (size_t off = 0; wrote && off < body.size();) {
+                    const ssize_t w = ::write(tfd, body.data() + off, body.size() - off);
+                    if (w < 0 && errno == EINTR) continue;
+                    wrote = w > 0;
+                    if (wrote) off += (size_t)w;
+                }
+                if (tfd >= 0) ::close(tfd);
+                reply = wrote ? http_response(200, "OK", "{" + analyze(clip_request(mj::Value(), tmp)) + "}")
+                              : http_response(500, "Internal Server Error",
+                                              "{\"status\":\"error\",\"error\":\"cannot stage upload\"}");
+                if (tfd >= 0) ::unlink(tmp);
+            }
+        }
+    } else {
+        reply = http_response(404, "Not Found", "{\"status\":\"error\",\"error\":\"not found\"}");
+    }
+    send_all(fd, reply);
+    ::close(fd);
+}
+
+// -------------------------
+// Main
+// -------------------------
+static int listen_unix(const std::string &path) {
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (fd < 0 || path.size() >= sizeof(addr.sun_path)) return -1;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    ::unlink(path.c_str());  // stale socket from a previous run
+    if (::bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(fd, 64) != 0) return -1;
+    return fd;
+}
+
+static int listen_tcp(const std::string &host, int port) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) return -1;
+    if (::bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(fd, 64) != 0) return -1;
+    return fd;
+}
+
+template <class F>
+static void accept_loop(int lfd, F serve) {
+    for (;;) {
+        const int cfd = ::accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::perror("accept");
+            return;
+        }
+        std::thread([serve, cfd] { serve(cfd); }).detach();
+    }
+}
+
+int main(int argc, char **argv) {
+    yolo::DetectorConfig cfg;
+    std::string sock_path = "/tmp/survi_yolo.sock", host = "127.0.0.1";
+    int http_port = 0;
+    float min_conf = 0.35f;
+    size_t max_upload_mb = 256;
+    yolo::SamplerConfig scfg;
+    bool every_frame = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto need = [&](const char *flag) {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << flag << "\n";
+                usage(argv[0]);
+                std::exit(2);
+            }
+        };
+
+        if (a == "--model") { need("--model"); cfg.model_path = argv[++i]; }
+        else if (a == "--socket") { need("--socket"); sock_path = argv[++i]; }
+        else if (a == "--http") { need("--http"); http_port = std::atoi(argv[++i]); }
+        else if (a == "--host") { need("--host"); host = argv[++i]; }
+        else if (a == "--max_batch") { need("--max_batch"); cfg.max_batch = std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--max_delay_ms") { need("--max_delay_ms"); cfg.max_delay_ms = std::max(0, std::atoi(argv[++i])); }
+        else if (a == "--max_pending") { need("--max_pending"); cfg.max_pending = (size_t)std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--threads") { need("--threads"); cfg.threads = std::max(0, std::atoi(argv[++i])); }
+        else if (a == "--conf") { need("--conf"); min_conf = std::stof(argv[++i]); }
+        else if (a == "--max_upload_mb") { need("--max_upload_mb"); max_upload_mb = (size_t)std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--sampling") {
+            need("--sampling");
+            const std::string m = argv[++i];
+            if (m != "sampled" && m != "every") {
+                std::cerr << "Bad --sampling (expected sampled|every): " << m << "\n";
+                return 2;
+            }
+            every_frame = m == "every";
+        }
+        else if (a == "--sparse_stride") { need("--sparse_stride"); scfg.sparse_stride = std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--dense_stride") { need("--dense_stride"); scfg.dense_stride = std::max(1, std::atoi(argv[++i])); }
+        else if (a == "--hint_window_ms") { need("--hint_window_ms"); scfg.hint_window_ms = std::max(0, std::atoi(argv[++i])); }
+        else if (a == "--help" || a == "-h") { usage(argv[0]); return 0; }
+        else {
+            std::cerr << "Unknown arg: " << a << "\n";
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (cfg.model_path.empty() || (sock_path.empty() && http_port <= 0)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    Server srv;
+    srv.min_conf = min_conf;
+    srv.max_upload = max_upload_mb << 20;
+    srv.sampler = scfg;
+    srv.every_frame = every_frame;
+    std::string err;
+    if (!srv.det.open(cfg, &err)) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+
+    int ufd = -1, tfd = -1;
+    if (!sock_path.empty() && (ufd = listen_unix(sock_path)) < 0) {
+        std::fprintf(stderr, "listen on %s: %s\n", sock_path.c_str(), std::strerror(errno));
+        return 1;
+    }
+    if (http_port > 0 && (tfd = listen_tcp(host, http_port)) < 0) {
+        std::fprintf(stderr, "listen on %s:%d: %s\n", host.c_str(), http_port, std::strerror(errno));
+        return 1;
+    }
+    std::cerr << "[YOLO] " << cfg.model_path << "  socket=" << (sock_path.empty() ? "-" : sock_path)
+              << "  http=" << (tfd >= 0 ? host + ":" + std::to_string(http_port) : "-")
+              << "  max_batch=" << srv.det.config().max_batch << "  max_delay_ms=" << cfg.max_delay_ms
+              << "  sampling=" << (every_frame ? "every" : "sampled") << "\n";
+
+    std::thread http;
+    if (tfd >= 0) http = std::thread([&] { accept_loop(tfd, [&srv](int fd) { srv.serve_http(fd); }); });
+    if (ufd >= 0) accept_loop(ufd, [&srv](int fd) { srv.serve_socket(fd); });
+    if (http.joinable()) http.join();
+    return 1;
+}
@@ -0,0 +1,82 @@
+"""
+bg_model.py  -  ctypes binding for cpp_infer's libsurvi_bg_model.so
+
+Adaptive background model for the capture loop's motion trigger (see
+cpp_infer/bg_model.h). It replaces the absdiff(prev_gray) + threshold step:
+
+  mask = model.update(gray)        # 0/255, same size as gray
+  dilate -> findContours -> motion_area_min, exactly as before
+
+Frame-wide brightness changes (clouds, auto-exposure) are divided out by a
+global gain; changes the gain can't explain (IR switching) relearn the
+background instead of starting an event.
+"""
+from __future__ import annotations
+
+import ctypes
+import os
+from typing import Optional
+
+import numpy as np
+
+DEFAULT_LIB = os.path.abspath(os.path.join(
+    os.path.dirname(os.path.abspath(__file__)),
+    "..", "cpp_infer", "build", "libsurvi_bg_model.so"))
+
+
+class BackgroundModel:
+    def __init__(self, cell: int = 8, alpha: float = 0.03, k_sigma: float = 3.0,
+                 min_diff: float = 25.0, max_fg_frac: float = 0.5,
+                 lib_path: Optional[str] = None) -> None:
+        lib = ctypes.CDLL(lib_path or DEFAULT_LIB)
+        c_vp, c_f, c_i = ctypes.c_void_p, ctypes.c_float, ctypes.c_int
+        lib.bg_open.argtypes     = [c_i, c_f, c_f, c_f, c_f]
+        lib.bg_open.restype      = c_vp
+        lib.bg_close.argtypes    = [c_vp]
+        lib.bg_update.argtypes   = [c_vp, c_vp, c_i, c_i, c_i, c_vp, c_i]
+        lib.bg_update.restype    = c_i
+        lib.bg_reset.argtypes    = [c_vp]
+        lib.bg_gain.argtypes     = [c_vp]
+        lib.bg_gain.restype      = c_f
+        lib.bg_relearns.argtypes = [c_vp]
+        lib.bg_relearns.restype  = ctypes.c_uint64
+
+        self._lib  = lib
+        self._h    = lib.bg_open(int(cell), float(alpha), float(k_sigma),
+                                 float(min_diff), float(max_fg_frac))
+        self._mask = None
+
+    def close(self) -> None:
+        if self._h:
+            self._lib.bg_close(self._h)
+            self._h = None
+
+    def update(self, gray: np.ndarray) -> np.ndarray:
+        """Foreground mask for a blurred uint8 gray frame (valid until the next call)."""
+        gray = np.ascontiguousarray(gray, dtype=np.uint8)
+        h, w = gray.shape[:2]
+        if self._mask is None or self._mask.shape != (h, w):
+            self._mask = np.zeros((h, w), dtype=np.uint8)
+        self._lib.bg_update(self._h, gray.ctypes.data, w, h, w,
+                            self._mask.ctypes.data, w)
+        return self._mask
+
+    def reset(self) -> None:
+        self._lib.bg_reset(self._h)
+
+    def stats(self) -> dict:
+        return {"gain":     round(float(self._lib.bg_gain(self._h)), 3),
+                "relearns": int(self._lib.bg_relearns(self._h))}
+
+
+def open_bg_model(lib_path: Optional[str] = None, **kw) -> Optional[BackgroundModel]:
+    """BackgroundModel, or None (with a log line) when the library isn't built."""
+    path = lib_path or DEFAULT_LIB
+    if not os.path.exists(path):
+        print(f"[MOTION] {path} not built; using frame difference")
+        return None
+    try:
+        return BackgroundModel(lib_path=path, **kw)
+    except Exception as exc:
+        print(f"[MOTION] background model failed ({exc}); using frame difference")
+        return None
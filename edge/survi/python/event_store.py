@@ -0,0 +1,149 @@
+"""
+event_store.py  -  ctypes binding for cpp_infer's libsurvi_event_store.so
+
+Replaces the events/final/<id>/ directory + marker-file layout:
+
+  incident.json / result.json  ->  put_doc(event_id, "incident" | "result", obj)
+  DONE / NEEDS_CLOUD           ->  set_flags(event_id, FLAG_DONE | FLAG_NEEDS_CLOUD)
+  SUPABASE_DONE                ->  set_flags(event_id, FLAG_UPLOADED)
+  clip.mp4 / snapshots         ->  written into blob_dir(event_id), then put_blob()
+
+Listing is an index range query instead of a directory scan:
+
+  store.list(limit=50)                          newest first
+  store.list(need=FLAG_DONE, skip=FLAG_UPLOADED, newest_first=False)
+  store.list_prefix("17723")                    ids starting with 17723
+
+The store is shared between processes (main.py, uploader_worker.py,
+survi_media_server); each call sees the others' writes.
+"""
+from __future__ import annotations
+
+import ctypes
+import json
+import os
+import time
+from typing import Any, Dict, List, Optional
+
+FLAG_DONE        = 1 << 0
+FLAG_NEEDS_CLOUD = 1 << 1
+FLAG_UPLOADED    = 1 << 2
+
+_U64_MAX = (1 << 64) - 1
+
+DEFAULT_LIB = os.path.abspath(os.path.join(
+    os.path.dirname(os.path.abspath(__file__)),
+    "..", "cpp_infer", "build", "libsurvi_event_store.so"))
+
+
+def _ms(ts: Optional[float]) -> int:
+    return int((time.time() if ts is None else ts) * 1000)
+
+
+class EventStore:
+    def __init__(self, dir_path: str, read_only: bool = False,
+                 lib_path: Optional[str] = None) -> None:
+        lib = ctypes.CDLL(lib_path or DEFAULT_LIB)
+        c_str, c_vp = ctypes.c_char_p, ctypes.c_void_p
+        i64, u32, u64 = ctypes.c_int64, ctypes.c_uint32, ctypes.c_uint64
+
+        lib.es_open.argtypes        = [c_str, ctypes.c_int]
+        lib.es_open.restype         = c_vp
+        lib.es_close.argtypes       = [c_vp]
+        lib.es_free.argtypes        = [c_vp]
+        lib.es_put_doc.argtypes     = [c_vp, c_str, c_str, c_str, ctypes.c_size_t, i64]
+        lib.es_set_flags.argtypes   = [c_vp, c_str, u32, u32, i64]
+        lib.es_put_blob.argtypes    = [c_vp, c_str, c_str, i64]
+        lib.es_remove.argtypes      = [c_vp, c_str, i64]
+        lib.es_checkpoint.argtypes  = [c_vp]
+        lib.es_blob_dir.argtypes    = [c_vp, c_str]
+        lib.es_blob_dir.restype     = c_vp
+        lib.es_get.argtypes         = [c_vp, c_str]
+        lib.es_get.restype          = c_vp
+        lib.es_list.argtypes        = [c_vp, u64, u64, u32, u32, ctypes.c_int, ctypes.c_int]
+        lib.es_list.restype         = c_vp
+        lib.es_list_prefix.argtypes = [c_vp, c_str, ctypes.c_int, ctypes.c_int]
+        lib.es_list_prefix.restype  = c_vp
+
+        self._lib = lib
+        self._h   = lib.es_open(dir_path.encode(), 1 if read_only else 0)
+        if not self._h:
+            raise RuntimeError(f"event store open failed: {dir_path}")
+        self.dir = dir_path
+
+    def close(self) -> None:
+        if self._h:
+            self._lib.es_close(self._h)
+            self._h = None
+
+    def _take(self, p: Optional[int]) -> Optional[str]:
+        if not p:
+            return None
+        try:
+            return ctypes.string_at(p).decode()
+        finally:
+            self._lib.es_free(p)
+
+    # ── writers ──────────────────────────────────────────────────────────
+    def put_doc(self, event_id: str, name: str, obj: dict,
+                ts: Optional[float] = None) -> None:
+        body = json.dumps(obj).encode()
+        if self._lib.es_put_doc(self._h, str(event_id).encode(), name.encode(),
+                                body, len(body), _ms(ts)) != 0:
+            raise RuntimeError(f"put_doc failed: {event_id}/{name}")
+
+    def set_flags(self, event_id: str, set_: int = 0, clear: int = 0,
+                  ts: Optional[float] = None) -> None:
+        if self._lib.es_set_flags(self._h, str(event_id).encode(),
+                                  set_, clear, _ms(ts)) != 0:
+            raise RuntimeError(f"set_flags failed: {event_id}")
+
+    def blob_dir(self, event_id: str) -> str:
+        d = self._take(self._lib.es_blob_dir(self._h, str(event_id).encode()))
+        if d is None:
+            raise RuntimeError(f"bad event id: {event_id}")
+        return d
+
+    def put_blob(self, event_id: str, name: str, ts: Optional[float] = None) -> None:
+        """Records that blob_dir(event_id)/name has been written."""
+        if self._lib.es_put_blob(self._h, str(event_id).encode(),
+                                 name.encode(), _ms(ts)) != 0:
+            raise RuntimeError(f"put_blob failed: {event_id}/{name}")
+
+    def remove(self, event_id: str, ts: Optional[float] = None) -> None:
+        self._lib.es_remove(self._h, str(event_id).encode(), _ms(ts))
+
+    def checkpoint(self) -> None:
+        self._lib.es_checkpoint(self._h)
+
+    # ── readers ──────────────────────────────────────────────────────────
+    def get(self, event_id: str) -> Optional[Dict[str, Any]]:
+        """Index entry plus the latest "incident" / "result" docs (or None)."""
+        s = self._take(self._lib.es_get(self._h, str(event_id).encode()))
+        return json.loads(s) if s else None
+
+    def list(self, lo: int = 0, hi: int = _U64_MAX, need: int = 0, skip: int = 0,
+             limit: int = 50, newest_first: bool = True) -> List[Dict[str, Any]]:
+        s = self._take(self._lib.es_list(self._h, lo, hi, need, skip,
+                                         limit, 1 if newest_first else 0))
+        return json.loads(s)["events"] if s else []
+
+    def list_prefix(self, prefix: str, limit: int = 50,
+                    newest_first: bool = True) -> List[Dict[str, Any]]:
+        s = self._take(self._lib.es_list_prefix(self._h, prefix.encode(),
+                                                limit, 1 if newest_first else 0))
+        return json.loads(s)["events"] if s else []
+
+
+def open_store(dir_path: str, read_only: bool = False,
+               lib_path: Optional[str] = None) -> Optional[EventStore]:
+    """EventStore, or None (with a log line) when the library isn't built."""
+    path = lib_path or DEFAULT_LIB
+    if not os.path.exists(path):
+        print(f"[STORE] {path} not built; using per-event directories")
+        return None
+    try:
+        return EventStore(dir_path, read_only=read_only, lib_path=path)
+    except Exception as exc:
+        print(f"[STORE] open failed ({exc}); using per-event directories")
+        return None
@@ -1,8 +1,10 @@
 import os
 import json
 import time
+import socket
 import tempfile
 import subprocess
+from typing import Callable, Optional
 
 def atomic_write_json(path: str, obj: dict):
     d = os.path.dirname(path) or "."
@@ -20,14 +22,160 @@ def atomic_write_json(path: str, obj: dict):
         except Exception:
             pass
 
+def _on_frame_safe(on_frame: Callable[[dict], None], rec: dict) -> None:
+    try:
+        on_frame(rec)
+    except Exception as e:
+        print(f"[LOCAL_INFER] on_frame failed: {e}")
+
+
+def _run_via_daemon(sock_path: str, req: dict, timeout: float,
+                    on_frame: Optional[Callable[[dict], None]] = None) -> Optional[dict]:
+    """
+    One job through survi_inferd (shared engine, per-camera DRR queues).
+    Returns its reply, or None when the daemon is not running or replied
+    "busy" (this camera's queue is full) - the caller runs the job itself.
+    With on_frame the daemon streams {"type": "frame"} records first.
+    """
+    frames_seen = 0
+    try:
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+            s.settimeout(timeout)
+            s.connect(sock_path)
+            if on_frame is not None:
+                req = dict(req, stream=True)
+            s.sendall((json.dumps(req) + "\n").encode())
+            buf = b""
+            while True:
+                nl = buf.find(b"\n")
+                if nl < 0:
+                    chunk = s.recv(4096)
+                    if not chunk:
+                        raise OSError("inferd closed the connection")
+                    buf += chunk
+                    continue
+                line, buf = buf[:nl], buf[nl + 1:]
+                rec = json.loads(line)
+                if rec.get("type") == "frame":
+                    frames_seen += 1
+                    if on_frame is not None:
+                        _on_frame_safe(on_frame, rec)
+                    continue
+                reply = rec
+                break
+    except (OSError, ValueError) as e:
+        if frames_seen:
+            # Frames were already delivered; a rerun would repeat them
+            return {"status": "error", "error": f"inferd: {e}"}
+        return None
+    if reply.get("status") == "busy":
+        return None
+    return reply
+
+
+def daemon_request(sock_path: str, req: dict, timeout: float = 1.0) -> Optional[dict]:
+    """
+    One request / one reply line to survi_inferd (route, route_outcome,
+    upload, stats). None when the daemon is not running or doesn't answer
+    in time; callers carry on without it.
+    """
+    if not sock_path or not os.path.exists(sock_path):
+        return None
+    try:
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+            s.settimeout(timeout)
+            s.connect(sock_path)
+            s.sendall((json.dumps(req) + "\n").encode())
+            buf = b""
+            while b"\n" not in buf:
+                chunk = s.recv(4096)
+                if not chunk:
+                    return None
+                buf += chunk
+        return json.loads(buf[:buf.find(b"\n")])
+    except (OSError, ValueError):
+        return None
+
+
 def run_local_ei_binary(event_id: str, mp4_path: str, out_path: str,
                         frames: int = 5, threshold: float = 0.50,
-                        runner_path: str = None) -> dict:
+                        runner_path: str = None,
+                        det_store_dir: str = None, camera: str = None,
+                        sampling: str = "even", tiles: int = 1,
+                        fidelity: str = "full",
+                        masks: list = None, daemon_socket: str = None,
+                        daemon_timeout: float = 300.0,
+                        on_frame: Optional[Callable[[dict], None]] = None,
+                        repeat_cooldown: float = 0.0, repeat_confirm: int = 2,
+                        repeat_cache: str = None, model_file: str = None,
+                        thermal_budget: bool = False,
+                        memory_budget_mb: int = 0) -> dict:
     """
     Calls compiled C++ EI runner which writes out_path.
     Returns parsed JSON dict.
     Always includes latency_ms in returned dict.
+    With det_store_dir the runner also appends every detection to the
+    columnar detection store there, tagged with camera.
+    sampling ("even" | "keyframe") and tiles are the runner's frame
+    selection and NxN tiling (see survi_sweep for what they cost and buy).
+    fidelity "fast" is the reduced-fidelity decode profile (libav backend).
+    masks: [[x0, y0, x1, y1], ...] normalised zones whose detections are
+    ignored.
+    With daemon_socket (and survi_inferd listening on it) the job goes to
+    the daemon instead of a runner exec; same result file either way.
+    on_frame(rec) is called with each {"type": "frame"} record as soon as
+    the runner has classified that frame (runner --stream / daemon
+    "stream"), before this returns the complete result.
+    repeat_cooldown (seconds, 0: off): an event on the same camera whose first
+    repeat_confirm frames match a result from that long ago inherits it
+    ("inherited_from" in the result) instead of a full pass. The daemon keeps
+    those results in memory; the runner exec keeps them in repeat_cache.
+    model_file: .tflite to run instead of the compiled-in model (same input
+    and output tensors). Replacing the file takes effect with the next event,
+    without restarting the daemon.
+    thermal_budget: run fewer frames / tiles and the fast decode while the SoC
+    is hot or its clock is capped ("thermal" in the result says what ran).
+    memory_budget_mb (0: off): keep the pass under that much memory by
+    streaming, fewer decoder threads, the fast decode, fewer tiles / frames
+    ("memory" in the result has what ran and the peak RSS).
     """
+    os.makedirs(os.path.dirname(out_path) or ".", exist_ok=True)
+
+    if daemon_socket and os.path.exists(daemon_socket):
+        t0 = time.time()
+        req = {
+            "op": "analyze", "id": str(event_id), "camera": str(camera or "cam0"),
+            "event_id": str(event_id), "mp4": os.path.abspath(mp4_path),
+            "out": os.path.abspath(out_path), "frames": int(frames),
+            "threshold": float(threshold), "sampling": str(sampling),
+            "tiles": int(tiles), "fidelity": str(fidelity),
+            "masks": masks or [],
+            "repeat_cooldown_s": float(repeat_cooldown),
+            "repeat_confirm": int(repeat_confirm),
+        }
+        if det_store_dir:
+            req["det_store"] = os.path.abspath(det_store_dir)
+        if model_file:
+            req["model"] = os.path.abspath(model_file)
+        if thermal_budget:
+            req["thermal"] = True
+        if int(memory_budget_mb) > 0:
+            req["memory_budget_mb"] = int(memory_budget_mb)
+        reply = _run_via_daemon(daemon_socket, req, daemon_timeout, on_frame)
+        if reply is not None:
+            dt_ms = int((time.time() - t0) * 1000)
+            if reply.get("status") != "ok" and not os.path.exists(out_path):
+                fail = {
+                    "event_id": str(event_id),
+                    "model": "edgeimpulse_fomo_local",
+                    "status": "error",
+                    "error": str(reply.get("error", "inferd error"))[:800],
+                    "latency_ms": dt_ms,
+                }
+                atomic_write_json(out_path, fail)
+                return fail
+            return _read_result(event_id, out_path, dt_ms)
+
     if runner_path is None:
         here = os.path.dirname(os.path.abspath(__file__))
         runner_path = os.path.abspath(os.path.join(here, "..", "cpp_infer", "build", "ei_infer_mp4"))
@@ -35,8 +183,6 @@ def run_local_ei_binary(event_id: str, mp4_path: str, out_path: str,
     if not os.path.exists(runner_path):
         raise RuntimeError(f"EI runner not found: {runner_path} (build cpp_infer first)")
 
-    os.makedirs(os.path.dirname(out_path) or ".", exist_ok=True)
-
     cmd = [
         runner_path,
         "--event_id", str(event_id),
@@ -45,13 +191,39 @@ def run_local_ei_binary(event_id: str, mp4_path: str, out_path: str,
         "--frames", str(int(frames)),
         "--threshold", str(float(threshold)),
     ]
+    if sampling != "even":
+        cmd += ["--sampling", str(sampling)]
+    if int(tiles) > 1:
+        cmd += ["--tiles", str(int(tiles))]
+    if fidelity != "full":
+        cmd += ["--fidelity", str(fidelity)]
+    if det_store_dir:
+        cmd += ["--det_store", str(det_store_dir)]
+    if camera:
+        cmd += ["--camera", str(camera)]
+    if repeat_cooldown > 0 and repeat_cache:
+        cmd += ["--repeat_cache", str(repeat_cache),
+                "--repeat_cooldown", str(float(repeat_cooldown)),
+                "--repeat_confirm", str(int(repeat_confirm))]
+    if model_file:
+        cmd += ["--model", str(model_file)]
+    if thermal_budget:
+        cmd += ["--thermal_budget"]
+    if int(memory_budget_mb) > 0:
+        cmd += ["--memory_budget_mb", str(int(memory_budget_mb))]
+    for m in masks or []:
+        cmd += ["--mask", ",".join(str(float(v)) for v in m)]
 
     t0 = time.time()
-    p = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    if on_frame is None:
+        p = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+        returncode, err = p.returncode, (p.stderr or p.stdout or "")
+    else:
+        returncode, err = _run_streaming(cmd + ["--stream"], on_frame)
     dt_ms = int((time.time() - t0) * 1000)
 
-    if p.returncode != 0:
-        err = (p.stderr or p.stdout or "").strip()
+    if returncode != 0:
+        err = err.strip()
         fail = {
             "event_id": str(event_id),
             "model": "edgeimpulse_fomo_local",
@@ -62,6 +234,30 @@ def run_local_ei_binary(event_id: str, mp4_path: str, out_path: str,
         atomic_write_json(out_path, fail)
         return fail
 
+    return _read_result(event_id, out_path, dt_ms)
+
+
+def _run_streaming(cmd: list, on_frame: Callable[[dict], None]):
+    """
+    Runs the runner with --stream, handing each frame record to on_frame as
+    it arrives. stderr goes to a temp file (the per-frame debug lines would
+    otherwise fill the pipe). Returns (returncode, stderr text).
+    """
+    with tempfile.TemporaryFile(mode="w+") as errf:
+        p = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=errf, text=True)
+        for line in p.stdout:
+            try:
+                rec = json.loads(line)
+            except ValueError:
+                continue
+            if rec.get("type") == "frame":
+                _on_frame_safe(on_frame, rec)
+        returncode = p.wait()
+        errf.seek(0)
+        return returncode, errf.read()
+
+
+def _read_result(event_id: str, out_path: str, dt_ms: int) -> dict:
     try:
         with open(out_path, "r") as f:
             obj = json.load(f)
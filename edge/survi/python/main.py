@@ -7,10 +7,17 @@ Frame pipeline
   Camera
     → FrameRingQueue     JPEG ring, ~30 s rolling, auto-expire
     → SegmentRingBuffer  .mp4 micro-segments, pinned during events
+                         (segment_store on: stored once by hash in
+                          events/segstore/, pins and event manifests are
+                          refcounts, clips rebuilt from segments.json)
     → MotionDetector     per-frame absdiff
+                         (motion_model "background": adaptive background
+                          model with gain compensation, bg_model.py)
     → EventFSM           idle ▶ active ▶ postroll ▶ [finalize] ▶ idle
 
   On event finalize:
+    (event_store on: docs + DONE/NEEDS_CLOUD go to the C++ event store
+     instead of files; clips live in events/store/blobs/<id>/)
     concat_mp4 → analysis_worker
                    ├─ COMPLETE  (local confidence ≥ threshold)
                    │       └─► events/final/  +  DONE  (uploader sends to cloud)
@@ -22,15 +29,24 @@ Live feed
 ─────────
   /video.mjpg     multipart JPEG stream (all viewers)
   /frame.jpg      latest single JPEG snapshot   ← cloud can poll this
+                  both 307 → survi_media_server when live_fanout is on
+                  (one encode per frame, fanned out from C++)
   /results.json   JSON live state
   /events         list finalised event packages
   /events/<id>.mp4 / .json / .result.json
+                  307 → survi_media_server (sendfile, Range, ETag) when running
+  /detections     aggregate query over every stored detection
+                  (?from=&to=&camera=&label=&min_conf=&zone=&bucket=)
+                  307 → survi_media_server when detection_store is on
 
 Routing decision (per event, at event-start)
 ────────────────────────────────────────────
   RECORD_ONLY   dark / blurry  →  store clip, no inference
   RUN_LOCAL     normal path    →  local EI → COMPLETE or INCOMPLETE→cloud
   RUN_CLOUD     high CPU       →  skip local, straight to cloud_pending
+  router "cost": re-decided at finalize by survi_inferd's measured cost
+                 model (queue, classifier time, local completion rate for
+                 the event's brightness/blur, upload time per MB)
 
 Threads
 ───────
@@ -38,6 +54,7 @@ Threads
   analysis_worker() local EI + routing decision
   cloud_worker()    stages INCOMPLETE events for uploader
   start_server()    HTTP server
+  start_media_server()  spawns cpp_infer/build/survi_media_server (optional)
 """
 from __future__ import annotations
 
@@ -45,6 +62,9 @@ import collections
 import json
 import os
 import queue
+import shutil
+import struct
+import subprocess
 import tempfile
 import threading
 import time
@@ -58,8 +78,12 @@ from h264_postprocess import make_browser_ready
 
 import cv2
 
-from local_infer import run_local_ei_binary
-from segment_buffer import SegmentRingBuffer, concat_mp4
+from bg_model import open_bg_model
+from event_store import FLAG_DONE, FLAG_NEEDS_CLOUD, FLAG_UPLOADED, EventStore, open_store
+from local_infer import daemon_request, run_local_ei_binary
+from replay_source import ReplayCapture, ReplayStats, write_report
+from segment_buffer import (MANIFEST_NAME, SegmentRingBuffer, SegmentStore,
+                            concat_mp4, manifest_paths, open_segment_store)
 
 
 # ═══════════════════════════════════════════════════════════════════════════
@@ -82,15 +106,43 @@ DEVICE_NAME  = CFG.get("device_name",  "UNO_Q")
 HOST         = CFG.get("host",  "0.0.0.0")
 PORT         = int(CFG.get("port", 8081))
 
+# C++ media server for event files (0 disables; Python serves them instead)
+MEDIA_SERVER_PORT = int(CFG.get("media_server_port", 0))
+MEDIA_SERVER_BIN  = CFG.get("media_server_bin") or os.path.abspath(os.path.join(
+    os.path.dirname(os.path.abspath(__file__)),
+    "..", "cpp_infer", "build", "survi_media_server"))
+# Feed encoded live frames to the media server for /video.mjpg fan-out
+LIVE_FANOUT       = bool(CFG.get("live_fanout", True))
+
 CAM_INDEX    = CFG.get("cam_index", 0)
 FRAME_W      = int(CFG.get("frame_w",   640))
 FRAME_H      = int(CFG.get("frame_h",   360))
 TARGET_FPS   = float(CFG.get("target_fps", 15.0))
 
+# Replay: recorded MP4/MJPEG files instead of the camera (load tests).
+# REPLAY_FILES=a.mp4,b.mjpg overrides replay_files. replay_t0 fixes the
+# timestamp of the first frame (epoch s) so runs are reproducible.
+REPLAY_FILES = [f for f in (os.environ.get("REPLAY_FILES", "").split(",")
+                            if os.environ.get("REPLAY_FILES")
+                            else CFG.get("replay_files", [])) if f]
+REPLAY_RATE  = float(CFG.get("replay_rate", 1.0))
+REPLAY_LOOPS = int(CFG.get("replay_loops", 1))
+REPLAY_T0    = CFG.get("replay_t0")
+REPLAY_BIN   = CFG.get("replay_bin") or os.path.abspath(os.path.join(
+    os.path.dirname(os.path.abspath(__file__)),
+    "..", "cpp_infer", "build", "survi_replay"))
+
 # Motion
 MOTION_AREA_MIN      = int(CFG.get("motion_area_min",      1200))
 MOTION_PIX_THRESH    = int(CFG.get("motion_pixel_thresh",    25))
 MOTION_DILATE_ITERS  = int(CFG.get("motion_dilate_iters",    2))
+# "diff": absdiff against the previous frame. "background": per-cell running
+# mean/variance with global gain compensation (libsurvi_bg_model.so), so
+# clouds, headlights and exposure / IR switches don't start events
+MOTION_MODEL         = CFG.get("motion_model", "diff")
+MOTION_BG_CELL       = int(CFG.get("motion_bg_cell",           8))
+MOTION_BG_ALPHA      = float(CFG.get("motion_bg_alpha",     0.03))
+MOTION_BG_SIGMA      = float(CFG.get("motion_bg_sigma",      3.0))
 EVENT_ON_FRAMES      = int(CFG.get("event_on_frames",         3))
 EVENT_OFF_SECONDS    = float(CFG.get("event_off_seconds",   2.0))
 
@@ -101,6 +153,34 @@ FINAL_DIR    = os.path.join(RECORD_DIR, "final")
 UPLOADED_DIR = os.path.join(RECORD_DIR, "uploaded")
 CLOUD_DIR    = os.path.join(RECORD_DIR, "cloud_pending")
 EVENT_LOG    = os.path.join(RECORD_DIR, "event_log.jsonl")
+ROUTE_LOG    = os.path.join(RECORD_DIR, "route_log.jsonl")
+REPLAY_REPORT = os.path.join(RECORD_DIR, "replay_report.json")
+STORE_DIR    = os.path.join(RECORD_DIR, "store")
+
+# Keep packages in the C++ event store (WAL + index) instead of
+# events/final/<id>/ directories with marker files
+EVENT_STORE  = bool(CFG.get("event_store", False))
+
+# Content-addressed, refcounted segments shared by overlapping events;
+# uploaded packages keep only segments.json and clips are rebuilt on demand
+SEGSTORE_DIR    = os.path.join(RECORD_DIR, "segstore")
+SEGMENT_STORE   = bool(CFG.get("segment_store", False))
+CLIP_CACHE_DIR  = os.path.join(RECORD_DIR, "clip_cache")
+# Uploaded packages older than this many days are deleted (their segment refs
+# released first, so the store frees footage no other event shares). 0: kept
+PACKAGE_KEEP_DAYS = float(CFG.get("package_keep_days", 0))
+
+# Columnar log of every local detection (camera, label, conf, position),
+# queried through the media server's /detections endpoint
+DETSTORE_DIR    = os.path.join(RECORD_DIR, "detections")
+DETECTION_STORE = bool(CFG.get("detection_store", False))
+CLIP_CACHE_MAX  = int(CFG.get("clip_cache_max", 8))
+
+# survi_inferd: one shared engine for every camera on the hub, per-camera
+# fair queues. Jobs fall back to running ei_infer_mp4 when it is not up.
+INFERD_SOCKET   = CFG.get("inferd_socket", "/tmp/survi_inferd.sock")
+# [[x0, y0, x1, y1], ...] normalised zones whose detections are ignored
+DETECTION_MASKS = CFG.get("detection_masks", [])
 
 RECORD_FOURCC    = CFG.get("record_fourcc",   "mp4v")
 RECORD_FPS       = float(CFG.get("record_fps",   15.0))
@@ -117,18 +197,57 @@ BRIGHTNESS_MIN   = float(CFG.get("brightness_min",   0.20))
 BLUR_VAR_MIN     = float(CFG.get("blur_var_min",     60.0))
 CPU_HIGH_PCT     = float(CFG.get("cpu_high_pct",     85.0))
 NET_SLOW_MS      = float(CFG.get("net_slow_ms",     250.0))
+# "static": the thresholds above decide at event start. "cost": survi_inferd's
+# measured cost model re-decides when the clip is finalised (cheapest route
+# whose latency to a final result meets route_target_ms), falling back to
+# the static decision when the daemon is not up. Either way local outcomes
+# are reported to the daemon, and routed events are logged with predicted
+# and actual cost in route_log.jsonl
+ROUTER_MODE      = CFG.get("router", "static")
+ROUTE_TARGET_MS  = float(CFG.get("route_target_ms", 30000.0))
+CLOUD_VERIFY_MS  = float(CFG.get("cloud_verify_ms",  5000.0))
 
 # Local inference
 LOCAL_INFER_FRAMES = int(os.environ.get(
     "LOCAL_INFER_FRAMES", str(CFG.get("local_infer_frames", 5))))
 LOCAL_INFER_THRESH = float(os.environ.get(
     "LOCAL_INFER_THRESH", str(CFG.get("local_infer_thresh", 0.50))))
+# Frame selection ("even" | "keyframe") and NxN tiling; pick with survi_sweep
+LOCAL_INFER_SAMPLING = CFG.get("local_infer_sampling", "even")
+LOCAL_INFER_TILES    = int(CFG.get("local_infer_tiles", 1))
+# "fast": reduced-fidelity decode (no deblocking, lowres, skipped non-ref
+# frames); survi_sweep --fidelity full,fast reports the accuracy cost
+LOCAL_INFER_FIDELITY = CFG.get("local_infer_fidelity", "full")
+# Stream per-frame results from the runner and settle an event COMPLETE on
+# its first frame at COMPLETE_THRESH, publishing result.json / incident.json
+# from the frames so far; the rest of the clip is still analysed, and the
+# package goes to the uploader (DONE) with the full result
+EARLY_DECISION       = bool(CFG.get("early_decision", False))
+# Repeat triggers (someone loitering): an event whose first REPEAT_CONFIRM
+# sampled frames match this camera's result from the last REPEAT_COOLDOWN_SEC
+# (same scene, no new objects) inherits it instead of a full pass. 0: off
+REPEAT_COOLDOWN_SEC  = float(CFG.get("repeat_cooldown_seconds", 0.0))
+REPEAT_CONFIRM       = int(CFG.get("repeat_confirm_frames", 2))
+REPEAT_CACHE_PATH    = os.path.join(RECORD_DIR, "repeat_cache.txt")
+# .tflite run instead of the model compiled into the runner (same input and
+# output tensors); replace it with write + rename, no restart needed. "": compiled
+LOCAL_MODEL_FILE     = CFG.get("local_model_file", "")
+# Shrink the local pass (frames, tiles, decode fidelity) while the SoC is hot
+# or throttled, instead of letting every event take longer
+THERMAL_BUDGET       = bool(CFG.get("thermal_budget", False))
+# Hard memory budget for the local pass on low-RAM boards (MB, 0: off): the
+# runner streams instead of preloading, decodes with fewer threads / lower
+# fidelity and samples fewer frames rather than being OOM-killed
+MEMORY_BUDGET_MB     = int(CFG.get("memory_budget_mb", 0))
 
 # Confidence threshold above which a local result is COMPLETE (no cloud needed)
 COMPLETE_THRESH = float(CFG.get("complete_confidence_thresh", 0.70))
 
 # How many seconds of raw frames to keep in the JPEG ring queue
 FRAME_RING_SEC = float(CFG.get("frame_ring_seconds", 35.0))
+# ...and at most this many MB of them (oldest dropped first). 0: a quarter of
+# memory_budget_mb when that is set, otherwise only the seconds bound
+FRAME_RING_MAX_MB = float(CFG.get("frame_ring_max_mb", 0.0)) or MEMORY_BUDGET_MB / 4.0
 
 
 # ═══════════════════════════════════════════════════════════════════════════
@@ -145,6 +264,7 @@ _live: Dict[str, Any] = {
     "motion": False,
     "motion_boxes": [],
     "motion_area": 0,
+    "motion_model": None,           # background model gain / relearns
     "event_id": None,
     "event_state": "idle",          # idle | active | postroll | analyzing
     "fps": 0.0,
@@ -157,6 +277,7 @@ _live: Dict[str, Any] = {
     "last_result": None,
     "cloud_pending_count": 0,       # events staged for cloud but not yet sent
     "analyzing_count": 0,           # events currently under local EI
+    "frame_ring": None,             # JPEG ring bytes / high-water / drops
 }
 
 def _patch(patch: Dict[str, Any]) -> None:
@@ -172,7 +293,8 @@ class FrameRingQueue:
     """
     Thread-safe rolling buffer of (timestamp, jpeg_bytes) tuples.
 
-    Capacity is bounded by maxlen = max_seconds x fps.
+    Capacity is bounded by maxlen = max_seconds x fps, and by max_bytes of
+    JPEG data when that is set (0: unbounded).
     Oldest entries are automatically dropped when full.
 
     Usage
@@ -182,18 +304,37 @@ class FrameRingQueue:
       recent = frq.snapshot_last(seconds=5)   # [(ts, bytes), ...]
     """
 
-    def __init__(self, max_seconds: float = 35.0, fps: float = 15.0) -> None:
+    def __init__(self, max_seconds: float = 35.0, fps: float = 15.0,
+                 max_bytes: int = 0) -> None:
         cap = int(max_seconds * fps) + 32
         self._q: collections.deque[Tuple[float, bytes]] = collections.deque(maxlen=cap)
         self._lock = threading.Lock()
         self.max_seconds = max_seconds
+        self.max_bytes = int(max_bytes)
+        self._bytes = 0
+        self._high_water = 0
+        self._dropped = 0    # frames dropped early for max_bytes
 
     def push(self, ts: float, jpeg: bytes) -> None:
         with self._lock:
+            if len(self._q) == self._q.maxlen:
+                self._bytes -= len(self._q[0][1])
             self._q.append((ts, jpeg))
+            self._bytes += len(jpeg)
+            while self.max_bytes and self._bytes > self.max_bytes and len(self._q) > 1:
+                self._bytes -= len(self._q.popleft()[1])
+                self._dropped += 1
+            self._high_water = max(self._high_water, self._bytes)
+
+    def stats(self) -> Dict[str, Any]:
+        with self._lock:
+            return {"frames": len(self._q), "bytes": self._bytes,
+                    "high_water_bytes": self._high_water,
+                    "max_bytes": self.max_bytes, "dropped": self._dropped}
 
-    def snapshot_last(self, seconds: float) -> List[Tuple[float, bytes]]:
-        cutoff = time.time() - seconds
+    def snapshot_last(self, seconds: float,
+                      now: Optional[float] = None) -> List[Tuple[float, bytes]]:
+        cutoff = (time.time() if now is None else now) - seconds
         with self._lock:
             return [(t, j) for t, j in self._q if t >= cutoff]
 
@@ -254,6 +395,53 @@ def _clamp_fps(loop_start: float, fps: float) -> None:
         time.sleep(remaining)
 
 
+# ═══════════════════════════════════════════════════════════════════════════
+# Package storage  -  event store when enabled, else events/final/<id>/
+# ═══════════════════════════════════════════════════════════════════════════
+
+_store: Optional[EventStore] = None
+_seg_store: Optional[SegmentStore] = None
+
+_MARKER_FLAGS = {"DONE": FLAG_DONE, "NEEDS_CLOUD": FLAG_NEEDS_CLOUD}
+
+
+def _pkg_dir(event_id: str) -> str:
+    """Where clip.mp4 (and the runner's raw output) for an event are written."""
+    if _store is not None:
+        return _store.blob_dir(event_id)
+    d = os.path.join(FINAL_DIR, event_id)
+    os.makedirs(d, exist_ok=True)
+    return d
+
+def _save_doc(event_id: str, name: str, obj: dict, path: str) -> None:
+    """name: "incident" | "result"; path is the file used without the store."""
+    if _store is not None:
+        _store.put_doc(event_id, name, obj)
+    else:
+        _atomic_json(path, obj)
+
+def _load_doc(event_id: str, name: str, path: str) -> Optional[dict]:
+    if _store is not None:
+        rec = _store.get(event_id)
+        return rec.get(name) if rec else None
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except Exception:
+        return None
+
+def _mark(event_id: str, pkg_dir: str, *markers: str) -> None:
+    """DONE / NEEDS_CLOUD: store flags, or marker files in pkg_dir."""
+    if _store is not None:
+        flags = 0
+        for m in markers:
+            flags |= _MARKER_FLAGS[m]
+        _store.set_flags(event_id, flags)
+        return
+    for m in markers:
+        _write_text(os.path.join(pkg_dir, m), "ok\n")
+
+
 # ═══════════════════════════════════════════════════════════════════════════
 # Router signals
 # ═══════════════════════════════════════════════════════════════════════════
@@ -328,6 +516,61 @@ def _router(b: float, bl: float, cpu: float,
 
     return "RUN_LOCAL", reasons
 
+
+def _cost_route(event_id: str, mp4: str, snap: dict, decision: str,
+                inc_path: str) -> str:
+    """
+    Re-decides a finalised event with survi_inferd's cost model (op "route")
+    and records the prediction in incident.json (raw.cost_route). Returns
+    the static decision unchanged when the daemon doesn't answer.
+    """
+    q   = snap.get("quality") or {}
+    net = float(snap.get("network_ms", -1))
+    reply = daemon_request(INFERD_SOCKET, {
+        "op": "route", "id": event_id,
+        "brightness": float(q.get("brightness", 0.5)),
+        "blur_var":   float(q.get("blur_var", 100.0)),
+        "frames": LOCAL_INFER_FRAMES, "tiles": LOCAL_INFER_TILES,
+        "clip_bytes": os.path.getsize(mp4) if os.path.exists(mp4) else 0,
+        "net_ms": net, "cloud_ok": bool(snap.get("cloud_health_url")) and net >= 0,
+        "cloud_ms": CLOUD_VERIFY_MS, "target_ms": ROUTE_TARGET_MS,
+    })
+    if not reply or reply.get("status") != "ok" or "route" not in reply:
+        return decision
+
+    routed = reply["route"]
+    inc = _load_doc(event_id, "incident", inc_path)
+    if inc is not None:
+        inc.setdefault("raw", {})["cost_route"] = {
+            k: reply.get(k) for k in ("route", "reason", "p_complete", "samples",
+                                      "meets_target", "predicted")}
+        if routed != decision:
+            inc["route_mode"]   = "CLOUD" if routed == "RUN_CLOUD" else "LOCAL"
+            inc["route_reason"] = "cost_model"
+            inc["raw"]["decision"] = routed
+            inc.setdefault("routing", {})["cloud_needed"] = routed == "RUN_CLOUD"
+            inc.setdefault("analysis", {}).update({
+                "mode":   {"RECORD_ONLY": "none", "RUN_CLOUD": "cloud"}.get(routed, "local"),
+                "status": "ok" if routed == "RECORD_ONLY" else "pending",
+            })
+        _save_doc(event_id, "incident", inc, inc_path)
+    print(f"[ROUTE] {event_id}  {decision} -> {routed}  ({reply.get('reason')})")
+    return routed
+
+
+def _report_local_outcome(event_id: str, snap: dict, complete: bool,
+                          latency_ms: float) -> None:
+    """Feeds a local pass back to the cost model; logs it if it routed the event."""
+    q = snap.get("quality") or {}
+    reply = daemon_request(INFERD_SOCKET, {
+        "op": "route_outcome", "id": event_id, "route": "RUN_LOCAL",
+        "complete": bool(complete), "actual_ms": float(latency_ms),
+        "brightness": float(q.get("brightness", 0.5)),
+        "blur_var":   float(q.get("blur_var", 100.0)),
+    })
+    if reply and reply.get("record"):
+        _append_jsonl(ROUTE_LOG, reply["record"])
+
 # ═══════════════════════════════════════════════════════════════════════════
 # Incident / result JSON builders
 # ═══════════════════════════════════════════════════════════════════════════
@@ -394,7 +637,7 @@ def _normalize_result(event_id: str, ei: dict) -> dict:
     summary = ei.get("summary") or {}
     dets    = ei.get("detections") if isinstance(ei.get("detections"), list) else []
     labels  = ei.get("labels")    if isinstance(ei.get("labels"),    list) else ["person", "car"]
-    return {
+    out = {
         "status":       status,
         "model_name":   model,
         "model_stage":  "local_fast",
@@ -409,6 +652,9 @@ def _normalize_result(event_id: str, ei: dict) -> dict:
         "event_id":       event_id,
         "created_at":     datetime.now(timezone.utc).isoformat(),
     }
+    if ei.get("inherited_from"):
+        out["inherited_from"] = str(ei["inherited_from"])
+    return out
 
 
 def _is_complete(result: dict) -> bool:
@@ -424,10 +670,29 @@ def _is_complete(result: dict) -> bool:
     if not dets:
         # No objects found; nothing to escalate
         return True
-    max_conf = max((float(d.get("value", 0.0) or 0.0) for d in dets), default=0.0)
+    # The runner reports "conf"; cloud results use "value"
+    max_conf = max((float(d.get("value", d.get("conf", 0.0)) or 0.0) for d in dets), default=0.0)
     return max_conf >= COMPLETE_THRESH
 
 
+def _partial_result(event_id: str, frames: list, t0: float) -> dict:
+    """Runner-format result from the streamed frame records seen so far."""
+    dets = []
+    people = cars = 0
+    for rec in frames:
+        for d in rec.get("detections", []) or []:
+            dets.append(dict(d, frame_idx=rec.get("frame_idx"), t_ms=rec.get("t_ms")))
+        people += int((rec.get("summary") or {}).get("people", 0) or 0)
+        cars   += int((rec.get("summary") or {}).get("cars",   0) or 0)
+    dets.sort(key=lambda d: -float(d.get("conf", 0.0) or 0.0))
+    return {
+        "event_id": event_id, "status": "ok",
+        "detections": dets[:25],
+        "summary": {"people": people, "cars": cars},
+        "latency_ms": int((time.time() - t0) * 1000),
+    }
+
+
 # ═══════════════════════════════════════════════════════════════════════════
 # Worker queues + tracking
 # ═══════════════════════════════════════════════════════════════════════════
@@ -438,6 +703,9 @@ _analysis_q: queue.Queue = queue.Queue(maxsize=64)
 # {event_id, pkg_dir}
 _cloud_q: queue.Queue = queue.Queue(maxsize=64)
 
+# Trigger -> result latency per event; only set while replaying
+_replay_stats: Optional[ReplayStats] = None
+
 _analyzing_ids:      set   = set()
 _analyzing_lock            = threading.Lock()
 _cloud_pending_count: int  = 0
@@ -459,6 +727,56 @@ def _remove_analyzing(eid: str) -> None:
 # analysis_worker  -  local EI + routing
 # ═══════════════════════════════════════════════════════════════════════════
 
+def _publish_result(event_id: str, result: dict, complete: bool,
+                    result_path: str, inc_path: str, pkg_dir: str,
+                    route: bool = True) -> None:
+    """
+    Writes result.json, folds it into incident.json and, with route, marks
+    the package DONE (+ NEEDS_CLOUD and a cloud job when incomplete).
+    route=False only writes the documents (an early COMPLETE before the
+    runner's full result).
+    """
+    _save_doc(event_id, "result", result, result_path)
+
+    # ── Update incident.json ──────────────────────────────────────
+    inc = _load_doc(event_id, "incident", inc_path) or {"incident_id": event_id}
+
+    summary = result.get("summary", {"people": 0, "cars": 0})
+    inc.setdefault("analysis", {}).update({
+        "mode":       result.get("model_stage", "local"),
+        "model":      result.get("model_name"),
+        "status":     result.get("status", "ok"),
+        "summary":    summary,
+        "latency_ms": result.get("latency_ms", -1),
+    })
+    if "scores" in inc:
+        has_det = bool(summary.get("people") or summary.get("cars"))
+        inc["scores"]["confidence_score"] = 1.0 if has_det else 0.0
+    inc.setdefault("routing", {}).update({
+        "complete":    complete,
+        "cloud_needed": not complete,
+    })
+    _save_doc(event_id, "incident", inc, inc_path)
+
+    # ── Route ─────────────────────────────────────────────────────
+    if route and complete:
+        # Ready for uploader to send upstream
+        _mark(event_id, pkg_dir, "DONE")
+        print(f"[ANALYSIS] COMPLETE  id={event_id}  "
+              f"people={summary.get('people')}  cars={summary.get('cars')}")
+    elif route:
+        # DONE so uploader ingests; NEEDS_CLOUD so it knows to request re-analysis
+        _mark(event_id, pkg_dir, "DONE", "NEEDS_CLOUD")
+        try:
+            _cloud_q.put_nowait({"event_id": event_id, "pkg_dir": pkg_dir})
+        except queue.Full:
+            print(f"[ANALYSIS] cloud_q full; {event_id} queued without cloud job")
+        print(f"[ANALYSIS] INCOMPLETE->cloud  id={event_id}  "
+              f"status={result.get('status')}")
+
+    _patch({"last_result": result_path})
+
+
 def analysis_worker() -> None:
     """
     Pulls jobs from _analysis_q.
@@ -470,6 +788,9 @@ def analysis_worker() -> None:
       RUN_LOCAL    -->  run EI binary
                           max_conf >= COMPLETE_THRESH  -->  COMPLETE
                           max_conf <  COMPLETE_THRESH  -->  INCOMPLETE -> cloud_q
+                        (EARLY_DECISION: COMPLETE as soon as one streamed
+                         frame reaches COMPLETE_THRESH; the documents are
+                         published then, DONE waits for the full result)
 
     Both paths write a DONE marker so the uploader can ingest the package.
     INCOMPLETE packages also get a NEEDS_CLOUD marker so the uploader knows
@@ -485,9 +806,15 @@ def analysis_worker() -> None:
         inc_path    = job["incident_json_path"]
         result_path = job["out_result_path"]
         decision    = job["decision"]
-        pkg_dir     = os.path.dirname(inc_path)
+        snap        = job.get("router_snap") or {}
+        pkg_dir     = os.path.dirname(mp4)
+        status      = "error"
+        early       = False     # early COMPLETE documents published (not DONE yet)
 
         try:
+            if ROUTER_MODE == "cost":
+                decision = _cost_route(event_id, mp4, snap, decision, inc_path)
+
             # ── Run inference ────────────────────────────────────────────
             if decision == "RECORD_ONLY":
                 result = {
@@ -512,59 +839,63 @@ def analysis_worker() -> None:
                 complete = False
 
             else:   # RUN_LOCAL
+                # With EARLY_DECISION the runner streams per-frame records;
+                # the first frame at COMPLETE_THRESH settles the event as
+                # COMPLETE (the max confidence can only grow), so its
+                # documents are published from the frames so far while the
+                # runner finishes the clip. DONE waits for the full result:
+                # the uploader sends a DONE package once and never again.
+                # INCOMPLETE still needs every frame.
+                seen: list = []
+                t0 = time.time()
+
+                def on_frame(rec: dict) -> None:
+                    nonlocal early
+                    seen.append(rec)
+                    if early or float(rec.get("max_conf", 0.0) or 0.0) < COMPLETE_THRESH:
+                        return
+                    partial = _normalize_result(event_id, _partial_result(event_id, seen, t0))
+                    partial["partial"] = True
+                    _publish_result(event_id, partial, True, result_path, inc_path, pkg_dir,
+                                    route=False)
+                    early = True
+                    print(f"[ANALYSIS] early COMPLETE  id={event_id}  "
+                          f"frame {rec.get('k')}/{rec.get('n')}")
+
                 ei       = run_local_ei_binary(
                     event_id=event_id, mp4_path=mp4,
                     out_path=result_path,
                     frames=LOCAL_INFER_FRAMES,
                     threshold=LOCAL_INFER_THRESH,
+                    sampling=LOCAL_INFER_SAMPLING,
+                    tiles=LOCAL_INFER_TILES,
+                    fidelity=LOCAL_INFER_FIDELITY,
+                    det_store_dir=DETSTORE_DIR if DETECTION_STORE else None,
+                    camera=CAMERA_ID,
+                    masks=DETECTION_MASKS,
+                    daemon_socket=INFERD_SOCKET,
+                    on_frame=on_frame if EARLY_DECISION else None,
+                    repeat_cooldown=REPEAT_COOLDOWN_SEC,
+                    repeat_confirm=REPEAT_CONFIRM,
+                    repeat_cache=REPEAT_CACHE_PATH,
+                    model_file=LOCAL_MODEL_FILE or None,
+                    thermal_budget=THERMAL_BUDGET,
+                    memory_budget_mb=MEMORY_BUDGET_MB,
                 )
                 result   = _normalize_result(event_id, ei)
-                complete = _is_complete(result)
-
-            _atomic_json(result_path, result)
-
-            # ── Update incident.json ──────────────────────────────────────
-            try:
-                with open(inc_path) as f:
-                    inc = json.load(f)
-            except Exception:
-                inc = {"incident_id": event_id}
-
-            summary = result.get("summary", {"people": 0, "cars": 0})
-            inc.setdefault("analysis", {}).update({
-                "mode":       result.get("model_stage", "local"),
-                "model":      result.get("model_name"),
-                "status":     result.get("status", "ok"),
-                "summary":    summary,
-                "latency_ms": result.get("latency_ms", -1),
-            })
-            if "scores" in inc:
-                has_det = bool(summary.get("people") or summary.get("cars"))
-                inc["scores"]["confidence_score"] = 1.0 if has_det else 0.0
-            inc.setdefault("routing", {}).update({
-                "complete":    complete,
-                "cloud_needed": not complete,
-            })
-            _atomic_json(inc_path, inc)
-
-            # ── Route ─────────────────────────────────────────────────────
-            if complete:
-                # Ready for uploader to send upstream
-                _write_text(os.path.join(pkg_dir, "DONE"), "ok\n")
-                print(f"[ANALYSIS] COMPLETE  id={event_id}  "
-                      f"people={summary.get('people')}  cars={summary.get('cars')}")
+                complete = _is_complete(result) or early
+                if result.get("status") != "error" and not result.get("inherited_from"):
+                    _report_local_outcome(event_id, snap, complete,
+                                          (time.time() - t0) * 1000.0)
+
+            status = result.get("status", "ok")
+            if early and status == "error":
+                # Keep the result of the early frames, and send that
+                print(f"[ANALYSIS] runner failed after early COMPLETE  id={event_id}: "
+                      f"{result.get('error', '')}")
+                _mark(event_id, pkg_dir, "DONE")
             else:
-                # DONE so uploader ingests; NEEDS_CLOUD so it knows to request re-analysis
-                _write_text(os.path.join(pkg_dir, "DONE"),       "ok\n")
-                _write_text(os.path.join(pkg_dir, "NEEDS_CLOUD"), "ok\n")
-                try:
-                    _cloud_q.put_nowait({"event_id": event_id, "pkg_dir": pkg_dir})
-                except queue.Full:
-                    print(f"[ANALYSIS] cloud_q full; {event_id} queued without cloud job")
-                print(f"[ANALYSIS] INCOMPLETE->cloud  id={event_id}  "
-                      f"status={result.get('status')}")
-
-            _patch({"last_result": result_path})
+                _publish_result(event_id, result, complete, result_path, inc_path, pkg_dir)
 
         except Exception as exc:
             print(f"[ANALYSIS] FAILED  id={event_id}: {exc}")
@@ -577,17 +908,20 @@ def analysis_worker() -> None:
                 "created_at": datetime.now(timezone.utc).isoformat(),
             }
             try:
-                _atomic_json(result_path, fail)
+                if not early:
+                    _save_doc(event_id, "result", fail, result_path)
             except Exception:
                 pass
             # Always write DONE so uploader never stalls on this package
             try:
-                _write_text(os.path.join(pkg_dir, "DONE"), "ok\n")
+                _mark(event_id, pkg_dir, "DONE")
             except Exception:
                 pass
 
         finally:
             _remove_analyzing(event_id)
+            if _replay_stats is not None:
+                _replay_stats.done(event_id, decision, status)
             _analysis_q.task_done()
 
 
@@ -695,7 +1029,8 @@ def _list_pkgs(base: str, limit: int = 50) -> List[dict]:
                 continue
             inc  = os.path.join(d, "incident.json")
             clip = os.path.join(d, "clip.mp4")
-            if not (os.path.exists(inc) and os.path.exists(clip)):
+            seg  = os.path.join(d, "segments.json")
+            if not (os.path.exists(inc) and (os.path.exists(clip) or os.path.exists(seg))):
                 continue
             items.append((os.path.getmtime(inc), name))
     except FileNotFoundError:
@@ -716,7 +1051,85 @@ def _list_pkgs(base: str, limit: int = 50) -> List[dict]:
     return out
 
 
+def _redirect_media(h: BaseHTTPRequestHandler, live: bool = False) -> bool:
+    """
+    307 the request to survi_media_server when it is up
+    (live=True: only while it is receiving the live frame feed).
+    Same host the client used, media server port.
+    """
+    if not _media_server_up or (live and not _live_feed_up):
+        return False
+    host = (h.headers.get("Host") or HOST).rsplit(":", 1)[0]
+    h.send_response(307)
+    h.send_header("Location", f"http://{host}:{MEDIA_SERVER_PORT}{h.path}")
+    h.send_header("Content-Length", "0")
+    h.send_header("Cache-Control", "no-store")
+    h.end_headers()
+    return True
+
+
+def _list_store(limit: int) -> List[dict]:
+    out = []
+    for e in _store.list(limit=limit):
+        out.append({
+            "bucket":      "uploaded" if e["uploaded"] else "final",
+            "event_id":    e["event_id"],
+            "json_path":   None,
+            "mp4_path":    os.path.join(e["blob_dir"], "clip.mp4"),
+            "result_path": None,
+            "has_result":  e["has_result"],
+            "needs_cloud": e["needs_cloud"],
+            "done":        e["done"],
+        })
+    return out
+
+
+def _store_doc_resp(h: BaseHTTPRequestHandler, event_id: str, name: str) -> None:
+    rec = _store.get(event_id)
+    if not rec:
+        return _json_resp(h, {"error": "not_found"}, 404)
+    if rec.get(name) is None:
+        return _json_resp(h, {"error": "result_not_ready"}, 404)
+    return _json_resp(h, rec[name])
+
+
+_clip_lock = threading.Lock()
+
+def _assemble_clip(event_id: str, pkg_dir: str) -> Optional[str]:
+    """
+    clip.mp4 for a package that only has segments.json left, concatenated
+    into clip_cache/ and made browser-ready (H.264 + faststart) on first
+    request. The cache keeps the CLIP_CACHE_MAX most recently used clips;
+    why an event's clip is not served virtually: SegmentStore.
+    """
+    paths = manifest_paths(SEGSTORE_DIR, pkg_dir)
+    if not paths:
+        return None
+    out = os.path.join(CLIP_CACHE_DIR, f"{os.path.basename(event_id)}.mp4")
+    with _clip_lock:
+        if os.path.exists(out):
+            os.utime(out)
+            return out
+        os.makedirs(CLIP_CACHE_DIR, exist_ok=True)
+        tmp = out + ".tmp.mp4"
+        if not concat_mp4(tmp, paths):
+            return None
+        make_browser_ready(tmp)  # segments are RECORD_FOURCC, as at finalize
+        os.replace(tmp, out)
+        try:
+            cached = sorted((os.path.getmtime(os.path.join(CLIP_CACHE_DIR, n)), n)
+                            for n in os.listdir(CLIP_CACHE_DIR) if n.endswith(".mp4"))
+            for _, n in cached[:-CLIP_CACHE_MAX]:
+                os.remove(os.path.join(CLIP_CACHE_DIR, n))
+        except OSError:
+            pass
+        return out
+
+
 def _find_pkg(event_id: str) -> Optional[str]:
+    if _store is not None:
+        rec = _store.get(event_id) if event_id.isdigit() else None
+        return rec["blob_dir"] if rec else None
     for base in (UPLOADED_DIR, FINAL_DIR):
         p = os.path.join(base, event_id)
         if os.path.isdir(p) and os.path.exists(os.path.join(p, "incident.json")):
@@ -751,6 +1164,8 @@ class _Handler(BaseHTTPRequestHandler):
 
         # /video.mjpg  (MJPEG multipart live stream)
         if p == "/video.mjpg":
+            if _redirect_media(self, live=True):
+                return
             self.send_response(200)
             self.send_header("Age", "0")
             self.send_header("Cache-Control", "no-store, private")
@@ -782,6 +1197,8 @@ class _Handler(BaseHTTPRequestHandler):
 
         # /frame.jpg  (single JPEG snapshot - cloud can poll this for live feed)
         if p == "/frame.jpg":
+            if _redirect_media(self, live=True):
+                return
             with _state_lock:
                 frame = _latest_jpeg
             if frame is None:
@@ -811,6 +1228,9 @@ class _Handler(BaseHTTPRequestHandler):
                         limit = max(1, min(200, int(v)))
             except Exception:
                 pass
+            if _store is not None:
+                merged = _list_store(limit)
+                return _json_resp(self, {"count": len(merged), "events": merged})
             final  = [{"bucket": "final",    **e} for e in _list_pkgs(FINAL_DIR,   limit)]
             upl    = [{"bucket": "uploaded", **e} for e in _list_pkgs(UPLOADED_DIR, limit)]
             merged = final + upl
@@ -820,10 +1240,20 @@ class _Handler(BaseHTTPRequestHandler):
                 pass
             return _json_resp(self, {"count": len(merged), "events": merged[:limit]})
 
+        # /detections  (aggregates are computed by the media server)
+        if p == "/detections":
+            if DETECTION_STORE and _redirect_media(self):
+                return
+            return _json_resp(self, {"error": "detection store not available"}, 503)
+
         # /events/<id>.json
         if p.startswith("/events/") and p.endswith(".json") and \
                 not p.endswith(".result.json"):
+            if _redirect_media(self):
+                return
             eid = unquote(p[len("/events/"):-len(".json")])
+            if _store is not None and eid.isdigit():
+                return _store_doc_resp(self, eid, "incident")
             pkg = _find_pkg(eid)
             if not pkg:
                 return _json_resp(self, {"error": "not_found"}, 404)
@@ -832,7 +1262,11 @@ class _Handler(BaseHTTPRequestHandler):
 
         # /events/<id>.result.json
         if p.startswith("/events/") and p.endswith(".result.json"):
+            if _redirect_media(self):
+                return
             eid = unquote(p[len("/events/"):-len(".result.json")])
+            if _store is not None and eid.isdigit():
+                return _store_doc_resp(self, eid, "result")
             pkg = _find_pkg(eid)
             if not pkg:
                 return _json_resp(self, {"error": "not_found"}, 404)
@@ -845,6 +1279,14 @@ class _Handler(BaseHTTPRequestHandler):
         if p.startswith("/events/") and p.endswith(".mp4"):
             eid = unquote(p[len("/events/"):-len(".mp4")])
             pkg = _find_pkg(eid)
+            if pkg and not os.path.exists(os.path.join(pkg, "clip.mp4")):
+                # Uploaded package without its clip: rebuild from segments
+                mp4 = _assemble_clip(eid, pkg)
+                if not mp4:
+                    return _json_resp(self, {"error": "not_found"}, 404)
+                return _send_file(self, mp4, "video/mp4")
+            if _redirect_media(self):
+                return
             if not pkg:
                 self.send_response(404)
                 self.end_headers()
@@ -869,6 +1311,61 @@ class _Server(ThreadingMixIn, HTTPServer):
     daemon_threads = True
 
 
+_media_server_up = False
+_media_proc: Optional[subprocess.Popen] = None
+_live_feed_up = False
+
+
+def start_media_server() -> None:
+    """
+    Spawns survi_media_server on MEDIA_SERVER_PORT over RECORD_DIR.
+    Falls back to Python file serving when it is disabled or not built.
+
+    With LIVE_FANOUT its stdin carries the live JPEG feed (_feed_live).
+    """
+    global _media_server_up, _media_proc, _live_feed_up
+    if MEDIA_SERVER_PORT <= 0:
+        return
+    if not os.path.exists(MEDIA_SERVER_BIN):
+        print(f"[MEDIA] {MEDIA_SERVER_BIN} not built; serving event files from Python")
+        return
+    cmd = [
+        MEDIA_SERVER_BIN,
+        "--root", os.path.abspath(RECORD_DIR),
+        "--host", HOST,
+        "--port", str(MEDIA_SERVER_PORT),
+    ]
+    if _store is not None:
+        cmd += ["--store", os.path.abspath(STORE_DIR)]
+    if DETECTION_STORE:
+        cmd += ["--detections", os.path.abspath(DETSTORE_DIR)]
+    if LIVE_FANOUT:
+        cmd += ["--frames_fd", "0"]
+    proc = subprocess.Popen(cmd, stdin=subprocess.PIPE if LIVE_FANOUT else None)
+    time.sleep(0.2)
+    if proc.poll() is not None:
+        print(f"[MEDIA] survi_media_server exited rc={proc.returncode}; serving from Python")
+        return
+    _media_proc      = proc
+    _media_server_up = True
+    _live_feed_up    = LIVE_FANOUT
+    print(f"[MEDIA] http://{HOST}:{MEDIA_SERVER_PORT}  (clips, incident/result JSON"
+          f"{', live MJPEG' if LIVE_FANOUT else ''})")
+
+
+def _feed_live(ts: float, jpg: bytes) -> None:
+    """Hands one encoded frame to survi_media_server: <u32 len><i64 ts_us><jpeg>."""
+    global _live_feed_up
+    if not _live_feed_up:
+        return
+    try:
+        _media_proc.stdin.write(struct.pack("<Iq", len(jpg), int(ts * 1e6)) + jpg)
+        _media_proc.stdin.flush()
+    except (BrokenPipeError, OSError, ValueError):
+        _live_feed_up = False
+        print("[MEDIA] live feed lost; /video.mjpg served from Python")
+
+
 def start_server() -> None:
     srv = _Server((HOST, PORT), _Handler)
     print(f"[HTTP] http://{HOST}:{PORT}")
@@ -910,37 +1407,56 @@ def capture_loop() -> None:
        On finalize:
          concat_mp4 -> write incident.json -> queue to analysis_worker
          analysis_worker decides COMPLETE vs INCOMPLETE (-> cloud_worker)
+
+    With REPLAY_FILES the frames come from survi_replay instead of the camera,
+    timestamped by the replay clock; when the files run out the loop waits
+    for the analysis queue, writes REPLAY_REPORT and returns.
     """
-    global _latest_jpeg, _latest_ts
+    global _latest_jpeg, _latest_ts, _replay_stats
 
     _ensure_dirs()
-    
-    #cap = cv2.VideoCapture(os.environ.get("VIDEO_DEVICE", CAM_INDEX), cv2.CAP_V4L2)
-    #cap.set(cv2.CAP_PROP_FOURCC, cv2.VideoWriter_fourcc(*"MJPG"))
-
-    src = os.environ.get("VIDEO_DEVICE", str(CAM_INDEX))
 
-    # A llow VIDEO_DEVICE="4" or VIDEO_DEVICE="/dev/video4"
-    if isinstance(src, str) and src.startswith("/dev/video") and src[len("/dev/video"):].isdigit():
-        src = src[len("/dev/video"):]
-    if isinstance(src, str) and src.isdigit():
-        src = int(src)
-
-    cap = cv2.VideoCapture(src, cv2.CAP_V4L2)
-    cap.set(cv2.CAP_PROP_FOURCC, cv2.VideoWriter_fourcc(*"MJPG"))
-
-
-    if not cap.isOpened():
-        raise RuntimeError(f"Cannot open camera index {CAM_INDEX}")
-    cap.set(cv2.CAP_PROP_FRAME_WIDTH,  FRAME_W)
-    cap.set(cv2.CAP_PROP_FRAME_HEIGHT, FRAME_H)
-    cap.set(cv2.CAP_PROP_FPS,          TARGET_FPS)
+    replay: Optional[ReplayCapture] = None
+    if REPLAY_FILES:
+        if not os.path.exists(REPLAY_BIN):
+            raise RuntimeError(f"Replay source not built: {REPLAY_BIN}")
+        replay = ReplayCapture(REPLAY_FILES, rate=REPLAY_RATE, fps=TARGET_FPS,
+                               loops=REPLAY_LOOPS, t0=REPLAY_T0,
+                               width=FRAME_W, height=FRAME_H,
+                               bin_path=REPLAY_BIN)
+        _replay_stats = ReplayStats()
+        cap = replay
+        print(f"[REPLAY] {len(REPLAY_FILES)} file(s)  rate={REPLAY_RATE}x  "
+              f"loops={REPLAY_LOOPS}  t0={REPLAY_T0 or 'now'}")
+    else:
+        #cap = cv2.VideoCapture(os.environ.get("VIDEO_DEVICE", CAM_INDEX), cv2.CAP_V4L2)
+        #cap.set(cv2.CAP_PROP_FOURCC, cv2.VideoWriter_fourcc(*"MJPG"))
+
+        src = os.environ.get("VIDEO_DEVICE", str(CAM_INDEX))
+
+        # A llow VIDEO_DEVICE="4" or VIDEO_DEVICE="/dev/video4"
+        if isinstance(src, str) and src.startswith("/dev/video") and src[len("/dev/video"):].isdigit():
+            src = src[len("/dev/video"):]
+        if isinstance(src, str) and src.isdigit():
+            src = int(src)
+
+        cap = cv2.VideoCapture(src, cv2.CAP_V4L2)
+        cap.set(cv2.CAP_PROP_FOURCC, cv2.VideoWriter_fourcc(*"MJPG"))
+
+
+        if not cap.isOpened():
+            raise RuntimeError(f"Cannot open camera index {CAM_INDEX}")
+        cap.set(cv2.CAP_PROP_FRAME_WIDTH,  FRAME_W)
+        cap.set(cv2.CAP_PROP_FRAME_HEIGHT, FRAME_H)
+        cap.set(cv2.CAP_PROP_FPS,          TARGET_FPS)
 
     # ── Frame ring queue (JPEG frames, auto-expire) ───────────────────────
-    frq = FrameRingQueue(max_seconds=FRAME_RING_SEC, fps=TARGET_FPS)
+    frq = FrameRingQueue(max_seconds=FRAME_RING_SEC, fps=TARGET_FPS,
+                         max_bytes=int(FRAME_RING_MAX_MB * 1024 * 1024))
 
     # ── Segment ring buffer (MP4 files, pinned during events) ─────────────
-    seg_rb     = SegmentRingBuffer(SEG_DIR, keep_seconds=RING_KEEP_SEC)
+    seg_rb     = SegmentRingBuffer(SEG_DIR, keep_seconds=RING_KEEP_SEC,
+                                   store=_seg_store)
     seg_writer = None
     seg_path:  Optional[str] = None
     seg_start: float = 0.0
@@ -955,7 +1471,7 @@ def capture_loop() -> None:
             print("[SEG] VideoWriter failed - check RECORD_FOURCC in config.json")
             seg_writer = None
 
-    def seg_close_commit() -> None:
+    def seg_close_commit(now: float) -> None:
         """Release current segment, add to ring, pin if event is active."""
         nonlocal seg_writer, seg_path, seg_start
         if seg_writer is None:
@@ -964,15 +1480,19 @@ def capture_loop() -> None:
         seg_writer = None
         try:
             if os.path.exists(seg_path) and os.path.getsize(seg_path) > 1024:
-                seg_rb.add(seg_start, seg_path)
-                if evt_state in ("active", "postroll"):
-                    evt_segs.append(seg_path)
-                    seg_rb.pin_many([seg_path])
+                stored = seg_rb.add(seg_start, seg_path, now=now)
+                if stored and evt_state in ("active", "postroll"):
+                    evt_segs.append(stored)
+                    seg_rb.pin_many([stored])
         except Exception:
             pass
 
     # ── Motion state ──────────────────────────────────────────────────────
     prev_gray: Optional[Any] = None
+    bg_model = (open_bg_model(cell=MOTION_BG_CELL, alpha=MOTION_BG_ALPHA,
+                              k_sigma=MOTION_BG_SIGMA,
+                              min_diff=float(MOTION_PIX_THRESH))
+                if MOTION_MODEL == "background" else None)
     motion_streak  = 0
     last_motion_ts = 0.0
 
@@ -1030,11 +1550,15 @@ def capture_loop() -> None:
 
         ok, frame = cap.read()
         if not ok or frame is None:
+            if replay is not None and replay.exhausted:
+                seg_close_commit(replay.ts)
+                _finish_replay(replay)
+                return
             time.sleep(0.05)
             continue
 
         frame = cv2.resize(frame, (FRAME_W, FRAME_H), cv2.INTER_AREA)
-        ts    = _now()
+        ts    = replay.ts if replay is not None else _now()
 
         # ── 1. Segment writer ─────────────────────────────────────────────
         if seg_writer is None:
@@ -1042,7 +1566,7 @@ def capture_loop() -> None:
         if seg_writer is not None:
             seg_writer.write(frame)
             if (ts - seg_start) >= SEGMENT_SECONDS:
-                seg_close_commit()
+                seg_close_commit(ts)
 
         # ── 2. Router signals ─────────────────────────────────────────────
         b   = _brightness(frame)
@@ -1075,10 +1599,14 @@ def capture_loop() -> None:
         boxes: List = []
         total_area = 0
 
-        if prev_gray is not None:
+        thresh = None
+        if bg_model is not None:
+            thresh = bg_model.update(gray)
+        elif prev_gray is not None:
             diff = cv2.absdiff(prev_gray, gray)
             _, thresh = cv2.threshold(
                 diff, MOTION_PIX_THRESH, 255, cv2.THRESH_BINARY)
+        if thresh is not None:
             thresh = cv2.dilate(thresh, None, iterations=MOTION_DILATE_ITERS)
             for c in cv2.findContours(
                     thresh, cv2.RETR_EXTERNAL, cv2.CHAIN_APPROX_SIMPLE)[0]:
@@ -1105,7 +1633,7 @@ def capture_loop() -> None:
             evt_state  = "active"
             evt_id     = str(int(ts * 1000))
             evt_start  = ts
-            evt_preroll = seg_rb.snapshot_last(PREROLL_SECONDS)
+            evt_preroll = seg_rb.snapshot_last(PREROLL_SECONDS, now=ts)
             evt_segs    = []
             postroll_until = 0.0
 
@@ -1123,6 +1651,8 @@ def capture_loop() -> None:
             }
 
             seg_rb.pin_many(evt_preroll)
+            if _replay_stats is not None:
+                _replay_stats.trigger(evt_id)
             print(f"[EVENT] START  id={evt_id}  preroll_segs={len(evt_preroll)}  "
                   f"decision={evt_decision}")
 
@@ -1152,22 +1682,28 @@ def capture_loop() -> None:
             evt_end  = ts
             _eid     = evt_id  # local copy for async worker
 
-            seg_close_commit()
-            postroll_segs = seg_rb.snapshot_last(POSTROLL_SECONDS + 1)
+            seg_close_commit(ts)
+            postroll_segs = seg_rb.snapshot_last(POSTROLL_SECONDS + 1, now=ts)
             seg_rb.pin_many(postroll_segs)
 
             all_segs = evt_preroll + evt_segs + postroll_segs
-            pkg_dir  = os.path.join(FINAL_DIR, _eid)
-            os.makedirs(pkg_dir, exist_ok=True)
+            pkg_dir  = _pkg_dir(_eid)
 
             out_mp4    = os.path.join(pkg_dir, "clip.mp4")
             out_inc    = os.path.join(pkg_dir, "incident.json")
-            out_result = os.path.join(pkg_dir, "result.json")
+            # With the store, result.json lives in the WAL; this file is only
+            # the runner's raw output
+            out_result = os.path.join(pkg_dir,
+                                      "ei_out.json" if _store else "result.json")
 
             ok_concat = concat_mp4(out_mp4, all_segs)
 
             if ok_concat:
                 make_browser_ready(out_mp4)
+                if _store is not None:
+                    _store.put_blob(_eid, "clip.mp4")
+                if _seg_store is not None:
+                    _seg_store.retain(pkg_dir, all_segs)
                 avg_area     = (s_sum_area / s_samples) if s_samples else 0.0
                 motion_stats = {
                     "max_area":       int(s_max_area),
@@ -1184,13 +1720,15 @@ def capture_loop() -> None:
                     router_snap=evt_router_snap,
                     motion_stats=motion_stats,
                 )
-                _atomic_json(out_inc, inc)
+                _save_doc(_eid, "incident", inc, out_inc)
                 _append_jsonl(EVENT_LOG, inc)
 
                 print(f"[PKG] {pkg_dir}  segs={len(all_segs)}")
 
                 # Queue for local EI (runs async - does not block capture)
                 _add_analyzing(_eid)
+                if _replay_stats is not None:
+                    _replay_stats.finalized(_eid)
                 try:
                     _analysis_q.put_nowait({
                         "event_id":           _eid,
@@ -1198,18 +1736,20 @@ def capture_loop() -> None:
                         "incident_json_path": out_inc,
                         "out_result_path":    out_result,
                         "decision":           evt_decision,
+                        "router_snap":        evt_router_snap,
                     })
                     print(f"[ANALYSIS] queued  id={_eid}")
                 except queue.Full:
                     print(f"[ANALYSIS] queue full - writing DONE without EI  id={_eid}")
                     _remove_analyzing(_eid)
-                    _write_text(os.path.join(pkg_dir, "DONE"), "ok\n")
+                    _mark(_eid, pkg_dir, "DONE")
 
                 _patch({"last_clip": out_mp4})
             else:
                 print(f"[PKG] concat FAILED  id={_eid}  segs={len(all_segs)}")
 
-            # Unpin; ring buffer can evict these segments now
+            # Unpin; ring buffer can evict these segments now (with the
+            # segment store, the manifest refs keep the event's footage)
             seg_rb.unpin_many(evt_preroll)
             seg_rb.unpin_many(evt_segs)
             seg_rb.unpin_many(postroll_segs)
@@ -1252,6 +1792,7 @@ def capture_loop() -> None:
             with _state_lock:
                 _latest_jpeg = jpg_bytes
                 _latest_ts   = ts
+            _feed_live(ts, jpg_bytes)
 
         # ── FPS counter ───────────────────────────────────────────────────
         frm_count += 1
@@ -1276,9 +1817,85 @@ def capture_loop() -> None:
                                "blur_var":   round(bl_avg,  1)},
             "network_ms":     round(net_avg, 1) if net_avg >= 0 else -1,
             "cpu_pct":        round(cpu_avg, 1) if cpu_avg >= 0 else -1,
+            "motion_model":   bg_model.stats() if bg_model is not None else None,
+            "frame_ring":     frq.stats(),
         })
 
-        _clamp_fps(loop_ts, TARGET_FPS)
+        if replay is None:       # the replay source paces itself
+            _clamp_fps(loop_ts, TARGET_FPS)
+
+
+def _finish_replay(cap: ReplayCapture) -> None:
+    """Replay ran out: let queued analysis finish, then write the report."""
+    print("[REPLAY] source exhausted; waiting for queued analysis")
+    _analysis_q.join()
+    cap.release()
+    report = _replay_stats.report(cap)
+    write_report(REPLAY_REPORT, report)
+    lat = report["finalize_to_result_ms"]
+    print(f"[REPLAY] frames={report['frames']}  fps={report['capture_fps']}  "
+          f"events={report['events']}  finalize->result p50={lat['p50']}ms "
+          f"p95={lat['p95']}ms  -> {REPLAY_REPORT}")
+
+
+# ═══════════════════════════════════════════════════════════════════════════
+# retention_worker  -  deletes old uploaded packages (PACKAGE_KEEP_DAYS)
+# ═══════════════════════════════════════════════════════════════════════════
+
+def _delete_pkg(event_id: str, pkg_dir: str) -> bool:
+    """Releases the package's segment refs, then removes it and its cached clip."""
+    if os.path.exists(os.path.join(pkg_dir, MANIFEST_NAME)):
+        if _seg_store is None:
+            return False   # refs can't be dropped without the library: keep it
+        _seg_store.release(pkg_dir)
+    shutil.rmtree(pkg_dir, ignore_errors=True)
+    try:
+        os.remove(os.path.join(CLIP_CACHE_DIR, f"{os.path.basename(event_id)}.mp4"))
+    except FileNotFoundError:
+        pass
+    return True
+
+
+def _prune_packages(now: Optional[float] = None) -> int:
+    cutoff = (time.time() if now is None else now) - PACKAGE_KEEP_DAYS * 86400
+    n = 0
+    if _store is not None:
+        # Event ids are the trigger time in epoch ms
+        for rec in _store.list(hi=int(cutoff * 1000), need=FLAG_UPLOADED,
+                               limit=200, newest_first=False):
+            eid = str(rec["event_id"])
+            if _delete_pkg(eid, rec["blob_dir"]):
+                _store.remove(eid)
+                n += 1
+        return n
+    for base in (UPLOADED_DIR, FINAL_DIR):
+        try:
+            names = os.listdir(base)
+        except FileNotFoundError:
+            continue
+        for name in names:
+            d = os.path.join(base, name)
+            try:
+                if (not os.path.isdir(d) or os.path.getmtime(d) >= cutoff
+                        or (base == FINAL_DIR
+                            and not os.path.exists(os.path.join(d, "SUPABASE_DONE")))):
+                    continue
+            except OSError:
+                continue
+            n += _delete_pkg(name, d)
+    return n
+
+
+def retention_worker() -> None:
+    while True:
+        try:
+            n = _prune_packages()
+            if n:
+                print(f"[RETENTION] deleted {n} uploaded package(s) "
+                      f"older than {PACKAGE_KEEP_DAYS:g} days")
+        except Exception as exc:
+            print(f"[RETENTION] {exc}")
+        time.sleep(3600)
 
 
 # ═══════════════════════════════════════════════════════════════════════════
@@ -1286,11 +1903,21 @@ def capture_loop() -> None:
 # ═══════════════════════════════════════════════════════════════════════════
 
 def main() -> None:
+    global _store, _seg_store
     _ensure_dirs()
+    if EVENT_STORE:
+        _store = open_store(STORE_DIR)
+    if SEGMENT_STORE:
+        _seg_store = open_segment_store(SEGSTORE_DIR)
+    start_media_server()
     threading.Thread(target=start_server,    daemon=True, name="http").start()
     threading.Thread(target=analysis_worker, daemon=True, name="analysis").start()
     threading.Thread(target=cloud_worker,    daemon=True, name="cloud").start()
-    capture_loop()   # blocks forever on the main thread
+    if PACKAGE_KEEP_DAYS > 0:
+        threading.Thread(target=retention_worker, daemon=True, name="retention").start()
+    capture_loop()   # blocks forever on the main thread (returns after a replay)
+    if _media_proc is not None:
+        _media_proc.terminate()
 
 
 if __name__ == "__main__":
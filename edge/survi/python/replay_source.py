@@ -0,0 +1,175 @@
+"""
+replay_source.py  -  virtual camera over cpp_infer's survi_replay
+
+capture_loop() normally opens the camera with cv2.VideoCapture(V4L2). With
+replay_files set (config.json) or REPLAY_FILES=a.mp4,b.mjpg in the
+environment it uses ReplayCapture instead: survi_replay decodes the files
+and streams BGR frames over a pipe, paced at replay_rate x real time.
+
+  cap = ReplayCapture(["walk.mp4"], rate=4.0, t0=1700000000.0,
+                      width=640, height=360)
+  ok, frame = cap.read()
+  ts = cap.ts            # frame time (epoch s), deterministic for a given t0
+
+The capture loop uses cap.ts instead of time.time(), so event ids, segment
+names and FSM timing repeat exactly between runs. ReplayStats collects
+wall-clock trigger -> result latency per event for the end-of-run report.
+"""
+from __future__ import annotations
+
+import json
+import os
+import struct
+import subprocess
+import threading
+import time
+from typing import Any, Dict, List, Optional, Tuple
+
+import numpy as np
+
+DEFAULT_BIN = os.path.abspath(os.path.join(
+    os.path.dirname(os.path.abspath(__file__)),
+    "..", "cpp_infer", "build", "survi_replay"))
+
+# u32 magic 'SRF1', u32 width, u32 height, u32 reserved, i64 ts_us, u64 seq
+_HDR       = struct.Struct("<IIIIqQ")
+_MAGIC     = 0x31465253
+
+
+class ReplayCapture:
+    """Drop-in for the cv2.VideoCapture calls capture_loop makes."""
+
+    def __init__(self, files: List[str], rate: float = 1.0, fps: float = 15.0,
+                 loops: int = 1, t0: Optional[float] = None,
+                 width: int = 0, height: int = 0,
+                 bin_path: Optional[str] = None) -> None:
+        cmd = [bin_path or DEFAULT_BIN,
+               "--rate", str(float(rate)), "--fps", str(float(fps)),
+               "--loops", str(int(loops))]
+        if t0 is not None:
+            cmd += ["--t0", repr(float(t0))]
+        if width > 0 and height > 0:
+            cmd += ["--width", str(int(width)), "--height", str(int(height))]
+        cmd += [str(f) for f in files]
+
+        self._proc = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                                      bufsize=1 << 20)
+        self.ts: float = 0.0          # timestamp of the last frame read
+        self.seq: int = -1
+        self.frames: int = 0
+        self.exhausted = False        # source hit EOF (replay finished)
+        self.started_wall = time.time()
+
+    def isOpened(self) -> bool:
+        return not self.exhausted
+
+    def set(self, prop: int, value: float) -> bool:
+        return False                  # geometry / fps come from the command line
+
+    def _read_exact(self, n: int) -> Optional[bytes]:
+        buf = self._proc.stdout.read(n)
+        if buf is None or len(buf) < n:
+            return None
+        return buf
+
+    def read(self) -> Tuple[bool, Optional[Any]]:
+        if self.exhausted:
+            return False, None
+        hdr = self._read_exact(_HDR.size)
+        if hdr is None:
+            self.exhausted = True
+            return False, None
+        magic, w, h, _, ts_us, seq = _HDR.unpack(hdr)
+        if magic != _MAGIC:
+            print("[REPLAY] bad frame header; stopping replay")
+            self.release()
+            self.exhausted = True
+            return False, None
+        body = self._read_exact(w * h * 3)
+        if body is None:
+            self.exhausted = True
+            return False, None
+        self.ts     = ts_us / 1e6
+        self.seq    = seq
+        self.frames += 1
+        return True, np.frombuffer(body, dtype=np.uint8).reshape(h, w, 3).copy()
+
+    def release(self) -> None:
+        if self._proc.poll() is None:
+            self._proc.terminate()
+        try:
+            self._proc.wait(timeout=2.0)
+        except subprocess.TimeoutExpired:
+            self._proc.kill()
+
+
+class ReplayStats:
+    """
+    Per-event wall-clock latency for a replay run.
+
+    trigger(eid) when the FSM starts an event, finalized(eid) when its clip
+    is queued for analysis, done(eid) when its result is written; report()
+    summarises them plus capture throughput.
+    """
+
+    def __init__(self) -> None:
+        self._lock      = threading.Lock()
+        self._trigger:  Dict[str, float] = {}
+        self._finalize: Dict[str, float] = {}
+        self._rows:     List[dict] = []
+
+    def trigger(self, event_id: str) -> None:
+        with self._lock:
+            self._trigger[event_id] = time.time()
+
+    def finalized(self, event_id: str) -> None:
+        with self._lock:
+            self._finalize[event_id] = time.time()
+
+    def done(self, event_id: str, decision: str, status: str) -> None:
+        now = time.time()
+        with self._lock:
+            t = self._trigger.pop(event_id, None)
+            f = self._finalize.pop(event_id, None)
+            if t is None or f is None:
+                return
+            self._rows.append({"event_id": event_id, "decision": decision,
+                               "status": status,
+                               "trigger_to_result_ms":  int((now - t) * 1000),
+                               "finalize_to_result_ms": int((now - f) * 1000)})
+
+    @staticmethod
+    def _pct(vals: List[int], p: float) -> int:
+        if not vals:
+            return -1
+        s = sorted(vals)
+        return s[min(len(s) - 1, int(round(p / 100.0 * (len(s) - 1))))]
+
+    def report(self, cap: ReplayCapture) -> dict:
+        wall = max(1e-6, time.time() - cap.started_wall)
+        with self._lock:
+            lat = [r["trigger_to_result_ms"] for r in self._rows]
+            fin = [r["finalize_to_result_ms"] for r in self._rows]
+            return {
+                "frames":            cap.frames,
+                "wall_s":            round(wall, 3),
+                "capture_fps":       round(cap.frames / wall, 2),
+                "events":            len(self._rows),
+                "events_unfinished": len(self._trigger),
+                "trigger_to_result_ms":  {"p50": self._pct(lat, 50),
+                                          "p95": self._pct(lat, 95),
+                                          "max": max(lat) if lat else -1},
+                "finalize_to_result_ms": {"p50": self._pct(fin, 50),
+                                          "p95": self._pct(fin, 95),
+                                          "max": max(fin) if fin else -1},
+                "per_event":         list(self._rows),
+            }
+
+
+def write_report(path: str, report: dict) -> None:
+    os.makedirs(os.path.dirname(path) or ".", exist_ok=True)
+    tmp = path + ".tmp"
+    with open(tmp, "w") as f:
+        json.dump(report, f, indent=2)
+        f.write("\n")
+    os.replace(tmp, path)
@@ -1,7 +1,156 @@
 import os
 import time
+import json
+import ctypes
 import collections
 import subprocess
+from typing import List, Optional
+
+DEFAULT_STORE_LIB = os.path.abspath(os.path.join(
+    os.path.dirname(os.path.abspath(__file__)),
+    "..", "cpp_infer", "build", "libsurvi_segment_store.so"))
+
+MANIFEST_NAME = "segments.json"
+
+
+class SegmentStore:
+    """
+    ctypes binding for cpp_infer's libsurvi_segment_store.so.
+
+    Segments are stored once under objects/ by SHA-256 and kept alive by
+    refcounts: transient refs (ring window, in-progress events) live in
+    memory, persistent refs (finalised event manifests) survive restarts.
+    An object is deleted as soon as its last ref is dropped.
+
+    A finalised event still gets its own clip.mp4 (concatenated, then
+    re-encoded to H.264 + faststart); only the long-lived copy is virtual.
+    The segments are the camera's mp4v, which browsers do not play, so a
+    playable clip means an encode, not a byte-range splice of the objects.
+    The runner (Mp4Index, readahead) and the upload (one storage object per
+    clip) also take a single file. After a successful upload
+    uploader_worker.drop_uploaded_clip deletes that copy and keeps
+    segments.json. From then on the footage is the shared objects, and
+    main._assemble_clip rebuilds the clip on demand into a bounded
+    clip_cache/.
+    """
+    def __init__(self, dir_path: str, lib_path: Optional[str] = None) -> None:
+        lib = ctypes.CDLL(lib_path or DEFAULT_STORE_LIB)
+        c_str, c_vp = ctypes.c_char_p, ctypes.c_void_p
+        lib.ss_open.argtypes          = [c_str]
+        lib.ss_open.restype           = c_vp
+        lib.ss_close.argtypes         = [c_vp]
+        lib.ss_ingest.argtypes        = [c_vp, c_str, ctypes.c_char_p]
+        lib.ss_ref.argtypes           = [c_vp, c_str, ctypes.c_int]
+        lib.ss_unref.argtypes         = [c_vp, c_str, ctypes.c_int]
+        lib.ss_gc.argtypes            = [c_vp]
+        lib.ss_object_count.argtypes  = [c_vp]
+        lib.ss_object_count.restype   = ctypes.c_uint64
+        lib.ss_bytes_on_disk.argtypes = [c_vp]
+        lib.ss_bytes_on_disk.restype  = ctypes.c_uint64
+
+        self._lib = lib
+        self._h   = lib.ss_open(dir_path.encode())
+        if not self._h:
+            raise RuntimeError(f"segment store open failed: {dir_path}")
+        self.dir = os.path.abspath(dir_path)
+
+    def close(self) -> None:
+        if self._h:
+            self._lib.ss_close(self._h)
+            self._h = None
+
+    def path(self, h: str) -> str:
+        return os.path.join(self.dir, "objects", h[:2], h + ".mp4")
+
+    @staticmethod
+    def hash_of(path: str) -> Optional[str]:
+        """Object hash for a path inside the store, else None."""
+        name = os.path.basename(path or "")
+        return name[:-4] if len(name) == 68 and name.endswith(".mp4") else None
+
+    def ingest(self, src: str) -> Optional[str]:
+        """Moves src into the store with one transient ref; returns its hash."""
+        out = ctypes.create_string_buffer(65)
+        if self._lib.ss_ingest(self._h, src.encode(), out) != 0:
+            return None
+        return out.value.decode()
+
+    def ref(self, hashes: List[str], persistent: bool = False) -> int:
+        if not hashes:
+            return 0
+        return self._lib.ss_ref(self._h, "\n".join(hashes).encode(), 1 if persistent else 0)
+
+    def unref(self, hashes: List[str], persistent: bool = False) -> int:
+        if not hashes:
+            return 0
+        return self._lib.ss_unref(self._h, "\n".join(hashes).encode(), 1 if persistent else 0)
+
+    def gc(self) -> int:
+        return self._lib.ss_gc(self._h)
+
+    def stats(self) -> dict:
+        return {"objects": int(self._lib.ss_object_count(self._h)),
+                "bytes":   int(self._lib.ss_bytes_on_disk(self._h))}
+
+    # ── event manifests ──────────────────────────────────────────────────
+    def retain(self, pkg_dir: str, paths: List[str]) -> List[str]:
+        """
+        Writes pkg_dir/segments.json and takes one persistent ref per
+        segment, so the event keeps its footage after the ring moves on.
+        """
+        hashes, seen = [], set()
+        for p in paths:
+            h = self.hash_of(p)
+            if h and h not in seen:
+                seen.add(h)
+                hashes.append(h)
+        tmp = os.path.join(pkg_dir, MANIFEST_NAME + ".tmp")
+        with open(tmp, "w") as f:
+            json.dump({"segments": hashes}, f)
+        os.replace(tmp, os.path.join(pkg_dir, MANIFEST_NAME))
+        self.ref(hashes, persistent=True)
+        return hashes
+
+    def release(self, pkg_dir: str) -> int:
+        """Drops the refs of a package's manifest (package being deleted)."""
+        hashes = load_manifest(pkg_dir)
+        if hashes is None:
+            return 0
+        n = self.unref(hashes, persistent=True)
+        try:
+            os.remove(os.path.join(pkg_dir, MANIFEST_NAME))
+        except FileNotFoundError:
+            pass
+        return n
+
+
+def load_manifest(pkg_dir: str) -> Optional[List[str]]:
+    try:
+        with open(os.path.join(pkg_dir, MANIFEST_NAME)) as f:
+            return list(json.load(f)["segments"])
+    except Exception:
+        return None
+
+
+def manifest_paths(store_dir: str, pkg_dir: str) -> Optional[List[str]]:
+    """Object paths for a package's manifest (no library needed)."""
+    hashes = load_manifest(pkg_dir)
+    if hashes is None:
+        return None
+    return [os.path.join(store_dir, "objects", h[:2], h + ".mp4") for h in hashes]
+
+
+def open_segment_store(dir_path: str, lib_path: Optional[str] = None) -> Optional[SegmentStore]:
+    """SegmentStore, or None (with a log line) when the library isn't built."""
+    path = lib_path or DEFAULT_STORE_LIB
+    if not os.path.exists(path):
+        print(f"[SEGSTORE] {path} not built; using plain segment files")
+        return None
+    try:
+        return SegmentStore(dir_path, lib_path=path)
+    except Exception as exc:
+        print(f"[SEGSTORE] open failed ({exc}); using plain segment files")
+        return None
 
 
 class SegmentRingBuffer:
@@ -10,30 +159,62 @@ class SegmentRingBuffer:
 
     Supports "pinning" segments so they won't be deleted while they're needed
     for an event clip build.
+
+    With a SegmentStore, add() moves each segment into the store and returns
+    its object path; the ring, pins and event manifests are all refcounts on
+    that object and eviction just drops the ring's ref.
     """
-    def __init__(self, dir_path: str, keep_seconds: int = 30):
+    def __init__(self, dir_path: str, keep_seconds: int = 30,
+                 store: Optional[SegmentStore] = None):
         self.dir = dir_path
         os.makedirs(self.dir, exist_ok=True)
         self.keep_seconds = keep_seconds
+        self.store = store
         self.segs = collections.deque()  # (ts, path)
         self._pinned = set()             # paths that must not be deleted
 
+    def _hashes(self, paths) -> List[str]:
+        return [h for h in (SegmentStore.hash_of(p) for p in paths) if h]
+
     def pin_many(self, paths):
+        if self.store is not None:
+            self.store.ref(self._hashes(paths))
+            return
         for p in paths:
             if p:
                 self._pinned.add(os.path.abspath(p))
 
     def unpin_many(self, paths):
+        if self.store is not None:
+            self.store.unref(self._hashes(paths))
+            return
         for p in paths:
             if p:
                 self._pinned.discard(os.path.abspath(p))
 
-    def add(self, ts: float, path: str):
+    def add(self, ts: float, path: str,
+            now: Optional[float] = None) -> Optional[str]:
+        """
+        Returns the path the segment now lives at (None if lost).
+        now: current capture time (replay clock); defaults to time.time().
+        """
+        if self.store is not None:
+            h = self.store.ingest(path)
+            if h is None:
+                return None
+            path = self.store.path(h)
         self.segs.append((ts, path))
-        self.evict(time.time())
+        self.evict(time.time() if now is None else now)
+        return path
 
     def evict(self, now_ts: float):
         cutoff = now_ts - self.keep_seconds
+        if self.store is not None:
+            expired = []
+            while self.segs and self.segs[0][0] < cutoff:
+                expired.append(self.segs.popleft()[1])
+            self.store.unref(self._hashes(expired))
+            return
         while self.segs and self.segs[0][0] < cutoff:
             _, p = self.segs[0]
             ap = os.path.abspath(p)
@@ -56,8 +237,8 @@ class SegmentRingBuffer:
             except Exception:
                 pass
 
-    def snapshot_last(self, seconds: int):
-        cutoff = time.time() - seconds
+    def snapshot_last(self, seconds: int, now: Optional[float] = None):
+        cutoff = (time.time() if now is None else now) - seconds
         return [p for (ts, p) in self.segs if ts >= cutoff]
 
 
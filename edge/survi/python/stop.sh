@@ -12,6 +12,7 @@ if [ -f logs/uploader.pid ]; then
 fi
 
 pkill -f "ffmpeg.*v4l2" 2>/dev/null || true
+pkill -f survi_media_server 2>/dev/null || true
 sudo fuser -k /dev/video4 2>/dev/null || true
 
 echo "[SYSTEM] Done."
@@ -14,6 +14,8 @@ Two paths:
   CLOUD event (has NEEDS_CLOUD marker)
     → status = "pending_cloud_verification"
     → uploads clip.mp4 to Supabase Storage (cloud runner needs the video)
+      and hints.json (frame times of the local detections, where the
+      cloud runner samples densely)
     → inserts incident row with pending status
     → cloud runner polls for pending_cloud_verification rows,
       downloads clip, runs big model, updates the incident row
@@ -30,8 +32,34 @@ Optional:
   SUPABASE_STORAGE_BUCKET  (default: incidents)
   POLL_SECONDS             (default: 2)
   RUN_ONCE                 (set to 1 to exit after one pass)
+  EVENT_STORE              (set to 1 when main.py runs with "event_store": true;
+                            pending events come from the store index instead
+                            of scanning events/final/, and SUPABASE_DONE
+                            becomes the store's UPLOADED flag)
+  EVENT_STORE_DIR          (default: ./events/store)
+  KEEP_UPLOADED_CLIPS      (set to 1 to keep clip.mp4 after upload even when
+                            the package has a segments.json manifest; by
+                            default the clip is dropped and main.py rebuilds
+                            it from the segment store on demand)
+  INFERD_SOCKET            (default: /tmp/survi_inferd.sock; clip upload times
+                            go to survi_inferd's cost-model router, and a
+                            CLOUD event it routed is logged to ROUTE_LOG)
+  ROUTE_LOG                (default: ./events/route_log.jsonl)
+  UPLOAD_AGENT_SPOOL       (directory; when set, events are not pushed from
+                            here but spooled as <id>.job.json for
+                            cpp_infer/survi_upload_agent, which uploads several
+                            at once, resumably and under a bandwidth cap. Each
+                            pass picks up its <id>.done.json / .failed.json and
+                            does the bookkeeping: SUPABASE_DONE or the store
+                            flag, clip cleanup, the cost model's upload time.
+                            Run the agent with --spool on the same directory)
+  UPLOAD_AGENT_MAX_ATTEMPTS (default: 5; an event the agent failed is held
+                            back in <id>.attempts.json, spooled again after a
+                            growing pause with the incident row it already
+                            created, and left out for good after this many)
 """
 
+import io
 import os
 import json
 import time
@@ -41,6 +69,9 @@ from datetime import datetime, timezone
 
 import requests
 
+from event_store import FLAG_DONE, FLAG_UPLOADED, open_store
+from local_infer import daemon_request
+
 EVENTS_FINAL_DIR = Path("./events/final")
 STATE_FILE       = Path("./events/supabase_uploaded.json")
 
@@ -53,6 +84,17 @@ STORAGE_BUCKET  = os.environ.get("SUPABASE_STORAGE_BUCKET",  "incidents")
 POLL_SECONDS = float(os.environ.get("POLL_SECONDS", "2"))
 RUN_ONCE     = os.environ.get("RUN_ONCE", "0") == "1"
 
+USE_EVENT_STORE = os.environ.get("EVENT_STORE", "0") == "1"
+EVENT_STORE_DIR = os.environ.get("EVENT_STORE_DIR", "./events/store")
+
+KEEP_UPLOADED_CLIPS = os.environ.get("KEEP_UPLOADED_CLIPS", "0") == "1"
+
+INFERD_SOCKET = os.environ.get("INFERD_SOCKET", "/tmp/survi_inferd.sock")
+ROUTE_LOG     = Path(os.environ.get("ROUTE_LOG", "./events/route_log.jsonl"))
+
+UPLOAD_AGENT_SPOOL        = os.environ.get("UPLOAD_AGENT_SPOOL", "")
+UPLOAD_AGENT_MAX_ATTEMPTS = int(os.environ.get("UPLOAD_AGENT_MAX_ATTEMPTS", "5"))
+
 DEFAULT_ROUTE_MODE = os.environ.get("DEFAULT_ROUTE_MODE", "LOCAL")
 DEFAULT_STATUS     = os.environ.get("DEFAULT_STATUS",     "stored")
 
@@ -166,14 +208,14 @@ def normalize_route_mode(value) -> str:
 # Status logic  —  the core LOCAL vs CLOUD split
 # ─────────────────────────────────────────────────────────────────────────────
 
-def resolve_status(event_dir: Path, incident: dict, result: dict) -> str:
+def resolve_status(needs_cloud: bool, incident: dict, result: dict) -> str:
     """
-    NEEDS_CLOUD file present         → pending_cloud_verification
+    NEEDS_CLOUD marker/flag present  → pending_cloud_verification
     result.status == pending_cloud   → pending_cloud_verification
     routing.cloud_needed == True     → pending_cloud_verification
     Everything else                  → stored
     """
-    if (event_dir / "NEEDS_CLOUD").exists():
+    if needs_cloud:
         return "pending_cloud_verification"
 
     if (result.get("status") or "").lower() == "pending_cloud":
@@ -190,8 +232,16 @@ def resolve_status(event_dir: Path, incident: dict, result: dict) -> str:
 # ─────────────────────────────────────────────────────────────────────────────
 
 def normalize_event(event_dir: Path) -> dict:
-    incident = load_json(event_dir / "incident.json")
-    result   = load_json(event_dir / "result.json")
+    return normalize_docs(
+        load_json(event_dir / "incident.json"),
+        load_json(event_dir / "result.json"),
+        (event_dir / "NEEDS_CLOUD").exists(),
+        event_dir.name,
+    )
+
+
+def normalize_docs(incident: dict, result: dict, needs_cloud: bool,
+                   fallback_id: str) -> dict:
     scores   = incident.get("scores", {})
 
     local_event_id = str(pick(
@@ -199,7 +249,7 @@ def normalize_event(event_dir: Path) -> dict:
         incident.get("id"),
         result.get("incident_id"),
         result.get("id"),
-        event_dir.name,
+        fallback_id,
     ))
 
     hub_id = clean_uuid(
@@ -225,7 +275,7 @@ def normalize_event(event_dir: Path) -> dict:
     started_at = pick(incident.get("started_at"), result.get("started_at"), now_iso())
     ended_at   = pick(incident.get("ended_at"),   result.get("ended_at"))
 
-    status = resolve_status(event_dir, incident, result)
+    status = resolve_status(needs_cloud, incident, result)
 
     threat_score = to_int(pick(
         scores.get("threat_score"),
@@ -301,10 +351,12 @@ def insert_incident(row: dict) -> str:
     return r.json()[0]["id"]
 
 
-def upload_file(local_path: Path, storage_path: str, content_type: str) -> str | None:
-    if not local_path.exists():
+def upload_file(local_path: Path | None, storage_path: str, content_type: str,
+                data: bytes | None = None) -> str | None:
+    """local_path's contents, or data when given."""
+    if data is None and not local_path.exists():
         return None
-    with open(local_path, "rb") as f:
+    with (open(local_path, "rb") if data is None else io.BytesIO(data)) as f:
         r = requests.post(
             f"{STORAGE_UPLOAD_URL}/{storage_path}",
             headers={
@@ -335,12 +387,15 @@ def insert_media(incident_db_id: str, storage_url: str,
         print(f"[ERR] incident_media insert failed: {r.status_code} {r.text}")
 
 
-def upload_media_files(event_dir: Path, local_event_id: str,
-                       incident_db_id: str, is_cloud: bool) -> None:
-    """
-    Always upload clip.mp4 — cloud runner needs the video for CLOUD events.
-    Only upload snapshots/thumbnails for LOCAL events (already fully analyzed).
-    """
+def detection_hints(result: dict) -> dict:
+    """hints.json: t_ms of result.json's detections (unknown times dropped)."""
+    times = sorted({int(d["t_ms"]) for d in result.get("detections") or []
+                    if isinstance(d.get("t_ms"), (int, float)) and d["t_ms"] >= 0})
+    return {"hints_ms": times}
+
+
+def media_files(event_dir: Path, is_cloud: bool) -> list:
+    """(filename, content_type, media_type) of the event's files to upload."""
     files = [("clip.mp4", "video/mp4", "clip")]
 
     if not is_cloud:
@@ -350,22 +405,172 @@ def upload_media_files(event_dir: Path, local_event_id: str,
             ("thumbnail.jpg", "image/jpeg", "thumbnail"),
             ("thumbnail.png", "image/png",  "thumbnail"),
         ]
+    return [f for f in files if (event_dir / f[0]).exists()]
 
-    for filename, content_type, media_type in files:
-        local_path = event_dir / filename
-        if not local_path.exists():
-            continue
 
+def upload_media_files(event_dir: Path, local_event_id: str,
+                       incident_db_id: str, is_cloud: bool,
+                       result: dict | None = None) -> None:
+    """
+    Always upload clip.mp4 — cloud runner needs the video for CLOUD events.
+    Only upload snapshots/thumbnails for LOCAL events (already fully analyzed).
+    CLOUD events also get hints.json from result, when it has detections.
+    """
+    for filename, content_type, media_type in media_files(event_dir, is_cloud):
+        local_path   = event_dir / filename
         storage_path = f"{local_event_id}/{filename}"
         print(f"  [UPLOAD] {filename} -> {STORAGE_BUCKET}/{storage_path}")
 
+        t0         = time.time()
         public_url = upload_file(local_path, storage_path, content_type)
+        if public_url and filename == "clip.mp4":
+            report_clip_upload(local_event_id, local_path.stat().st_size,
+                               (time.time() - t0) * 1000.0, is_cloud)
         if public_url:
             insert_media(incident_db_id, public_url, media_type, content_type)
             print(f"  [OK]     {filename}")
         else:
             print(f"  [WARN]   {filename} upload failed")
 
+    hints = detection_hints(result or {}) if is_cloud else None
+    if hints and hints["hints_ms"]:
+        storage_path = f"{local_event_id}/hints.json"
+        public_url = upload_file(None, storage_path, "application/json",
+                                 data=json.dumps(hints).encode())
+        if public_url:
+            insert_media(incident_db_id, public_url, "hints", "application/json")
+            print(f"  [OK]     hints.json ({len(hints['hints_ms'])} times)")
+
+
+def report_clip_upload(local_event_id: str, size: int, ms: float,
+                       is_cloud: bool) -> None:
+    """Upload time to the cost model; a CLOUD event's upload is its outcome."""
+    daemon_request(INFERD_SOCKET, {"op": "upload", "bytes": size, "ms": ms})
+    if not is_cloud:
+        return
+    reply = daemon_request(INFERD_SOCKET, {
+        "op": "route_outcome", "id": local_event_id,
+        "route": "RUN_CLOUD", "actual_ms": ms,
+    })
+    if reply and reply.get("record"):
+        try:
+            with open(ROUTE_LOG, "a") as f:
+                f.write(json.dumps(reply["record"]) + "\n")
+        except OSError:
+            pass
+
+
+def drop_uploaded_clip(event_dir: Path) -> None:
+    """
+    The segment store still holds the footage (segments.json refs it), so the
+    concatenated copy is redundant once it is in Supabase.
+    """
+    if KEEP_UPLOADED_CLIPS or not (event_dir / "segments.json").exists():
+        return
+    try:
+        (event_dir / "clip.mp4").unlink()
+        print("  [DISK]   dropped clip.mp4 (segments.json kept)")
+    except FileNotFoundError:
+        pass
+
+
+# ─────────────────────────────────────────────────────────────────────────────
+# Upload agent spool (cpp_infer/upload_job.h has the file formats)
+# ─────────────────────────────────────────────────────────────────────────────
+
+def agent_has(job_id: str) -> bool:
+    """Spooled and not yet collected, or held back after failing."""
+    spool = Path(UPLOAD_AGENT_SPOOL)
+    if any((spool / f"{job_id}{suffix}").exists()
+           for suffix in (".job.json", ".done.json", ".failed.json")):
+        return True
+    held = load_json(spool / f"{job_id}.attempts.json")
+    return bool(held) and (held.get("attempts", 0) >= UPLOAD_AGENT_MAX_ATTEMPTS
+                           or time.time() < held.get("retry_at", 0))
+
+
+def spool_upload(job_id: str, media_dir: Path, norm: dict,
+                 result: dict | None) -> bool:
+    """Hands the event to survi_upload_agent."""
+    spool = Path(UPLOAD_AGENT_SPOOL)
+    spool.mkdir(parents=True, exist_ok=True)
+
+    local_event_id = norm["local_event_id"]
+    is_cloud       = (norm["status"] == "pending_cloud_verification")
+    files          = media_files(media_dir, is_cloud)
+
+    # The agent uploads files only, so hints.json goes next to the clip
+    hints = detection_hints(result or {}) if is_cloud else None
+    if hints and hints["hints_ms"]:
+        (media_dir / "hints.json").write_text(json.dumps(hints))
+        files.append(("hints.json", "application/json", "hints"))
+
+    job = {
+        "event_id":      job_id,
+        "priority":      norm["incident_row"].get("threat_score") or 0,
+        "created_ms":    int(time.time() * 1000),
+        "incident_body": json.dumps([norm["incident_row"]]),
+        # The row an earlier, failed attempt created: not inserted again
+        "incident_db_id": load_json(spool / f"{job_id}.attempts.json")
+                          .get("incident_db_id", ""),
+        "media": [{
+            "path":         str((media_dir / filename).resolve()),
+            "storage_path": f"{local_event_id}/{filename}",
+            "content_type": content_type,
+            "media_type":   media_type,
+        } for filename, content_type, media_type in files],
+    }
+    tmp = spool / f".{job_id}.job.json.tmp"
+    tmp.write_text(json.dumps(job))
+    os.replace(tmp, spool / f"{job_id}.job.json")
+    print(f"  [SPOOL]  {len(files)} file(s), priority {job['priority']}")
+    return True
+
+
+def collect_agent_results(on_done) -> int:
+    """Calls on_done(job_id, done_doc) for each finished agent job."""
+    spool = Path(UPLOAD_AGENT_SPOOL)
+    if not spool.exists():
+        return 0
+    n = 0
+    for path in sorted(spool.glob("*.failed.json")):
+        doc    = load_json(path)
+        job_id = path.name[:-len(".failed.json")]
+        held_path = spool / f"{job_id}.attempts.json"
+        held   = load_json(held_path)
+        tries  = held.get("attempts", 0) + 1
+        pause  = min(3600, 60 * 2 ** (tries - 1))
+        print(f"[ERR] {job_id}: upload agent: {doc.get('error')} "
+              + (f"(attempt {tries}, giving up)" if tries >= UPLOAD_AGENT_MAX_ATTEMPTS
+                 else f"(attempt {tries}, again in {pause} s)"))
+        tmp = spool / f".{job_id}.attempts.json.tmp"
+        tmp.write_text(json.dumps({
+            "attempts":       tries,
+            "retry_at":       time.time() + pause,
+            "error":          doc.get("error"),
+            "incident_db_id": doc.get("incident_db_id") or held.get("incident_db_id", ""),
+        }))
+        os.replace(tmp, held_path)
+        path.unlink()
+    for path in sorted(spool.glob("*.done.json")):
+        doc    = load_json(path)
+        job_id = path.name[:-len(".done.json")]
+        try:
+            on_done(job_id, doc)
+            n += 1
+        except Exception as e:
+            print(f"[ERR] {job_id}: {e}")
+        path.unlink()
+        (spool / f"{job_id}.attempts.json").unlink(missing_ok=True)
+    return n
+
+
+def report_agent_clip(doc: dict, norm: dict) -> None:
+    for m in doc.get("media") or []:
+        if m.get("media_type") == "clip" and not m.get("skipped"):
+            report_clip_upload(norm["local_event_id"], m.get("bytes", 0), m.get("ms", 0),
+                               norm["status"] == "pending_cloud_verification")
+
 
 # ─────────────────────────────────────────────────────────────────────────────
 # Main loop
@@ -395,21 +600,108 @@ def process_event_dir(event_dir: Path, done_ids: set) -> bool:
     is_cloud       = (status == "pending_cloud_verification")
 
     label = "CLOUD -> pending_cloud_verification" if is_cloud else "LOCAL -> stored"
+
+    if UPLOAD_AGENT_SPOOL:
+        if agent_has(event_id):
+            return False
+        print(f"[PUSH] {local_event_id}  ({label})")
+        return spool_upload(event_id, event_dir, norm, load_json(event_dir / "result.json"))
+
     print(f"[PUSH] {local_event_id}  ({label})")
 
     incident_db_id = insert_incident(row)
     print(f"[OK]   db id={incident_db_id}")
 
-    upload_media_files(event_dir, local_event_id, incident_db_id, is_cloud)
+    upload_media_files(event_dir, local_event_id, incident_db_id, is_cloud,
+                       load_json(event_dir / "result.json"))
 
     done_ids.add(event_id)
     save_state(done_ids)
     (event_dir / "SUPABASE_DONE").write_text(now_iso())
+    drop_uploaded_clip(event_dir)
+
+    return True
+
+
+def process_store_event(store, entry: dict) -> bool:
+    """Store counterpart of process_event_dir; entry comes from store.list()."""
+    event_id = entry["event_id"]
+    rec      = store.get(event_id)
+    if not rec or (rec.get("incident") is None and rec.get("result") is None):
+        print(f"[SKIP] {event_id}: no incident or result doc")
+        return False
+
+    norm           = normalize_docs(rec.get("incident") or {}, rec.get("result") or {},
+                                    bool(rec.get("needs_cloud")), event_id)
+    local_event_id = norm["local_event_id"]
+    row            = norm["incident_row"]
+    is_cloud       = (norm["status"] == "pending_cloud_verification")
+
+    label = "CLOUD -> pending_cloud_verification" if is_cloud else "LOCAL -> stored"
+
+    if UPLOAD_AGENT_SPOOL:
+        if agent_has(event_id):
+            return False
+        print(f"[PUSH] {local_event_id}  ({label})")
+        return spool_upload(event_id, Path(rec["blob_dir"]), norm, rec.get("result"))
+
+    print(f"[PUSH] {local_event_id}  ({label})")
+
+    incident_db_id = insert_incident(row)
+    print(f"[OK]   db id={incident_db_id}")
+
+    upload_media_files(Path(rec["blob_dir"]), local_event_id, incident_db_id, is_cloud,
+                       rec.get("result"))
 
+    store.set_flags(event_id, FLAG_UPLOADED)
+    drop_uploaded_clip(Path(rec["blob_dir"]))
     return True
 
 
+def run_store_loop(store) -> None:
+    print(f"[WORKER] event store    {EVENT_STORE_DIR}")
+    print(f"[WORKER] incidents      {INCIDENTS_TABLE}")
+    print(f"[WORKER] storage bucket {STORAGE_BUCKET}")
+    print()
+
+    def agent_done(event_id: str, doc: dict) -> None:
+        rec = store.get(event_id)
+        if not rec:
+            return
+        norm = normalize_docs(rec.get("incident") or {}, rec.get("result") or {},
+                              bool(rec.get("needs_cloud")), event_id)
+        print(f"[OK]   {event_id} uploaded by agent, db id={doc.get('incident_db_id')}")
+        report_agent_clip(doc, norm)
+        store.set_flags(event_id, FLAG_UPLOADED)
+        drop_uploaded_clip(Path(rec["blob_dir"]))
+
+    while True:
+        pushed = 0
+        if UPLOAD_AGENT_SPOOL:
+            collect_agent_results(agent_done)
+
+        # DONE and not yet UPLOADED, oldest first
+        for entry in store.list(need=FLAG_DONE, skip=FLAG_UPLOADED,
+                                limit=200, newest_first=False):
+            try:
+                if process_store_event(store, entry):
+                    pushed += 1
+            except Exception as e:
+                print(f"[ERR] {entry.get('event_id')}: {e}")
+
+        if RUN_ONCE:
+            break
+
+        if pushed == 0:
+            time.sleep(POLL_SECONDS)
+
+
 def run_loop() -> None:
+    if USE_EVENT_STORE:
+        store = open_store(EVENT_STORE_DIR)
+        if store is not None:
+            return run_store_loop(store)
+
     print(f"[WORKER] watching       {EVENTS_FINAL_DIR}")
     print(f"[WORKER] incidents      {INCIDENTS_TABLE}")
     print(f"[WORKER] storage bucket {STORAGE_BUCKET}")
@@ -417,8 +709,21 @@ def run_loop() -> None:
 
     done_ids = load_state()
 
+    def agent_done(event_id: str, doc: dict) -> None:
+        event_dir = EVENTS_FINAL_DIR / event_id
+        print(f"[OK]   {event_id} uploaded by agent, db id={doc.get('incident_db_id')}")
+        if event_dir.is_dir():
+            report_agent_clip(doc, normalize_event(event_dir))
+        done_ids.add(event_id)
+        save_state(done_ids)
+        if event_dir.is_dir():
+            (event_dir / "SUPABASE_DONE").write_text(now_iso())
+            drop_uploaded_clip(event_dir)
+
     while True:
         pushed = 0
+        if UPLOAD_AGENT_SPOOL:
+            collect_agent_results(agent_done)
 
         if EVENTS_FINAL_DIR.exists():
             for event_dir in sorted(EVENTS_FINAL_DIR.iterdir()):
@@ -7,7 +7,9 @@ import numpy as np
 from PIL import Image, ImageEnhance
 import io
 import argparse
+import json
 import os
+import socket
 import tempfile
 import logging
 import queue
@@ -60,6 +62,15 @@ SCAN_INTERVAL = 30
 
 # Lower confidence threshold for low-light -- YOLO is less certain in the dark
 CONFIDENCE_THRESHOLD = 0.35
+
+# survi_yolo_server (edge/survi/cpp_infer): same analysis in C++, frames from
+# concurrent clips batched into one forward pass. Used by --cloud-scan when
+# set (or given as --yolo-server); the workers then only download and wait.
+# The server infers a sample of the frames - dense around motion and the
+# times in the incident's hints.json (local detections), sparse elsewhere -
+# and tracks boxes across the rest.
+YOLO_SERVER_SOCKET  = os.getenv("YOLO_SERVER_SOCKET", "")
+YOLO_SERVER_TIMEOUT = 600
 COOLDOWN_SECONDS = 10
 
 # --- Class maps ------------------------------------
@@ -248,6 +259,55 @@ def fetch_pending_cloud_incidents(client, batch: int = SCAN_BATCH_SIZE) -> list[
     return unique
 
 
+def _media_url(client, incident_id: str, media_type: str) -> str | None:
+    """storage_url of the incident's first incident_media row of media_type."""
+    resp = (
+        client.table("incident_media")
+        .select("storage_url, media_type")
+        .eq("incident_id", incident_id)
+        .eq("media_type", media_type)
+        .limit(1)
+        .execute()
+    )
+    rows = resp.data or []
+    return rows[0]["storage_url"] if rows else None
+
+
+def _storage_relative(incident_id: str, storage_url: str) -> str | None:
+    """Bucket-relative path from a storage_url (full URL or already relative)."""
+    if not storage_url.startswith("http"):
+        return storage_url  # already a relative path
+    # If it's already a full https URL extract just the path after /object/incidents/
+    marker = "/object/incidents/"
+    idx = storage_url.find(marker)
+    if idx != -1:
+        return storage_url[idx + len(marker):]
+    # also try /object/public/incidents/
+    marker2 = "/object/public/incidents/"
+    idx2 = storage_url.find(marker2)
+    if idx2 != -1:
+        return storage_url[idx2 + len(marker2):]
+    log.warning("  [%s] couldn't parse storage path from URL: %s", incident_id, storage_url)
+    return None
+
+
+def fetch_detection_hints(client, incident_id: str) -> list[int]:
+    """
+    Frame times (ms) of the edge runner's detections, from the hints.json the
+    uploader stores for cloud incidents. Empty when there is none.
+    """
+    try:
+        storage_url = _media_url(client, incident_id, "hints")
+        path = _storage_relative(incident_id, storage_url) if storage_url else None
+        if path is None:
+            return []
+        data = json.loads(client.storage.from_(STORAGE_BUCKET).download(path))
+        return [int(t) for t in data.get("hints_ms", []) if isinstance(t, (int, float))]
+    except Exception as exc:
+        log.warning("  [%s] hints unavailable: %s", incident_id, exc)
+        return []
+
+
 def _resolve_storage_path(client, incident_id: str) -> str | None:
     """
     The storage bucket uses numeric timestamp folder names (e.g. 1772344051904/clip.mp4),
@@ -257,31 +317,9 @@ def _resolve_storage_path(client, incident_id: str) -> str | None:
     """
     # ── 1. incident_media table ───────────────────────────────────────────────
     try:
-        resp = (
-            client.table("incident_media")
-            .select("storage_url, media_type")
-            .eq("incident_id", incident_id)
-            .eq("media_type", "clip")
-            .limit(1)
-            .execute()
-        )
-        rows = resp.data or []
-        if rows:
-            storage_url: str = rows[0]["storage_url"]
-            # If it's already a full https URL extract just the path after /object/incidents/
-            if storage_url.startswith("http"):
-                marker = "/object/incidents/"
-                idx = storage_url.find(marker)
-                if idx != -1:
-                    return storage_url[idx + len(marker):]
-                # also try /object/public/incidents/
-                marker2 = "/object/public/incidents/"
-                idx2 = storage_url.find(marker2)
-                if idx2 != -1:
-                    return storage_url[idx2 + len(marker2):]
-                log.warning("  [%s] couldn't parse storage path from URL: %s", incident_id, storage_url)
-                return None
-            return storage_url  # already a relative path
+        storage_url = _media_url(client, incident_id, "clip")
+        if storage_url is not None:
+            return _storage_relative(incident_id, storage_url)
     except Exception as exc:
         log.warning("  [%s] incident_media lookup failed: %s", incident_id, exc)
 
@@ -438,6 +476,38 @@ def analyze_video_file(video_path: str, model: YOLO) -> dict | None:
     }
 
 
+def analyze_video_file_remote(video_path: str, sock_path: str,
+                              hints_ms: list[int] | None = None,
+                              timeout: float = YOLO_SERVER_TIMEOUT) -> dict | None:
+    """
+    analyze_video_file() through survi_yolo_server on sock_path; same dict
+    (plus "frames" and "frames_inferred"). hints_ms: times the server samples
+    densely around. Returns None if the server cannot read the clip or is
+    unreachable.
+    """
+    req = {"op": "analyze", "id": os.path.basename(video_path),
+           "mp4": os.path.abspath(video_path), "hints_ms": hints_ms or []}
+    try:
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+            s.settimeout(timeout)
+            s.connect(sock_path)
+            s.sendall((json.dumps(req) + "\n").encode())
+            buf = b""
+            while b"\n" not in buf:
+                chunk = s.recv(65536)
+                if not chunk:
+                    raise OSError("yolo server closed the connection")
+                buf += chunk
+        reply = json.loads(buf.split(b"\n", 1)[0])
+    except (OSError, ValueError) as exc:
+        log.warning("  yolo server %s: %s", sock_path, exc)
+        return None
+    if reply.get("status") != "ok":
+        log.warning("  yolo server: %s", reply.get("error"))
+        return None
+    return reply.get("analysis")
+
+
 def update_incident(client, incident_id: str, analysis: dict) -> bool:
     """Patch the incident row in Supabase with cloud analysis results."""
     patch = {
@@ -468,7 +538,8 @@ def update_incident(client, incident_id: str, analysis: dict) -> bool:
         return False
 
 
-def run_cloud_scan(model: YOLO, once: bool = False):
+def run_cloud_scan(model: YOLO | None, once: bool = False,
+                   server: str | None = None, workers: int = 1):
     """
     Queue-based cloud analysis worker.
 
@@ -491,6 +562,11 @@ def run_cloud_scan(model: YOLO, once: bool = False):
 
     --cloud-scan-once  →  one scanner pass then drain queue and exit.
     --cloud-scan       →  runs forever (use as a background daemon).
+
+    With server (survi_yolo_server socket) step 2 runs there and `workers`
+    clips are analysed at once, their frames batched together by the server;
+    it samples frames (dense around the incident's hints.json times) rather
+    than running on every one.
     """
     client   = _supabase_client()
     work_q   : queue.Queue          = queue.Queue()
@@ -550,7 +626,11 @@ def run_cloud_scan(model: YOLO, once: bool = False):
                     if clip_path is None:
                         log.warning("  [%s] clip unavailable — skipping", inc_id)
                     else:
-                        analysis = analyze_video_file(clip_path, model)
+                        if server:
+                            analysis = analyze_video_file_remote(
+                                clip_path, server, fetch_detection_hints(client, inc_id))
+                        else:
+                            analysis = analyze_video_file(clip_path, model)
                         if analysis is None:
                             log.warning("  [%s] video unreadable — skipping", inc_id)
                         else:
@@ -580,19 +660,26 @@ def run_cloud_scan(model: YOLO, once: bool = False):
         stop_evt.set()  # signal scanner to stop if not already done
 
     # ── launch ──────────────────────────────────────────────────────────────
-    log.info("☁️  SentinelQ cloud worker starting  [once=%s]", once)
+    # One clip at a time without a server: the in-process model is not shared
+    n_workers = max(1, workers) if server else 1
+    log.info("☁️  SentinelQ cloud worker starting  [once=%s, server=%s, workers=%d]",
+             once, server or "-", n_workers)
     t_scanner = threading.Thread(target=scanner, daemon=True, name="scanner")
-    t_worker  = threading.Thread(target=worker,  daemon=False, name="worker")
+    t_workers = [threading.Thread(target=worker, daemon=False, name=f"worker{i}")
+                 for i in range(n_workers)]
 
     t_scanner.start()
-    t_worker.start()
+    for t in t_workers:
+        t.start()
 
     try:
-        t_worker.join()   # wait for the worker to drain and exit
+        for t in t_workers:
+            t.join()   # wait for the workers to drain and exit
     except KeyboardInterrupt:
         log.info("Interrupted — shutting down …")
         stop_evt.set()
-        t_worker.join(timeout=10)
+        for t in t_workers:
+            t.join(timeout=10)
 
     log.info("☁️  Cloud worker finished")
 
@@ -621,13 +708,26 @@ def main():
         action="store_true",
         help="Same as --cloud-scan but exits after a single pass (useful for cron jobs).",
     )
+    parser.add_argument(
+        "--yolo-server",
+        type=str,
+        default=YOLO_SERVER_SOCKET,
+        help="survi_yolo_server unix socket: analyse cloud-scan clips there (batched C++ inference).",
+    )
+    parser.add_argument(
+        "--workers",
+        type=int,
+        default=4,
+        help="Clips analysed concurrently with --yolo-server (default 4).",
+    )
     
     args = parser.parse_args()
 
     # ── Cloud-scan mode ──────────────────────────────────────────────────────
     if args.cloud_scan or args.cloud_scan_once:
-        model = YOLO(os.path.join(os.path.dirname(__file__), "yolov8n.pt"))
-        run_cloud_scan(model, once=args.cloud_scan_once)
+        model = None if args.yolo_server else YOLO(os.path.join(os.path.dirname(__file__), "yolov8n.pt"))
+        run_cloud_scan(model, once=args.cloud_scan_once,
+                       server=args.yolo_server or None, workers=args.workers)
         return
 
     # ── Live-source mode (original behaviour) ────────────────────────────────